@@ -37,7 +37,7 @@ $0 ~ /info core: unload module/ {
 $0 ~ /^debug packet:/ { next; }
 $0 ~ /^debug pcre:/ { next; }
 $0 ~ /^debug states:/ { next; }
-$0 ~ /^debug event: signal/ { next; }
+$0 ~ /^debug event: / { next; }
 $0 ~ /^debug time: / { next; }
 $0 ~ /^info pcap: progress/ { next; }
 $0 ~ /^debug core: memory report/ { next; }
@@ -74,7 +74,8 @@ $0 ~ /^debug lua: closing state$/ {
 }
 
 $0 ~ /^debug conn: .* connection/ {
-	if (closing) {
+	/* A state closed by a reload is followed by new connections */
+	if (closing && $3 != "opening") {
 		print($1 " " $2 " <cleanup> " $4);
 		next;
 	}
@@ -0,0 +1 @@
+set(HAKA_VERSION_BUILD "+8970ea5-dirty")
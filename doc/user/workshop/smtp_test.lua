@@ -6,3 +6,5 @@ local smtp = require('smtp')
 
 smtp.install_tcp_rule(25)
 
+-- No rule uses the dissector yet, force it to run on the flows
+smtp.options.lazy = false
@@ -74,6 +74,7 @@ struct alert {
 	struct alert_node **targets;             /**< Alert targets (NULL terminated array of nodes). */
 	size_t              alert_ref_count;     /**< Reference count. */
 	uint64             *alert_ref;           /**< Array of references. */
+	uint64              count;               /**< Number of merged alerts (0 if the alert was not aggregated). */
 };
 
 /**
@@ -135,7 +136,8 @@ struct alert {
 /**
  * Raise a new alert.
  *
- * \returns The alert unique id.
+ * \returns The alert unique id, the id of the aggregated alert if it was
+ * merged or 0 if it was discarded by the rate limits.
  */
 uint64          alert(const struct alert *alert);
 
@@ -178,6 +180,7 @@ struct alerter {
 	void        (*destroy)(struct alerter *state);
 	bool        (*alert)(struct alerter *state, uint64 id, const struct time *time, const struct alert *alert);
 	bool        (*update)(struct alerter *state, uint64 id, const struct time *time, const struct alert *alert);
+	bool          async;           /**< Deliver the alerts from the alert thread. */
 	bool          mark_for_remove; /**< \private */
 };
 
@@ -192,8 +195,41 @@ bool add_alerter(struct alerter *alerter);
 bool remove_alerter(struct alerter *alerter);
 
 /**
- * Remove all alert listener.
+ * Remove all alert listener. The pending asynchronous alerts are
+ * delivered first.
  */
 void remove_all_alerter();
 
+/**
+ * Deliver all pending asynchronous alerts.
+ */
+void alert_flush();
+
+/**
+ * Number of alerts that were not delivered to the asynchronous alerters
+ * because the alert queue of the thread was full.
+ */
+uint64 alert_dropped();
+
+/**
+ * Alert aggregation and rate limits.
+ */
+struct alert_limits {
+	int   aggregate_window; /**< Time window in seconds to merge identical alerts, 0 to disable. */
+	int   rate;             /**< Maximum number of alerts per second, 0 for no limit. */
+	int   burst;            /**< Maximum burst of alerts above the rate. */
+	int   key_rate;         /**< Maximum number of identical alerts per second, 0 for no limit. */
+	int   key_burst;        /**< Maximum burst of identical alerts above the rate. */
+};
+
+/**
+ * Set the alert aggregation and rate limits.
+ */
+bool alert_set_limits(const struct alert_limits *limits);
+
+/**
+ * Number of alerts discarded by the rate limits.
+ */
+uint64 alert_limited();
+
 #endif /* _HAKA_ALERT_H */
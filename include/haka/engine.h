@@ -7,6 +7,7 @@
 
 #include <haka/types.h>
 #include <stdlib.h>
+#include <sys/select.h>
 
 enum thread_status {
 	THREAD_RUNNING,
@@ -24,6 +25,14 @@ struct packet_stats {
 	size_t       drop_packets;
 };
 
+/* Explicit Lua garbage collection done by the thread */
+struct gc_stats {
+	uint64       time;        /* Time spent in the collector, in microseconds */
+	size_t       steps;
+	size_t       idle_steps;
+	size_t       cycles;
+};
+
 struct engine_thread;
 struct lua_State;
 
@@ -38,6 +47,8 @@ int                            engine_thread_id(struct engine_thread *thread);
 enum thread_status             engine_thread_update_status(struct engine_thread *thread, enum thread_status status);
 enum thread_status             engine_thread_status(struct engine_thread *thread);
 volatile struct packet_stats  *engine_thread_statistics(struct engine_thread *thread);
+volatile struct gc_stats      *engine_thread_gc_statistics(struct engine_thread *thread);
+void                           engine_thread_set_lua_state(struct engine_thread *thread, struct lua_State *L);
 
 bool                           engine_thread_remote_launch(struct engine_thread *thread, void (*callback)(void *), void *data);
 int                            engine_thread_lua_remote_launch(struct engine_thread *thread, struct lua_State *L, int index);
@@ -47,4 +58,17 @@ void                           engine_thread_interrupt_begin(struct engine_threa
 void                           engine_thread_interrupt_end(struct engine_thread *thread);
 int                            engine_thread_interrupt_fd();
 
+/*
+ * Callback called by the packet modules when no packet is waiting, just
+ * before blocking.
+ */
+void                           engine_thread_set_idle(struct engine_thread *thread, void (*callback)(void *), void *data);
+
+/*
+ * Wait on the file descriptors of read_set like select() without timeout. If
+ * none of them is ready, the idle callback of the current thread is called
+ * first.
+ */
+int                            engine_thread_select(int nfds, fd_set *read_set);
+
 #endif /* _HAKA_ENGINE_H */
@@ -155,6 +155,7 @@ struct logger {
 	struct list   list;
 	void        (*destroy)(struct logger *state);
 	int         (*message)(struct logger *state, log_level level, const char *module, const char *message);
+	bool          async; /**< Receive the messages from the log thread. */
 	bool          mark_for_remove; /**< \private */
 };
 
@@ -175,4 +176,14 @@ bool remove_logger(struct logger *logger);
  */
 void remove_all_logger();
 
+/**
+ * Deliver the queued messages to the asynchronous loggers.
+ */
+void log_flush();
+
+/**
+ * Get the number of messages lost by the asynchronous loggers.
+ */
+uint64 log_dropped();
+
 #endif /* _HAKA_LOG_H */
@@ -0,0 +1,61 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef _HAKA_LUA_ALLOC_H
+#define _HAKA_LUA_ALLOC_H
+
+#include <haka/types.h>
+#include <stddef.h>
+
+
+/*
+ * Lua allocator
+ *
+ * Each Lua state gets its own allocator, and thus each thread. The small
+ * blocks are taken from free lists by size class, carved from large arenas
+ * that are kept until the allocator is destroyed. The larger blocks are
+ * allocated with realloc.
+ */
+
+#define LUA_ALLOC_GRANULARITY     16
+#define LUA_ALLOC_CLASS_COUNT     16
+#define LUA_ALLOC_SMALL_MAX       (LUA_ALLOC_GRANULARITY*LUA_ALLOC_CLASS_COUNT)
+
+/* LuaJIT only accepts its own allocator on x86_64 */
+#if HAKA_LUAJIT && defined(__x86_64__)
+	#define LUA_ALLOC_SUPPORTED   0
+#else
+	#define LUA_ALLOC_SUPPORTED   1
+#endif
+
+struct lua_alloc_class_stats {
+	size_t       count;       /* Blocks in use */
+	size_t       allocs;      /* Allocations done since the creation */
+};
+
+struct lua_alloc_stats {
+	size_t       used;        /* Bytes requested by Lua and not yet freed */
+	size_t       peak;        /* Maximum of used */
+	uint64       allocated;   /* Bytes allocated since the creation */
+	size_t       arena;       /* Bytes reserved for the small blocks */
+	size_t       large;       /* Bytes of the blocks larger than LUA_ALLOC_SMALL_MAX */
+	bool         hugepages;   /* The arenas are backed by huge pages */
+	struct lua_alloc_class_stats classes[LUA_ALLOC_CLASS_COUNT];
+};
+
+struct lua_alloc;
+
+/* Global options applied to the allocators created afterward */
+void                           lua_alloc_set_enabled(bool enabled);
+bool                           lua_alloc_enabled();
+void                           lua_alloc_set_hugepages(bool hugepages);
+
+struct lua_alloc              *lua_alloc_create();
+void                           lua_alloc_destroy(struct lua_alloc *alloc);
+const struct lua_alloc_stats  *lua_alloc_statistics(struct lua_alloc *alloc);
+
+/* Function to give to lua_newstate() with the allocator as user data */
+void                          *lua_alloc_function(void *ud, void *ptr, size_t osize, size_t nsize);
+
+#endif /* _HAKA_LUA_ALLOC_H */
@@ -10,6 +10,7 @@
 
 struct lua_State;
 struct lua_Debug;
+struct lua_alloc_stats;
 
 struct lua_state {
 	struct lua_State    *L;
@@ -32,6 +33,9 @@ int lua_state_error_formater(struct lua_State *L);
 void lua_state_print_error(struct lua_State *L, const char *msg);
 struct lua_state *lua_state_get(struct lua_State *L);
 
+/* Statistics of the haka allocator, NULL if the state uses the default one */
+const struct lua_alloc_stats *lua_state_alloc_statistics(struct lua_state *state);
+
 extern void (*lua_state_error_hook)(struct lua_State *L);
 
 #if HAKA_LUA52
@@ -0,0 +1,58 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/**
+ * \file
+ * Literal prefilter for PCRE like regular expressions.
+ */
+
+#ifndef _HAKA_REGEXP_LITERAL_H
+#define _HAKA_REGEXP_LITERAL_H
+
+#include <haka/types.h>
+#include <haka/vbuffer.h>
+
+/** Literals shorter than this are not worth searching for. */
+#define REGEXP_LITERAL_MIN  3
+/** Longer literals are truncated. */
+#define REGEXP_LITERAL_MAX  32
+
+/**
+ * Literal string that must be found in the data for a regular expression
+ * to match.
+ */
+struct regexp_literal {
+	size_t  len;                      /**< Length of the literal, 0 if none. */
+	bool    prefix;                   /**< The literal starts every match. */
+	bool    caseless;                 /**< The literal is stored lower case. */
+	char    data[REGEXP_LITERAL_MAX];
+};
+
+/**
+ * Extract a literal required by the regular expression `pattern`. The
+ * extraction is conservative: if the pattern is not fully understood, no
+ * literal is extracted.
+ */
+void regexp_literal_extract(const char *pattern, int options, struct regexp_literal *literal);
+
+/**
+ * Check if the regular expression can match on the given data. Returns false
+ * only if the data does not contain the literal.
+ */
+bool regexp_literal_contains(const struct regexp_literal *literal, const char *buf, size_t len);
+
+/**
+ * Same as regexp_literal_contains() on a buffer. The literal is also looked for
+ * across the chunks of the buffer.
+ */
+bool regexp_literal_vbcontains(const struct regexp_literal *literal, struct vbuffer_sub *vbuf);
+
+/**
+ * Check if a chunk of a stream can be skipped when no match is in progress.
+ * This is the case when the literal is a prefix of the regular expression
+ * and the chunk does not contain the literal, even partially at its end.
+ */
+bool regexp_literal_skip(const struct regexp_literal *literal, const char *buf, size_t len);
+
+#endif /* _HAKA_REGEXP_LITERAL_H */
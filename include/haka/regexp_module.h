@@ -63,4 +63,54 @@ struct regexp_sink {
 struct regexp_module *regexp_module_load(const char *module_name, struct parameters *args);
 void regexp_module_release(struct regexp_module *module);
 
+/**
+ * Select the regexp module used by the grammars and the dissectors
+ * (`regexp/pcre` by default). This must be done before the Lua states are
+ * created.
+ */
+bool regexp_module_set_default(const char *module_name);
+
+/**
+ * Get the name of the regexp module used by the grammars.
+ */
+const char *regexp_module_get_default();
+
+/**
+ * Per-thread cache of compiled regular expressions.
+ */
+struct regexp_cache_stats {
+	uint64   hits;   /**< Number of lookups that found a compiled regexp. */
+	uint64   misses; /**< Number of lookups that did not. */
+	size_t   size;   /**< Number of regexps currently cached. */
+};
+
+/**
+ * Look for a compiled regexp in the cache of the current thread. The returned
+ * regexp has its reference count incremented and must be released by the caller.
+ * The entry is then owned by `owner`. Returns NULL if the regexp is not in the
+ * cache.
+ */
+struct regexp *regexp_cache_get_regexp(struct regexp_module *module, const char *pattern, int options,
+		const void *owner);
+
+/**
+ * Add a compiled regexp to the cache of the current thread. The cache takes its
+ * own reference on the regexp. The least recently used entry is dropped when
+ * the cache is full. The `owner` is usually the Lua state which compiled the
+ * regexp.
+ */
+bool regexp_cache_add_regexp(struct regexp_module *module, const char *pattern, int options,
+		struct regexp *regexp, const void *owner);
+
+/**
+ * Release the regexps cached by the current thread for `owner`, or all of them
+ * if `owner` is NULL. This must be done before the regexp modules are unloaded.
+ */
+void regexp_cache_clear(const void *owner);
+
+/**
+ * Get the cache statistics of the current thread.
+ */
+void regexp_cache_getstats(struct regexp_cache_stats *stats);
+
 #endif /* _HAKA_LOG_MODULE_H */
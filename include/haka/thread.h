@@ -198,9 +198,13 @@ bool rwlock_unlock(rwlock_t *rwlock);
 
 typedef sem_t semaphore_t; /**< Opaque semaphore type. */
 
+struct time;
+
 bool semaphore_init(semaphore_t *semaphore, uint32 initial);
 bool semaphore_destroy(semaphore_t *semaphore);
 bool semaphore_wait(semaphore_t *semaphore);
+/** Wait until the absolute time `deadline`, returns false if the semaphore was not taken. */
+bool semaphore_timedwait(semaphore_t *semaphore, const struct time *deadline);
 bool semaphore_post(semaphore_t *semaphore);
 
 /**@}*/
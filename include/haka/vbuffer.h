@@ -454,6 +454,54 @@ uint8        *vbuffer_mmap(struct vbuffer_sub *data, size_t *len, bool write, st
  */
 bool          vbuffer_zero(struct vbuffer_sub *data);
 
+/**
+ * Set of bytes used by vbuffer_sub_findset().
+ */
+struct vbuffer_byteset {
+	uint32   bits[8]; /**< \private */
+};
+
+/**
+ * Empty byte set initializer.
+ */
+#define VBUFFER_BYTESET_INIT { { 0 } }
+
+/**
+ * Add a byte to the set.
+ */
+INLINE void   vbuffer_byteset_add(struct vbuffer_byteset *set, uint8 byte);
+
+/**
+ * Check if a byte is in the set.
+ */
+INLINE bool   vbuffer_byteset_test(const struct vbuffer_byteset *set, uint8 byte);
+
+#define VBUFFER_FIND_NOMATCH  0 /**< vbuffer_sub_find() result: not found. */
+#define VBUFFER_FIND_MATCH    1 /**< vbuffer_sub_find() result: found. */
+#define VBUFFER_FIND_PARTIAL  2 /**< vbuffer_sub_find() result: the buffer ends with the beginning of the string. */
+
+/**
+ * Find the first occurrence of a byte in the buffer.
+ * \return true if the byte is found, `pos` is then set to its position.
+ */
+bool          vbuffer_sub_findbyte(struct vbuffer_sub *data, uint8 byte, struct vbuffer_iterator *pos);
+
+/**
+ * Find the first byte of the buffer that is in the set.
+ * \return true if such a byte is found, `pos` is then set to its position.
+ */
+bool          vbuffer_sub_findset(struct vbuffer_sub *data, const struct vbuffer_byteset *set, struct vbuffer_iterator *pos);
+
+/**
+ * Find the first occurrence of a string in the buffer. The string can span over
+ * several memory blocks, the buffer is never flattened.
+ * \return VBUFFER_FIND_MATCH if the string is found, `begin` and `end` are then set
+ * around it. VBUFFER_FIND_PARTIAL if the buffer ends with the beginning of the string,
+ * `begin` is then set at the start of this partial match. VBUFFER_FIND_NOMATCH otherwise.
+ */
+int           vbuffer_sub_find(struct vbuffer_sub *data, const uint8 *str, size_t len,
+		struct vbuffer_iterator *begin, struct vbuffer_iterator *end);
+
 /**
  * Extract part of a buffer. The data are removed from the original buffer and moved to a new
  * vbuffer.
@@ -576,4 +624,14 @@ INLINE bool   vbuffer_clone(struct vbuffer *data, struct vbuffer *buffer, bool c
 	return vbuffer_sub_clone(&sub, buffer, copy);
 }
 
+INLINE void   vbuffer_byteset_add(struct vbuffer_byteset *set, uint8 byte)
+{
+	set->bits[byte >> 5] |= (1U << (byte & 31));
+}
+
+INLINE bool   vbuffer_byteset_test(const struct vbuffer_byteset *set, uint8 byte)
+{
+	return (set->bits[byte >> 5] & (1U << (byte & 31))) != 0;
+}
+
 #endif /* _HAKA_VBUFFER_H */
@@ -15,6 +15,8 @@
 #include <haka/alert_module.h>
 #include <haka/container/list.h>
 #include <haka/colors.h>
+#include <haka/thread.h>
+#include <haka/container/hash.h>
 
 
 static struct alerter *alerters = NULL;
@@ -24,6 +26,51 @@ static rwlock_t alert_module_lock = RWLOCK_INIT;
 
 #define BUFFER_SIZE    3072
 
+/*
+ * Asynchronous alerts are copied in a bounded queue owned by the thread
+ * that raised them. Each queue has a single producer, its thread, and a
+ * single consumer, the holder of alert_dispatch_mutex, so no lock is
+ * needed to push an alert. The alert thread delivers them to the
+ * asynchronous alerters.
+ */
+
+#define ALERT_QUEUE_SIZE    1024 /* Must be a power of 2 */
+
+enum alert_event_type {
+	ALERT_EVENT_NEW,
+	ALERT_EVENT_UPDATE,
+};
+
+struct alert_event {
+	struct alert_event    *next; /* Used by the rate limits */
+	enum alert_event_type  type;
+	uint64                 id;
+	struct time            time;
+	struct alert          *alert;
+};
+
+struct alert_queue {
+	struct alert_queue    *next;
+	volatile uint32        head; /* Updated by the consumer */
+	volatile uint32        tail; /* Updated by the producer */
+	struct alert_event    *events[ALERT_QUEUE_SIZE];
+};
+
+static local_storage_t alert_queue_key;
+static struct alert_queue *alert_queues = NULL;
+static atomic64_t alert_dropped_count;
+static atomic64_t alert_limited_count;
+static mutex_t alert_dispatch_mutex = MUTEX_INIT;
+static mutex_t alert_thread_mutex = MUTEX_INIT;
+static semaphore_t alert_thread_wait;
+static thread_t alert_thread;
+static bool alert_thread_started = false;
+static volatile bool alert_thread_exit = false;
+
+static void alert_dispatch_stop();
+static void alert_aggregate_clear();
+static void alert_aggregate_flush();
+
 static void alert_string_delete(void *value)
 {
 	free(value);
@@ -36,13 +83,33 @@ INIT static void _alert_init()
 	ret = local_storage_init(&alert_string_key, alert_string_delete);
 	assert(ret);
 
+	/* The queues are kept until the end as they can still hold alerts
+	 * when their thread exits */
+	ret = local_storage_init(&alert_queue_key, NULL);
+	assert(ret);
+
+	ret = semaphore_init(&alert_thread_wait, 0);
+	assert(ret);
+
 	atomic64_init(&alert_id, 0);
+	atomic64_init(&alert_dropped_count, 0);
+	atomic64_init(&alert_limited_count, 0);
 }
 
 FINI static void _alert_fini()
 {
 	remove_all_alerter();
 	atomic64_destroy(&alert_id);
+	atomic64_destroy(&alert_dropped_count);
+	atomic64_destroy(&alert_limited_count);
+
+	while (alert_queues) {
+		struct alert_queue *queue = alert_queues;
+		alert_queues = queue->next;
+		free(queue);
+	}
+
+	semaphore_destroy(&alert_thread_wait);
 
 	{
 		char *buffer = local_storage_get(&alert_string_key);
@@ -72,7 +139,7 @@ static void cleanup_alerter(struct alerter *alerter, struct alerter **head)
 	alerter->destroy(alerter);
 }
 
-bool remove_alerter(struct alerter *alerter)
+static bool _remove_alerter(struct alerter *alerter)
 {
 	struct alerter *module_to_release = NULL;
 	struct alerter *iter;
@@ -104,10 +171,25 @@ bool remove_alerter(struct alerter *alerter)
 	return true;
 }
 
+bool remove_alerter(struct alerter *alerter)
+{
+	assert(alerter);
+
+	/* Give the pending alerts to the alerter before it goes away */
+	if (alerter->async) {
+		alert_flush();
+	}
+
+	return _remove_alerter(alerter);
+}
+
 void remove_all_alerter()
 {
 	struct alerter *alerter = NULL;
 
+	alert_aggregate_clear();
+	alert_dispatch_stop();
+
 	{
 		rwlock_writelock(&alert_module_lock);
 		alerter = alerters;
@@ -132,51 +214,772 @@ static void alert_remove_pass()
 	for (iter=alerters; iter; iter = list_next(iter)) {
 		if (iter->mark_for_remove) {
 			rwlock_unlock(&alert_module_lock);
-			remove_alerter(iter);
+			_remove_alerter(iter);
 			rwlock_readlock(&alert_module_lock);
 		}
 	}
 	rwlock_unlock(&alert_module_lock);
 }
 
-uint64 alert(const struct alert *alert)
+/*
+ * Alert copy
+ *
+ * The alert is copied with its strings and arrays in a single memory
+ * block placed after the event.
+ */
+
+struct alert_block {
+	void               **ptrs;
+	struct alert_node   *nodes;
+	char                *strings;
+};
+
+static size_t string_size(const char *str)
+{
+	return str ? strlen(str)+1 : 0;
+}
+
+static size_t stringlist_size(char **list, size_t *ptrs)
+{
+	size_t size = 0;
+	char **iter;
+
+	if (!list) return 0;
+
+	for (iter = list; *iter; ++iter) {
+		size += string_size(*iter);
+		(*ptrs)++;
+	}
+	(*ptrs)++;
+
+	return size;
+}
+
+static size_t nodes_size(struct alert_node **nodes, size_t *ptrs, size_t *count)
+{
+	size_t size = 0;
+	struct alert_node **iter;
+
+	if (!nodes) return 0;
+
+	for (iter = nodes; *iter; ++iter) {
+		size += stringlist_size((*iter)->list, ptrs);
+		(*count)++;
+		(*ptrs)++;
+	}
+	(*ptrs)++;
+
+	return size;
+}
+
+static char *copy_string(struct alert_block *block, const char *str)
+{
+	char *ret;
+	size_t len;
+
+	if (!str) return NULL;
+
+	len = strlen(str)+1;
+	ret = block->strings;
+	memcpy(ret, str, len);
+	block->strings += len;
+	return ret;
+}
+
+static char **copy_stringlist(struct alert_block *block, char **list)
+{
+	char **ret, **iter;
+
+	if (!list) return NULL;
+
+	ret = (char **)block->ptrs;
+	for (iter = list; *iter; ++iter) {
+		*block->ptrs++ = copy_string(block, *iter);
+	}
+	*block->ptrs++ = NULL;
+
+	return ret;
+}
+
+static struct alert_node **copy_nodes(struct alert_block *block, struct alert_node **nodes)
+{
+	struct alert_node **ret;
+	size_t i, count = 0;
+
+	if (!nodes) return NULL;
+
+	while (nodes[count]) count++;
+
+	ret = (struct alert_node **)block->ptrs;
+	block->ptrs += count+1;
+
+	for (i = 0; i < count; ++i) {
+		struct alert_node *node = block->nodes++;
+		node->type = nodes[i]->type;
+		node->list = copy_stringlist(block, nodes[i]->list);
+		ret[i] = node;
+	}
+	ret[count] = NULL;
+
+	return ret;
+}
+
+static struct alert_event *alert_event_create(enum alert_event_type type, uint64 id,
+		const struct time *time, const struct alert *alert)
+{
+	struct alert_event *event;
+	struct alert_block block;
+	struct alert *copy;
+	uint64 *refs;
+	size_t ptrs = 0, nodes = 0, strings, ref_count;
+
+	strings = string_size(alert->description) + string_size(alert->method_description) +
+		stringlist_size(alert->method_ref, &ptrs) +
+		nodes_size(alert->sources, &ptrs, &nodes) +
+		nodes_size(alert->targets, &ptrs, &nodes);
+	ref_count = alert->alert_ref ? alert->alert_ref_count : 0;
+
+	event = malloc(sizeof(struct alert_event) + sizeof(struct alert) +
+		nodes*sizeof(struct alert_node) + ref_count*sizeof(uint64) +
+		ptrs*sizeof(void *) + strings);
+	if (!event) {
+		return NULL;
+	}
+
+	event->next = NULL;
+	event->type = type;
+	event->id = id;
+	event->time = *time;
+	event->alert = copy = (struct alert *)(event+1);
+	*copy = *alert;
+
+	block.nodes = (struct alert_node *)(copy+1);
+	refs = (uint64 *)(block.nodes + nodes);
+	block.ptrs = (void **)(refs + ref_count);
+	block.strings = (char *)(block.ptrs + ptrs);
+
+	copy->description = copy_string(&block, alert->description);
+	copy->method_description = copy_string(&block, alert->method_description);
+	copy->method_ref = copy_stringlist(&block, alert->method_ref);
+	copy->sources = copy_nodes(&block, alert->sources);
+	copy->targets = copy_nodes(&block, alert->targets);
+
+	if (alert->alert_ref) {
+		memcpy(refs, alert->alert_ref, ref_count*sizeof(uint64));
+		copy->alert_ref = refs;
+	}
+
+	return event;
+}
+
+
+/*
+ * Alert thread
+ */
+
+static void alert_deliver(struct alert_event *event)
 {
-	const uint64 id = atomic64_inc(&alert_id);
 	struct alerter *iter;
 	bool remove_pass = false;
-	struct time time;
-
-	time_gettimestamp(&time);
 
 	rwlock_readlock(&alert_module_lock);
 	for (iter=alerters; iter; iter = list_next(iter)) {
-		iter->alert(iter, id, &time, alert);
+		if (!iter->async) continue;
+
+		if (event->type == ALERT_EVENT_NEW) {
+			iter->alert(iter, event->id, &event->time, event->alert);
+		}
+		else {
+			iter->update(iter, event->id, &event->time, event->alert);
+		}
 		remove_pass |= iter->mark_for_remove;
 	}
 	rwlock_unlock(&alert_module_lock);
 
 	if (remove_pass) alert_remove_pass();
+}
 
-	return id;
+static void alert_dispatch_queue(struct alert_queue *queue)
+{
+	const uint32 tail = queue->tail;
+	__sync_synchronize();
+
+	while (queue->head != tail) {
+		struct alert_event *event = queue->events[queue->head & (ALERT_QUEUE_SIZE-1)];
+
+		alert_deliver(event);
+		free(event);
+
+		__sync_synchronize();
+		queue->head++;
+	}
 }
 
-bool alert_update(uint64 id, const struct alert *alert)
+void alert_flush()
+{
+	struct alert_queue *queue;
+
+	mutex_lock(&alert_dispatch_mutex);
+	for (queue = alert_queues; queue; queue = queue->next) {
+		alert_dispatch_queue(queue);
+	}
+	mutex_unlock(&alert_dispatch_mutex);
+}
+
+#define ALERT_THREAD_WAKEUP    1 /* Seconds between two sweeps of the aggregated alerts */
+
+static void *alert_thread_main(void *param)
+{
+	while (!alert_thread_exit) {
+		struct time deadline;
+
+		/* Wake up regularly to give the count of the aggregation windows
+		 * that ended without any new alert */
+		if (time_gettimestamp(&deadline)) {
+			deadline.secs += ALERT_THREAD_WAKEUP;
+			semaphore_timedwait(&alert_thread_wait, &deadline);
+		}
+		else {
+			semaphore_wait(&alert_thread_wait);
+		}
+
+		alert_aggregate_flush();
+		alert_flush();
+	}
+
+	return NULL;
+}
+
+static bool alert_dispatch_start()
+{
+	bool ret = true;
+
+	if (!alert_thread_started) {
+		mutex_lock(&alert_thread_mutex);
+		if (!alert_thread_started) {
+			alert_thread_exit = false;
+			if (thread_create(&alert_thread, &alert_thread_main, NULL)) {
+				alert_thread_started = true;
+			}
+			else {
+				ret = false;
+			}
+		}
+		mutex_unlock(&alert_thread_mutex);
+	}
+
+	return ret;
+}
+
+static void alert_dispatch_stop()
+{
+	uint64 dropped, limited;
+
+	mutex_lock(&alert_thread_mutex);
+	if (alert_thread_started) {
+		alert_thread_exit = true;
+		semaphore_post(&alert_thread_wait);
+		thread_join(alert_thread, NULL);
+		alert_thread_started = false;
+	}
+	mutex_unlock(&alert_thread_mutex);
+
+	/* Deliver the remaining alerts */
+	alert_flush();
+
+	dropped = atomic64_get(&alert_dropped_count);
+	if (dropped > 0) {
+		LOG_WARNING(core, "%llu alerts dropped, alert queue full", dropped);
+		atomic64_set(&alert_dropped_count, 0);
+	}
+
+	limited = atomic64_get(&alert_limited_count);
+	if (limited > 0) {
+		LOG_WARNING(core, "%llu alerts discarded by the rate limits", limited);
+		atomic64_set(&alert_limited_count, 0);
+	}
+}
+
+static struct alert_queue *alert_queue_get()
+{
+	struct alert_queue *queue = local_storage_get(&alert_queue_key);
+	if (!queue) {
+		queue = malloc(sizeof(struct alert_queue));
+		if (!queue) {
+			return NULL;
+		}
+
+		queue->head = 0;
+		queue->tail = 0;
+
+		do {
+			queue->next = alert_queues;
+		} while (!__sync_bool_compare_and_swap(&alert_queues, queue->next, queue));
+
+		local_storage_set(&alert_queue_key, queue);
+	}
+
+	return queue;
+}
+
+static void alert_enqueue(enum alert_event_type type, uint64 id, const struct time *time,
+		const struct alert *alert)
+{
+	struct alert_queue *queue = alert_queue_get();
+	struct alert_event *event;
+
+	if (!queue || !alert_dispatch_start() ||
+	    queue->tail - queue->head >= ALERT_QUEUE_SIZE) {
+		atomic64_inc(&alert_dropped_count);
+		return;
+	}
+
+	event = alert_event_create(type, id, time, alert);
+	if (!event) {
+		atomic64_inc(&alert_dropped_count);
+		return;
+	}
+
+	queue->events[queue->tail & (ALERT_QUEUE_SIZE-1)] = event;
+	__sync_synchronize();
+	queue->tail++;
+
+	semaphore_post(&alert_thread_wait);
+}
+
+uint64 alert_dropped()
+{
+	return atomic64_get(&alert_dropped_count);
+}
+
+static bool alert_dispatch(enum alert_event_type type, uint64 id, const struct alert *alert)
 {
-	bool remove_pass = false;
 	struct alerter *iter;
+	bool remove_pass = false, async = false;
 	struct time time;
 
 	time_gettimestamp(&time);
 
+	/* Synchronous alerters are called directly, the others from
+	 * the alert thread */
 	rwlock_readlock(&alert_module_lock);
 	for (iter=alerters; iter; iter = list_next(iter)) {
-		iter->update(iter, id, &time, alert);
+		if (iter->async) {
+			async = true;
+			continue;
+		}
+
+		if (type == ALERT_EVENT_NEW) {
+			iter->alert(iter, id, &time, alert);
+		}
+		else {
+			iter->update(iter, id, &time, alert);
+		}
 		remove_pass |= iter->mark_for_remove;
 	}
 	rwlock_unlock(&alert_module_lock);
 
+	if (async) alert_enqueue(type, id, &time, alert);
+
 	if (remove_pass) alert_remove_pass();
 
+	return true;
+}
+
+/*
+ * Aggregation and rate limits
+ *
+ * Alerts with the same severity, description, method, sources and
+ * targets share a key. During the aggregation window, the alerts of a
+ * key are merged in the first one and their count is given with updates
+ * of this alert. New alerts are then limited by a token bucket for each
+ * key and by a global one.
+ */
+
+#define ALERT_KEY_SIZE           1024 /* Larger keys are allocated */
+#define ALERT_AGGREGATE_MAX      4096 /* Maximum number of tracked keys */
+#define ALERT_UPDATE_INTERVAL    1.   /* Seconds between two updates of a merged alert */
+#define ALERT_SWEEP_INTERVAL     1.   /* Seconds between two removals of expired keys */
+
+struct token_bucket {
+	double               tokens;
+	double               last;
+};
+
+struct alert_aggregate {
+	hash_head_t          hh;
+	struct alert_event  *event;    /* First alert of the window */
+	double               end;      /* End of the window */
+	double               updated;  /* Time of the last update */
+	uint64               count;
+	uint64               reported; /* Count given in the last update */
+	struct token_bucket  bucket;
+	size_t               key_len;
+	char                 key[0];
+};
+
+static struct alert_limits limits_config = { 0 };
+static bool alert_limits_enabled = false;
+static struct alert_aggregate *alert_aggregates = NULL;
+static size_t alert_aggregate_count = 0;
+static struct token_bucket alert_bucket;
+static double alert_last_sweep = 0;
+static mutex_t alert_aggregate_mutex = MUTEX_INIT;
+
+static bool token_bucket_take(struct token_bucket *bucket, int rate, int burst, double now)
+{
+	if (rate <= 0) return true;
+
+	bucket->tokens += (now - bucket->last) * rate;
+	if (bucket->tokens > burst) bucket->tokens = burst;
+	bucket->last = now;
+
+	if (bucket->tokens < 1.) return false;
+
+	bucket->tokens -= 1.;
+	return true;
+}
+
+static bool token_bucket_full(struct token_bucket *bucket, int rate, int burst, double now)
+{
+	return rate <= 0 || bucket->tokens + (now - bucket->last) * rate >= burst;
+}
+
+struct alert_key {
+	char                *iter;
+	size_t               left;
+	size_t               size; /* Full size of the key */
+};
+
+static void alert_key_append(struct alert_key *key, const char *str)
+{
+	const size_t len = str ? strlen(str)+1 : 1;
+
+	key->size += len;
+
+	/* The key is not truncated, its size is still computed to build
+	 * it again in a larger buffer */
+	if (len > key->left) {
+		key->left = 0;
+		return;
+	}
+
+	if (str) memcpy(key->iter, str, len);
+	else *key->iter = '\0';
+
+	key->iter += len;
+	key->left -= len;
+}
+
+static void alert_key_append_nodes(struct alert_key *key, struct alert_node **nodes)
+{
+	if (!nodes) return;
+
+	for (; *nodes; ++nodes) {
+		char **iter;
+
+		alert_key_append(key, alert_node_to_str((*nodes)->type));
+		for (iter = (*nodes)->list; iter && *iter; ++iter) {
+			alert_key_append(key, *iter);
+		}
+	}
+}
+
+/* Returns the size of the key, the key is complete only if it fits in the buffer */
+static size_t alert_key_build(const struct alert *alert, char *buffer, size_t size)
+{
+	struct alert_key key = { buffer, size, 0 };
+	char level[2] = { '0' + alert->severity, '\0' };
+
+	alert_key_append(&key, level);
+	alert_key_append(&key, alert->description);
+	alert_key_append(&key, alert->method_description);
+	alert_key_append_nodes(&key, alert->sources);
+	alert_key_append(&key, "");
+	alert_key_append_nodes(&key, alert->targets);
+
+	return key.size;
+}
+
+/*
+ * The updates are not dispatched while alert_aggregate_mutex is held, they
+ * are copied in a list given to alert_dispatch_pending() once the mutex is
+ * released.
+ */
+static void alert_aggregate_report(struct alert_aggregate *aggregate, double now,
+		struct alert_event **pending)
+{
+	if (aggregate->event && aggregate->count > aggregate->reported) {
+		struct alert_event *update;
+
+		aggregate->event->alert->count = aggregate->count;
+		update = alert_event_create(ALERT_EVENT_UPDATE, aggregate->event->id,
+				&aggregate->event->time, aggregate->event->alert);
+		if (!update) return;
+
+		update->next = *pending;
+		*pending = update;
+
+		aggregate->reported = aggregate->count;
+		aggregate->updated = now;
+	}
+}
+
+static void alert_dispatch_pending(struct alert_event *pending)
+{
+	while (pending) {
+		struct alert_event *event = pending;
+		pending = event->next;
+
+		alert_dispatch(event->type, event->id, event->alert);
+		free(event);
+	}
+}
+
+/* Give the final count of the window and forget its alert */
+static void alert_aggregate_close(struct alert_aggregate *aggregate, double now,
+		struct alert_event **pending)
+{
+	alert_aggregate_report(aggregate, now, pending);
+
+	free(aggregate->event);
+	aggregate->event = NULL;
+}
+
+static void alert_aggregate_remove(struct alert_aggregate *aggregate)
+{
+	HASH_DEL(alert_aggregates, aggregate);
+	free(aggregate->event);
+	free(aggregate);
+	alert_aggregate_count--;
+}
+
+static void alert_aggregate_sweep(double now, struct alert_event **pending)
+{
+	struct alert_aggregate *aggregate, *tmp;
+
+	HASH_ITER(hh, alert_aggregates, aggregate, tmp) {
+		if (now >= aggregate->end) {
+			alert_aggregate_close(aggregate, now, pending);
+
+			if (token_bucket_full(&aggregate->bucket, limits_config.key_rate,
+					limits_config.key_burst, now)) {
+				alert_aggregate_remove(aggregate);
+			}
+		}
+	}
+
+	alert_last_sweep = now;
+}
+
+static struct alert_aggregate *alert_aggregate_get(const char *key, size_t key_len, double now)
+{
+	struct alert_aggregate *aggregate;
+
+	HASH_FIND(hh, alert_aggregates, key, key_len, aggregate);
+	if (aggregate) return aggregate;
+
+	if (alert_aggregate_count >= ALERT_AGGREGATE_MAX) return NULL;
+
+	aggregate = malloc(sizeof(struct alert_aggregate) + key_len);
+	if (!aggregate) return NULL;
+
+	aggregate->event = NULL;
+	aggregate->end = 0;
+	aggregate->updated = 0;
+	aggregate->count = 0;
+	aggregate->reported = 0;
+	aggregate->bucket.tokens = limits_config.key_burst;
+	aggregate->bucket.last = now;
+	aggregate->key_len = key_len;
+	memcpy(aggregate->key, key, key_len);
+
+	HASH_ADD_KEYPTR(hh, alert_aggregates, aggregate->key, key_len, aggregate);
+	alert_aggregate_count++;
+
+	return aggregate;
+}
+
+/* Close the windows that ended, called regularly by the alert thread */
+static void alert_aggregate_flush()
+{
+	struct alert_event *pending = NULL;
+	struct time time;
+	double now;
+
+	if (!alert_limits_enabled) return;
+
+	time_gettimestamp(&time);
+	now = time_sec(&time);
+
+	mutex_lock(&alert_aggregate_mutex);
+	if (now - alert_last_sweep >= ALERT_SWEEP_INTERVAL) {
+		alert_aggregate_sweep(now, &pending);
+	}
+	mutex_unlock(&alert_aggregate_mutex);
+
+	alert_dispatch_pending(pending);
+}
+
+static uint64 alert_limit(const struct alert *alert)
+{
+	struct alert_aggregate *aggregate = NULL;
+	struct alert_event *pending = NULL;
+	struct time time;
+	char buffer[ALERT_KEY_SIZE];
+	char *key = buffer;
+	size_t key_len;
+	double now;
+	uint64 id;
+
+	time_gettimestamp(&time);
+	now = time_sec(&time);
+
+	key_len = alert_key_build(alert, buffer, ALERT_KEY_SIZE);
+	if (key_len > ALERT_KEY_SIZE) {
+		key = malloc(key_len);
+		if (key) alert_key_build(alert, key, key_len);
+	}
+
+	mutex_lock(&alert_aggregate_mutex);
+
+	if (now - alert_last_sweep >= ALERT_SWEEP_INTERVAL) {
+		alert_aggregate_sweep(now, &pending);
+	}
+
+	/* Keys that cannot be tracked are only limited by the global rate */
+	if (key) {
+		aggregate = alert_aggregate_get(key, key_len, now);
+	}
+
+	if (aggregate && aggregate->event) {
+		if (now < aggregate->end) {
+			aggregate->count++;
+			if (now - aggregate->updated >= ALERT_UPDATE_INTERVAL) {
+				alert_aggregate_report(aggregate, now, &pending);
+			}
+
+			id = aggregate->event->id;
+			mutex_unlock(&alert_aggregate_mutex);
+			goto end;
+		}
+
+		alert_aggregate_close(aggregate, now, &pending);
+	}
+
+	if ((aggregate && !token_bucket_take(&aggregate->bucket, limits_config.key_rate,
+			limits_config.key_burst, now)) ||
+	    !token_bucket_take(&alert_bucket, limits_config.rate, limits_config.burst, now)) {
+		mutex_unlock(&alert_aggregate_mutex);
+		atomic64_inc(&alert_limited_count);
+		id = 0;
+		goto end;
+	}
+
+	id = atomic64_inc(&alert_id);
+
+	if (aggregate && limits_config.aggregate_window > 0) {
+		aggregate->event = alert_event_create(ALERT_EVENT_NEW, id, &time, alert);
+		aggregate->end = now + limits_config.aggregate_window;
+		aggregate->updated = now;
+		aggregate->count = 1;
+		aggregate->reported = 1;
+	}
+
+	mutex_unlock(&alert_aggregate_mutex);
+
+	/* The alert thread closes the windows that get no more alerts, it is
+	 * started on the first one as the process could still fork before */
+	if (aggregate && limits_config.aggregate_window > 0) {
+		alert_dispatch_start();
+	}
+
+	/* The final count of the previous window is given first */
+	alert_dispatch_pending(pending);
+	pending = NULL;
+
+	alert_dispatch(ALERT_EVENT_NEW, id, alert);
+
+end:
+	alert_dispatch_pending(pending);
+	if (key != buffer) free(key);
+	return id;
+}
+
+/* Close all the windows and forget the keys */
+static void alert_aggregate_clear()
+{
+	struct alert_aggregate *aggregate, *tmp;
+	struct alert_event *pending = NULL;
+	struct time time;
+
+	time_gettimestamp(&time);
+
+	mutex_lock(&alert_aggregate_mutex);
+	HASH_ITER(hh, alert_aggregates, aggregate, tmp) {
+		alert_aggregate_close(aggregate, time_sec(&time), &pending);
+		alert_aggregate_remove(aggregate);
+	}
+	mutex_unlock(&alert_aggregate_mutex);
+
+	alert_dispatch_pending(pending);
+}
+
+bool alert_set_limits(const struct alert_limits *limits)
+{
+	struct time time;
+
+	if (limits->aggregate_window < 0 || limits->rate < 0 || limits->burst < 0 ||
+	    limits->key_rate < 0 || limits->key_burst < 0) {
+		error("invalid alert limits");
+		return false;
+	}
+
+	alert_aggregate_clear();
+
+	time_gettimestamp(&time);
+
+	mutex_lock(&alert_aggregate_mutex);
+	limits_config = *limits;
+
+	/* A burst lower than one alert would discard all of them */
+	if (limits_config.burst < 1) limits_config.burst = 1;
+	if (limits_config.key_burst < 1) limits_config.key_burst = 1;
+
+	alert_bucket.tokens = limits_config.burst;
+	alert_bucket.last = time_sec(&time);
+
+	alert_limits_enabled = limits_config.aggregate_window > 0 ||
+		limits_config.rate > 0 || limits_config.key_rate > 0;
+	mutex_unlock(&alert_aggregate_mutex);
+
+	return true;
+}
+
+uint64 alert_limited()
+{
+	return atomic64_get(&alert_limited_count);
+}
+
+uint64 alert(const struct alert *alert)
+{
+	uint64 id;
+
+	if (alert_limits_enabled) {
+		return alert_limit(alert);
+	}
+
+	id = atomic64_inc(&alert_id);
+	alert_dispatch(ALERT_EVENT_NEW, id, alert);
+	return id;
+}
+
+bool alert_update(uint64 id, const struct alert *alert)
+{
+	/* The alert was discarded by the rate limits */
+	if (id == 0) return false;
+
+	alert_dispatch(ALERT_EVENT_UPDATE, id, alert);
 	return id;
 }
 
@@ -326,6 +1129,9 @@ const char *alert_tostring(uint64 id, const struct time *time, const struct aler
 	if (alert->description)
 		alert_string_append(&iter, &len, "%s%sdescription%s = %s", indent, color, clear, alert->description);
 
+	if (alert->count > 1)
+		alert_string_append(&iter, &len, "%s%scount%s = %llu", indent, color, clear, alert->count);
+
 	if (alert->method_description || alert->method_ref) {
 		alert_string_append(&iter, &len, "%s%smethod%s = {", indent, color, clear);
 
@@ -32,6 +32,7 @@ struct remote_launch {
 struct engine_thread {
 	volatile enum thread_status    status;
 	volatile struct packet_stats   packet_stats;
+	volatile struct gc_stats       gc_stats;
 	mutex_t                        remote_launch_lock;
 	thread_t                       thread;
 	int                            id;
@@ -39,6 +40,8 @@ struct engine_thread {
 	int                            interrupt_fd[2];
 	struct lua_State              *lua_state;
 	struct list2                   remote_launches;
+	void                         (*idle)(void *);
+	void                          *idle_data;
 };
 
 static local_storage_t engine_thread_localstorage;
@@ -172,6 +175,19 @@ volatile struct packet_stats *engine_thread_statistics(struct engine_thread *thr
 	else return NULL;
 }
 
+volatile struct gc_stats *engine_thread_gc_statistics(struct engine_thread *thread)
+{
+	if (thread) return &thread->gc_stats;
+	else return NULL;
+}
+
+void engine_thread_set_lua_state(struct engine_thread *thread, struct lua_State *L)
+{
+	assert(thread);
+	assert(thread == engine_thread_current());
+	thread->lua_state = L;
+}
+
 bool engine_thread_remote_launch(struct engine_thread *thread, void (*callback)(void *), void *data)
 {
 	struct remote_launch new;
@@ -388,3 +404,30 @@ int engine_thread_interrupt_fd()
 	struct engine_thread *thread = engine_thread_current();
 	return thread->interrupt_fd[0];
 }
+
+void engine_thread_set_idle(struct engine_thread *thread, void (*callback)(void *), void *data)
+{
+	assert(thread);
+	thread->idle = callback;
+	thread->idle_data = data;
+}
+
+int engine_thread_select(int nfds, fd_set *read_set)
+{
+	struct engine_thread *thread = engine_thread_current();
+
+	if (thread && thread->idle) {
+		fd_set ready = *read_set;
+		struct timeval timeout = { 0, 0 };
+
+		const int ret = select(nfds, &ready, NULL, NULL, &timeout);
+		if (ret != 0) {
+			if (ret > 0) *read_set = ready;
+			return ret;
+		}
+
+		thread->idle(thread->idle_data);
+	}
+
+	return select(nfds, read_set, NULL, NULL, NULL);
+}
@@ -15,6 +15,7 @@
 #include <haka/log_module.h>
 #include <haka/container/list.h>
 #include <haka/container/bitfield.h>
+#include <haka/thread.h>
 
 
 static struct logger *loggers = NULL;
@@ -28,6 +29,7 @@ static bool stdout_use_colors = 0;
 static int stdout_module_size = 0;
 
 static void cleanup_sections(void);
+static void log_dispatch_stop();
 
 #define MODULE_COLOR   CYAN
 
@@ -42,6 +44,45 @@ static const char *level_color[HAKA_LOG_LEVEL_LAST] = {
 
 #define MESSAGE_BUFSIZE   3072
 
+/*
+ * Messages for the asynchronous loggers are formatted by the caller and
+ * copied in a ring buffer owned by its thread. Each ring has a single
+ * producer, its thread, and a single consumer, the holder of
+ * log_dispatch_mutex, so no lock is needed to push a message. The log
+ * thread delivers them to the asynchronous loggers.
+ */
+
+#define LOG_QUEUE_SIZE    (64*1024) /* Must be a power of 2 */
+#define LOG_RECORD_ALIGN  8
+
+#define LOG_RECORD_PADDING   1 /* Unused space up to the end of the ring */
+
+struct log_record {
+	uint32     size; /* Record size, header included */
+	uint16     section;
+	uint8      level;
+	uint8      flags;
+	char       message[0];
+};
+
+struct log_queue {
+	struct log_queue     *next;
+	volatile uint32       head; /* Updated by the consumer */
+	volatile uint32       tail; /* Updated by the producer */
+	char                  buffer[LOG_QUEUE_SIZE];
+};
+
+static local_storage_t log_queue_key;
+static struct log_queue *log_queues = NULL;
+static atomic64_t log_dropped_count;
+static uint64 log_dropped_reported = 0;
+static mutex_t log_dispatch_mutex = MUTEX_INIT;
+static mutex_t log_thread_mutex = MUTEX_INIT;
+static semaphore_t log_thread_wait;
+static thread_t log_thread;
+static bool log_thread_started = false;
+static volatile bool log_thread_exit = false;
+
 static void message_delete(void *value)
 {
 	free(value);
@@ -78,6 +119,16 @@ INIT static void _message_init()
 	ret = mutex_init(&stdout_mutex, true);
 	assert(ret);
 
+	/* The queues are kept until the end as they can still hold messages
+	 * when their thread exits */
+	ret = local_storage_init(&log_queue_key, NULL);
+	assert(ret);
+
+	ret = semaphore_init(&log_thread_wait, 0);
+	assert(ret);
+
+	atomic64_init(&log_dropped_count, 0);
+
 	stdout_use_colors = colors_supported(fileno(stdout));
 
 	for (i=0; static_log_section[i].name; ++i) {
@@ -92,6 +143,15 @@ FINI static void _message_fini()
 {
 	remove_all_logger();
 
+	while (log_queues) {
+		struct log_queue *queue = log_queues;
+		log_queues = queue->next;
+		free(queue);
+	}
+
+	semaphore_destroy(&log_thread_wait);
+	atomic64_destroy(&log_dropped_count);
+
 	{
 		void *buffer = local_storage_get(&local_message_key);
 		if (buffer) {
@@ -153,7 +213,7 @@ static void cleanup_logger(struct logger *logger, struct logger **head)
 	logger->destroy(logger);
 }
 
-bool remove_logger(struct logger *logger)
+static bool _remove_logger(struct logger *logger)
 {
 	struct logger *module_to_release = NULL;
 	struct logger *iter;
@@ -185,10 +245,24 @@ bool remove_logger(struct logger *logger)
 	return true;
 }
 
+bool remove_logger(struct logger *logger)
+{
+	assert(logger);
+
+	/* Give the pending messages to the logger before it goes away */
+	if (logger->async) {
+		log_flush();
+	}
+
+	return _remove_logger(logger);
+}
+
 void remove_all_logger()
 {
 	struct logger *logger = NULL;
 
+	log_dispatch_stop();
+
 	{
 		rwlock_writelock(&log_module_lock);
 		logger = loggers;
@@ -323,9 +397,233 @@ section_id search_log_section(const char *name)
 	return INVALID_SECTION_ID;
 }
 
-static void message(log_level level, const char *module, const char *message, struct message_context_t *context)
+static void log_remove_pass()
+{
+	struct logger *iter;
+
+	rwlock_readlock(&log_module_lock);
+	for (iter = loggers; iter; iter = list_next(iter)) {
+		if (iter->mark_for_remove) {
+			rwlock_unlock(&log_module_lock);
+			_remove_logger(iter);
+			rwlock_readlock(&log_module_lock);
+		}
+	}
+	rwlock_unlock(&log_module_lock);
+}
+
+/* Deliver a message to the asynchronous loggers */
+static void log_deliver(log_level level, const char *module, const char *message)
+{
+	bool remove_pass = false;
+	struct logger *iter;
+
+	rwlock_readlock(&log_module_lock);
+	for (iter = loggers; iter; iter = list_next(iter)) {
+		if (iter->async) {
+			iter->message(iter, level, module, message);
+			remove_pass |= iter->mark_for_remove;
+		}
+	}
+	rwlock_unlock(&log_module_lock);
+
+	if (remove_pass) log_remove_pass();
+}
+
+static void log_dispatch_queue(struct log_queue *queue)
+{
+	const uint32 tail = queue->tail;
+	uint32 head = queue->head;
+	__sync_synchronize();
+
+	while (head != tail) {
+		struct log_record *record = (struct log_record *)(queue->buffer + (head & (LOG_QUEUE_SIZE-1)));
+
+		if (!(record->flags & LOG_RECORD_PADDING)) {
+			log_deliver(record->level, sections[record->section].name, record->message);
+		}
+
+		head += record->size;
+
+		__sync_synchronize();
+		queue->head = head;
+	}
+}
+
+void log_flush()
+{
+	struct message_context_t *context = message_context();
+	const bool doing_message = context->doing_message;
+	struct log_queue *queue;
+
+	mutex_lock(&log_dispatch_mutex);
+
+	/* Messages emitted by the loggers themselves are ignored like
+	 * for the synchronous loggers */
+	context->doing_message = true;
+	for (queue = log_queues; queue; queue = queue->next) {
+		log_dispatch_queue(queue);
+	}
+	context->doing_message = doing_message;
+
+	mutex_unlock(&log_dispatch_mutex);
+}
+
+uint64 log_dropped()
 {
+	return atomic64_get(&log_dropped_count);
+}
+
+static void *log_thread_main(void *param)
+{
+	while (!log_thread_exit) {
+		semaphore_wait(&log_thread_wait);
+		log_flush();
+
+		/* Report the lost messages once the queues have room again */
+		{
+			const uint64 dropped = atomic64_get(&log_dropped_count);
+			if (dropped != log_dropped_reported) {
+				LOG_WARNING(core, "%llu log messages lost, log queue full",
+						dropped - log_dropped_reported);
+				log_dropped_reported = dropped;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static bool log_dispatch_start()
+{
+	bool ret = true;
+
+	if (!log_thread_started) {
+		mutex_lock(&log_thread_mutex);
+		if (!log_thread_started) {
+			log_thread_exit = false;
+			if (thread_create(&log_thread, &log_thread_main, NULL)) {
+				log_thread_started = true;
+			}
+			else {
+				ret = false;
+			}
+		}
+		mutex_unlock(&log_thread_mutex);
+	}
+
+	return ret;
+}
+
+static void message(log_level level, section_id section, const char *message,
+		struct message_context_t *context, bool async);
+
+static void log_dispatch_stop()
+{
+	uint64 dropped;
+
+	mutex_lock(&log_thread_mutex);
+	if (log_thread_started) {
+		log_thread_exit = true;
+		semaphore_post(&log_thread_wait);
+		thread_join(log_thread, NULL);
+		log_thread_started = false;
+	}
+	mutex_unlock(&log_thread_mutex);
+
+	/* Deliver the remaining messages */
+	log_flush();
+
+	dropped = atomic64_get(&log_dropped_count);
+	if (dropped != log_dropped_reported) {
+		struct message_context_t *context = message_context();
+		if (!context->doing_message) {
+			snprintf(context->buffer, MESSAGE_BUFSIZE, "%llu log messages lost, log queue full",
+					dropped - log_dropped_reported);
+			message(HAKA_LOG_WARNING, LOG_SECTION(core), context->buffer, context, false);
+		}
+		log_dropped_reported = dropped;
+	}
+}
+
+static struct log_queue *log_queue_get()
+{
+	struct log_queue *queue = local_storage_get(&log_queue_key);
+	if (!queue) {
+		queue = malloc(sizeof(struct log_queue));
+		if (!queue) {
+			return NULL;
+		}
+
+		queue->head = 0;
+		queue->tail = 0;
+
+		do {
+			queue->next = log_queues;
+		} while (!__sync_bool_compare_and_swap(&log_queues, queue->next, queue));
+
+		local_storage_set(&log_queue_key, queue);
+	}
+
+	return queue;
+}
+
+static void log_enqueue(log_level level, section_id section, const char *message)
+{
+	struct log_queue *queue = log_queue_get();
+	const size_t len = strlen(message) + 1;
+	const uint32 size = (sizeof(struct log_record) + len + LOG_RECORD_ALIGN-1) & ~(LOG_RECORD_ALIGN-1);
+	struct log_record *record;
+	uint32 tail, pos, left;
+
+	if (!queue || !log_dispatch_start()) {
+		atomic64_inc(&log_dropped_count);
+		return;
+	}
+
+	tail = queue->tail;
+	pos = tail & (LOG_QUEUE_SIZE-1);
+	left = LOG_QUEUE_SIZE - pos;
+
+	/* A record is never split, the end of the ring is skipped if
+	 * it is too small */
+	if (LOG_QUEUE_SIZE - (tail - queue->head) < size + (left < size ? left : 0)) {
+		atomic64_inc(&log_dropped_count);
+		return;
+	}
+
+	if (left < size) {
+		record = (struct log_record *)(queue->buffer + pos);
+		record->size = left;
+		record->flags = LOG_RECORD_PADDING;
+
+		tail += left;
+		pos = 0;
+	}
+
+	record = (struct log_record *)(queue->buffer + pos);
+	record->size = size;
+	record->section = section;
+	record->level = level;
+	record->flags = 0;
+	memcpy(record->message, message, len);
+
+	__sync_synchronize();
+	queue->tail = tail + size;
+
+	semaphore_post(&log_thread_wait);
+}
+
+/*
+ * Errors are given directly to every logger as the process might not
+ * survive them. Other messages are queued for the asynchronous loggers.
+ */
+static void message(log_level level, section_id section, const char *message,
+		struct message_context_t *context, bool async)
+{
+	const char *module = sections[section].name;
 	bool remove_pass = false;
+	bool enqueue = false;
 
 	context->doing_message = true;
 
@@ -333,6 +631,11 @@ static void message(log_level level, const char *module, const char *message, st
 
 	rwlock_readlock(&log_module_lock);
 	for (iter = loggers; iter; iter = list_next(iter)) {
+		if (async && iter->async) {
+			enqueue = true;
+			continue;
+		}
+
 		iter->message(iter, level, module, message);
 
 		remove_pass |= iter->mark_for_remove;
@@ -343,24 +646,25 @@ static void message(log_level level, const char *module, const char *message, st
 		stdout_message(level, module, message);
 	}
 
-	if (remove_pass) {
-		rwlock_readlock(&log_module_lock);
-		for (iter = loggers; iter; iter = list_next(iter)) {
-			if (iter->mark_for_remove) {
-				rwlock_unlock(&log_module_lock);
-				remove_logger(iter);
-				rwlock_readlock(&log_module_lock);
-			}
-		}
-		rwlock_unlock(&log_module_lock);
-	}
+	if (remove_pass) log_remove_pass();
 
 	context->doing_message = false;
+
+	if (enqueue) {
+		log_enqueue(level, section, message);
+	}
 }
 
 void _messagef(log_level level, section_id section, const char *fmt, ...)
 {
-	struct message_context_t *context = message_context();
+	struct message_context_t *context;
+
+	/* Nothing to format if there is no output */
+	if (!stdout_enable && !loggers) {
+		return;
+	}
+
+	context = message_context();
 	if (context && !context->doing_message) {
 		if (section >= sections_count) {
 			error("invalid section");
@@ -370,7 +674,7 @@ void _messagef(log_level level, section_id section, const char *fmt, ...)
 		va_list ap;
 		va_start(ap, fmt);
 		vsnprintf(context->buffer, MESSAGE_BUFSIZE, fmt, ap);
-		message(level, sections[section].name, context->buffer, context);
+		message(level, section, context->buffer, context, level > HAKA_LOG_ERROR);
 		va_end(ap);
 	}
 }
@@ -0,0 +1,227 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <haka/lua/alloc.h>
+#include <haka/error.h>
+#include <haka/log.h>
+#include <haka/compiler.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+
+#define ARENA_SIZE            (256*1024)
+#define ARENA_HUGE_SIZE       (2*1024*1024)
+
+/* The header keeps the blocks aligned on the granularity */
+#define ARENA_HEADER_SIZE     ((sizeof(struct lua_alloc_arena) + LUA_ALLOC_GRANULARITY - 1) & \
+                               ~(LUA_ALLOC_GRANULARITY - 1))
+
+struct lua_alloc_block {
+	struct lua_alloc_block  *next;
+};
+
+struct lua_alloc_arena {
+	struct lua_alloc_arena  *next;
+	size_t                   size;
+};
+
+struct lua_alloc {
+	struct lua_alloc_block  *free[LUA_ALLOC_CLASS_COUNT];
+	struct lua_alloc_arena  *arenas;
+	char                    *current;
+	char                    *end;
+	struct lua_alloc_stats   stats;
+};
+
+static bool alloc_enabled = LUA_ALLOC_SUPPORTED;
+static bool alloc_hugepages = false;
+
+void lua_alloc_set_enabled(bool enabled)
+{
+	if (enabled && !LUA_ALLOC_SUPPORTED) {
+		LOG_WARNING(lua, "lua allocator not supported by LuaJIT on this architecture, using the default one");
+		enabled = false;
+	}
+
+	alloc_enabled = enabled;
+}
+
+bool lua_alloc_enabled()
+{
+	return alloc_enabled;
+}
+
+void lua_alloc_set_hugepages(bool hugepages)
+{
+	if (hugepages && !alloc_enabled) {
+		LOG_WARNING(lua, "huge pages require the lua allocator, option ignored");
+		hugepages = false;
+	}
+
+	alloc_hugepages = hugepages;
+}
+
+struct lua_alloc *lua_alloc_create()
+{
+	struct lua_alloc *alloc = malloc(sizeof(struct lua_alloc));
+	if (!alloc) {
+		error("memory error");
+		return NULL;
+	}
+
+	memset(alloc, 0, sizeof(struct lua_alloc));
+	alloc->stats.hugepages = alloc_hugepages;
+	return alloc;
+}
+
+void lua_alloc_destroy(struct lua_alloc *alloc)
+{
+	struct lua_alloc_arena *arena = alloc->arenas;
+	while (arena) {
+		struct lua_alloc_arena *next = arena->next;
+		munmap(arena, arena->size);
+		arena = next;
+	}
+
+	free(alloc);
+}
+
+const struct lua_alloc_stats *lua_alloc_statistics(struct lua_alloc *alloc)
+{
+	return &alloc->stats;
+}
+
+static bool new_arena(struct lua_alloc *alloc)
+{
+	struct lua_alloc_arena *arena = MAP_FAILED;
+	size_t size = ARENA_SIZE;
+
+	if (alloc->stats.hugepages) {
+		size = ARENA_HUGE_SIZE;
+		arena = mmap(NULL, size, PROT_READ|PROT_WRITE,
+				MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+		if (arena == MAP_FAILED) {
+			LOG_WARNING(lua, "huge pages not available for the lua allocator");
+			alloc->stats.hugepages = false;
+			size = ARENA_SIZE;
+		}
+	}
+
+	if (arena == MAP_FAILED) {
+		arena = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (arena == MAP_FAILED) {
+			return false;
+		}
+	}
+
+	arena->size = size;
+	arena->next = alloc->arenas;
+	alloc->arenas = arena;
+
+	alloc->current = (char *)arena + ARENA_HEADER_SIZE;
+	alloc->end = (char *)arena + size;
+	alloc->stats.arena += size;
+	return true;
+}
+
+INLINE int size_class(size_t size)
+{
+	return (size - 1) / LUA_ALLOC_GRANULARITY;
+}
+
+static void *small_alloc(struct lua_alloc *alloc, int class)
+{
+	struct lua_alloc_block *block = alloc->free[class];
+
+	if (block) {
+		alloc->free[class] = block->next;
+	}
+	else {
+		const size_t size = (class + 1) * LUA_ALLOC_GRANULARITY;
+
+		/* The end of the previous arena is lost */
+		if (alloc->current + size > alloc->end) {
+			if (!new_arena(alloc)) return NULL;
+		}
+
+		block = (struct lua_alloc_block *)alloc->current;
+		alloc->current += size;
+	}
+
+	alloc->stats.classes[class].count++;
+	alloc->stats.classes[class].allocs++;
+	return block;
+}
+
+static void small_free(struct lua_alloc *alloc, int class, void *ptr)
+{
+	struct lua_alloc_block *block = (struct lua_alloc_block *)ptr;
+
+	block->next = alloc->free[class];
+	alloc->free[class] = block;
+	alloc->stats.classes[class].count--;
+}
+
+static void account(struct lua_alloc *alloc, size_t osize, size_t nsize)
+{
+	alloc->stats.used += nsize - osize;
+	if (nsize > osize) alloc->stats.allocated += nsize - osize;
+	if (alloc->stats.used > alloc->stats.peak) {
+		alloc->stats.peak = alloc->stats.used;
+	}
+
+	if (osize > LUA_ALLOC_SMALL_MAX) alloc->stats.large -= osize;
+	if (nsize > LUA_ALLOC_SMALL_MAX) alloc->stats.large += nsize;
+}
+
+/*
+ * Lua always gives back the size of the block (osize), it is then used to
+ * find its class. On Lua 5.2, osize encodes the type of the object when ptr
+ * is NULL.
+ */
+void *lua_alloc_function(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+	struct lua_alloc *alloc = (struct lua_alloc *)ud;
+	void *ret;
+
+	if (!ptr) osize = 0;
+
+	if (nsize == 0) {
+		if (ptr) {
+			if (osize <= LUA_ALLOC_SMALL_MAX) small_free(alloc, size_class(osize), ptr);
+			else free(ptr);
+
+			account(alloc, osize, 0);
+		}
+		return NULL;
+	}
+
+	if (osize > LUA_ALLOC_SMALL_MAX && nsize > LUA_ALLOC_SMALL_MAX) {
+		ret = realloc(ptr, nsize);
+		if (!ret) return NULL;
+	}
+	else if (ptr && osize <= LUA_ALLOC_SMALL_MAX && nsize <= LUA_ALLOC_SMALL_MAX &&
+			size_class(osize) == size_class(nsize)) {
+		ret = ptr;
+	}
+	else {
+		if (nsize <= LUA_ALLOC_SMALL_MAX) ret = small_alloc(alloc, size_class(nsize));
+		else ret = malloc(nsize);
+
+		if (!ret) return NULL;
+
+		if (ptr) {
+			memcpy(ret, ptr, osize < nsize ? osize : nsize);
+
+			if (osize <= LUA_ALLOC_SMALL_MAX) small_free(alloc, size_class(osize), ptr);
+			else free(ptr);
+		}
+	}
+
+	account(alloc, osize, nsize);
+	return ret;
+}
@@ -17,6 +17,8 @@
 #include <haka/colors.h>
 #include <haka/engine.h>
 #include <haka/system.h>
+#include <haka/lua/state.h>
+#include <haka/lua/alloc.h>
 
 %}
 
@@ -76,6 +78,7 @@ struct time {
 STRUCT_UNKNOWN_KEY_ERROR(time);
 
 %native(_threads_info) int threads_info(lua_State *L);
+%native(_lua_memory_info) int lua_memory_info(lua_State *L);
 
 %{
 	int threads_info(struct lua_State *L)
@@ -89,6 +92,7 @@ STRUCT_UNKNOWN_KEY_ERROR(time);
 			if (!engine) break;
 
 			volatile struct packet_stats *packet_stats = engine_thread_statistics(engine);
+			volatile struct gc_stats *gc_stats = engine_thread_gc_statistics(engine);
 
 			lua_pushnumber(L, i+1);
 
@@ -118,12 +122,72 @@ STRUCT_UNKNOWN_KEY_ERROR(time);
 			lua_setfield(L, -2, "trans_bytes");
 			lua_pushnumber(L, (double)packet_stats->drop_packets);
 			lua_setfield(L, -2, "drop_pkt");
+			lua_pushnumber(L, (double)(gc_stats->time / 1000));
+			lua_setfield(L, -2, "gc_ms");
+			lua_pushnumber(L, (double)gc_stats->cycles);
+			lua_setfield(L, -2, "gc_cycles");
 
 			lua_settable(L, -3);
 		}
 
 		return 1;
 	}
+
+	/* Memory used by the Lua state of the current thread */
+	int lua_memory_info(struct lua_State *L)
+	{
+		const struct lua_alloc_stats *stats = lua_state_alloc_statistics(lua_state_get(L));
+		int i;
+
+		lua_newtable(L);
+
+		lua_pushnumber(L, thread_getid());
+		lua_setfield(L, -2, "thread");
+
+		if (!stats) {
+			/* Default allocator, only the current usage is known */
+			lua_pushstring(L, "default");
+			lua_setfield(L, -2, "allocator");
+			lua_pushnumber(L, (double)lua_gc(L, LUA_GCCOUNT, 0) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0));
+			lua_setfield(L, -2, "used");
+			return 1;
+		}
+
+		lua_pushstring(L, stats->hugepages ? "haka (huge pages)" : "haka");
+		lua_setfield(L, -2, "allocator");
+		lua_pushnumber(L, (double)stats->used);
+		lua_setfield(L, -2, "used");
+		lua_pushnumber(L, (double)stats->peak);
+		lua_setfield(L, -2, "peak");
+		lua_pushnumber(L, (double)stats->allocated);
+		lua_setfield(L, -2, "allocated");
+		lua_pushnumber(L, (double)stats->arena);
+		lua_setfield(L, -2, "arena");
+		lua_pushnumber(L, (double)stats->large);
+		lua_setfield(L, -2, "large");
+
+		lua_newtable(L);
+		for (i=0; i<LUA_ALLOC_CLASS_COUNT; ++i) {
+			const size_t size = (i+1)*LUA_ALLOC_GRANULARITY;
+
+			lua_pushnumber(L, i+1);
+
+			lua_newtable(L);
+			lua_pushnumber(L, size);
+			lua_setfield(L, -2, "size");
+			lua_pushnumber(L, (double)stats->classes[i].count);
+			lua_setfield(L, -2, "count");
+			lua_pushnumber(L, (double)(stats->classes[i].count*size));
+			lua_setfield(L, -2, "bytes");
+			lua_pushnumber(L, (double)stats->classes[i].allocs);
+			lua_setfield(L, -2, "allocs");
+
+			lua_settable(L, -3);
+		}
+		lua_setfield(L, -2, "classes");
+
+		return 1;
+	}
 %}
 
 %luacode {
@@ -148,10 +212,53 @@ STRUCT_UNKNOWN_KEY_ERROR(time);
 		error(nil)
 	end
 
+	-- Flows of the dissectors. On a reload, the previous Lua state is kept
+	-- until its flows are closed and still receives their packets.
+	haka.open_flows = {}
+	haka.flow_owners = {}
+
+	function haka.open_flow_count()
+		local total = 0
+		for _, count in pairs(haka.open_flows) do
+			total = total + count()
+		end
+		return total
+	end
+
+	function haka.owns_packet(pkt)
+		for _, owns in pairs(haka.flow_owners) do
+			if owns(pkt) then return true end
+		end
+		return false
+	end
+
 	haka.console = {}
 
 	haka.console.threads = haka._threads_info
 	haka._threads_info = nil
+
+	local lua_memory_info = haka._lua_memory_info
+	haka._lua_memory_info = nil
+
+	function haka.console.lua_memory()
+		local info = lua_memory_info()
+		info.classes = nil
+		return { info }
+	end
+
+	function haka.console.lua_memory_classes()
+		local info = lua_memory_info()
+		if not info.classes then
+			error("size classes are only available with the haka lua allocator")
+		end
+
+		local ret = {}
+		for _, class in ipairs(info.classes) do
+			class.thread = info.thread
+			table.insert(ret, class)
+		end
+		return ret
+	end
 }
 
 %include "lua/vbuffer.si"
@@ -28,6 +28,7 @@ function BaseClassView.__tostring(self)
 end
 
 local BaseClass = {}
+local set_dynamic
 
 local function build_class_index_table(cls)
 	local cache = {}
@@ -94,6 +95,7 @@ local BaseObject = {
 			end
 
 			property[name] = { get = get, set = set }
+			set_dynamic(module.classof(self))
 		end
 	},
 	property = {}
@@ -111,9 +113,25 @@ function module.super(cls)
 	return rawget(cls.super, '__view')
 end
 
+--
+-- The methods and the properties of a class are flattened on first access,
+-- which ends the class definition. The first definition found from the
+-- class to its ancestors is used.
+--
+-- When possible, the index is a plain table that holds the methods which
+-- keeps the lookups simple for the trace compiler. A function is only
+-- needed if the class has getters, a custom __index or if some of its
+-- instances carry dynamic properties (see addproperty).
+--
+
+local function is_dynamic(cls)
+	return rawget(cls, '__dynamic') == true
+end
+
 local function build_index_table(cls)
-	local cache = {}
-	local index
+	local methods, getters = {}, {}
+	local defined = {}
+	local index, has_getters
 
 	for c in class_hierarchy(cls) do
 		for name, method in pairs(rawget(c, 'method')) do
@@ -121,45 +139,64 @@ local function build_index_table(cls)
 				if not index then
 					index = method
 				end
-			else
-				if not cache[name] then
-					cache[name] = function () return method end
-				end
+			elseif not defined[name] then
+				defined[name] = true
+				methods[name] = method
 			end
 		end
 
 		for name, prop in pairs(rawget(c, 'property')) do
-			if prop.get and not cache[name] then
-				local getter = prop.get
-				cache[name] = function (self) return getter(self) end
+			if prop.get and not defined[name] then
+				defined[name] = true
+				getters[name] = prop.get
+				has_getters = true
 			end
 		end
 	end
 
-	return function (self, key)
-		local v
+	if is_dynamic(cls) then
+		return function (self, key)
+			local v
 
-		-- Dynamic properties
-		v = rawget(self, '__property')
-		if v then
-			v = v[key]
-			if v and v.get then
-				return v.get(self)
+			-- Dynamic properties
+			v = rawget(self, '__property')
+			if v then
+				v = v[key]
+				if v and v.get then
+					return v.get(self)
+				end
+			end
+
+			v = methods[key]
+			if v ~= nil then return v end
+
+			v = getters[key]
+			if v then return v(self) end
+
+			if index then
+				return index(self, key)
 			end
 		end
+	elseif has_getters or index then
+		return function (self, key)
+			local v = methods[key]
+			if v ~= nil then return v end
 
-		v = cache[key]
-		if v then return v(self) end
+			v = getters[key]
+			if v then return v(self) end
 
-		if index then
-			return index(self, key)
+			if index then
+				return index(self, key)
+			end
 		end
+	else
+		return methods
 	end
 end
 
 local function build_newindex_table(cls)
-	local cache = {}
-	local newindex
+	local setters = {}
+	local newindex, has_setters
 
 	for c in class_hierarchy(cls) do
 		if not newindex then
@@ -167,33 +204,80 @@ local function build_newindex_table(cls)
 		end
 
 		for name, prop in pairs(rawget(c, 'property')) do
-			if prop.set and not cache[name] then
-				local setter = prop.set
-				cache[name] = function (self, value) return setter(self, value) end
+			if prop.set and not setters[name] then
+				setters[name] = prop.set
+				has_setters = true
 			end
 		end
 	end
 
-	return function (self, key, value)
-		local v
+	if is_dynamic(cls) then
+		return function (self, key, value)
+			local v
+
+			-- Dynamic properties
+			v = rawget(self, '__property')
+			if v then
+				v = v[key]
+				if v and v.set then
+					return v.set(self, value)
+				end
+			end
+
+			v = setters[key]
+			if v then return v(self, value) end
 
-		-- Dynamic properties
-		v = rawget(self, '__property')
-		if v then
-			v = v[key]
-			if v and v.set then
-				return v.set(self, value)
+			if newindex then
+				return newindex(self, key, value)
 			end
+
+			rawset(self, key, value)
 		end
+	elseif has_setters or newindex then
+		return function (self, key, value)
+			local v = setters[key]
+			if v then return v(self, value) end
+
+			if newindex then
+				return newindex(self, key, value)
+			end
 
-		v = cache[key]
-		if v then return v(self, value) end
+			rawset(self, key, value)
+		end
+	else
+		-- No metamethod, the assignments are raw
+		return nil
+	end
+end
 
+local function set_lazy_index(cls)
+	rawset(cls, '__index', function (self, key)
+		local index = build_index_table(cls)
+		rawset(cls, '__index', index)
+		if type(index) == 'table' then
+			return index[key]
+		else
+			return index(self, key)
+		end
+	end)
+
+	rawset(cls, '__newindex', function (self, key, value)
+		local newindex = build_newindex_table(cls)
+		rawset(cls, '__newindex', newindex)
 		if newindex then
 			return newindex(self, key, value)
+		else
+			rawset(self, key, value)
 		end
+	end)
+end
 
-		rawset(self, key, value)
+-- Switch the class to the slower dispatch which handles the dynamic
+-- properties of its instances
+function set_dynamic(cls)
+	if cls and not is_dynamic(cls) then
+		rawset(cls, '__dynamic', true)
+		set_lazy_index(cls)
 	end
 end
 
@@ -215,14 +299,7 @@ function module.class(name, super)
 
 	cls.method = {}
 	cls.property = {}
-	cls.__index = function (self, key)
-		cls.__index = build_index_table(cls)
-		return cls.__index(self, key)
-	end
-	cls.__newindex = function (self, key, value)
-		cls.__newindex = build_newindex_table(cls)
-		return cls.__newindex(self, key, value)
-	end
+	set_lazy_index(cls)
 
 	setmetatable(cls, BaseClass)
 
@@ -240,6 +317,7 @@ function module.merge(dst, src)
 			table.merge(pdst, psrc)
 		end
 		rawset(src, '__property', nil)
+		set_dynamic(module.classof(dst))
 	end
 
 	table.merge(dst, src)
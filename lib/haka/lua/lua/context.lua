@@ -8,6 +8,51 @@ local Scope = class.class()
 
 function Scope.method:__init()
 	self._connections = {}
+	self:_invalidate()
+end
+
+function Scope.method:_invalidate()
+	self._dispatch = {}
+	self._generation = haka.event.generation()
+end
+
+function Scope.method:addconnections(connections)
+	table.insert(self._connections, connections)
+	self:_invalidate()
+end
+
+-- Dispatch function over all the connections of the scope, false if
+-- there is no listener
+function Scope.method:dispatcher(event)
+	if self._generation ~= haka.event.generation() then
+		self:_invalidate()
+	end
+
+	local dispatch = self._dispatch[event]
+	if dispatch == nil then
+		local dispatchers = {}
+		for _, connections in ipairs(self._connections) do
+			local d = connections:dispatcher(event)
+			if d then table.insert(dispatchers, d) end
+		end
+
+		local count = #dispatchers
+		if count == 0 then
+			dispatch = false
+		elseif count == 1 then
+			dispatch = dispatchers[1]
+		else
+			dispatch = function (emitter, ...)
+				for i = 1, count do
+					dispatchers[i](emitter, ...)
+				end
+			end
+		end
+
+		self._dispatch[event] = dispatch
+	end
+
+	return dispatch
 end
 
 function Scope.method:createnamespace(ref, data)
@@ -26,23 +71,33 @@ function Context.method:__init()
 end
 
 function Context.method:signal(emitter, event, ...)
-	assert(class.classof(event, haka.event.Event), "event expected")
+	assert(event, "event expected")
 
-	if not self.connections:signal(emitter, event, ...) then
-		return false
+	local dispatch = self.connections:dispatcher(event)
+	if dispatch then
+		dispatch(emitter, ...)
 	end
 
-	if self.scope then
-		for _, connections in ipairs(self.scope._connections) do
-			if not connections:signal(emitter, event, ...) then
-				return false
-			end
+	local scope = self.scope
+	if scope then
+		dispatch = scope:dispatcher(event)
+		if dispatch then
+			dispatch(emitter, ...)
 		end
 	end
 
 	return true
 end
 
+function Context.method:haslisteners(event)
+	if self.connections:dispatcher(event) then
+		return true
+	end
+
+	local scope = self.scope
+	return scope ~= nil and scope:dispatcher(event) ~= false
+end
+
 function Context.method:newscope()
 	return Scope:new()
 end
@@ -58,7 +113,7 @@ end
 function Context.method:register_connections(connections)
 	if connections then
 		if self.scope then
-			table.insert(self.scope._connections, connections)
+			self.scope:addconnections(connections)
 		else
 			error("invalid scope")
 		end
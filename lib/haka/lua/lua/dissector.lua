@@ -29,6 +29,7 @@ function type.Dissector.__class_init(self, cls)
 	setmetatable(cls.events, event_mt)
 	self.inherit_events(cls)
 	cls.options = {}
+	cls.next_dissectors = {}
 end
 
 function type.Dissector.register_event(cls, name, continue, signal, options)
@@ -36,6 +37,20 @@ function type.Dissector.register_event(cls, name, continue, signal, options)
 	cls.events[name] = haka.event.Event:new(string.format('%s:%s', cls.name, name), continue, signal, options)
 end
 
+-- Key that rules can match on, added to the given events or to all the
+-- events of the dissector
+function type.Dissector.register_match_key(cls, name, get, value, events)
+	if events then
+		for _, event in ipairs(events) do
+			cls.events[event]:register_key(name, get, value)
+		end
+	else
+		for _, event in pairs(cls.events) do
+			event:register_key(name, get, value)
+		end
+	end
+end
+
 function type.Dissector.inherit_events(cls)
 	local parent_events = cls.super.events
 	if parent_events then
@@ -47,6 +62,63 @@ function type.Dissector.inherit_events(cls)
 	end
 end
 
+--
+-- Demand-driven dissection: a dissector is needed if a rule listens to
+-- one of its events, if some dissectors are installed on its ports or if
+-- one of the dissectors it can lead to is needed.
+-- Setting the option `lazy` to false makes a dissector always needed. The
+-- packets are not given to the dissectors that are not needed and
+-- are sent by the last needed layer.
+--
+
+function type.Dissector.add_next_dissector(cls, dissector)
+	table.insert(cls.next_dissectors, dissector)
+end
+
+local function compute_needed(cls)
+	local connections = haka.context.connections
+
+	if cls.options.lazy == false then
+		return true
+	end
+
+	-- The flows are given to the dissectors installed on their ports
+	if cls.port_table and not cls.port_table:isempty() then
+		return true
+	end
+
+	for _, event in pairs(cls.events) do
+		if connections:haslisteners(event) then
+			return true
+		end
+	end
+
+	for _, next_dissector in ipairs(cls.next_dissectors) do
+		if next_dissector:isneeded() then
+			return true
+		end
+	end
+
+	return false
+end
+
+-- The result is computed again only when the rules change
+function type.Dissector.isneeded(cls)
+	local generation = haka.event.generation()
+	if rawget(cls, '_needed_generation') ~= generation then
+		rawset(cls, '_needed_generation', generation)
+		rawset(cls, '_needed', false)
+		rawset(cls, '_needed', compute_needed(cls))
+	end
+
+	return rawget(cls, '_needed')
+end
+
+-- An instance always needs to be called as it has been selected on a flow
+function type.Dissector.method:isneeded()
+	return true
+end
+
 type.Dissector.auto_state_machine = true
 
 function type.Dissector.method:__init()
@@ -64,6 +136,11 @@ function type.Dissector.method:trigger(signal, ...)
 	haka.context:signal(self, class.classof(self).events[signal], ...)
 end
 
+-- Check if an event has listeners, to avoid building its parameters
+function type.Dissector.method:haslisteners(signal)
+	return haka.context:haslisteners(class.classof(self).events[signal])
+end
+
 function type.Dissector.method:send()
 	error("not implemented")
 end
@@ -199,7 +276,7 @@ function type.EncapsulatedPacketDissector.method:emit()
 	self:trigger('receive_packet')
 
 	local next_dissector = self:next_dissector()
-	if next_dissector then
+	if next_dissector and next_dissector:isneeded() then
 		return next_dissector:receive(self)
 	else
 		return self:send()
@@ -294,6 +371,25 @@ function type.FlowDissector.method:get_comanager(stream)
 	return self._costream[stream]
 end
 
+-- Give the stream managers back to the pool, including the ones of the
+-- next dissector
+function type.FlowDissector.method:release_comanagers()
+	-- The references are dropped before the managers go back to the pool,
+	-- a pooled manager must not be reachable from this flow anymore
+	local costream = self._costream
+	if costream then
+		self._costream = nil
+		for _, comanager in pairs(costream) do
+			comanager:release()
+		end
+	end
+
+	local next_dissector = self._next_dissector
+	if next_dissector and next_dissector.release_comanagers then
+		next_dissector:release_comanagers()
+	end
+end
+
 function type.FlowDissector.method:next_dissector()
 	return self._next_dissector
 end
@@ -303,6 +399,62 @@ function type.FlowDissector.method:select_next_dissector(dissector)
 	self._next_dissector = dissector
 end
 
+--
+-- Selection of the dissector of the new flows from their ports. The
+-- dissectors are registered on the destination port of the flow, which is
+-- the server port, or on its source port with the direction 'down'. A
+-- single port is found with one lookup, the ranges are checked in their
+-- registration order when no single port matches.
+--
+
+type.PortTable = class.class('PortTable')
+
+function type.PortTable.method:__init()
+	self.ports = { up = {}, down = {} }
+	self.ranges = {}
+	self.count = 0
+end
+
+local function flow_port(flow, direction)
+	if direction == 'up' then return flow.dstport
+	else return flow.srcport end
+end
+
+function type.PortTable.method:add(dissector, port, direction)
+	direction = direction or 'up'
+	check.assert(direction == 'up' or direction == 'down', "invalid direction")
+
+	if _G.type(port) == 'table' then
+		local first, last = port[1], port[2] or port[1]
+		check.assert(first and first <= last, "invalid port range")
+		table.insert(self.ranges, { first = first, last = last,
+			direction = direction, dissector = dissector })
+	else
+		check.assert(_G.type(port) == 'number', "invalid port")
+		self.ports[direction][port] = dissector
+	end
+
+	self.count = self.count + 1
+end
+
+function type.PortTable.method:isempty()
+	return self.count == 0
+end
+
+function type.PortTable.method:lookup(flow)
+	local dissector = self.ports.up[flow.dstport] or self.ports.down[flow.srcport]
+	if dissector then
+		return dissector
+	end
+
+	for _, range in ipairs(self.ranges) do
+		local port = flow_port(flow, range.direction)
+		if port >= range.first and port <= range.last then
+			return range.dissector
+		end
+	end
+end
+
 --
 -- Utility functions
 --
@@ -17,29 +17,245 @@ function module.Event.method:__init(name, continue, signal)
 	self.name = name
 	self.continue = continue or function () end
 	self.signal = signal or function (f, options, ...) return f(...) end
+	self.keys = {}
+end
+
+--
+-- Match keys
+--
+-- A key gives a value from the parameters of the event that rules can
+-- match against, for instance a port. The get function is called with the
+-- emitter and the parameters of the event. The optional value function
+-- converts the values given by the rules to the type returned by get.
+--
+
+function module.Event.method:register_key(name, get, value)
+	assert(type(get) == 'function', "function expected")
+	self.keys[name] = { get = get, value = value }
+end
+
+function module.Event.method:clone()
+	local c = module.Event:new(self.name, self.continue, self.signal)
+	table.merge(c.keys, self.keys)
+	return c
+end
+
+-- Convert the match clause of a rule to a set of accepted values by key
+function module.Event.method:compile_match(match)
+	local ret = {}
+	for name, values in pairs(match) do
+		local key = self.keys[name]
+		if not key then
+			error(string.format("unknown match key '%s' for event '%s'", name, self.name))
+		end
+
+		if type(values) ~= 'table' then
+			values = { values }
+		end
+
+		local set = {}
+		for _, value in ipairs(values) do
+			if key.value then value = key.value(value) end
+			set[value] = true
+		end
+
+		ret[name] = set
+	end
+	return ret
 end
 
 
 --
 -- Connections
 --
+-- The listeners of each event are compiled into a dispatch function which
+-- is kept until a new listener is registered. The events without listener
+-- are compiled to false which makes the check for listeners cheap.
+--
+-- When some listeners have a match clause, the key used by most of them
+-- indexes the listeners by value. The dispatch then only goes through the
+-- listeners registered for the value of the event and the ones that do not
+-- match on this key, in their registration order. The other keys of the
+-- match clauses are checked before calling each listener.
+--
 
 module.EventConnections = class.class('EventConnections')
 
-function module.EventConnections.method:_signal(event, listener, emitter, ...)
-	event.signal(listener.f, listener.options, emitter, ...)
+-- Incremented on each registration to invalidate the compiled dispatchers
+local generation = 0
+
+-- Compiled dispatchers of each connections object, kept outside of the
+-- object as the static connections only contain the listeners
+local compiled = setmetatable({}, { __mode = 'k' })
+
+function module.invalidate()
+	generation = generation + 1
 end
 
-function module.EventConnections.method:signal(emitter, event, ...)
-	local listeners = self:_get(event)
-	if listeners then
-		log.debug("signal '%s', %d listeners", event.name, #listeners)
+function module.generation()
+	return generation
+end
+
+local function compile_list(event, listeners, prepare)
+	local count = #listeners
+	if count == 0 then
+		return false
+	end
+
+	local signal, continue = event.signal, event.continue
+
+	if count == 1 and not listeners[1].checks then
+		local f, options = listeners[1].f, listeners[1].options
+		return function (emitter, ...)
+			if prepare then prepare() end
+			signal(f, options, emitter, ...)
+			continue(emitter, ...)
+		end
+	end
+
+	local funcs, options, checks = {}, {}, {}
+	for i, listener in ipairs(listeners) do
+		funcs[i] = listener.f
+		options[i] = listener.options
+		checks[i] = listener.checks or false
+	end
+
+	local function accept(check, emitter, ...)
+		for key, set in pairs(check) do
+			if not set[key.get(emitter, ...)] then
+				return false
+			end
+		end
+		return true
+	end
+
+	return function (emitter, ...)
+		for i = 1, count do
+			local check = checks[i]
+			if not check or accept(check, emitter, ...) then
+				if prepare then prepare() end
+				signal(funcs[i], options[i], emitter, ...)
+				continue(emitter, ...)
+			end
+		end
+	end
+end
 
-		for _, listener in ipairs(listeners) do
-			self:_signal(event, listener, emitter, ...)
-			event.continue(emitter, ...)
+-- Key matched by the largest number of listeners
+local function index_key(listeners)
+	local counts = {}
+	local best, best_count = nil, 0
+	for _, listener in ipairs(listeners) do
+		for name in sorted_pairs(listener.match or {}) do
+			local count = (counts[name] or 0) + 1
+			counts[name] = count
+			if count > best_count then
+				best, best_count = name, count
+			end
 		end
 	end
+	return best
+end
+
+-- Listener with the checks of its keys other than the index key
+local function checked_listener(event, listener, index)
+	local checks = nil
+	for name, set in pairs(listener.match or {}) do
+		if name ~= index then
+			checks = checks or {}
+			checks[event.keys[name]] = set
+		end
+	end
+
+	return { f = listener.f, options = listener.options, checks = checks }
+end
+
+local function compile_listeners(event, listeners, prepare)
+	local count = listeners and #listeners or 0
+	if count == 0 then
+		return false
+	end
+
+	log.debug("compile event '%s', %d listeners", event.name, count)
+
+	local index = index_key(listeners)
+	if not index then
+		return compile_list(event, listeners, prepare)
+	end
+
+	-- Each value gets the listeners on this value and the ones that
+	-- do not match on the index key
+	local values = {}
+	local default = {}
+	for _, listener in ipairs(listeners) do
+		local compiled = checked_listener(event, listener, index)
+		local set = listener.match and listener.match[index]
+		if set then
+			for value in pairs(set) do
+				local list = values[value]
+				if not list then
+					list = table.copy(default)
+					values[value] = list
+				end
+				table.insert(list, compiled)
+			end
+		else
+			table.insert(default, compiled)
+			for _, list in pairs(values) do
+				table.insert(list, compiled)
+			end
+		end
+	end
+
+	local dispatchers = {}
+	for value, list in pairs(values) do
+		dispatchers[value] = compile_list(event, list, prepare)
+	end
+
+	local default_dispatch = compile_list(event, default, prepare)
+	local get = event.keys[index].get
+
+	log.debug("event '%s' indexed by '%s'", event.name, index)
+
+	return function (emitter, ...)
+		local dispatch = dispatchers[get(emitter, ...)]
+		if dispatch == nil then dispatch = default_dispatch end
+		if dispatch then
+			dispatch(emitter, ...)
+		end
+	end
+end
+
+function module.EventConnections.method:_compile(event)
+	return compile_listeners(event, self:_get(event))
+end
+
+-- Dispatch function for the event, false if there is no listener
+function module.EventConnections.method:dispatcher(event)
+	local cache = compiled[self]
+	if not cache or cache[compiled] ~= generation then
+		cache = { [compiled] = generation }
+		compiled[self] = cache
+	end
+
+	local dispatch = cache[event]
+	if dispatch == nil then
+		dispatch = self:_compile(event)
+		cache[event] = dispatch
+	end
+
+	return dispatch
+end
+
+function module.EventConnections.method:haslisteners(event)
+	return self:dispatcher(event) ~= false
+end
+
+function module.EventConnections.method:signal(emitter, event, ...)
+	local dispatch = self:dispatcher(event)
+	if dispatch then
+		dispatch(emitter, ...)
+	end
 
 	return true
 end
@@ -47,17 +263,22 @@ end
 
 module.StaticEventConnections = class.class('StaticEventConnections', module.EventConnections)
 
-function module.StaticEventConnections.method:register(event, func, options)
+function module.StaticEventConnections.method:register(event, func, options, match)
 	assert(class.isa(event, module.Event), "event expected")
 	assert(type(func) == 'function', "function expected")
 
+	if match then
+		match = event:compile_match(match)
+	end
+
 	local listeners = self[event]
 	if not listeners then
 		listeners = {}
 		self[event] = listeners
 	end
 
-	table.insert(listeners, {f=func, options=options})
+	table.insert(listeners, {f=func, options=options, match=match})
+	module.invalidate()
 end
 
 function module.StaticEventConnections.method:_get(event)
@@ -76,9 +297,11 @@ function module.ObjectEventConnections.method:__init(object, connections)
 	self.connections = connections
 end
 
-function module.ObjectEventConnections.method:_signal(event, listener, emitter, ...)
-	module.ObjectEventConnections.current = self.object
-	event.signal(listener.f, listener.options, emitter, ...)
+function module.ObjectEventConnections.method:_compile(event)
+	local object = self.object
+	return compile_listeners(event, self:_get(event), function ()
+		module.ObjectEventConnections.current = object
+	end)
 end
 
 function module.ObjectEventConnections.method:_get(event)
@@ -0,0 +1,124 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+--
+-- LuaJIT FFI bindings for the hottest accessors of the swig objects.
+--
+-- The calls to the swig wrappers cannot be compiled by the trace
+-- compiler. On LuaJIT, the accessors registered here call the C functions
+-- directly through the FFI. On plain Lua, `enabled` is false and the swig
+-- wrappers are used.
+--
+
+local module = {}
+
+local ok, ffi = pcall(require, 'ffi')
+module.enabled = ok and swig.userdata_ptr_offset ~= nil
+
+if not module.enabled then
+	return module
+end
+
+ffi.cdef[[
+	bool check_error();
+	const char *clear_error();
+]]
+
+local C = ffi.C
+local ptr_offset = swig.userdata_ptr_offset
+local charptr = ffi.typeof('char *')
+local voidptrptr = ffi.typeof('void **')
+
+module.C = C
+
+-- Pointer to the C object of a swig userdata, NULL if released
+function module.topointer(obj)
+	return ffi.cast(voidptrptr, ffi.cast(charptr, obj) + ptr_offset)[0]
+end
+
+local topointer = module.topointer
+
+-- Raise the pending haka error like the swig wrappers do
+function module.check()
+	if C.check_error() then
+		error(ffi.string(C.clear_error()), 0)
+	end
+end
+
+--
+-- Replace the method `name` of a swig class by `func(ptr, ...)`. The
+-- original wrapper is still used if the object is not a valid instance of
+-- the class.
+--
+function module.method(classname, name, func)
+	local mt = swig.getclassmetatable(classname)
+	local fallback = mt['.fn'][name]
+	assert(fallback, string.format("unknown method '%s' in swig class '%s'", name, classname))
+
+	mt['.fn'][name] = function (self, ...)
+		if type(self) == 'userdata' and getmetatable(self) == mt then
+			local ptr = topointer(self)
+			if ptr ~= nil then
+				return func(ptr, ...)
+			end
+		end
+
+		return fallback(self, ...)
+	end
+end
+
+--
+-- Read the fields listed in `getters` (name -> func(ptr)) before calling
+-- the swig index function. If `getitem` is given, it is used for the
+-- integer keys.
+--
+function module.getters(classname, getters, getitem)
+	local mt = swig.getclassmetatable(classname)
+	local index = mt.__index
+	local methods = mt['.fn']
+	assert(type(index) == 'function', string.format("invalid index for swig class '%s'", classname))
+
+	mt.__index = function (self, key)
+		local get = getters[key]
+		if get then
+			local ptr = topointer(self)
+			if ptr ~= nil then
+				return get(ptr)
+			end
+		elseif getitem and type(key) == 'number' then
+			local ptr = topointer(self)
+			if ptr ~= nil then
+				return getitem(ptr, key)
+			end
+		else
+			local method = methods[key]
+			if method then return method end
+		end
+
+		return index(self, key)
+	end
+end
+
+--
+-- Build the getters from the function pointers exported by a swig
+-- module (name -> lightuserdata).
+--
+function module.functions(ctype, pointers)
+	local ret = {}
+	local fntype = ffi.typeof(ctype)
+	local check = module.check
+
+	for name, pointer in pairs(pointers) do
+		local func = ffi.cast(fntype, pointer)
+		ret[name] = function (ptr)
+			local value = func(ptr)
+			check()
+			return value
+		end
+	end
+
+	return ret
+end
+
+return module
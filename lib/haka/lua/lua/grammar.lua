@@ -3,7 +3,7 @@
 -- file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 local class = require('class')
-local rem = require("regexp/pcre")
+local rem = require(haka.regexp_module())
 local parse = require("parse")
 local grammar_dg = require('grammar_dg')
 
@@ -13,6 +13,52 @@ local log = haka.log_section("grammar")
 
 grammar.result = require("parse_result")
 
+--
+-- Compiled regexp cache
+--
+
+-- Token patterns are shared by many rules and each rule reference
+-- compiles its own clone of the entity. Keep the compiled regexps of
+-- the Lua state indexed by their source pattern to avoid compiling
+-- them again for each reference and each grammar.
+--
+-- The cache is bounded: once the current generation is full, it becomes
+-- the previous one and the regexps which are not used again are dropped
+-- on the next rotation.
+--
+-- The misses go through the regexp cache of the thread, which is kept
+-- when the configuration is reloaded. The new Lua state then gets the
+-- regexps compiled by the previous one instead of compiling them again.
+local compiled_re_max = 256
+local compiled_re = { current = {}, previous = {}, count = 0, hits = 0, misses = 0 }
+
+local function compile_re(pattern)
+	local cache = compiled_re
+	local re = cache.current[pattern]
+	if re then
+		cache.hits = cache.hits + 1
+		return re
+	end
+
+	re = cache.previous[pattern]
+	if re then
+		cache.hits = cache.hits + 1
+	else
+		cache.misses = cache.misses + 1
+		re = rem.re:_cached_compile(pattern)
+	end
+
+	if cache.count >= compiled_re_max then
+		cache.previous = cache.current
+		cache.current = {}
+		cache.count = 0
+	end
+
+	cache.current[pattern] = re
+	cache.count = cache.count + 1
+	return re
+end
+
 --
 -- Grammar env
 --
@@ -451,11 +497,46 @@ end
 
 grammar_int.Bytes = class.class('Bytes', grammar_int.Entity)
 
+local literal_escapes = { n = '\n', r = '\r', t = '\t', f = '\f' }
+
+-- Convert a token made only of literal characters to the string it
+-- matches. Returns nil if the token uses any regexp construct.
+local function literal_pattern(pattern)
+	local literal = {}
+	local i = 1
+
+	while i <= #pattern do
+		local c = pattern:sub(i, i)
+		if c == '%' or c == '\\' then
+			c = pattern:sub(i+1, i+1)
+			if c == '' then return nil end
+			if c:match('%w') then
+				c = literal_escapes[c]
+				if not c then return nil end
+			end
+			i = i + 2
+		elseif c:match('[%^%$%.|%?%*%+%(%)%[%]{}]') then
+			return nil
+		else
+			i = i + 1
+		end
+
+		table.insert(literal, c)
+	end
+
+	if #literal == 0 then return nil end
+	return table.concat(literal)
+end
+
 function grammar_int.Bytes.method:do_compile(env, rule, id)
-	if self._untiltoken and not self._untilre then
-		self._untilre = rem.re:compile("(?:"..self._untiltoken..")")
+	if self._untiltoken and not self._untilre and not self._untilstr then
+		self._untilstr = literal_pattern(self._untiltoken)
+		if not self._untilstr then
+			self._untilre = compile_re("(?:"..self._untiltoken..")")
+		end
 	end
-	local ret = grammar_dg.Bytes:new(rule, id, self._count, self._untilre, self.named, self._chunked)
+	local ret = grammar_dg.Bytes:new(rule, id, self._count, self._untilre, self.named, self._chunked,
+		self._untilstr)
 	self:compile_setup(ret)
 	return ret
 end
@@ -516,7 +597,7 @@ end
 
 function grammar_int.Token.method:do_compile(env, rule, id)
 	if not self.re then
-		self.re = rem.re:compile("^(?:"..self.pattern..")")
+		self.re = compile_re("^(?:"..self.pattern..")")
 	end
 	local ret = grammar_dg.Token:new(rule, id, self.pattern, self.re, self.named, self.raw)
 	self:compile_setup(ret)
@@ -832,6 +913,18 @@ function grammar.new(name, def)
 	return g
 end
 
+function grammar.regexp_cache_info()
+	local size = compiled_re.count
+	for pattern, _ in pairs(compiled_re.previous) do
+		if not compiled_re.current[pattern] then
+			size = size + 1
+		end
+	end
+
+	return { size = size, max = 2*compiled_re_max,
+		hits = compiled_re.hits, misses = compiled_re.misses }
+end
+
 grammar.debug = false
 
 haka.grammar = grammar
@@ -3,7 +3,7 @@
 -- file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 local class = require('class')
-local rem = require("regexp/pcre")
+local rem = require(haka.regexp_module())
 local parseResult = require("parse_result")
 local parse = require("parse")
 
@@ -662,11 +662,25 @@ function dg.Number.method:_parse(res, input, ctx)
 	local bitoffset = ctx._bitoffset
 	local size, bit = math.ceil((bitoffset + self.size) / 8), (bitoffset + self.size) % 8
 
-	local sub = input:copy():sub(size)
+	-- The sub buffer is only needed to read or modify the value
+	if not self.name and not self._post_apply then
+		if bit ~= 0 then
+			input:advance(size-1)
+		else
+			input:advance(size)
+		end
+
+		ctx._bitoffset = bit
+		return
+	end
+
+	local sub
 	if bit ~= 0 then
+		sub = input:copy():sub(size)
 		input:advance(size-1)
 	else
-		input:advance(size)
+		-- Moves the iterator like advance()
+		sub = input:sub(size)
 	end
 
 	ctx._bitoffset = bit
@@ -743,11 +757,12 @@ end
 
 dg.Bytes = class.class('DGBytes', dg.Primitive)
 
-function dg.Bytes.method:__init(rule, id, size, untilre, name, chunked_callback)
+function dg.Bytes.method:__init(rule, id, size, untilre, name, chunked_callback, untilstr)
 	class.super(dg.Bytes).__init(self, rule, id)
 	self.size = size
 	self.name = name
 	self.untilre = untilre
+	self.untilstr = untilstr
 	self.chunked_callback = chunked_callback
 end
 
@@ -787,11 +802,55 @@ function dg.Bytes.method:_parse(res, iter, ctx)
 	end
 
 	-- Easiest case
-	if not self.chunked_callback and not self.untilre then
+	if not self.chunked_callback and not self.untilre and not self.untilstr then
 		create_property(iter:sub(size))
 		return
 	end
 
+	-- Literal delimiter, it is searched directly in the buffer
+	if self.untilstr then
+		local begin = iter:copy()
+		local pending
+
+		begin:mark(haka.packet_mode() == 'passthrough')
+
+		while true do
+			iter:wait()
+			sub = iter:sub('available')
+
+			if not sub then
+				if pending then
+					chunked_callback(haka.vbuffer_sub(pending, iter), true)
+				end
+				break
+			end
+
+			local region = pending and haka.vbuffer_sub(pending, iter) or sub
+			local mbegin, mend, partial = region:find(self.untilstr)
+
+			if mbegin then
+				chunked_callback(haka.vbuffer_sub(region:pos('begin'), mbegin), true)
+				iter:move_to(mbegin)
+				break
+			elseif partial and not iter.iseof then
+				-- The end of the data could be the beginning of the delimiter,
+				-- keep it until more data are available
+				chunked_callback(haka.vbuffer_sub(region:pos('begin'), partial), false)
+				pending = partial
+			else
+				chunked_callback(region, iter.iseof)
+				pending = nil
+			end
+		end
+
+		begin:unmark()
+
+		if not self.chunked_callback then
+			create_property(haka.vbuffer_sub(begin, iter))
+		end
+		return
+	end
+
 	-- Complexe case
 	-- We have to go all over the bytes to
 	--   - pass it to chunked_callback
@@ -18,8 +18,10 @@
 #include <haka/log.h>
 #include <haka/compiler.h>
 #include <haka/error.h>
+#include <haka/regexp_module.h>
 #include <haka/timer.h>
 #include <haka/lua/luautils.h>
+#include <haka/lua/alloc.h>
 #include <haka/container/vector.h>
 #include <haka/luadebug/debugger.h>
 
@@ -35,6 +37,7 @@ struct lua_interrupt_data {
 
 struct lua_state_ext {
 	struct lua_state       state;
+	struct lua_alloc      *alloc;
 	bool                   hook_installed;
 	lua_hook               debug_hook;
 	struct vector          interrupts;
@@ -342,17 +345,38 @@ static int lua_setfenv_wrapper(lua_State *L)
 struct lua_state *lua_state_init()
 {
 	struct lua_state_ext *ret;
-	lua_State *L = luaL_newstate();
+	struct lua_alloc *alloc = NULL;
+	lua_State *L = NULL;
+
+#if LUA_ALLOC_SUPPORTED
+	if (lua_alloc_enabled()) {
+		alloc = lua_alloc_create();
+		if (alloc) {
+			L = lua_newstate(lua_alloc_function, alloc);
+			if (!L) {
+				lua_alloc_destroy(alloc);
+				alloc = NULL;
+			}
+		}
+	}
+#endif
+
 	if (!L) {
-		return NULL;
+		L = luaL_newstate();
+		if (!L) {
+			return NULL;
+		}
 	}
 
 	ret = malloc(sizeof(struct lua_state_ext));
 	if (!ret) {
+		lua_close(L);
+		if (alloc) lua_alloc_destroy(alloc);
 		return NULL;
 	}
 
 	ret->state.L = L;
+	ret->alloc = alloc;
 	ret->hook_installed = false;
 	ret->debug_hook = NULL;
 	ret->has_interrupts = false;
@@ -449,8 +473,17 @@ void lua_state_close(struct lua_state *_state)
 	vector_destroy(&state->interrupts);
 	state->has_interrupts = false;
 
+	/* Cached regexps must be released while their module is still loaded.
+	 * Another state of the thread may still use its own entries. */
+	regexp_cache_clear(_state);
+
 	lua_close(state->state.L);
 	state->state.L = NULL;
+
+	if (state->alloc) {
+		lua_alloc_destroy(state->alloc);
+		state->alloc = NULL;
+	}
 }
 
 FINI_P(2000) static void lua_state_cleanup()
@@ -489,6 +522,13 @@ struct lua_state *lua_state_get(lua_State *L)
 	return &lua_state_getext(L)->state;
 }
 
+const struct lua_alloc_stats *lua_state_alloc_statistics(struct lua_state *_state)
+{
+	struct lua_state_ext *state = (struct lua_state_ext *)_state;
+	if (state->alloc) return lua_alloc_statistics(state->alloc);
+	else return NULL;
+}
+
 static void lua_interrupt_call(struct lua_state_ext *state)
 {
 	int i, h;
@@ -10,13 +10,23 @@
 %nodefaultdtor;
 
 %native(_getswigclassmetatable) int _getswigclassmetatable(struct lua_State *L);
+%native(_userdata_ptr_offset) int _userdata_ptr_offset(struct lua_State *L);
 
 %{
+#include <stddef.h>
+
 int _getswigclassmetatable(struct lua_State *L)
 {
 	SWIG_Lua_get_class_registry(L);
 	return 1;
 }
+
+/* Offset of the object pointer in the swig userdata, used by the ffi bindings */
+int _userdata_ptr_offset(struct lua_State *L)
+{
+	lua_pushinteger(L, offsetof(swig_lua_userdata, ptr));
+	return 1;
+}
 %}
 
 %luacode {
@@ -28,5 +38,8 @@ int _getswigclassmetatable(struct lua_State *L)
 		return ret
 	end
 
+	this.userdata_ptr_offset = this._userdata_ptr_offset()
+	this._userdata_ptr_offset = nil
+
 	return this
 }
@@ -0,0 +1,440 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <ctype.h>
+#include <string.h>
+
+#include <haka/regexp_literal.h>
+#include <haka/regexp_module.h>
+
+
+/* Escape sequences that are not a literal character */
+#define ATOM_BREAK   -1
+#define ATOM_ABORT   -2
+
+struct literal_parser {
+	struct regexp_literal *best;
+	char                   run[REGEXP_LITERAL_MAX];
+	size_t                 run_len;
+	bool                   run_prefix;
+	bool                   last_appended;
+};
+
+static void parser_commit(struct literal_parser *parser)
+{
+	struct regexp_literal *best = parser->best;
+
+	if (parser->run_len >= REGEXP_LITERAL_MIN) {
+		/* A prefix literal is preferred as it can also be used on streams */
+		if (best->len == 0 || (!best->prefix && parser->run_len > best->len)) {
+			memcpy(best->data, parser->run, parser->run_len);
+			best->len = parser->run_len;
+			best->prefix = parser->run_prefix;
+		}
+	}
+
+	parser->run_len = 0;
+	parser->run_prefix = false;
+	parser->last_appended = false;
+}
+
+static void parser_append(struct literal_parser *parser, int c)
+{
+	/* Any part of a required literal is also required, so longer
+	 * literals are simply truncated */
+	if (parser->run_len < REGEXP_LITERAL_MAX) {
+		parser->run[parser->run_len++] = c;
+		parser->last_appended = true;
+	}
+	else {
+		parser->last_appended = false;
+	}
+}
+
+static int hexvalue(int c)
+{
+	if (isdigit(c)) return c - '0';
+	return tolower(c) - 'a' + 10;
+}
+
+static int parse_escape(const char **pattern)
+{
+	const char *p = *pattern + 1;
+	const int c = (unsigned char)*p;
+
+	if (c == '\0') return ATOM_ABORT;
+
+	*pattern = p + 1;
+
+	if (!isalnum(c)) return c;
+
+	switch (c) {
+	case 'n': return '\n';
+	case 'r': return '\r';
+	case 't': return '\t';
+	case 'f': return '\f';
+	case 'e': return 0x1b;
+	case 'a': return 0x07;
+	case 'x':
+		if (isxdigit((unsigned char)p[1])) {
+			int value = hexvalue((unsigned char)p[1]);
+			p += 2;
+			if (isxdigit((unsigned char)*p)) {
+				value = value*16 + hexvalue((unsigned char)*p);
+				p++;
+			}
+			*pattern = p;
+			return value;
+		}
+		return ATOM_ABORT;
+
+	/* Escapes followed by an argument */
+	case 'c': case 'g': case 'k': case 'N': case 'o':
+	case 'p': case 'P': case 'Q':
+		return ATOM_ABORT;
+
+	default:
+		/* Back references and octal values */
+		if (isdigit(c)) {
+			while (isdigit((unsigned char)**pattern)) (*pattern)++;
+		}
+		return ATOM_BREAK;
+	}
+}
+
+static const char *skip_class(const char *p)
+{
+	p++;
+	if (*p == '^') p++;
+	if (*p == ']') p++;
+
+	while (*p) {
+		if (*p == '\\') {
+			if (p[1] == '\0') return NULL;
+			p += 2;
+		}
+		else if (*p == '[' && p[1] == ':') {
+			/* POSIX class name */
+			const char *q = p + 2;
+			while (isalpha((unsigned char)*q)) q++;
+			if (q[0] == ':' && q[1] == ']') p = q + 2;
+			else p++;
+		}
+		else if (*p == ']') {
+			return p + 1;
+		}
+		else {
+			p++;
+		}
+	}
+
+	return NULL;
+}
+
+static const char *skip_group(const char *p)
+{
+	int depth = 0;
+
+	while (*p) {
+		switch (*p) {
+		case '\\':
+			if (p[1] == '\0' || p[1] == 'Q') return NULL;
+			p += 2;
+			break;
+		case '[':
+			p = skip_class(p);
+			if (!p) return NULL;
+			break;
+		case '(':
+			if (p[1] == '?' && p[2] == '#') {
+				/* Comment */
+				p = strchr(p, ')');
+				if (!p) return NULL;
+				p++;
+				if (depth == 0) return p;
+			}
+			else {
+				depth++;
+				p++;
+			}
+			break;
+		case ')':
+			p++;
+			if (--depth == 0) return p;
+			break;
+		default:
+			p++;
+		}
+	}
+
+	return NULL;
+}
+
+/* Parse a {n}, {n,} or {n,m} repetition, anything else is a literal '{'.
+ * Recent PCRE2 versions also accept {,m} and spaces inside the braces, these
+ * forms are taken as a repetition from 0, which is right for both engines
+ * as it only removes characters from the literal. */
+static const char *parse_repeat(const char *p, int *min)
+{
+	bool digits = false;
+
+	p++;
+	while (*p == ' ') p++;
+
+	*min = 0;
+	while (isdigit((unsigned char)*p)) {
+		*min = *min*10 + (*p - '0');
+		digits = true;
+		p++;
+	}
+
+	while (*p == ' ') p++;
+
+	if (*p == ',') {
+		p++;
+		while (*p == ' ') p++;
+		while (isdigit((unsigned char)*p)) {
+			digits = true;
+			p++;
+		}
+		while (*p == ' ') p++;
+	}
+
+	if (!digits || *p != '}') return NULL;
+	return p + 1;
+}
+
+static const char *skip_quantifier_mode(const char *p)
+{
+	/* Lazy or possessive quantifier */
+	if (*p == '?' || *p == '+') p++;
+	return p;
+}
+
+static bool is_option(int c)
+{
+	return c != '\0' && strchr("imsxnJUX-^", c) != NULL;
+}
+
+void regexp_literal_extract(const char *pattern, int options, struct regexp_literal *literal)
+{
+	struct literal_parser parser;
+	const char *p = pattern;
+	int min;
+
+	memset(literal, 0, sizeof(struct regexp_literal));
+
+	/* White spaces and comments are not literals in extended mode */
+	if (options & REGEXP_EXTENDED) return;
+
+	parser.best = literal;
+	parser.run_len = 0;
+	parser.run_prefix = true;
+	parser.last_appended = false;
+
+	/* The start anchor does not consume any character */
+	if (*p == '^') p++;
+
+	while (*p) {
+		int c;
+
+		switch (*p) {
+		case '|':
+			/* Top level alternation, nothing is required */
+			goto abort;
+
+		case ')':
+			goto abort;
+
+		case '(':
+			/* Verbs and option settings could change the meaning
+			 * of the rest of the pattern */
+			if (p[1] == '*' || (p[1] == '?' && is_option(p[2]))) goto abort;
+			p = skip_group(p);
+			if (!p) goto abort;
+			parser_commit(&parser);
+			continue;
+
+		case '[':
+			p = skip_class(p);
+			if (!p) goto abort;
+			parser_commit(&parser);
+			continue;
+
+		case '.':
+		case '^':
+		case '$':
+			p++;
+			parser_commit(&parser);
+			continue;
+
+		case '?':
+		case '*':
+			/* The previous character is optional */
+			p = skip_quantifier_mode(p + 1);
+			if (parser.last_appended) parser.run_len--;
+			parser_commit(&parser);
+			continue;
+
+		case '+':
+			p = skip_quantifier_mode(p + 1);
+			parser_commit(&parser);
+			continue;
+
+		case '{':
+			{
+				const char *end = parse_repeat(p, &min);
+				if (end) {
+					p = skip_quantifier_mode(end);
+					if (min == 0 && parser.last_appended) parser.run_len--;
+					parser_commit(&parser);
+					continue;
+				}
+			}
+			c = '{';
+			p++;
+			break;
+
+		case '\\':
+			c = parse_escape(&p);
+			if (c == ATOM_ABORT) goto abort;
+			if (c == ATOM_BREAK) {
+				parser_commit(&parser);
+				continue;
+			}
+			break;
+
+		default:
+			c = (unsigned char)*p++;
+			break;
+		}
+
+		parser_append(&parser, c);
+	}
+
+	parser_commit(&parser);
+
+	if (options & REGEXP_CASE_INSENSITIVE) {
+		size_t i;
+		for (i = 0; i < literal->len; ++i) {
+			literal->data[i] = tolower((unsigned char)literal->data[i]);
+		}
+		literal->caseless = true;
+	}
+	return;
+
+abort:
+	memset(literal, 0, sizeof(struct regexp_literal));
+}
+
+static bool literal_equals(const struct regexp_literal *literal, const char *buf, size_t len)
+{
+	size_t i;
+
+	if (!literal->caseless) {
+		return memcmp(literal->data, buf, len) == 0;
+	}
+
+	for (i = 0; i < len; ++i) {
+		if ((unsigned char)literal->data[i] != tolower((unsigned char)buf[i])) return false;
+	}
+	return true;
+}
+
+static const char *literal_find(const struct regexp_literal *literal, const char *buf, size_t len)
+{
+	const char *end;
+	int lower, upper;
+
+	if (len < literal->len) return NULL;
+
+	if (!literal->caseless) {
+		return memmem(buf, len, literal->data, literal->len);
+	}
+
+	end = buf + len - literal->len + 1;
+	lower = (unsigned char)literal->data[0];
+	upper = toupper(lower);
+
+	while (buf < end) {
+		if (lower == upper) {
+			buf = memchr(buf, lower, end - buf);
+			if (!buf) return NULL;
+		}
+		else if ((unsigned char)*buf != lower && (unsigned char)*buf != upper) {
+			buf++;
+			continue;
+		}
+
+		if (literal_equals(literal, buf, literal->len)) return buf;
+		buf++;
+	}
+
+	return NULL;
+}
+
+bool regexp_literal_contains(const struct regexp_literal *literal, const char *buf, size_t len)
+{
+	if (literal->len == 0) return true;
+
+	return literal_find(literal, buf, len) != NULL;
+}
+
+bool regexp_literal_vbcontains(const struct regexp_literal *literal, struct vbuffer_sub *vbuf)
+{
+	struct vbuffer_sub_mmap iter = vbuffer_mmap_init;
+	const char *ptr;
+	size_t len;
+	/* Last bytes of the previous chunks followed by the first
+	 * bytes of the current one */
+	char window[2*(REGEXP_LITERAL_MAX-1)];
+	size_t tail = 0;
+	const size_t keep = literal->len - 1;
+
+	if (literal->len == 0) return true;
+
+	while ((ptr = (const char *)vbuffer_mmap(vbuf, &len, false, &iter, NULL))) {
+		if (len == 0) continue;
+
+		if (tail > 0) {
+			const size_t head = len < keep ? len : keep;
+			memcpy(window + tail, ptr, head);
+			if (literal_find(literal, window, tail + head)) return true;
+		}
+
+		if (literal_find(literal, ptr, len)) return true;
+
+		/* Keep the last bytes for the next chunk */
+		if (len >= keep) {
+			memcpy(window, ptr + len - keep, keep);
+			tail = keep;
+		}
+		else {
+			if (tail == 0) memcpy(window, ptr, len);
+			tail += len;
+			if (tail > keep) {
+				memmove(window, window + tail - keep, keep);
+				tail = keep;
+			}
+		}
+	}
+
+	return false;
+}
+
+bool regexp_literal_skip(const struct regexp_literal *literal, const char *buf, size_t len)
+{
+	size_t i;
+
+	if (literal->len == 0 || !literal->prefix) return false;
+
+	if (literal_find(literal, buf, len)) return false;
+
+	/* A match could start at the end of the chunk */
+	for (i = (len < literal->len ? len : literal->len - 1); i > 0; --i) {
+		if (literal_equals(literal, buf + len - i, i)) return false;
+	}
+
+	return true;
+}
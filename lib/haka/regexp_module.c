@@ -2,8 +2,249 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <haka/compiler.h>
+#include <haka/container/hash.h>
 #include <haka/error.h>
 #include <haka/regexp_module.h>
+#include <haka/thread.h>
+
+
+/* Number of compiled regexps kept per thread, large enough for the tokens
+ * of the grammars */
+#define REGEXP_CACHE_SIZE   256
+
+struct regexp_cache_key {
+	struct regexp_module   *module;
+	int                     options;
+	char                    pattern[0];
+};
+
+struct regexp_cache_entry {
+	struct regexp          *regexp;
+	const void             *owner;
+	size_t                  key_size;
+	hash_head_t             hh;
+	struct regexp_cache_key key; /* must be last */
+};
+
+struct regexp_cache {
+	struct regexp_cache_entry *head;
+	size_t                     count;
+	uint64                     hits;
+	uint64                     misses;
+	struct regexp_cache_key   *lookup;
+	size_t                     lookup_size;
+};
+
+static local_storage_t regexp_cache_key;
+
+static void regexp_cache_remove(struct regexp_cache *cache, struct regexp_cache_entry *entry)
+{
+	HASH_DEL(cache->head, entry);
+	entry->regexp->module->release_regexp(entry->regexp);
+	free(entry);
+	cache->count--;
+}
+
+static void regexp_cache_flush(struct regexp_cache *cache)
+{
+	struct regexp_cache_entry *entry, *tmp;
+	HASH_ITER(hh, cache->head, entry, tmp) {
+		regexp_cache_remove(cache, entry);
+	}
+	assert(cache->count == 0);
+}
+
+static void regexp_cache_delete(void *value)
+{
+	struct regexp_cache *cache = (struct regexp_cache *)value;
+	if (cache) {
+		regexp_cache_flush(cache);
+		free(cache->lookup);
+		free(cache);
+	}
+}
+
+INIT static void _regexp_cache_init()
+{
+	UNUSED const bool ret = local_storage_init(&regexp_cache_key, regexp_cache_delete);
+	assert(ret);
+}
+
+FINI static void _regexp_cache_fini()
+{
+	regexp_cache_delete(local_storage_get(&regexp_cache_key));
+	UNUSED const bool ret = local_storage_destroy(&regexp_cache_key);
+	assert(ret);
+}
+
+static struct regexp_cache *regexp_cache_get()
+{
+	struct regexp_cache *cache = (struct regexp_cache *)local_storage_get(&regexp_cache_key);
+	if (!cache) {
+		cache = malloc(sizeof(struct regexp_cache));
+		if (!cache) {
+			error("memory error");
+			return NULL;
+		}
+
+		memset(cache, 0, sizeof(struct regexp_cache));
+
+		if (!local_storage_set(&regexp_cache_key, cache)) {
+			free(cache);
+			return NULL;
+		}
+	}
+	return cache;
+}
+
+static struct regexp_cache_key *regexp_cache_lookup_key(struct regexp_cache *cache,
+		struct regexp_module *module, const char *pattern, int options, size_t *key_size)
+{
+	const size_t len = strlen(pattern);
+
+	*key_size = offsetof(struct regexp_cache_key, pattern) + len;
+
+	if (cache->lookup_size < *key_size) {
+		struct regexp_cache_key *lookup = realloc(cache->lookup, *key_size);
+		if (!lookup) {
+			error("memory error");
+			return NULL;
+		}
+
+		cache->lookup = lookup;
+		cache->lookup_size = *key_size;
+	}
+
+	cache->lookup->module = module;
+	cache->lookup->options = options;
+	memcpy(cache->lookup->pattern, pattern, len);
+	return cache->lookup;
+}
+
+struct regexp *regexp_cache_get_regexp(struct regexp_module *module, const char *pattern, int options,
+		const void *owner)
+{
+	struct regexp_cache_entry *entry;
+	struct regexp_cache_key *key;
+	size_t key_size;
+
+	struct regexp_cache *cache = regexp_cache_get();
+	if (!cache) return NULL;
+
+	key = regexp_cache_lookup_key(cache, module, pattern, options, &key_size);
+	if (!key) return NULL;
+
+	HASH_FIND(hh, cache->head, key, key_size, entry);
+	if (!entry) {
+		cache->misses++;
+		return NULL;
+	}
+
+	/* Move the entry at the end of the table, the head is then always
+	 * the least recently used one. */
+	HASH_DEL(cache->head, entry);
+	HASH_ADD_KEYPTR(hh, cache->head, &entry->key, entry->key_size, entry);
+
+	/* The entry is now used by this owner, it may be the last one to
+	 * keep its module loaded */
+	entry->owner = owner;
+
+	cache->hits++;
+
+	atomic_inc(&entry->regexp->ref_count);
+	return entry->regexp;
+}
+
+bool regexp_cache_add_regexp(struct regexp_module *module, const char *pattern, int options,
+		struct regexp *regexp, const void *owner)
+{
+	struct regexp_cache_entry *entry;
+	const size_t len = strlen(pattern);
+
+	struct regexp_cache *cache = regexp_cache_get();
+	if (!cache) return false;
+
+	entry = malloc(sizeof(struct regexp_cache_entry) + len);
+	if (!entry) {
+		error("memory error");
+		return false;
+	}
+
+	entry->key.module = module;
+	entry->key.options = options;
+	memcpy(entry->key.pattern, pattern, len);
+	entry->key_size = offsetof(struct regexp_cache_key, pattern) + len;
+
+	atomic_inc(&regexp->ref_count);
+	entry->regexp = regexp;
+	entry->owner = owner;
+
+	if (cache->count >= REGEXP_CACHE_SIZE) {
+		regexp_cache_remove(cache, cache->head);
+	}
+
+	HASH_ADD_KEYPTR(hh, cache->head, &entry->key, entry->key_size, entry);
+	cache->count++;
+	return true;
+}
+
+void regexp_cache_clear(const void *owner)
+{
+	struct regexp_cache_entry *entry, *tmp;
+	struct regexp_cache *cache = (struct regexp_cache *)local_storage_get(&regexp_cache_key);
+	if (!cache) return;
+
+	if (!owner) {
+		regexp_cache_flush(cache);
+		return;
+	}
+
+	HASH_ITER(hh, cache->head, entry, tmp) {
+		if (entry->owner == owner) {
+			regexp_cache_remove(cache, entry);
+		}
+	}
+}
+
+void regexp_cache_getstats(struct regexp_cache_stats *stats)
+{
+	struct regexp_cache *cache = (struct regexp_cache *)local_storage_get(&regexp_cache_key);
+	if (cache) {
+		stats->hits = cache->hits;
+		stats->misses = cache->misses;
+		stats->size = cache->count;
+	}
+	else {
+		memset(stats, 0, sizeof(struct regexp_cache_stats));
+	}
+}
+
+/* Name of the regexp module used by the grammars */
+#define REGEXP_DEFAULT_MODULE_MAX   128
+
+static char regexp_default_module[REGEXP_DEFAULT_MODULE_MAX] = "regexp/pcre";
+
+bool regexp_module_set_default(const char *module_name)
+{
+	const size_t len = strlen(module_name);
+	if (len == 0 || len >= REGEXP_DEFAULT_MODULE_MAX) {
+		error("invalid regexp module name '%s'", module_name);
+		return false;
+	}
+
+	memcpy(regexp_default_module, module_name, len+1);
+	return true;
+}
+
+const char *regexp_module_get_default()
+{
+	return regexp_default_module;
+}
 
 struct regexp_module *regexp_module_load(const char *module_name, struct parameters *args) {
 	struct module *module = module_load(module_name, args);
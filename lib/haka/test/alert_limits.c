@@ -0,0 +1,236 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <string.h>
+#include <unistd.h>
+#include <check.h>
+#include <haka/config.h>
+#include <haka/alert.h>
+#include <haka/thread.h>
+
+
+static mutex_t test_lock;
+static int test_new;
+static int test_updates;
+static uint64 test_count;
+static bool test_reentrant;
+
+static void raise_alert(char *description);
+
+static void test_destroy(struct alerter *state)
+{
+}
+
+static bool test_alert(struct alerter *state, uint64 id, const struct time *time, const struct alert *alert)
+{
+	bool reentrant;
+
+	mutex_lock(&test_lock);
+	test_new++;
+	reentrant = test_reentrant;
+	test_reentrant = false;
+	mutex_unlock(&test_lock);
+
+	/* The alerters can raise alerts themselves */
+	if (reentrant) {
+		raise_alert("raised by the alerter");
+	}
+	return true;
+}
+
+static bool test_update(struct alerter *state, uint64 id, const struct time *time, const struct alert *alert)
+{
+	mutex_lock(&test_lock);
+	test_updates++;
+	test_count = alert->count;
+	mutex_unlock(&test_lock);
+	return true;
+}
+
+static struct alerter test_alerter = {
+	destroy: test_destroy,
+	alert: test_alert,
+	update: test_update,
+	async: false
+};
+
+static uint64 alert_id;
+
+static void raise_alert(char *description)
+{
+	ALERT(test, 0, 0)
+		description: description,
+		severity: HAKA_ALERT_LOW,
+	ENDALERT
+
+	alert_id = alert(&test);
+}
+
+static void set_limits(int window, int rate)
+{
+	struct alert_limits limits = { 0 };
+	limits.aggregate_window = window;
+	limits.rate = rate;
+	limits.burst = rate;
+	ck_assert(alert_set_limits(&limits));
+}
+
+static void setup()
+{
+	ck_assert(mutex_init(&test_lock, false));
+	test_new = 0;
+	test_updates = 0;
+	test_count = 0;
+	test_reentrant = false;
+	test_alerter.mark_for_remove = false;
+	ck_assert(add_alerter(&test_alerter));
+}
+
+static void teardown()
+{
+	set_limits(0, 0);
+	remove_all_alerter();
+	mutex_destroy(&test_lock);
+}
+
+START_TEST(test_aggregate)
+{
+	uint64 first;
+	int i;
+
+	set_limits(60, 0);
+
+	raise_alert("aggregated");
+	first = alert_id;
+	for (i=0; i<4; ++i) {
+		raise_alert("aggregated");
+		ck_assert_int_eq(alert_id, first);
+	}
+
+	raise_alert("other");
+	ck_assert(alert_id != first);
+	ck_assert_int_eq(test_new, 2);
+}
+END_TEST
+
+START_TEST(test_aggregate_flush_on_shutdown)
+{
+	int i;
+
+	set_limits(60, 0);
+
+	for (i=0; i<3; ++i) {
+		raise_alert("aggregated");
+	}
+	ck_assert_int_eq(test_new, 1);
+	ck_assert_int_eq(test_updates, 0);
+
+	/* The count of the open windows is given when haka stops */
+	remove_all_alerter();
+	ck_assert_int_eq(test_updates, 1);
+	ck_assert_int_eq(test_count, 3);
+}
+END_TEST
+
+START_TEST(test_aggregate_flush_on_timer)
+{
+	int i, count;
+
+	set_limits(1, 0);
+
+	for (i=0; i<5; ++i) {
+		raise_alert("aggregated");
+	}
+
+	/* The window ends without any other alert, its count is given by
+	 * the alert thread */
+	for (i=0; i<50; ++i) {
+		usleep(100000);
+
+		mutex_lock(&test_lock);
+		count = test_count;
+		mutex_unlock(&test_lock);
+
+		if (count != 0) break;
+	}
+
+	ck_assert_int_eq(count, 5);
+	ck_assert_int_eq(test_new, 1);
+}
+END_TEST
+
+START_TEST(test_aggregate_long_key)
+{
+	char description[4096];
+	uint64 first;
+
+	set_limits(60, 0);
+
+	/* Keys larger than the key buffer are not truncated */
+	memset(description, 'a', sizeof(description)-1);
+	description[sizeof(description)-1] = '\0';
+	raise_alert(description);
+	first = alert_id;
+
+	description[sizeof(description)-2] = 'b';
+	raise_alert(description);
+	ck_assert(alert_id != first);
+
+	raise_alert(description);
+	ck_assert_int_eq(test_new, 2);
+}
+END_TEST
+
+START_TEST(test_rate_limit)
+{
+	const uint64 limited = alert_limited();
+
+	set_limits(0, 2);
+
+	raise_alert("first");
+	raise_alert("second");
+	raise_alert("third");
+	ck_assert_int_eq(alert_id, 0);
+	ck_assert_int_eq(test_new, 2);
+	ck_assert_int_eq(alert_limited() - limited, 1);
+}
+END_TEST
+
+START_TEST(test_alerter_reentrant)
+{
+	set_limits(60, 0);
+
+	/* The alerters are not called with the limit lock held */
+	test_reentrant = true;
+	raise_alert("aggregated");
+	ck_assert_int_eq(test_new, 2);
+}
+END_TEST
+
+int main(int argc, char *argv[])
+{
+	int number_failed;
+
+	Suite *suite = suite_create("alert_limits");
+	TCase *tcase = tcase_create("case");
+	tcase_set_timeout(tcase, 10);
+	tcase_add_checked_fixture(tcase, setup, teardown);
+	tcase_add_test(tcase, test_aggregate);
+	tcase_add_test(tcase, test_aggregate_flush_on_shutdown);
+	tcase_add_test(tcase, test_aggregate_flush_on_timer);
+	tcase_add_test(tcase, test_aggregate_long_key);
+	tcase_add_test(tcase, test_rate_limit);
+	tcase_add_test(tcase, test_alerter_reentrant);
+	suite_add_tcase(suite, tcase);
+
+	SRunner *runner = srunner_create(suite);
+#ifdef HAKA_DEBUG
+	srunner_set_fork_status(runner, CK_NOFORK);
+#endif
+	srunner_run_all(runner, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(runner);
+	srunner_free(runner);
+
+	return number_failed;
+}
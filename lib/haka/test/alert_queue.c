@@ -0,0 +1,155 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <check.h>
+#include <haka/config.h>
+#include <haka/alert.h>
+#include <haka/thread.h>
+
+
+/* Must match the size of the alert queues */
+#define QUEUE_SIZE    1024
+
+static mutex_t test_blocked;
+static volatile int test_delivered;
+static volatile int test_destroyed;
+
+static void test_destroy(struct alerter *state)
+{
+	test_destroyed++;
+}
+
+static bool test_alert(struct alerter *state, uint64 id, const struct time *time, const struct alert *alert)
+{
+	/* Holds the alert thread while the test fills the queue */
+	mutex_lock(&test_blocked);
+	test_delivered++;
+	mutex_unlock(&test_blocked);
+	return true;
+}
+
+static bool test_update(struct alerter *state, uint64 id, const struct time *time, const struct alert *alert)
+{
+	return true;
+}
+
+static struct alerter test_alerter = {
+	destroy: test_destroy,
+	alert: test_alert,
+	update: test_update,
+	async: true
+};
+
+static void raise_alerts(int count)
+{
+	int i;
+
+	ALERT(test, 0, 0)
+		description: "queued alert",
+		severity: HAKA_ALERT_LOW,
+	ENDALERT
+
+	for (i=0; i<count; ++i) {
+		ck_assert(alert(&test) != 0);
+	}
+}
+
+static void setup()
+{
+	ck_assert(mutex_init(&test_blocked, false));
+	test_delivered = 0;
+	test_destroyed = 0;
+	test_alerter.mark_for_remove = false;
+	ck_assert(add_alerter(&test_alerter));
+}
+
+static void teardown()
+{
+	mutex_destroy(&test_blocked);
+}
+
+START_TEST(test_queue_flush_on_shutdown)
+{
+	raise_alerts(100);
+
+	/* All the queued alerts are delivered before the alerter goes away */
+	remove_all_alerter();
+	ck_assert_int_eq(test_delivered, 100);
+	ck_assert_int_eq(test_destroyed, 1);
+	ck_assert_int_eq(alert_dropped(), 0);
+}
+END_TEST
+
+START_TEST(test_queue_flush)
+{
+	raise_alerts(10);
+	alert_flush();
+	ck_assert_int_eq(test_delivered, 10);
+
+	remove_all_alerter();
+	ck_assert_int_eq(test_delivered, 10);
+}
+END_TEST
+
+START_TEST(test_queue_overflow)
+{
+	mutex_lock(&test_blocked);
+
+	/* The alert thread is stuck on the first alert which stays in the
+	 * queue until it is delivered */
+	raise_alerts(QUEUE_SIZE + 500);
+	ck_assert_int_eq(alert_dropped(), 500);
+	ck_assert_int_eq(test_delivered, 0);
+
+	mutex_unlock(&test_blocked);
+
+	remove_all_alerter();
+	ck_assert_int_eq(test_delivered, QUEUE_SIZE);
+
+	/* The count is reset once the drops are reported */
+	ck_assert_int_eq(alert_dropped(), 0);
+}
+END_TEST
+
+START_TEST(test_queue_reuse)
+{
+	mutex_lock(&test_blocked);
+	raise_alerts(QUEUE_SIZE + 1);
+	ck_assert_int_eq(alert_dropped(), 1);
+	mutex_unlock(&test_blocked);
+
+	/* The queue accepts new alerts once it has been emptied */
+	alert_flush();
+	raise_alerts(QUEUE_SIZE);
+	alert_flush();
+	ck_assert_int_eq(test_delivered, 2*QUEUE_SIZE);
+	ck_assert_int_eq(alert_dropped(), 1);
+
+	remove_all_alerter();
+}
+END_TEST
+
+int main(int argc, char *argv[])
+{
+	int number_failed;
+
+	Suite *suite = suite_create("alert_queue");
+	TCase *tcase = tcase_create("case");
+	tcase_add_checked_fixture(tcase, setup, teardown);
+	tcase_add_test(tcase, test_queue_flush_on_shutdown);
+	tcase_add_test(tcase, test_queue_flush);
+	tcase_add_test(tcase, test_queue_overflow);
+	tcase_add_test(tcase, test_queue_reuse);
+	suite_add_tcase(suite, tcase);
+
+	SRunner *runner = srunner_create(suite);
+#ifdef HAKA_DEBUG
+	srunner_set_fork_status(runner, CK_NOFORK);
+#endif
+	srunner_run_all(runner, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(runner);
+	srunner_free(runner);
+
+	return number_failed;
+}
@@ -0,0 +1,73 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+require('luaunit')
+
+TestEventMatch = {}
+
+local function new_event()
+	local event = haka.event.Event:new('test')
+	event:register_key('port', function (emitter, port, host) return port end)
+	event:register_key('host', function (emitter, port, host) return host end, string.lower)
+	return event
+end
+
+local function listener(calls, name)
+	return function (emitter, port, host)
+		table.insert(calls, name)
+	end
+end
+
+function TestEventMatch:test_indexed_dispatch()
+	-- Given
+	local event = new_event()
+	local connections = haka.event.StaticEventConnections:new()
+	local calls = {}
+
+	connections:register(event, listener(calls, 'any'), {})
+	connections:register(event, listener(calls, '80'), {}, { port = 80 })
+	connections:register(event, listener(calls, '80-443'), {}, { port = { 80, 443 } })
+	connections:register(event, listener(calls, 'last'), {})
+
+	-- When
+	connections:signal(nil, event, 80, 'a')
+	connections:signal(nil, event, 443, 'a')
+	connections:signal(nil, event, 22, 'a')
+
+	-- Then
+	assertEquals(table.concat(calls, ' '), 'any 80 80-443 last any 80-443 last any last')
+end
+
+function TestEventMatch:test_several_keys()
+	-- Given
+	local event = new_event()
+	local connections = haka.event.StaticEventConnections:new()
+	local calls = {}
+
+	connections:register(event, listener(calls, 'port'), {}, { port = 80 })
+	connections:register(event, listener(calls, 'host'), {}, { host = 'Example.com' })
+	connections:register(event, listener(calls, 'both'), {}, { port = 80, host = 'example.com' })
+
+	-- When
+	connections:signal(nil, event, 80, 'example.com')
+	connections:signal(nil, event, 80, 'other.com')
+	connections:signal(nil, event, 22, 'example.com')
+
+	-- Then
+	assertEquals(table.concat(calls, ' '), 'port host both port host')
+end
+
+function TestEventMatch:test_unknown_key()
+	-- Given
+	local event = new_event()
+	local connections = haka.event.StaticEventConnections:new()
+
+	-- When
+	local ok = pcall(connections.register, connections, event, function () end, {}, { unknown = 1 })
+
+	-- Then
+	assertEquals(ok, false)
+end
+
+addTestSuite('TestEventMatch')
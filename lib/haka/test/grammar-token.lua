@@ -34,4 +34,68 @@ function TestGrammarToken:test_raw_token()
 	assertEquals(result.token:asstring(), "abcdefghijklmnopqrstuvwxyz")
 end
 
+function TestGrammarToken:test_shared_token()
+	-- Given
+	local before = haka.grammar.regexp_cache_info()
+	local buf = haka.vbuffer_from("abcdef 0123456789")
+	local grammar = haka.grammar.new("test", function ()
+		word = token("[a-z]*")
+		elem = record{
+			field("first", word),
+			token(" "),
+			field("second", token("[0-9]*")),
+		}
+
+		export(elem)
+	end)
+	local compiled = haka.grammar.regexp_cache_info()
+	local other = haka.grammar.new("other", function ()
+		elem = field("token", token("[a-z]*"))
+
+		export(elem)
+	end)
+	local after = haka.grammar.regexp_cache_info()
+
+	-- When
+	local result = grammar.elem:parse(buf:pos('begin'))
+	local other_result = other.elem:parse(buf:pos('begin'))
+
+	-- Then
+	assertEquals(result.first, "abcdef")
+	assertEquals(result.second, "0123456789")
+	assertEquals(other_result.token, "abcdef")
+
+	-- The token of the second grammar is found in the cache
+	assertTrue(compiled.misses > before.misses)
+	assertEquals(after.misses, compiled.misses)
+	assertTrue(after.hits > compiled.hits)
+end
+
+local function compile_token(pattern)
+	local before = haka.grammar.regexp_cache_info()
+	haka.grammar.new("bounded", function ()
+		elem = token(pattern)
+
+		export(elem)
+	end)
+	return haka.grammar.regexp_cache_info().misses - before.misses
+end
+
+function TestGrammarToken:test_regexp_cache_is_bounded()
+	-- Given
+	local max = haka.grammar.regexp_cache_info().max
+
+	-- When
+	for i=1,max+1 do
+		assertEquals(compile_token(string.format("bounded%d", i)), 1)
+	end
+
+	-- Then
+	assertTrue(haka.grammar.regexp_cache_info().size <= max)
+
+	-- The newest pattern is still cached and the oldest one was dropped
+	assertEquals(compile_token(string.format("bounded%d", max+1)), 0)
+	assertEquals(compile_token("bounded1"), 1)
+end
+
 addTestSuite('TestGrammarToken')
@@ -0,0 +1,231 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <check.h>
+#include <haka/config.h>
+#include <haka/log.h>
+#include <haka/thread.h>
+
+
+REGISTER_LOG_SECTION(test);
+REGISTER_LOG_SECTION(other);
+
+/* Longest message given to the loggers, must match MESSAGE_BUFSIZE in
+ * log.c without the final zero */
+#define MESSAGE_MAX     3071
+
+#define MAX_RECEIVED    8192
+
+/* Messages received by the logger, in order */
+struct received {
+	log_level   level;
+	char        module[16];
+	char       *message;
+};
+
+static struct received received[MAX_RECEIVED];
+static volatile int received_count;
+static mutex_t received_lock;
+static mutex_t test_blocked;
+
+static void test_destroy(struct logger *state)
+{
+}
+
+static int test_message(struct logger *state, log_level level, const char *module, const char *message)
+{
+	/* The log thread stays in the logger until the test releases it */
+	if (strcmp(message, "block") == 0) {
+		mutex_lock(&test_blocked);
+		mutex_unlock(&test_blocked);
+	}
+
+	mutex_lock(&received_lock);
+	if (received_count < MAX_RECEIVED) {
+		struct received *entry = &received[received_count++];
+		entry->level = level;
+		snprintf(entry->module, sizeof(entry->module), "%s", module);
+		entry->message = strdup(message);
+	}
+	mutex_unlock(&received_lock);
+	return 0;
+}
+
+static struct logger test_logger = {
+	destroy: test_destroy,
+	message: test_message,
+	async: true
+};
+
+static struct received *find_received(const char *module, const char *prefix)
+{
+	int i;
+
+	for (i=0; i<received_count; ++i) {
+		if (strcmp(received[i].module, module) == 0 &&
+		    strncmp(received[i].message, prefix, strlen(prefix)) == 0) {
+			return &received[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void setup()
+{
+	ck_assert(mutex_init(&received_lock, false));
+	ck_assert(mutex_init(&test_blocked, false));
+	enable_stdout_logging(false);
+	received_count = 0;
+	test_logger.mark_for_remove = false;
+	ck_assert(add_logger(&test_logger));
+}
+
+static void teardown()
+{
+	int i;
+
+	remove_all_logger();
+
+	for (i=0; i<received_count; ++i) {
+		free(received[i].message);
+	}
+
+	mutex_destroy(&test_blocked);
+	mutex_destroy(&received_lock);
+}
+
+START_TEST(test_long_message_truncated)
+{
+	char *text = malloc(2*MESSAGE_MAX);
+	ck_assert(text);
+	memset(text, 'a', 2*MESSAGE_MAX - 1);
+	text[2*MESSAGE_MAX - 1] = 0;
+
+	LOG_INFO(test, "%s", text);
+	log_flush();
+	free(text);
+
+	/* The record holds the formatted message, cut to the buffer size */
+	ck_assert_int_eq(received_count, 1);
+	ck_assert_int_eq(strlen(received[0].message), MESSAGE_MAX);
+	ck_assert_int_eq(received[0].message[MESSAGE_MAX-1], 'a');
+}
+END_TEST
+
+START_TEST(test_messages_keep_order_and_content)
+{
+	const int count = 1000;
+	char expected[64];
+	int i;
+
+	/* Records of every size from 16 to 56 bytes, enough of them to
+	 * wrap around the ring several times */
+	for (i=0; i<count; ++i) {
+		LOG_INFO(test, "%0*d", 1 + i % 40, i);
+		if (i % 100 == 99) log_flush();
+	}
+	log_flush();
+
+	ck_assert_int_eq(received_count, count);
+	for (i=0; i<count; ++i) {
+		snprintf(expected, sizeof(expected), "%0*d", 1 + i % 40, i);
+		ck_assert_str_eq(received[i].message, expected);
+		ck_assert_str_eq(received[i].module, "test");
+		ck_assert_int_eq(received[i].level, HAKA_LOG_INFO);
+	}
+}
+END_TEST
+
+START_TEST(test_level_by_section)
+{
+	setlevel(HAKA_LOG_WARNING, "test");
+
+	LOG_INFO(test, "filtered");
+	LOG_WARNING(test, "warning");
+	LOG_INFO(other, "other section");
+	log_flush();
+
+	setlevel(HAKA_LOG_DEFAULT, "test");
+
+	/* Only the section set to warning filters its info messages */
+	ck_assert_int_eq(received_count, 2);
+	ck_assert(find_received("test", "filtered") == NULL);
+	ck_assert(find_received("test", "warning") != NULL);
+	ck_assert_int_eq(find_received("test", "warning")->level, HAKA_LOG_WARNING);
+	ck_assert(find_received("other", "other section") != NULL);
+	ck_assert_int_eq(find_received("other", "other section")->level, HAKA_LOG_INFO);
+}
+END_TEST
+
+START_TEST(test_error_not_queued)
+{
+	/* The process might not survive the error, it is given to the
+	 * logger before the call returns */
+	LOG_ERROR(test, "error");
+	ck_assert_int_eq(received_count, 1);
+	ck_assert_int_eq(received[0].level, HAKA_LOG_ERROR);
+
+	log_flush();
+	ck_assert_int_eq(received_count, 1);
+}
+END_TEST
+
+START_TEST(test_lost_messages_reported)
+{
+	/* The block record and the filler records take 16 bytes each, the
+	 * block record stays in the ring until it is delivered */
+	const int capacity = 64*1024 / 16;
+	const uint64 dropped = log_dropped();
+	char report[64];
+	int i;
+
+	mutex_lock(&test_blocked);
+
+	LOG_INFO(test, "block");
+	for (i=0; i<capacity + 9; ++i) {
+		LOG_INFO(test, "fill");
+	}
+
+	ck_assert(log_dropped() - dropped >= 10);
+	snprintf(report, sizeof(report), "%llu log messages lost, log queue full",
+			log_dropped() - dropped);
+
+	mutex_unlock(&test_blocked);
+
+	remove_all_logger();
+
+	/* The lost messages are reported in a warning of the core section */
+	ck_assert(find_received("core", report) != NULL);
+	ck_assert_int_eq(find_received("core", report)->level, HAKA_LOG_WARNING);
+}
+END_TEST
+
+int main(int argc, char *argv[])
+{
+	int number_failed;
+
+	Suite *suite = suite_create("log_queue");
+	TCase *tcase = tcase_create("case");
+	tcase_add_checked_fixture(tcase, setup, teardown);
+	tcase_add_test(tcase, test_long_message_truncated);
+	tcase_add_test(tcase, test_messages_keep_order_and_content);
+	tcase_add_test(tcase, test_level_by_section);
+	tcase_add_test(tcase, test_error_not_queued);
+	tcase_add_test(tcase, test_lost_messages_reported);
+	suite_add_tcase(suite, tcase);
+
+	SRunner *runner = srunner_create(suite);
+#ifdef HAKA_DEBUG
+	srunner_set_fork_status(runner, CK_NOFORK);
+#endif
+	srunner_run_all(runner, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(runner);
+	srunner_free(runner);
+
+	return number_failed;
+}
@@ -0,0 +1,152 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include <haka/config.h>
+#include <haka/lua/alloc.h>
+
+
+static void *alloc_fill(struct lua_alloc *alloc, void *ptr, size_t osize, size_t nsize, char c)
+{
+	char *ret = lua_alloc_function(alloc, ptr, osize, nsize);
+	ck_assert(ret != NULL);
+	memset(ret, c, nsize);
+	return ret;
+}
+
+static bool check_fill(const char *ptr, size_t size, char c)
+{
+	size_t i;
+	for (i=0; i<size; ++i) {
+		if (ptr[i] != c) return false;
+	}
+	return true;
+}
+
+START_TEST(test_small)
+{
+	const struct lua_alloc_stats *stats;
+	struct lua_alloc *alloc = lua_alloc_create();
+	char *a, *b, *c;
+	ck_assert(alloc != NULL);
+
+	stats = lua_alloc_statistics(alloc);
+
+	a = alloc_fill(alloc, NULL, 0, 24, 'a');
+	b = alloc_fill(alloc, NULL, 0, 32, 'b');
+	ck_assert_int_eq(stats->used, 56);
+	ck_assert_int_eq(stats->classes[1].count, 2);
+	ck_assert_int_eq(stats->large, 0);
+
+	/* The freed block is reused by the next allocation of its class */
+	lua_alloc_function(alloc, a, 24, 0);
+	c = alloc_fill(alloc, NULL, 0, 20, 'c');
+	ck_assert(a == c);
+	ck_assert_int_eq(stats->classes[1].allocs, 3);
+	ck_assert(check_fill(b, 32, 'b'));
+
+	lua_alloc_function(alloc, b, 32, 0);
+	lua_alloc_function(alloc, c, 20, 0);
+	ck_assert_int_eq(stats->used, 0);
+	ck_assert_int_eq(stats->peak, 56);
+	ck_assert_int_eq(stats->allocated, 76);
+	ck_assert_int_eq(stats->classes[1].count, 0);
+
+	lua_alloc_destroy(alloc);
+}
+END_TEST
+
+START_TEST(test_realloc)
+{
+	const struct lua_alloc_stats *stats;
+	struct lua_alloc *alloc = lua_alloc_create();
+	char *a;
+	ck_assert(alloc != NULL);
+
+	stats = lua_alloc_statistics(alloc);
+
+	/* Lua 5.2 gives the object type as osize for new blocks */
+	a = alloc_fill(alloc, NULL, 5, 10, 'a');
+	ck_assert_int_eq(stats->used, 10);
+
+	/* Same class, the block is kept */
+	ck_assert(lua_alloc_function(alloc, a, 10, 14) == a);
+
+	/* Growing from small to large and back keeps the content */
+	a = lua_alloc_function(alloc, a, 14, 1000);
+	ck_assert(a != NULL);
+	ck_assert(check_fill(a, 10, 'a'));
+	ck_assert_int_eq(stats->large, 1000);
+	ck_assert_int_eq(stats->classes[0].count, 0);
+
+	memset(a, 'b', 1000);
+	a = lua_alloc_function(alloc, a, 1000, 100);
+	ck_assert(a != NULL);
+	ck_assert(check_fill(a, 100, 'b'));
+	ck_assert_int_eq(stats->large, 0);
+	ck_assert_int_eq(stats->classes[6].count, 1);
+	ck_assert_int_eq(stats->used, 100);
+
+	lua_alloc_function(alloc, a, 100, 0);
+	ck_assert_int_eq(stats->used, 0);
+
+	lua_alloc_destroy(alloc);
+}
+END_TEST
+
+START_TEST(test_arenas)
+{
+	const struct lua_alloc_stats *stats;
+	struct lua_alloc *alloc = lua_alloc_create();
+	const int count = 100000;
+	void **blocks;
+	int i;
+	ck_assert(alloc != NULL);
+
+	stats = lua_alloc_statistics(alloc);
+
+	blocks = malloc(sizeof(void *)*count);
+	ck_assert(blocks != NULL);
+
+	for (i=0; i<count; ++i) {
+		blocks[i] = alloc_fill(alloc, NULL, 0, 1 + i % LUA_ALLOC_SMALL_MAX, i);
+	}
+
+	ck_assert(stats->arena > 0);
+
+	for (i=0; i<count; ++i) {
+		ck_assert(check_fill(blocks[i], 1 + i % LUA_ALLOC_SMALL_MAX, i));
+		lua_alloc_function(alloc, blocks[i], 1 + i % LUA_ALLOC_SMALL_MAX, 0);
+	}
+
+	ck_assert_int_eq(stats->used, 0);
+
+	free(blocks);
+	lua_alloc_destroy(alloc);
+}
+END_TEST
+
+int main(int argc, char *argv[])
+{
+	int number_failed;
+
+	Suite *suite = suite_create("lua_alloc_suite");
+	TCase *tcase = tcase_create("case");
+	tcase_add_test(tcase, test_small);
+	tcase_add_test(tcase, test_realloc);
+	tcase_add_test(tcase, test_arenas);
+	suite_add_tcase(suite, tcase);
+
+	SRunner *runner = srunner_create(suite);
+#ifdef HAKA_DEBUG
+	srunner_set_fork_status(runner, CK_NOFORK);
+#endif
+	srunner_run_all(runner, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(runner);
+	srunner_free(runner);
+
+	return number_failed;
+}
@@ -0,0 +1,51 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+require('luaunit')
+
+TestPortTable = {}
+
+local function flow(srcport, dstport)
+	return { srcport = srcport, dstport = dstport }
+end
+
+function TestPortTable:test_single_port()
+	-- Given
+	local ports = haka.helper.PortTable:new()
+	ports:add('http', 80)
+	ports:add('ftp-data', 20, 'down')
+
+	-- Then
+	assertEquals(ports:lookup(flow(40000, 80)), 'http')
+	assertEquals(ports:lookup(flow(20, 40000)), 'ftp-data')
+	assertEquals(ports:lookup(flow(80, 40000)), nil)
+	assertEquals(ports:lookup(flow(40000, 20)), nil)
+end
+
+function TestPortTable:test_range()
+	-- Given
+	local ports = haka.helper.PortTable:new()
+	ports:add('range', { 8000, 8999 })
+	ports:add('other', { 8500, 9500 })
+	ports:add('single', 8080)
+
+	-- Then
+	assertEquals(ports:lookup(flow(40000, 8000)), 'range')
+	assertEquals(ports:lookup(flow(40000, 8600)), 'range')
+	assertEquals(ports:lookup(flow(40000, 9000)), 'other')
+	assertEquals(ports:lookup(flow(40000, 8080)), 'single')
+	assertEquals(ports:lookup(flow(40000, 9501)), nil)
+end
+
+function TestPortTable:test_empty()
+	-- Given
+	local ports = haka.helper.PortTable:new()
+
+	-- Then
+	assertEquals(ports:isempty(), true)
+	ports:add('http', 80)
+	assertEquals(ports:isempty(), false)
+end
+
+addTestSuite('TestPortTable')
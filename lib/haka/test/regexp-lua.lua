@@ -230,6 +230,28 @@ function TestRegexpModule:test_match_should_allow_case_insensitive ()
 	assertIsString(ret)
 end
 
+function TestRegexpModule:test_match_should_reuse_cached_regexp ()
+	-- Given
+	local before = haka.console.regexp_cache()[1]
+	-- When
+	for i = 1, 10 do
+		assertIsString(self.rem.re:match("cached [0-9]+", "a cached 1234 regexp"))
+	end
+	-- Then
+	local after = haka.console.regexp_cache()[1]
+	assertTrue(after.hits - before.hits >= 9)
+	assertTrue(after.misses - before.misses <= 1)
+end
+
+function TestRegexpModule:test_match_should_not_share_cached_regexp_between_options ()
+	-- Given
+	self.rem.re:match("cache option", "CaChE OpTiOn", self.rem.re.CASE_INSENSITIVE)
+	-- When
+	local ret = self.rem.re:match("cache option", "CaChE OpTiOn")
+	-- Then
+	assertIsNil(ret)
+end
+
 function TestRegexpModule:test_match_can_work_on_iterator ()
 	-- Given
 	local re = self.rem.re:compile("foo")
@@ -0,0 +1,121 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdlib.h>
+#include <check.h>
+#include <haka/config.h>
+#include <haka/regexp_module.h>
+
+
+static int test_released;
+
+static void test_release_regexp(struct regexp *regexp)
+{
+	if (atomic_dec(&regexp->ref_count) == 0) {
+		test_released++;
+		free(regexp);
+	}
+}
+
+static struct regexp_module test_module = {
+	release_regexp: test_release_regexp
+};
+
+/* Owners of the cache entries, as the Lua states would be */
+static int old_state, new_state;
+
+static struct regexp *compile(const char *pattern, const void *owner)
+{
+	struct regexp *regexp = malloc(sizeof(struct regexp));
+	ck_assert(regexp);
+
+	regexp->module = &test_module;
+	atomic_set(&regexp->ref_count, 1);
+
+	ck_assert(regexp_cache_add_regexp(&test_module, pattern, 0, regexp, owner));
+	test_release_regexp(regexp);
+	return regexp;
+}
+
+static void setup()
+{
+	test_released = 0;
+}
+
+static void teardown()
+{
+	regexp_cache_clear(NULL);
+}
+
+START_TEST(test_cache_hit)
+{
+	struct regexp *regexp = compile("abc", &old_state);
+
+	ck_assert(regexp_cache_get_regexp(&test_module, "abc", 0, &old_state) == regexp);
+	ck_assert(regexp_cache_get_regexp(&test_module, "abc", REGEXP_CASE_INSENSITIVE, &old_state) == NULL);
+	ck_assert(regexp_cache_get_regexp(&test_module, "abd", 0, &old_state) == NULL);
+	test_release_regexp(regexp);
+}
+END_TEST
+
+START_TEST(test_cache_clear_owner)
+{
+	struct regexp_cache_stats stats;
+
+	compile("abc", &old_state);
+	compile("def", &new_state);
+
+	/* Closing the old state keeps the entries of the new one */
+	regexp_cache_clear(&old_state);
+	ck_assert_int_eq(test_released, 1);
+
+	regexp_cache_getstats(&stats);
+	ck_assert_int_eq(stats.size, 1);
+	ck_assert(regexp_cache_get_regexp(&test_module, "abc", 0, &new_state) == NULL);
+	test_release_regexp(regexp_cache_get_regexp(&test_module, "def", 0, &new_state));
+}
+END_TEST
+
+START_TEST(test_cache_clear_shared)
+{
+	struct regexp_cache_stats stats;
+	struct regexp *regexp = compile("abc", &old_state);
+
+	/* The entry goes to the new state once it has used it */
+	ck_assert(regexp_cache_get_regexp(&test_module, "abc", 0, &new_state) == regexp);
+	test_release_regexp(regexp);
+
+	regexp_cache_clear(&old_state);
+	ck_assert_int_eq(test_released, 0);
+
+	regexp_cache_getstats(&stats);
+	ck_assert_int_eq(stats.size, 1);
+
+	regexp_cache_clear(&new_state);
+	ck_assert_int_eq(test_released, 1);
+}
+END_TEST
+
+int main(int argc, char *argv[])
+{
+	int number_failed;
+
+	Suite *suite = suite_create("regexp_cache");
+	TCase *tcase = tcase_create("case");
+	tcase_add_checked_fixture(tcase, setup, teardown);
+	tcase_add_test(tcase, test_cache_hit);
+	tcase_add_test(tcase, test_cache_clear_owner);
+	tcase_add_test(tcase, test_cache_clear_shared);
+	suite_add_tcase(suite, tcase);
+
+	SRunner *runner = srunner_create(suite);
+#ifdef HAKA_DEBUG
+	srunner_set_fork_status(runner, CK_NOFORK);
+#endif
+	srunner_run_all(runner, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(runner);
+	srunner_free(runner);
+
+	return number_failed;
+}
@@ -0,0 +1,170 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <string.h>
+#include <check.h>
+#include <haka/config.h>
+#include <haka/regexp_literal.h>
+#include <haka/regexp_module.h>
+
+
+static void check_literal(const char *pattern, int options, const char *expected, bool prefix)
+{
+	struct regexp_literal literal;
+	regexp_literal_extract(pattern, options, &literal);
+
+	ck_assert_msg(literal.len == strlen(expected),
+		"pattern '%s': literal '%.*s' expected '%s'", pattern,
+		(int)literal.len, literal.data, expected);
+	ck_assert_msg(memcmp(literal.data, expected, literal.len) == 0,
+		"pattern '%s': literal '%.*s' expected '%s'", pattern,
+		(int)literal.len, literal.data, expected);
+	if (literal.len > 0) {
+		ck_assert_msg(literal.prefix == prefix, "pattern '%s': wrong prefix flag", pattern);
+	}
+}
+
+START_TEST(test_literal_plain)
+{
+	check_literal("abcdef", 0, "abcdef", true);
+	check_literal("^abcdef$", 0, "abcdef", true);
+	check_literal("ab", 0, "", false);
+	check_literal("ab.cdef", 0, "cdef", false);
+	check_literal("abc\\.def", 0, "abc.def", true);
+	check_literal("abc\\x41def", 0, "abcAdef", true);
+	check_literal("abc\\d+def", 0, "abc", true);
+	check_literal("abc def", REGEXP_EXTENDED, "", false);
+}
+END_TEST
+
+START_TEST(test_literal_alternation)
+{
+	/* Nothing is required by a top level alternation */
+	check_literal("abcdef|ghijkl", 0, "", false);
+	check_literal("abc(def|ghi)", 0, "abc", true);
+	check_literal("(abc|def)ghijkl", 0, "ghijkl", false);
+	check_literal("(abc|(def|x))ghijkl", 0, "ghijkl", false);
+	check_literal("abc)def", 0, "", false);
+}
+END_TEST
+
+START_TEST(test_literal_optional)
+{
+	check_literal("abcd?efgh", 0, "abc", true);
+	check_literal("abcd*efgh", 0, "abc", true);
+	check_literal("abcd+efgh", 0, "abcd", true);
+	check_literal("abcd??efgh", 0, "abc", true);
+	check_literal("ab?cdefg", 0, "cdefg", false);
+	check_literal("(foo)?barbaz", 0, "barbaz", false);
+	check_literal("(?:foo)*barbaz", 0, "barbaz", false);
+	check_literal("\\.?abc", 0, "abc", false);
+}
+END_TEST
+
+START_TEST(test_literal_class)
+{
+	check_literal("[abc]defg", 0, "defg", false);
+	check_literal("abc[xyz]defgh", 0, "abc", true);
+	check_literal("abc[\\]x]defgh", 0, "abc", true);
+	check_literal("[]abc]defg", 0, "defg", false);
+	check_literal("[^]abc]defg", 0, "defg", false);
+	check_literal("[[:alpha:]]defg", 0, "defg", false);
+	check_literal("abc[xyz", 0, "", false);
+}
+END_TEST
+
+START_TEST(test_literal_caseless)
+{
+	struct regexp_literal literal;
+	regexp_literal_extract("HeLLo", REGEXP_CASE_INSENSITIVE, &literal);
+
+	ck_assert(literal.caseless);
+	ck_assert_int_eq(literal.len, 5);
+	ck_assert(memcmp(literal.data, "hello", 5) == 0);
+
+	ck_assert(regexp_literal_contains(&literal, "xxHELLOxx", 9));
+	ck_assert(regexp_literal_contains(&literal, "xxhElLo", 7));
+	ck_assert(!regexp_literal_contains(&literal, "xxHELL", 6));
+
+	/* Options set inside the pattern are not understood */
+	check_literal("(?i)hello", 0, "", false);
+	check_literal("(?i:hello)", 0, "", false);
+}
+END_TEST
+
+START_TEST(test_literal_repeat)
+{
+	check_literal("abcd{2}efg", 0, "abcd", true);
+	check_literal("abcd{0}efgh", 0, "abc", true);
+	check_literal("abcd{0,2}efgh", 0, "abc", true);
+	check_literal("abcd{2,}efg", 0, "abcd", true);
+
+	/* Repetition from 0 with recent PCRE2, a literal for PCRE */
+	check_literal("abcd{,3}efgh", 0, "abc", true);
+	check_literal("abcd{ ,3 }efgh", 0, "abc", true);
+	check_literal("abcd{ 0 }efgh", 0, "abc", true);
+
+	/* Not a repetition */
+	check_literal("abc{def", 0, "abc{def", true);
+	check_literal("abc{}def", 0, "abc{}def", true);
+	check_literal("abc{x}def", 0, "abc{x}def", true);
+}
+END_TEST
+
+START_TEST(test_literal_truncated)
+{
+	struct regexp_literal literal;
+	regexp_literal_extract("0123456789012345678901234567890123456789", 0, &literal);
+
+	ck_assert_int_eq(literal.len, REGEXP_LITERAL_MAX);
+	ck_assert(literal.prefix);
+}
+END_TEST
+
+START_TEST(test_literal_skip)
+{
+	struct regexp_literal literal;
+	regexp_literal_extract("abcdef.*", 0, &literal);
+
+	ck_assert(regexp_literal_skip(&literal, "xxxxxxxx", 8));
+	ck_assert(!regexp_literal_skip(&literal, "xxabcdefxx", 10));
+
+	/* The literal could continue in the next chunk */
+	ck_assert(!regexp_literal_skip(&literal, "xxxxxabc", 8));
+	ck_assert(!regexp_literal_skip(&literal, "xxxxxxxa", 8));
+	ck_assert(!regexp_literal_skip(&literal, "ab", 2));
+
+	/* A literal which is not a prefix cannot be used on streams */
+	regexp_literal_extract("x+abcdef", 0, &literal);
+	ck_assert(!literal.prefix);
+	ck_assert(!regexp_literal_skip(&literal, "yyyyyyyy", 8));
+}
+END_TEST
+
+int main(int argc, char *argv[])
+{
+	int number_failed;
+
+	Suite *suite = suite_create("regexp_literal");
+	TCase *tcase = tcase_create("case");
+	tcase_add_test(tcase, test_literal_plain);
+	tcase_add_test(tcase, test_literal_alternation);
+	tcase_add_test(tcase, test_literal_optional);
+	tcase_add_test(tcase, test_literal_class);
+	tcase_add_test(tcase, test_literal_caseless);
+	tcase_add_test(tcase, test_literal_repeat);
+	tcase_add_test(tcase, test_literal_truncated);
+	tcase_add_test(tcase, test_literal_skip);
+	suite_add_tcase(suite, tcase);
+
+	SRunner *runner = srunner_create(suite);
+#ifdef HAKA_DEBUG
+	srunner_set_fork_status(runner, CK_NOFORK);
+#endif
+	srunner_run_all(runner, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(runner);
+	srunner_free(runner);
+
+	return number_failed;
+}
@@ -76,4 +76,33 @@ function TestVBuffer:test_append_on_itself()
 	assertEquals(not success and msg, "circular buffer insertion")
 end
 
+function TestVBuffer:test_find_across_chunks()
+	local buf = haka.vbuffer_from("foo\r")
+	buf:append(haka.vbuffer_from("\nbar"))
+	local begin, _end = buf:sub():find("\r\n")
+	assertEquals(haka.vbuffer_sub(buf:pos('begin'), begin):asstring(), "foo")
+	assertEquals(haka.vbuffer_sub(_end, buf:pos('end')):asstring(), "bar")
+end
+
+function TestVBuffer:test_find_partial()
+	local buf = haka.vbuffer_from("foo\r")
+	local begin, _end, partial = buf:sub():find("\r\n")
+	assertEquals(begin, nil)
+	assertEquals(haka.vbuffer_sub(partial, buf:pos('end')):asstring(), "\r")
+end
+
+function TestVBuffer:test_asnumber()
+	local buf = haka.vbuffer_from(string.char(0x01, 0x02, 0x03, 0x04, 0xff, 0xff, 0xff, 0xff))
+
+	-- Loop to get the accessors compiled on LuaJIT
+	for i=1,200 do
+		assertEquals(buf:sub(0, 2):asnumber(), 0x0102)
+		assertEquals(buf:sub(0, 2):asnumber('little'), 0x0201)
+		assertEquals(buf:sub(4, 4):asnumber(), -1)
+		assertEquals(buf:sub(0, 4):asbits(4, 8), 0x10)
+		assertEquals(buf:sub(0, 4):asbits(4, 8, 'little'), 0x20)
+		assertEquals(buf:sub()[3], 0x03)
+	end
+end
+
 addTestSuite('TestVBuffer')
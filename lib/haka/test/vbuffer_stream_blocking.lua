@@ -17,6 +17,8 @@ function TestVBufferStream:gen_stream(f)
 
 		manager:process_all(current)
 	end
+
+	manager:release()
 end
 
 function TestVBufferStream:test_stream_blocking_advance()
@@ -70,4 +72,70 @@ function TestVBufferStream:test_stream_blocking_available()
 	assertEquals(loop, 10)
 end
 
+function TestVBufferStream:test_stream_blocking_find()
+	self:gen_stream(function (iter)
+		local begin, _end = iter:find("kaHa")
+		assertEquals(haka.vbuffer_sub(begin, _end):asstring(), "kaHa")
+		assertEquals(iter:sub(2):asstring(), "ka")
+
+		begin, _end = iter:find("foo")
+		assertEquals(begin, nil)
+		assert(iter.iseof)
+	end)
+end
+
+function TestVBufferStream:test_stream_pool()
+	local stats = haka.console.coroutine_pool()[1]
+	local hits, manager_hits = stats.hits, stats.manager_hits
+
+	for i=1,3 do
+		local loop = 0
+
+		self:gen_stream(function (iter)
+			for sub in iter:foreach_available() do
+				loop = loop+1
+			end
+		end)
+
+		assertEquals(loop, 10)
+	end
+
+	-- The coroutine and the manager of the first stream are reused
+	stats = haka.console.coroutine_pool()[1]
+	assert(stats.hits >= hits+2)
+	assert(stats.manager_hits >= manager_hits+2)
+end
+
+function TestVBufferStream:test_stream_pool_release_twice()
+	local manager = haka.vbuffer_stream_comanager:new(haka.vbuffer_stream())
+	manager:release()
+	manager:release()
+
+	-- The manager was pooled once, it cannot be given to two streams
+	local first = haka.vbuffer_stream_comanager:new(haka.vbuffer_stream())
+	local second = haka.vbuffer_stream_comanager:new(haka.vbuffer_stream())
+	assert(first ~= second)
+
+	first:release()
+	second:release()
+end
+
+function TestVBufferStream:test_stream_pool_error()
+	local ok, err = pcall(self.gen_stream, self, function (iter)
+		iter:advance(1)
+		error("failure")
+	end)
+	assert(not ok)
+	assert(err:find("failure"))
+
+	-- The pooled coroutine is reused by the next stream
+	local loop = 0
+	self:gen_stream(function (iter)
+		for sub in iter:foreach_available() do
+			loop = loop+1
+		end
+	end)
+	assertEquals(loop, 10)
+end
+
 addTestSuite('TestVBufferStream')
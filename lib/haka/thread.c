@@ -12,6 +12,7 @@
 
 #include <haka/thread.h>
 #include <haka/error.h>
+#include <haka/time.h>
 
 
 static int thread_capture_count = 0;
@@ -464,6 +465,22 @@ bool semaphore_wait(semaphore_t *semaphore)
 	return true;
 }
 
+bool semaphore_timedwait(semaphore_t *semaphore, const struct time *deadline)
+{
+	struct timespec ts;
+
+	ts.tv_sec = deadline->secs;
+	ts.tv_nsec = deadline->nsecs;
+
+	if (sem_timedwait(semaphore, &ts)) {
+		if (errno != ETIMEDOUT && errno != EINTR) {
+			error("semaphore error: %s", errno_error(errno));
+		}
+		return false;
+	}
+	return true;
+}
+
 bool semaphore_post(semaphore_t *semaphore)
 {
 	const int err = sem_post(semaphore);
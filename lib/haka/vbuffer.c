@@ -1304,6 +1304,177 @@ bool vbuffer_zero(struct vbuffer_sub *data)
 	return check_error();
 }
 
+/*
+ * Search
+ */
+
+bool vbuffer_sub_findbyte(struct vbuffer_sub *data, uint8 byte, struct vbuffer_iterator *pos)
+{
+	struct vbuffer_sub_mmap mmapiter = vbuffer_mmap_init;
+	struct vbuffer_iterator iter;
+	const uint8 *ptr;
+	size_t len;
+
+	if (!_vbuffer_sub_check(data)) return false;
+
+	while ((ptr = vbuffer_mmap(data, &len, false, &mmapiter, &iter))) {
+		const uint8 *found = memchr(ptr, byte, len);
+		if (found) {
+			if (pos) {
+				vbuffer_iterator_copy(&iter, pos);
+				vbuffer_iterator_advance(pos, found - ptr);
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool vbuffer_sub_findset(struct vbuffer_sub *data, const struct vbuffer_byteset *set, struct vbuffer_iterator *pos)
+{
+	struct vbuffer_sub_mmap mmapiter = vbuffer_mmap_init;
+	struct vbuffer_iterator iter;
+	const uint8 *ptr;
+	size_t len;
+
+	assert(set);
+
+	if (!_vbuffer_sub_check(data)) return false;
+
+	while ((ptr = vbuffer_mmap(data, &len, false, &mmapiter, &iter))) {
+		const uint8 *cur = ptr;
+		const uint8 *end = ptr + len;
+
+		/* Unrolled to let the compiler vectorize the bit tests */
+		while (end - cur >= 4) {
+			if (vbuffer_byteset_test(set, cur[0]) || vbuffer_byteset_test(set, cur[1]) ||
+			    vbuffer_byteset_test(set, cur[2]) || vbuffer_byteset_test(set, cur[3])) {
+				break;
+			}
+			cur += 4;
+		}
+
+		for (; cur < end; ++cur) {
+			if (vbuffer_byteset_test(set, *cur)) {
+				if (pos) {
+					vbuffer_iterator_copy(&iter, pos);
+					vbuffer_iterator_advance(pos, cur - ptr);
+				}
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+/* Length of the longest end of ptr that is the beginning of str */
+static size_t _vbuffer_find_partial(const uint8 *str, size_t len, const uint8 *ptr, size_t size)
+{
+	size_t k = size < len ? size : len - 1;
+
+	for (; k > 0; --k) {
+		if (ptr[size - k] == str[0] && memcmp(ptr + size - k, str, k) == 0) {
+			return k;
+		}
+	}
+
+	return 0;
+}
+
+int vbuffer_sub_find(struct vbuffer_sub *data, const uint8 *str, size_t len,
+		struct vbuffer_iterator *begin, struct vbuffer_iterator *end)
+{
+	struct vbuffer_sub_mmap mmapiter = vbuffer_mmap_init;
+	struct vbuffer_iterator iter;
+	/* Possible match started in a previous memory block: the previous data
+	 * ends with the first partial bytes of str. */
+	struct vbuffer_iterator partial_iter;
+	size_t partial = 0, partial_offset = 0;
+	const uint8 *ptr;
+	size_t size;
+
+	assert(str);
+
+	if (!_vbuffer_sub_check(data)) return VBUFFER_FIND_NOMATCH;
+
+	if (len == 0) {
+		if (begin) vbuffer_sub_begin(data, begin);
+		if (end) vbuffer_sub_begin(data, end);
+		return VBUFFER_FIND_MATCH;
+	}
+
+	while ((ptr = vbuffer_mmap(data, &size, false, &mmapiter, &iter))) {
+		const uint8 *found;
+
+		/* Continue the partial match, fall back to a shorter one when
+		 * it fails. The partial data are the first bytes of str, so this
+		 * only needs to look at str itself. */
+		while (partial > 0) {
+			const size_t need = len - partial;
+			const size_t n = need < size ? need : size;
+
+			if (memcmp(ptr, str + partial, n) == 0) {
+				if (n == need) {
+					if (begin) {
+						vbuffer_iterator_copy(&partial_iter, begin);
+						vbuffer_iterator_advance(begin, partial_offset);
+					}
+					if (end) {
+						vbuffer_iterator_copy(&iter, end);
+						vbuffer_iterator_advance(end, n);
+					}
+					return VBUFFER_FIND_MATCH;
+				}
+
+				partial += n;
+				break;
+			}
+			else {
+				const size_t old = partial;
+
+				while (--partial > 0) {
+					if (memcmp(str + old - partial, str, partial) == 0) break;
+				}
+
+				partial_offset += old - partial;
+			}
+		}
+
+		if (partial > 0) continue;
+
+		found = memmem(ptr, size, str, len);
+		if (found) {
+			if (begin) {
+				vbuffer_iterator_copy(&iter, begin);
+				vbuffer_iterator_advance(begin, found - ptr);
+			}
+			if (end) {
+				vbuffer_iterator_copy(&iter, end);
+				vbuffer_iterator_advance(end, found - ptr + len);
+			}
+			return VBUFFER_FIND_MATCH;
+		}
+
+		partial = _vbuffer_find_partial(str, len, ptr, size);
+		if (partial > 0) {
+			vbuffer_iterator_copy(&iter, &partial_iter);
+			partial_offset = size - partial;
+		}
+	}
+
+	if (partial > 0) {
+		if (begin) {
+			vbuffer_iterator_copy(&partial_iter, begin);
+			vbuffer_iterator_advance(begin, partial_offset);
+		}
+		return VBUFFER_FIND_PARTIAL;
+	}
+
+	return VBUFFER_FIND_NOMATCH;
+}
+
 static struct vbuffer_chunk *_vbuffer_extract(struct vbuffer_sub *data, struct vbuffer *buffer,
 		bool mark_modified, bool insert_ctl)
 {
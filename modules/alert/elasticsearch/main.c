@@ -8,11 +8,14 @@
 #include <haka/geoip.h>
 #include <haka/error.h>
 #include <haka/log.h>
+#include <haka/thread.h>
 
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include <jansson.h>
+#include "json.h"
 
 /* Limit the length of alert id suffixes */
 #define ALERT_ID_LENGTH 16
@@ -21,327 +24,179 @@ static REGISTER_LOG_SECTION(elasticsearch);
 
 const char ELASTICSEARCH_INDEX[] = "ips";
 
-static bool json_insert_string(json_t *obj, const char *key, const char *string)
+static void json_write_list(struct json_writer *writer, char **array)
 {
-	json_t *json_str = json_string(string);
-	if (!json_str) {
-		error("json string creation error");
-		return false;
-	}
-	if (json_object_set_new(obj, key, json_str)) {
-		error("json object insertion error");
-		return false;
+	char **iter;
+	for (iter = array; *iter; ++iter) {
+		json_write_string(writer, *iter);
 	}
-	return true;
 }
 
-static bool json_insert_double(json_t *obj, const char *key, double val)
+static void json_write_time(struct json_writer *writer, const char *key, const struct time *time)
 {
-	json_t *json_val = json_real(val);
-	if (!json_val) {
-		error("json real creation error");
-		return false;
-	}
-	if (json_object_set_new(obj, key, json_val)) {
-		error("json object insertion error");
-		return false;
-	}
-	return true;
+	char timestr[TIME_BUFSIZE];
+	time_tostring(time, timestr, TIME_BUFSIZE);
+	json_write_key(writer, key);
+	json_write_string(writer, timestr);
 }
 
-static bool alert_add_geolocalization(json_t *list, char *address, struct geoip_handle *geoip_handler)
+/* All the nodes of the same type are merged in a single list */
+static void json_write_nodes(struct json_writer *writer, struct alert_node **nodes,
+		struct geoip_handle *geoip_handler)
 {
-	if (geoip_handler) {
-		char country_code[3];
-		ipv4addr addr = ipv4_addr_from_string(address);
-		if (addr && geoip_lookup_country(geoip_handler, addr, country_code)) {
-			json_t *json_country = json_string(country_code);
-			if (!json_country) {
-				error("json string creation error");
-				return false;
-			}
-			if (json_array_append_new(list, json_country)) {
-				error("json array insertion error");
-				return false;
-			}
-		}
-	}
-	return true;
-}
+	struct alert_node **iter;
+	char **addr;
+	bool address = false, service = false;
 
-json_t *json_get_or_create_list(json_t *obj, const char *key)
-{
-	json_t *array = json_object_get(obj, key);
-	if (!array) {
-		array = json_array();
-		if (!array) {
-			error("json array creation error");
-			return NULL;
-		}
-		if (json_object_set(obj, key, array) < 0) {
-			error("json object insertion error");
-			json_decref(array);
-			return NULL;
-		}
+	for (iter = nodes; *iter; ++iter) {
+		if ((*iter)->type == HAKA_ALERT_NODE_ADDRESS) address = true;
+		else service = true;
 	}
-	else {
-		json_incref(array);
-	}
-	return array;
-}
 
-static bool json_insert_list(json_t *obj, const char *key, char **array)
-{
-	char **iter;
-	json_t *json_str;
+	json_begin_object(writer);
 
-	json_t *nodes = json_array();
-	if (!nodes) {
-		error("json array creation error");
-		return false;
-	}
-
-	for (iter = array; *iter; ++iter) {
-		json_str = json_string(*iter);
-		if (!json_str) {
-			error("json string creation error");
-			json_decref(nodes);
-			return false;
+	if (address) {
+		json_write_key(writer, "address");
+		json_begin_array(writer);
+		for (iter = nodes; *iter; ++iter) {
+			if ((*iter)->type == HAKA_ALERT_NODE_ADDRESS) {
+				json_write_list(writer, (*iter)->list);
+			}
 		}
-		if (json_array_append_new(nodes, json_str)) {
-			error("json array insertion error");
-			return false;
+		json_end_array(writer);
+
+		json_write_key(writer, "geo");
+		json_begin_array(writer);
+		if (geoip_handler) {
+			for (iter = nodes; *iter; ++iter) {
+				if ((*iter)->type != HAKA_ALERT_NODE_ADDRESS) continue;
+
+				for (addr = (*iter)->list; *addr; ++addr) {
+					char country_code[3];
+					ipv4addr ip = ipv4_addr_from_string(*addr);
+					if (ip && geoip_lookup_country(geoip_handler, ip, country_code)) {
+						json_write_string(writer, country_code);
+					}
+				}
+			}
 		}
+		json_end_array(writer);
 	}
 
-	if (json_object_set_new(obj, key, nodes)) {
-		error("json object insertion error");
-		return false;
-	}
-
-	return true;
-}
-
-static bool json_insert_address(json_t *obj, char **list, struct geoip_handle *geoip_handler)
-{
-	json_t *json_str;
-	char **iter;
-	json_t *address, *geo;
-
-	address = json_get_or_create_list(obj, "address");
-	if (!address) {
-		return false;
-	}
-
-	geo = json_get_or_create_list(obj, "geo");
-	if (!geo) {
-		json_decref(address);
-		return false;
-	}
-
-	for (iter = list; *iter; ++iter) {
-		alert_add_geolocalization(geo, *iter, geoip_handler);
-		json_str = json_string(*iter);
-		if (!json_str) {
-			error("json string creation error");
-			json_decref(address);
-			json_decref(geo);
-			return false;
-		}
-		if (json_array_append_new(address, json_str)) {
-			error("json array insertion error");
-			json_decref(address);
-			json_decref(geo);
-			return false;
+	if (service) {
+		json_write_key(writer, "services");
+		json_begin_array(writer);
+		for (iter = nodes; *iter; ++iter) {
+			if ((*iter)->type != HAKA_ALERT_NODE_ADDRESS) {
+				json_write_list(writer, (*iter)->list);
+			}
 		}
+		json_end_array(writer);
 	}
-	return true;
+
+	json_end_object(writer);
 }
 
 static void json_create_mapping(struct elasticsearch_connector *connector, const char *index)
 {
-	json_t *mapping = json_pack("{s{s{s{s{s{s{ssss}s{ssss}}}}}}}",
-		"mappings", "alert", "properties", "method", "properties",
-		"ref", "type", "string", "index", "not_analyzed", "description",
-		"type", "string", "index", "not_analyzed"
-	);
-	if (!mapping) {
-		error("json mapping creation error");
-		return;
-	}
-	if (!elasticsearch_newindex(connector, index, mapping)) {
+	static const char mapping[] =
+		"{\"mappings\":{\"alert\":{\"properties\":{\"method\":{\"properties\":{"
+		"\"ref\":{\"type\":\"string\",\"index\":\"not_analyzed\"},"
+		"\"description\":{\"type\":\"string\",\"index\":\"not_analyzed\"}}}}}}}";
+
+	if (!elasticsearch_newindex(connector, index, mapping, sizeof(mapping)-1)) {
 		error("elasticsearch index creation error");
-		json_decref(mapping);
-		return;
 	}
-	json_decref(mapping);
 }
 
-json_t *alert_tojson(const struct time *time, const struct alert *alert, struct geoip_handle *geoip_handler)
+/* Write the alert document at the end of the writer output */
+bool alert_tojson(struct json_writer *writer, const struct time *time, const struct alert *alert,
+		struct geoip_handle *geoip_handler)
 {
-	struct alert_node **iter;
-	json_t *ret = json_object();
-	if (!ret) {
-		error("json object creation error");
-		return NULL;
-	}
+	json_begin_object(writer);
 
 	{
 		char timestr[TIME_BUFSIZE];
 		elasticsearch_formattimestamp(time, timestr, TIME_BUFSIZE);
-		if (!json_insert_string(ret, "time", timestr)) {
-			json_decref(ret);
-			return NULL;
-		}
+		json_write_key(writer, "time");
+		json_write_string(writer, timestr);
 	}
 
 	if (time_isvalid(&alert->start_time)) {
-		char timestr[TIME_BUFSIZE];
-		time_tostring(&alert->start_time, timestr, TIME_BUFSIZE);
-		if (!json_insert_string(ret, "start time", timestr)) {
-			json_decref(ret);
-			return NULL;
-		}
+		json_write_time(writer, "start time", &alert->start_time);
 	}
 
 	if (time_isvalid(&alert->end_time)) {
-		char timestr[TIME_BUFSIZE];
-		time_tostring(&alert->end_time, timestr, TIME_BUFSIZE);
-		if (!json_insert_string(ret, "end time", timestr)) {
-			json_decref(ret);
-			return NULL;
-		}
+		json_write_time(writer, "end time", &alert->end_time);
 	}
 
 	if (alert->severity > HAKA_ALERT_LEVEL_NONE && alert->severity < HAKA_ALERT_NUMERIC) {
-		if (!json_insert_string(ret, "severity", alert_level_to_str(alert->severity))) {
-			json_decref(ret);
-			return NULL;
-		}
+		json_write_key(writer, "severity");
+		json_write_string(writer, alert_level_to_str(alert->severity));
 	}
 
 	if (alert->confidence > HAKA_ALERT_LEVEL_NONE) {
+		json_write_key(writer, "confidence");
 		if (alert->confidence == HAKA_ALERT_NUMERIC) {
-			if (!json_insert_double(ret, "confidence", alert->confidence_num)) {
-				json_decref(ret);
-				return NULL;
-			}
+			json_write_number(writer, alert->confidence_num);
 		}
 		else {
-			if (!json_insert_string(ret, "confidence", alert_level_to_str(alert->confidence))) {
-				json_decref(ret);
-				return NULL;
-			}
+			json_write_string(writer, alert_level_to_str(alert->confidence));
 		}
 	}
 
 	if (alert->completion > HAKA_ALERT_COMPLETION_NONE) {
-		if (!json_insert_string(ret, "completion", alert_completion_to_str(alert->completion))) {
-			json_decref(ret);
-			return NULL;
-		}
+		json_write_key(writer, "completion");
+		json_write_string(writer, alert_completion_to_str(alert->completion));
 	}
 
 	if (alert->description) {
-		if (!json_insert_string(ret, "description", alert->description)) {
-			json_decref(ret);
-			return NULL;
-		}
+		json_write_key(writer, "description");
+		json_write_string(writer, alert->description);
+	}
+
+	if (alert->count > 1) {
+		json_write_key(writer, "count");
+		json_write_integer(writer, alert->count);
 	}
 
 	if (alert->method_description || alert->method_ref) {
-		json_t *desc = json_object();
-		if (!desc) {
-			error("json object creation error");
-			json_decref(ret);
-			return NULL;
-		}
+		json_write_key(writer, "method");
+		json_begin_object(writer);
 
 		if (alert->method_description) {
-			if (!json_insert_string(desc, "description", alert->method_description)) {
-				json_decref(desc);
-				json_decref(ret);
-				return NULL;
-			}
+			json_write_key(writer, "description");
+			json_write_string(writer, alert->method_description);
 		}
 
 		if (alert->method_ref) {
-			if (!json_insert_list(desc, "ref", alert->method_ref)) {
-				json_decref(desc);
-				json_decref(ret);
-				return NULL;
-			}
+			json_write_key(writer, "ref");
+			json_begin_array(writer);
+			json_write_list(writer, alert->method_ref);
+			json_end_array(writer);
 		}
 
-		if (json_object_set_new(ret, "method", desc) < 0) {
-			error("json object insertion error");
-			json_decref(ret);
-			return NULL;
-		}
+		json_end_object(writer);
 	}
 
 	if (alert->sources) {
-		json_t *sources = json_object();
-		if (!sources) {
-			error("json object creation error");
-			json_decref(ret);
-			return NULL;
-		}
-		for (iter = alert->sources; *iter; ++iter) {
-			if (strcmp(alert_node_to_str((*iter)->type), "address") == 0) {
-				if (!json_insert_address(sources, (*iter)->list, geoip_handler)) {
-					json_decref(sources);
-					json_decref(ret);
-					return NULL;
-				}
-			}
-			else {
-				if (!json_insert_list(sources, "services", (*iter)->list)) {
-					json_decref(sources);
-					json_decref(ret);
-					return NULL;
-				}
-			}
-		}
-
-		if (!json_object_set_new(ret, "sources", sources) < 0) {
-			error("json object insertion error");
-			json_decref(ret);
-			return NULL;
-		}
+		json_write_key(writer, "sources");
+		json_write_nodes(writer, alert->sources, geoip_handler);
 	}
 
 	if (alert->targets) {
-		json_t *targets = json_object();
-		if (!targets) {
-			error("json object creation error");
-			json_decref(ret);
-			return NULL;
-		}
-		for (iter = alert->targets; *iter; ++iter) {
-			if (strcmp(alert_node_to_str((*iter)->type), "address") == 0) {
-				if (!json_insert_address(targets, (*iter)->list, geoip_handler)) {
-					json_decref(targets);
-					json_decref(ret);
-					return NULL;
-				}
-			}
-			else {
-				if (!json_insert_list(targets, "services", (*iter)->list)) {
-					json_decref(targets);
-					json_decref(ret);
-				}
-			}
-		}
+		json_write_key(writer, "targets");
+		json_write_nodes(writer, alert->targets, geoip_handler);
+	}
 
-		if (!json_object_set_new(ret, "targets", targets) < 0) {
-			error("json object insertion error");
-			json_decref(ret);
-			return NULL;
-		}
+	json_end_object(writer);
+
+	if (json_writer_failed(writer)) {
+		if (!check_error()) error("json alert creation error");
+		return false;
 	}
 
-	return ret;
+	return true;
 }
 
 struct elasticsearch_alerter {
@@ -351,6 +206,8 @@ struct elasticsearch_alerter {
 	char                             *index;
 	struct geoip_handle              *geoip_handler;
 	char                              alert_id_prefix[ELASTICSEARCH_ID_LENGTH + 1];
+	mutex_t                           json_mutex;
+	struct vector                     json;       /* Reused for each alert */
 };
 
 static int init(struct parameters *args)
@@ -366,26 +223,46 @@ static bool do_alert(struct alerter *state, uint64 id, const struct time *time,
 {
 	struct elasticsearch_alerter *alerter = (struct elasticsearch_alerter *)state;
 
-	json_t *ret;
+	struct json_writer writer;
+	bool ret;
 	char elasticsearch_id[ELASTICSEARCH_ID_LENGTH + ALERT_ID_LENGTH + 1];
 	snprintf(elasticsearch_id, ELASTICSEARCH_ID_LENGTH + ALERT_ID_LENGTH + 1,
 		"%s%llx", alerter->alert_id_prefix, id);
 
-	ret = alert_tojson(time, alert, alerter->geoip_handler);
-	return ret && elasticsearch_insert(alerter->connector, alerter->index, "alert", elasticsearch_id, ret);
+	mutex_lock(&alerter->json_mutex);
+
+	vector_resize(&alerter->json, 0);
+	json_writer_init(&writer, &alerter->json);
+
+	ret = alert_tojson(&writer, time, alert, alerter->geoip_handler) &&
+		elasticsearch_insert(alerter->connector, alerter->index, "alert", elasticsearch_id,
+				alerter->json.data, vector_count(&alerter->json));
+
+	mutex_unlock(&alerter->json_mutex);
+	return ret;
 }
 
 static bool do_alert_update(struct alerter *state, uint64 id, const struct time *time, const struct alert *alert)
 {
 	struct elasticsearch_alerter *alerter = (struct elasticsearch_alerter *)state;
 
-	json_t *ret;
+	struct json_writer writer;
+	bool ret;
 	char elasticsearch_id[ELASTICSEARCH_ID_LENGTH + ALERT_ID_LENGTH + 1];
 	snprintf(elasticsearch_id, ELASTICSEARCH_ID_LENGTH + ALERT_ID_LENGTH + 1,
 		"%s%llx", alerter->alert_id_prefix, id);
 
-	ret = alert_tojson(time, alert, alerter->geoip_handler);
-	return ret && elasticsearch_update(alerter->connector, alerter->index, "alert", elasticsearch_id, ret);
+	mutex_lock(&alerter->json_mutex);
+
+	vector_resize(&alerter->json, 0);
+	json_writer_init(&writer, &alerter->json);
+
+	ret = alert_tojson(&writer, time, alert, alerter->geoip_handler) &&
+		elasticsearch_update(alerter->connector, alerter->index, "alert", elasticsearch_id,
+				alerter->json.data, vector_count(&alerter->json));
+
+	mutex_unlock(&alerter->json_mutex);
+	return ret;
 }
 
 void cleanup_alerter(struct alerter_module *module)
@@ -399,6 +276,8 @@ void cleanup_alerter(struct alerter_module *module)
 	if (alerter->geoip_handler) {
 		geoip_destroy(alerter->geoip_handler);
 	}
+	vector_destroy(&alerter->json);
+	mutex_destroy(&alerter->json_mutex);
 	free(alerter);
 }
 
@@ -412,22 +291,42 @@ struct alerter_module *init_alerter(struct parameters *args)
 
 	elasticsearch_alerter->module.alerter.alert = do_alert;
 	elasticsearch_alerter->module.alerter.update = do_alert_update;
+	elasticsearch_alerter->module.alerter.async = true;
+	elasticsearch_alerter->connector = NULL;
+	elasticsearch_alerter->geoip_handler = NULL;
+	vector_create(&elasticsearch_alerter->json, char, NULL);
+	mutex_init(&elasticsearch_alerter->json_mutex, false);
 
 	const char *server = parameters_get_string(args, "elasticsearch_server", NULL);
 	if (!server) {
 		error("missing elasticsearch address server");
-		free(elasticsearch_alerter);
+		cleanup_alerter(&elasticsearch_alerter->module);
 		return NULL;
 	}
 
 	elasticsearch_alerter->server = strdup(server);
 	if (!elasticsearch_alerter->server) {
 		error("memory error");
-		free(elasticsearch_alerter);
+		cleanup_alerter(&elasticsearch_alerter->module);
 		return NULL;
 	}
 
-	elasticsearch_alerter->connector = elasticsearch_connector_new(elasticsearch_alerter->server);
+	{
+		struct elasticsearch_options options = elasticsearch_default_options;
+		options.max_bulk_size = parameters_get_integer(args, "elasticsearch_max_bulk_size",
+				options.max_bulk_size);
+		options.max_bulk_count = parameters_get_integer(args, "elasticsearch_max_bulk_count",
+				options.max_bulk_count);
+		options.flush_interval = parameters_get_integer(args, "elasticsearch_flush_interval",
+				options.flush_interval);
+		options.max_queue = parameters_get_integer(args, "elasticsearch_max_queue",
+				options.max_queue);
+		options.compress = parameters_get_boolean(args, "elasticsearch_compress",
+				options.compress);
+
+		elasticsearch_alerter->connector = elasticsearch_connector_new(elasticsearch_alerter->server,
+				&options);
+	}
 	if (!elasticsearch_alerter->connector) {
 		error("enable to connect to elasticsearch server %s", elasticsearch_alerter->server);
 		cleanup_alerter(&elasticsearch_alerter->module);
@@ -126,6 +126,7 @@ struct alerter_module *init_alerter(struct parameters *args)
 			error("cannot open file '%s' for alert", filename);
 			return NULL;
 		}
+		file_alerter->stdio = false;
 	} else {
 		file_alerter->stdio = true;
 		file_alerter->output = stdout;
@@ -133,6 +134,9 @@ struct alerter_module *init_alerter(struct parameters *args)
 
 	file_alerter->color = colors_supported(fileno(file_alerter->output));
 
+	/* Alerts on the standard output stay in order with the other messages */
+	file_alerter->module.alerter.async = !file_alerter->stdio;
+
 	return &file_alerter->module;
 }
 
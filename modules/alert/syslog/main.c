@@ -49,7 +49,8 @@ struct alerter_module *init_alerter(struct parameters *args)
 	static struct alerter_module static_module = {
 		alerter: {
 			alert: do_alert,
-			update: do_alert_update
+			update: do_alert_update,
+			async: true
 		}
 	};
 
@@ -46,7 +46,8 @@ struct logger_module *init_logger(struct parameters *args)
 {
 	static struct logger_module static_module = {
 		logger: {
-			message: logger_message
+			message: logger_message,
+			async: true
 		}
 	};
 
@@ -0,0 +1,546 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <assert.h>
+#include <string.h>
+
+#include <haka/compiler.h>
+
+#include "haka/decode.h"
+
+
+/*
+ * Helpers
+ */
+
+static int hex_value(uint8 c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static const uint8 *find_byte(const uint8 *iter, const uint8 *end, uint8 c)
+{
+	const uint8 *found = memchr(iter, c, end - iter);
+	return found ? found : end;
+}
+
+/* Copy the bytes that do not need decoding */
+static const uint8 *copy_until(const uint8 *iter, const uint8 *next, uint8 **out)
+{
+	const size_t size = next - iter;
+	memmove(*out, iter, size);
+	*out += size;
+	return next;
+}
+
+static size_t utf8_length(uint32 cp)
+{
+	if (cp < 0x80) return 1;
+	if (cp < 0x800) return 2;
+	if (cp < 0x10000) return 3;
+	if (cp < 0x200000) return 4;
+	if (cp < 0x4000000) return 5;
+	return 6;
+}
+
+static uint8 *utf8_encode(uint32 cp, uint8 *out)
+{
+	static const uint8 lead[] = { 0, 0, 0xc0, 0xe0, 0xf0, 0xf8, 0xfc };
+	const size_t len = utf8_length(cp);
+	size_t i;
+
+	if (len == 1) {
+		*out = cp;
+		return out + 1;
+	}
+
+	for (i = len-1; i > 0; --i) {
+		out[i] = 0x80 | (cp & 0x3f);
+		cp >>= 6;
+	}
+	out[0] = lead[len] | cp;
+	return out + len;
+}
+
+
+/*
+ * Each decoder function decodes as much data as possible. When last is
+ * false, an incomplete sequence at the end of the data is not consumed.
+ * The output is never larger than the input.
+ */
+
+typedef size_t (*decode_func)(const uint8 *src, size_t len, uint8 *dst, size_t *consumed,
+		bool last);
+
+
+/* Percent decoding */
+
+static const uint8 *find_percent_plus(const uint8 *iter, const uint8 *end)
+{
+	while (iter < end && *iter != '%' && *iter != '+') iter++;
+	return iter;
+}
+
+static size_t _decode_percent(const uint8 *src, size_t len, uint8 *dst, size_t *consumed,
+		bool last, bool plus)
+{
+	const uint8 *iter = src, *end = src + len;
+	uint8 *out = dst;
+
+	while (iter < end) {
+		iter = copy_until(iter, plus ? find_percent_plus(iter, end) : find_byte(iter, end, '%'), &out);
+		if (iter == end) break;
+
+		if (*iter == '+') {
+			*out++ = ' ';
+			iter++;
+		}
+		else if (end - iter < 3) {
+			if (!last && (end - iter == 1 || hex_value(iter[1]) >= 0)) break;
+			*out++ = *iter++;
+		}
+		else {
+			const int high = hex_value(iter[1]);
+			const int low = hex_value(iter[2]);
+
+			if (high >= 0 && low >= 0) {
+				*out++ = (high << 4) | low;
+				iter += 3;
+			}
+			else {
+				*out++ = *iter++;
+			}
+		}
+	}
+
+	*consumed = iter - src;
+	return out - dst;
+}
+
+static size_t decode_percent(const uint8 *src, size_t len, uint8 *dst, size_t *consumed,
+		bool last)
+{
+	return _decode_percent(src, len, dst, consumed, last, false);
+}
+
+static size_t decode_percent_plus(const uint8 *src, size_t len, uint8 *dst, size_t *consumed,
+		bool last)
+{
+	return _decode_percent(src, len, dst, consumed, last, true);
+}
+
+
+/* Html entities */
+
+#define ENTITY_MAX    12  /* Longest named entity with its '&' and ';' */
+
+#define ENTITY_OK          0
+#define ENTITY_INVALID     1
+#define ENTITY_INCOMPLETE  2
+
+static const struct {
+	const char  *name;
+	size_t       len;
+	uint32       cp;
+} entities[] = {
+	{ "amp",  3, '&' },
+	{ "lt",   2, '<' },
+	{ "gt",   2, '>' },
+	{ "quot", 4, '"' },
+	{ "apos", 4, '\'' },
+	{ "nbsp", 4, 0xa0 },
+};
+
+static bool is_hex_prefix(const uint8 *iter, const uint8 *end)
+{
+	return iter + 1 < end && (iter[1] == 'x' || iter[1] == 'X');
+}
+
+static int parse_entity(const uint8 *iter, const uint8 *end, uint32 *cp, size_t *size,
+		bool last)
+{
+	const uint8 *begin = iter++;
+
+	if (iter == end) return last ? ENTITY_INVALID : ENTITY_INCOMPLETE;
+
+	if (*iter == '#') {
+		/* Numeric entity, the final ';' is optional like in the browsers.
+		 * The leading zeros are not limited, the value is. */
+		const bool hex = is_hex_prefix(iter, end);
+		const uint8 *digits;
+		uint32 value = 0;
+
+		iter += hex ? 2 : 1;
+		digits = iter;
+
+		while (iter < end && *iter == '0') iter++;
+
+		while (iter < end) {
+			const int d = hex ? hex_value(*iter) : (*iter >= '0' && *iter <= '9' ? *iter - '0' : -1);
+			if (d < 0) break;
+
+			value = value * (hex ? 16 : 10) + d;
+			if (value > 0x10ffff) return ENTITY_INVALID;
+			iter++;
+		}
+
+		if (iter == end && !last) return ENTITY_INCOMPLETE;
+		if (iter == digits) return ENTITY_INVALID;
+		if (iter < end && *iter == ';') iter++;
+
+		*cp = value;
+		*size = iter - begin;
+		return ENTITY_OK;
+	}
+	else {
+		const uint8 *name = iter;
+		int i;
+
+		while (iter < end && iter - begin < ENTITY_MAX && *iter != ';') iter++;
+
+		if (iter == end) return last ? ENTITY_INVALID : ENTITY_INCOMPLETE;
+		if (*iter != ';') return ENTITY_INVALID;
+
+		for (i = 0; i < sizeof(entities)/sizeof(entities[0]); ++i) {
+			if (entities[i].len == iter - name &&
+			    memcmp(entities[i].name, name, entities[i].len) == 0) {
+				*cp = entities[i].cp;
+				*size = iter + 1 - begin;
+				return ENTITY_OK;
+			}
+		}
+
+		return ENTITY_INVALID;
+	}
+}
+
+static size_t decode_html(const uint8 *src, size_t len, uint8 *dst, size_t *consumed,
+		bool last)
+{
+	const uint8 *iter = src, *end = src + len;
+	uint8 *out = dst;
+
+	while (iter < end) {
+		uint32 cp;
+		size_t size;
+
+		iter = copy_until(iter, find_byte(iter, end, '&'), &out);
+		if (iter == end) break;
+
+		switch (parse_entity(iter, end, &cp, &size, last)) {
+		case ENTITY_OK:
+			out = utf8_encode(cp, out);
+			iter += size;
+			break;
+
+		case ENTITY_INCOMPLETE:
+			goto incomplete;
+
+		default:
+			*out++ = *iter++;
+			break;
+		}
+	}
+
+incomplete:
+	*consumed = iter - src;
+	return out - dst;
+}
+
+/* Position of the first leading zero of an incomplete numeric entity and
+ * count of the other zeros, which are not kept in the pending bytes */
+static size_t html_extra_zeros(const uint8 *src, size_t len, size_t *count)
+{
+	const uint8 *iter = src, *end = src + len, *zeros;
+
+	*count = 0;
+	if (len < 2 || src[0] != '&' || src[1] != '#') return 0;
+
+	iter += is_hex_prefix(src + 1, end) ? 3 : 2;
+	zeros = iter;
+	while (iter < end && *iter == '0') iter++;
+
+	if (iter - zeros > 1) {
+		*count = iter - zeros - 1;
+		return zeros + 1 - src;
+	}
+	return 0;
+}
+
+
+/* Overlong utf-8 sequences */
+
+#define SWAR_HIGH  0x8080808080808080ULL
+
+/* Skip the bytes that cannot start a multi-byte sequence (< 0xc0),
+ * eight bytes at a time */
+static const uint8 *find_utf8_lead(const uint8 *iter, const uint8 *end)
+{
+	while (end - iter >= 8) {
+		uint64 word;
+		memcpy(&word, iter, 8);
+		if (word & (word << 1) & SWAR_HIGH) break;
+		iter += 8;
+	}
+
+	while (iter < end && *iter < 0xc0) iter++;
+	return iter;
+}
+
+static size_t decode_utf8(const uint8 *src, size_t len, uint8 *dst, size_t *consumed,
+		bool last)
+{
+	const uint8 *iter = src, *end = src + len;
+	uint8 *out = dst;
+
+	while (iter < end) {
+		size_t count, i;
+		uint32 cp;
+
+		iter = copy_until(iter, find_utf8_lead(iter, end), &out);
+		if (iter == end) break;
+
+		if (*iter >= 0xfe) {
+			*out++ = *iter++;
+			continue;
+		}
+
+		count = *iter >= 0xfc ? 6 : *iter >= 0xf8 ? 5 : *iter >= 0xf0 ? 4 : *iter >= 0xe0 ? 3 : 2;
+		cp = *iter & (0x7f >> count);
+
+		for (i = 1; i < count && iter + i < end; ++i) {
+			if ((iter[i] & 0xc0) != 0x80) break;
+			cp = (cp << 6) | (iter[i] & 0x3f);
+		}
+
+		if (i < count) {
+			if (!last && iter + i == end) break;
+			*out++ = *iter++;
+			continue;
+		}
+
+		if (utf8_length(cp) < count) {
+			out = utf8_encode(cp, out);
+		}
+		else {
+			memmove(out, iter, count);
+			out += count;
+		}
+		iter += count;
+	}
+
+	*consumed = iter - src;
+	return out - dst;
+}
+
+
+/* Base64 */
+
+#define B64_INVALID  0xff
+#define B64_PAD      0xfe
+
+static uint8 base64_table[256];
+
+INIT static void _decode_init()
+{
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	int i;
+
+	memset(base64_table, B64_INVALID, sizeof(base64_table));
+	for (i = 0; i < 64; ++i) {
+		base64_table[(uint8)alphabet[i]] = i;
+	}
+
+	/* Url safe alphabet */
+	base64_table['-'] = 62;
+	base64_table['_'] = 63;
+	base64_table['='] = B64_PAD;
+}
+
+/* Invalid characters are skipped and a padding ends the current block,
+ * the state is kept in the decoder so nothing is left pending. */
+static size_t decode_base64(struct decoder *decoder, const uint8 *src, size_t len, uint8 *dst)
+{
+	const uint8 *iter = src, *end = src + len;
+	uint8 *out = dst;
+	uint32 bits = decoder->bits;
+	int count = decoder->bit_count;
+
+	while (iter < end) {
+		uint8 value;
+
+		/* Fast path for complete quantums of valid characters */
+		if (count == 0) {
+			while (end - iter >= 4) {
+				const uint8 a = base64_table[iter[0]], b = base64_table[iter[1]];
+				const uint8 c = base64_table[iter[2]], d = base64_table[iter[3]];
+
+				if ((a | b | c | d) & 0xc0) break;
+
+				bits = (a << 18) | (b << 12) | (c << 6) | d;
+				out[0] = bits >> 16;
+				out[1] = bits >> 8;
+				out[2] = bits;
+				out += 3;
+				iter += 4;
+			}
+
+			bits = 0;
+			if (iter == end) break;
+		}
+
+		value = base64_table[*iter++];
+		if (value == B64_INVALID) continue;
+
+		if (value == B64_PAD) {
+			bits = 0;
+			count = 0;
+			continue;
+		}
+
+		bits = (bits << 6) | value;
+		count += 6;
+
+		if (count >= 8) {
+			count -= 8;
+			*out++ = bits >> count;
+			bits &= (1 << count) - 1;
+		}
+	}
+
+	decoder->bits = bits;
+	decoder->bit_count = count;
+	return out - dst;
+}
+
+
+/*
+ * Decoders
+ */
+
+static const decode_func decode_funcs[DECODE_TYPE_COUNT] = {
+	[DECODE_PERCENT]      = decode_percent,
+	[DECODE_PERCENT_PLUS] = decode_percent_plus,
+	[DECODE_HTML]         = decode_html,
+	[DECODE_UTF8]         = decode_utf8,
+};
+
+static const char *decode_names[DECODE_TYPE_COUNT] = {
+	[DECODE_PERCENT]      = "percent",
+	[DECODE_PERCENT_PLUS] = "form",
+	[DECODE_BASE64]       = "base64",
+	[DECODE_HTML]         = "html",
+	[DECODE_UTF8]         = "utf8",
+};
+
+bool decode_type_parse(const char *name, enum decode_type *type)
+{
+	int i;
+
+	for (i = 0; i < DECODE_TYPE_COUNT; ++i) {
+		if (strcmp(decode_names[i], name) == 0) {
+			*type = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void decoder_init(struct decoder *decoder, enum decode_type type)
+{
+	memset(decoder, 0, sizeof(*decoder));
+	decoder->type = type;
+}
+
+size_t decoder_max_output(struct decoder *decoder, size_t len)
+{
+	return decoder->pending_size + len;
+}
+
+static void keep_pending(struct decoder *decoder, const uint8 *src, size_t len)
+{
+	size_t prefix = 0, skip = 0;
+
+	if (decoder->type == DECODE_HTML) {
+		prefix = html_extra_zeros(src, len, &skip);
+	}
+
+	assert(len - skip <= DECODE_MAX_PENDING);
+	memcpy(decoder->pending, src, prefix);
+	memcpy(decoder->pending + prefix, src + prefix + skip, len - prefix - skip);
+	decoder->pending_size = len - skip;
+}
+
+size_t decoder_feed(struct decoder *decoder, const uint8 *src, size_t len, uint8 *dst,
+		bool last)
+{
+	const decode_func func = decode_funcs[decoder->type];
+	size_t size = 0, consumed;
+
+	/* Without data, only flush the pending bytes on the last piece. The
+	 * source can then be NULL, it must not reach memcpy. */
+	if (len == 0) {
+		if (last) {
+			if (decoder->pending_size > 0) {
+				size = func(decoder->pending, decoder->pending_size, dst, &consumed, true);
+			}
+
+			decoder->pending_size = 0;
+			decoder->bits = 0;
+			decoder->bit_count = 0;
+		}
+		return size;
+	}
+
+	if (decoder->type == DECODE_BASE64) {
+		size = decode_base64(decoder, src, len, dst);
+		if (last) {
+			decoder->bits = 0;
+			decoder->bit_count = 0;
+		}
+		return size;
+	}
+
+	/* Complete the pending sequence with the beginning of the new data,
+	 * no sequence is longer than DECODE_MAX_PENDING once compacted */
+	while (decoder->pending_size > 0) {
+		uint8 temp[DECODE_MAX_PENDING*2];
+		const size_t pending = decoder->pending_size;
+		const size_t count = len < DECODE_MAX_PENDING ? len : DECODE_MAX_PENDING;
+
+		memcpy(temp, decoder->pending, pending);
+		memcpy(temp + pending, src, count);
+
+		size += func(temp, pending + count, dst + size, &consumed, last && count == len);
+		decoder->pending_size = 0;
+
+		if (consumed < pending) {
+			/* The sequence is still incomplete with all the new data */
+			keep_pending(decoder, temp + consumed, pending + count - consumed);
+			src += count;
+			len -= count;
+			if (len == 0) return size;
+		}
+		else {
+			src += consumed - pending;
+			len -= consumed - pending;
+		}
+	}
+
+	size += func(src, len, dst + size, &consumed, last);
+	keep_pending(decoder, src + consumed, len - consumed);
+
+	return size;
+}
+
+size_t decode(enum decode_type type, const uint8 *src, size_t len, uint8 *dst)
+{
+	struct decoder decoder;
+	decoder_init(&decoder, type);
+	return decoder_feed(&decoder, src, len, dst, true);
+}
@@ -0,0 +1,166 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+%module decode
+
+%include "haka/lua/swig.si"
+%include "haka/lua/vbuffer.si"
+
+%{
+#include <haka/error.h>
+#include <haka/vbuffer.h>
+
+#include "haka/decode.h"
+
+static uint8 *alloc_output(struct decoder *decoder, size_t len,
+		char **TEMP_OUTPUT, size_t *TEMP_SIZE)
+{
+	*TEMP_OUTPUT = malloc(decoder_max_output(decoder, len) + 1);
+	if (!*TEMP_OUTPUT) {
+		error("memory error");
+		return NULL;
+	}
+
+	*TEMP_SIZE = 0;
+	return (uint8 *)*TEMP_OUTPUT;
+}
+
+static void decoder_feed_string(struct decoder *decoder, const char *STRING, size_t SIZE,
+		bool last, char **TEMP_OUTPUT, size_t *TEMP_SIZE)
+{
+	uint8 *out = alloc_output(decoder, SIZE, TEMP_OUTPUT, TEMP_SIZE);
+	if (out) {
+		*TEMP_SIZE = decoder_feed(decoder, (const uint8 *)STRING, SIZE, out, last);
+	}
+}
+
+/* Decode the chunks of the buffer in place, only the output is allocated */
+static void decoder_feed_vbuffer(struct decoder *decoder, struct vbuffer_sub *data,
+		bool last, char **TEMP_OUTPUT, size_t *TEMP_SIZE)
+{
+	struct vbuffer_sub_mmap iter = vbuffer_mmap_init;
+	const uint8 *ptr;
+	uint8 *out;
+	size_t len;
+
+	if (!data) {
+		error("nil argument");
+		return;
+	}
+
+	out = alloc_output(decoder, vbuffer_sub_size(data), TEMP_OUTPUT, TEMP_SIZE);
+	if (!out) return;
+
+	while ((ptr = vbuffer_mmap(data, &len, false, &iter, NULL))) {
+		*TEMP_SIZE += decoder_feed(decoder, ptr, len, out + *TEMP_SIZE, false);
+	}
+
+	if (check_error()) {
+		free(*TEMP_OUTPUT);
+		*TEMP_OUTPUT = NULL;
+		*TEMP_SIZE = (size_t)-1;
+		return;
+	}
+
+	*TEMP_SIZE += decoder_feed(decoder, NULL, 0, out + *TEMP_SIZE, last);
+}
+
+static void _decode(int type, const char *STRING, size_t SIZE,
+		char **TEMP_OUTPUT, size_t *TEMP_SIZE)
+{
+	struct decoder decoder;
+	decoder_init(&decoder, type);
+	decoder_feed_string(&decoder, STRING, SIZE, true, TEMP_OUTPUT, TEMP_SIZE);
+}
+
+static void _vbdecode(int type, struct vbuffer_sub *data,
+		char **TEMP_OUTPUT, size_t *TEMP_SIZE)
+{
+	struct decoder decoder;
+	decoder_init(&decoder, type);
+	decoder_feed_vbuffer(&decoder, data, true, TEMP_OUTPUT, TEMP_SIZE);
+}
+
+%}
+
+%nodefaultctor;
+%nodefaultdtor;
+
+struct decoder {
+	%extend {
+		decoder(const char *type)
+		{
+			struct decoder *decoder;
+			enum decode_type decode_type;
+
+			if (!type || !decode_type_parse(type, &decode_type)) {
+				error("unknown decoding type");
+				return NULL;
+			}
+
+			decoder = malloc(sizeof(struct decoder));
+			if (!decoder) {
+				error("memory error");
+				return NULL;
+			}
+
+			decoder_init(decoder, decode_type);
+			return decoder;
+		}
+
+		~decoder()
+		{
+			free($self);
+		}
+
+		void _feed(const char *STRING, size_t SIZE, bool last, char **TEMP_OUTPUT, size_t *TEMP_SIZE)
+		{
+			decoder_feed_string($self, STRING, SIZE, last, TEMP_OUTPUT, TEMP_SIZE);
+		}
+
+		void _vbfeed(struct vbuffer_sub *data, bool last, char **TEMP_OUTPUT, size_t *TEMP_SIZE)
+		{
+			decoder_feed_vbuffer($self, data, last, TEMP_OUTPUT, TEMP_SIZE);
+		}
+	}
+};
+
+void _decode(int type, const char *STRING, size_t SIZE,
+		char **TEMP_OUTPUT, size_t *TEMP_SIZE);
+void _vbdecode(int type, struct vbuffer_sub *data,
+		char **TEMP_OUTPUT, size_t *TEMP_SIZE);
+
+%constant int PERCENT = DECODE_PERCENT;
+%constant int FORM = DECODE_PERCENT_PLUS;
+%constant int BASE64 = DECODE_BASE64;
+%constant int HTML = DECODE_HTML;
+%constant int UTF8 = DECODE_UTF8;
+
+%luacode {
+	local this = unpack({...})
+
+	local function decoder(kind)
+		return function (data)
+			if type(data) == 'string' then
+				return this._decode(kind, data)
+			else
+				return this._vbdecode(kind, data)
+			end
+		end
+	end
+
+	this.percent = decoder(this.PERCENT)
+	this.form = decoder(this.FORM)
+	this.base64 = decoder(this.BASE64)
+	this.html = decoder(this.HTML)
+	this.utf8 = decoder(this.UTF8)
+
+	swig.getclassmetatable('decoder')['.fn'].feed = function (self, data, last)
+		if type(data) == 'string' then
+			return self:_feed(data, last or false)
+		else
+			return self:_vbfeed(data, last or false)
+		end
+	end
+}
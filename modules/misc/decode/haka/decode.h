@@ -0,0 +1,50 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef _DECODE_H_
+#define _DECODE_H_
+
+#include <haka/types.h>
+
+enum decode_type {
+	DECODE_PERCENT,       /* %XX escapes */
+	DECODE_PERCENT_PLUS,  /* %XX escapes and '+' as space */
+	DECODE_BASE64,        /* Base64, invalid characters are skipped */
+	DECODE_HTML,          /* Named and numeric html entities */
+	DECODE_UTF8,          /* Overlong utf-8 sequences */
+
+	DECODE_TYPE_COUNT
+};
+
+/* Longest sequence that can be kept between two calls */
+#define DECODE_MAX_PENDING 16
+
+/*
+ * Decoding state allowing to decode data split in several pieces.
+ * Incomplete sequences at the end of a piece are kept until the next
+ * one.
+ */
+struct decoder {
+	enum decode_type  type;
+	uint8             pending[DECODE_MAX_PENDING];
+	size_t            pending_size;
+	uint32            bits;       /* Base64 accumulator */
+	int               bit_count;
+};
+
+bool   decode_type_parse(const char *name, enum decode_type *type);
+void   decoder_init(struct decoder *decoder, enum decode_type type);
+
+/* Maximum size of the output for len bytes of input. */
+size_t decoder_max_output(struct decoder *decoder, size_t len);
+
+/* Decode a piece of data and returns the number of bytes written to dst.
+ * Set last to true for the last piece to flush the pending bytes. */
+size_t decoder_feed(struct decoder *decoder, const uint8 *src, size_t len, uint8 *dst,
+		bool last);
+
+/* Decode a complete buffer. */
+size_t decode(enum decode_type type, const uint8 *src, size_t len, uint8 *dst);
+
+#endif /* _DECODE_H_ */
@@ -0,0 +1,58 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+local decode = require('misc/decode')
+
+TestDecode = {}
+
+function TestDecode:test_percent()
+	assertEquals(decode.percent("a%41%4g%%41+%2"), "aA%4g%A+%2")
+	assertEquals(decode.form("a+b%2B"), "a b+")
+end
+
+function TestDecode:test_base64()
+	assertEquals(decode.base64("SGVsbG8gV29ybGQ="), "Hello World")
+	assertEquals(decode.base64("SGVs\nbG8g V29y bGQ"), "Hello World")
+end
+
+function TestDecode:test_html()
+	assertEquals(decode.html("&lt;script&gt;&#60;&#x3C;&#X3c&bogus;&amp;"), "<script><<<&bogus;&")
+	assertEquals(decode.html("&#x10FFFF;"), "\xf4\x8f\xbf\xbf")
+	assertEquals(decode.html("&#60"), "<")
+	assertEquals(decode.html("&#0000000060;&#x000000000000003c"), "<<")
+	assertEquals(decode.html("&#1114112;&#"), "&#1114112;&#")
+end
+
+function TestDecode:test_utf8()
+	assertEquals(decode.utf8("%\xc0\xaf\xe0\x80\xaf\xc3\xa9"), "%//\xc3\xa9")
+end
+
+function TestDecode:test_vbuffer()
+	local buf = haka.vbuffer_from("%2e%2")
+	buf:append(haka.vbuffer_from("e/a"))
+	assertEquals(decode.percent(buf:sub()), "../a")
+end
+
+function TestDecode:test_stream()
+	local decoder = decode.decoder('html')
+	assertEquals(decoder:feed("a&l"), "a")
+	assertEquals(decoder:feed("t;b&#6"), "<b")
+	assertEquals(decoder:feed("0", true), "<")
+end
+
+function TestDecode:test_stream_zeros()
+	local decoder = decode.decoder('html')
+	assertEquals(decoder:feed("a&#x"), "a")
+	assertEquals(decoder:feed(string.rep("0", 100)), "")
+	assertEquals(decoder:feed(string.rep("0", 100)), "")
+	assertEquals(decoder:feed("3c;b", true), "<b")
+end
+
+function TestDecode:test_stream_flush()
+	local decoder = decode.decoder('percent')
+	assertEquals(decoder:feed("a%4"), "a")
+	assertEquals(decoder:feed("", true), "%4")
+end
+
+addTestSuite('TestDecode')
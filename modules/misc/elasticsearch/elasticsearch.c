@@ -6,8 +6,11 @@
 #include <string.h>
 #include <assert.h>
 
+#include <unistd.h>
+
 #include <curl/curl.h>
 #include <uuid/uuid.h>
+#include <zlib.h>
 
 #include <haka/error.h>
 #include <haka/log.h>
@@ -95,29 +98,43 @@ struct elasticsearch_request {
 		NEWINDEX,
 	}                   request_type;
 	char               *index;
-	char               *type;
-	char               *id;
-	char               *data;
+	char               *data; /* Lines of the bulk request or body of the index creation */
+	size_t              size;
 };
 
+/* Delay before retrying a failed bulk request, doubled on each failure */
+#define BACKOFF_MIN    100
+#define BACKOFF_MAX    30000
+
 struct elasticsearch_connector {
-	char          *server_address;
-	CURL          *curl;
-	mutex_t        request_mutex;
-	semaphore_t    request_wait;
-	struct list2   request;
-	struct vector  request_content;
-	thread_t       request_thread;
-	bool           started:1;
-	bool           exit:1;
+	char                          *server_address;
+	struct elasticsearch_options   options;
+	CURL                          *curl;
+	struct curl_slist             *headers;
+	mutex_t                        request_mutex;
+	semaphore_t                    request_wait;
+	struct list2                   request;
+	size_t                         request_count;
+	struct vector                  request_content;
+	struct vector                  request_compressed;
+	uint64                         dropped;
+	thread_t                       request_thread;
+	bool                           started:1;
+	bool                           exit:1;
+};
+
+const struct elasticsearch_options elasticsearch_default_options = {
+	max_bulk_size:   5*1024*1024,
+	max_bulk_count:  1000,
+	flush_interval:  0,
+	max_queue:       100000,
+	compress:        false,
 };
 
 
 static void free_request(struct elasticsearch_request *req)
 {
 	free(req->index);
-	free(req->type);
-	free(req->id);
 	free(req->data);
 	free(req);
 }
@@ -130,45 +147,6 @@ static size_t write_callback_null(char *ptr, size_t size, size_t nmemb, void *us
 	return size*nmemb;
 }
 
-struct callback_sting_data {
-	char    *string;
-	size_t   rem;
-};
-
-static size_t read_callback_string(char *buffer, size_t size, size_t nmemb, void *_data)
-{
-	size_t maxsize;
-	struct callback_sting_data *data = _data;
-
-	maxsize = size*nmemb;
-	if (maxsize > data->rem) maxsize = data->rem;
-
-	memcpy(buffer, data->string, maxsize);
-	data->string += maxsize;
-	data->rem -= maxsize;
-
-	return maxsize;
-}
-
-static size_t write_callback_string(char *ptr, size_t size, size_t nmemb, void *_data)
-{
-	struct callback_sting_data *data = _data;
-
-	size *= nmemb;
-
-	data->string = realloc(data->string, data->rem + size + 1);
-	if (!data->string) {
-		error("memory error");
-		return 0;
-	}
-
-	memcpy(data->string+data->rem, ptr, size);
-	*(data->string+data->rem+size) = '\0';
-	data->rem += size;
-
-	return size;
-}
-
 static bool start_request_thread(struct elasticsearch_connector *connector)
 {
 	if (!connector->started) {
@@ -177,6 +155,7 @@ static bool start_request_thread(struct elasticsearch_connector *connector)
 			connector->started = true;
 			mutex_unlock(&connector->request_mutex);
 			if (!thread_create(&connector->request_thread, &elasticsearch_request_thread, connector)) {
+				connector->started = false;
 				return false;
 			}
 		} else {
@@ -190,7 +169,8 @@ bool elasticsearch_formattimestamp(const struct time *time, char *timestr, size_
     return time_format(time, "%Y/%m/%d %H:%M:%S", timestr, size);
 }
 
-struct elasticsearch_connector *elasticsearch_connector_new(const char *server)
+struct elasticsearch_connector *elasticsearch_connector_new(const char *server,
+		const struct elasticsearch_options *options)
 {
 	struct elasticsearch_connector *ret;
 
@@ -218,6 +198,8 @@ struct elasticsearch_connector *elasticsearch_connector_new(const char *server)
 
 	list2_init(&ret->request);
 	vector_create(&ret->request_content, char, NULL);
+	vector_create(&ret->request_compressed, char, NULL);
+	ret->options = options ? *options : elasticsearch_default_options;
 	ret->exit = false;
 
 	ret->server_address = strdup(server);
@@ -236,6 +218,23 @@ struct elasticsearch_connector *elasticsearch_connector_new(const char *server)
 	/* Uses of signal is not possible here in multi-threaded environment */
 	curl_easy_setopt(ret->curl, CURLOPT_NOSIGNAL, 1L);
 
+	/* The handle is reused for all requests to keep the connection
+	 * alive. The bulk requests are large, do not wait for a 100-continue
+	 * answer before sending them. */
+	curl_easy_setopt(ret->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
+	ret->headers = curl_slist_append(ret->headers, "Expect:");
+	if (ret->options.compress) {
+		ret->headers = curl_slist_append(ret->headers, "Content-Encoding: gzip");
+	}
+	if (!ret->headers) {
+		error("memory error");
+		elasticsearch_connector_close(ret);
+		return NULL;
+	}
+
+	curl_easy_setopt(ret->curl, CURLOPT_HTTPHEADER, ret->headers);
+
 	ret->started = false;
 
 	return ret;
@@ -247,8 +246,14 @@ bool elasticsearch_connector_close(struct elasticsearch_connector *connector)
 
 	/* Stop request thread */
 	connector->exit = true;
-	semaphore_post(&connector->request_wait);
-	thread_join(connector->request_thread, NULL);
+	if (connector->started) {
+		semaphore_post(&connector->request_wait);
+		thread_join(connector->request_thread, NULL);
+	}
+
+	if (connector->dropped > 0) {
+		LOG_WARNING(elasticsearch, "%llu requests dropped", connector->dropped);
+	}
 
 	end = list2_end(&connector->request);
 	for (iter = list2_begin(&connector->request); iter != end; ) {
@@ -260,41 +265,72 @@ bool elasticsearch_connector_close(struct elasticsearch_connector *connector)
 	mutex_destroy(&connector->request_mutex);
 	semaphore_destroy(&connector->request_wait);
 	vector_destroy(&connector->request_content);
+	vector_destroy(&connector->request_compressed);
 
 	if (connector->curl) curl_easy_cleanup(connector->curl);
+	curl_slist_free_all(connector->headers);
 	free(connector->server_address);
 	free(connector);
 	return true;
 }
 
+static bool gzip_compress(const char *data, size_t len, struct vector *out)
+{
+	z_stream stream;
+	int ret;
+
+	memset(&stream, 0, sizeof(stream));
+
+	/* 16 added to the window bits selects the gzip format */
+	if (deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		error("compression error");
+		return false;
+	}
+
+	if (!vector_resize(out, deflateBound(&stream, len))) {
+		deflateEnd(&stream);
+		return false;
+	}
+
+	stream.next_in = (Bytef *)data;
+	stream.avail_in = len;
+	stream.next_out = (Bytef *)vector_first(out, char);
+	stream.avail_out = vector_count(out);
+
+	ret = deflate(&stream, Z_FINISH);
+	deflateEnd(&stream);
+
+	if (ret != Z_STREAM_END) {
+		error("compression error");
+		return false;
+	}
+
+	vector_resize(out, stream.total_out);
+	return true;
+}
+
 static int elasticsearch_post(struct elasticsearch_connector *connector, const char *url,
-		const char *data, json_t **json_res)
+		const char *data, size_t size)
 {
 	CURLcode res;
-	struct callback_sting_data reqdata, resdata;
 	long ret_code;
 
-	reqdata.string = (char *)data;
-	reqdata.rem = strlen(reqdata.string);
+	if (connector->options.compress) {
+		if (!gzip_compress(data, size, &connector->request_compressed)) {
+			return -CURL_LAST;
+		}
 
-	resdata.string = NULL;
-	resdata.rem = 0;
+		data = vector_first(&connector->request_compressed, char);
+		size = vector_count(&connector->request_compressed);
+	}
 
 	curl_easy_setopt(connector->curl, CURLOPT_POST, 1L);
+	curl_easy_setopt(connector->curl, CURLOPT_WRITEFUNCTION, &write_callback_null);
+	curl_easy_setopt(connector->curl, CURLOPT_WRITEDATA, NULL);
 
-	if (json_res) {
-		curl_easy_setopt(connector->curl, CURLOPT_WRITEFUNCTION, &write_callback_string);
-		curl_easy_setopt(connector->curl, CURLOPT_WRITEDATA, &resdata);
-	}
-	else {
-		curl_easy_setopt(connector->curl, CURLOPT_WRITEFUNCTION, &write_callback_null);
-		curl_easy_setopt(connector->curl, CURLOPT_WRITEDATA, NULL);
-	}
-
-	curl_easy_setopt(connector->curl, CURLOPT_READFUNCTION, &read_callback_string);
-	curl_easy_setopt(connector->curl, CURLOPT_READDATA, &reqdata);
-	curl_easy_setopt(connector->curl, CURLOPT_POSTFIELDSIZE, reqdata.rem);
-	curl_easy_setopt(connector->curl, CURLOPT_POSTFIELDS, NULL);
+	/* The data are sent from the buffer without any copy */
+	curl_easy_setopt(connector->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)size);
+	curl_easy_setopt(connector->curl, CURLOPT_POSTFIELDS, data);
 	curl_easy_setopt(connector->curl, CURLOPT_URL, url);
 
 	curl_easy_setopt(connector->curl, CURLOPT_TIMEOUT, 5);
@@ -303,14 +339,12 @@ static int elasticsearch_post(struct elasticsearch_connector *connector, const c
 
 	if (res != CURLE_OK) {
 		error("post error: %s", curl_easy_strerror(res));
-		free(resdata.string);
 		return -res;
 	}
 
 	res = curl_easy_getinfo(connector->curl, CURLINFO_RESPONSE_CODE, &ret_code);
 	if (res != CURLE_OK) {
 		error("post error: %s", curl_easy_strerror(res));
-		free(resdata.string);
 		return -res;
 	}
 
@@ -318,34 +352,21 @@ static int elasticsearch_post(struct elasticsearch_connector *connector, const c
 
 	/* Check for the rest API return code, treat non 2** has error. */
 	if (ret_code < 200 || ret_code >= 300) {
-		free(resdata.string);
 		return ret_code;
 	}
 
-	if (json_res) {
-		if (!resdata.string) {
-			error("post error: invalid json response");
-			free(resdata.string);
-			return -CURL_LAST;
-		}
-
-		*json_res = json_loads(resdata.string, 0, NULL);
-		free(resdata.string);
-
-		if (!(*json_res)) {
-			error("post error: invalid json response");
-			return -CURL_LAST;
-		}
-	}
-
 	return 0;
 }
 
-static void append(struct vector *string, const char *str)
+static void append(struct vector *string, const char *str, size_t len)
 {
-	const size_t len = strlen(str);
 	const size_t index = vector_count(string);
 
+	/* Grow geometrically, the buffer is reused for all the bulks */
+	if (index+len > string->allocated_count) {
+		vector_reserve(string, 2*(index+len));
+	}
+
 	vector_resize(string, index+len);
 	memcpy(vector_get(string, char, index), str, len);
 }
@@ -360,17 +381,40 @@ static void push_request(struct elasticsearch_connector *connector, struct elast
 	list2_elem_init(&req->list);
 
 	mutex_lock(&connector->request_mutex);
+
+	/* Drop the documents if the server cannot keep up, the index
+	 * creations are always kept */
+	if (req->request_type != NEWINDEX && connector->options.max_queue > 0 &&
+	    connector->request_count >= connector->options.max_queue) {
+		connector->dropped++;
+		mutex_unlock(&connector->request_mutex);
+		free_request(req);
+		return;
+	}
+
 	list2_insert(list2_end(&connector->request), &req->list);
+	connector->request_count++;
 	semaphore_post(&connector->request_wait);
 	mutex_unlock(&connector->request_mutex);
 }
 
+uint64 elasticsearch_dropped(struct elasticsearch_connector *connector)
+{
+	uint64 dropped;
+
+	mutex_lock(&connector->request_mutex);
+	dropped = connector->dropped;
+	mutex_unlock(&connector->request_mutex);
+
+	return dropped;
+}
+
 #define BUFFER_SIZE    1024
 
 static int do_one_request(struct elasticsearch_connector *connector, const char *url, const char *data,
-		int *lasterror)
+		size_t size, int *lasterror)
 {
-	const int code = elasticsearch_post(connector, url, data, NULL);
+	const int code = elasticsearch_post(connector, url, data, size);
 	if (check_error()) {
 		assert(code < 0);
 
@@ -384,141 +428,291 @@ static int do_one_request(struct elasticsearch_connector *connector, const char
 	return code;
 }
 
-static void *elasticsearch_request_thread(void *_connector)
+/* Move the requests of the next bulk to the pending list */
+static void take_requests(struct elasticsearch_connector *connector, struct list2 *pending)
 {
-	struct elasticsearch_connector *connector = _connector;
-	char buffer[BUFFER_SIZE];
-	char url[BUFFER_SIZE];
-	int lasterror = 0;
-
-	while (true) {
-		struct list2 copy;
-		list2_iter iter, end;
-		int code;
+	const struct elasticsearch_options *options = &connector->options;
+	list2_iter iter, end;
+	size_t count = 0, size = 0;
 
-		list2_init(&copy);
+	mutex_lock(&connector->request_mutex);
 
-		/* Wait for request */
-		semaphore_wait(&connector->request_wait);
+	end = list2_end(&connector->request);
+	for (iter = list2_begin(&connector->request); iter != end; iter = list2_next(iter)) {
+		struct elasticsearch_request *req = list2_get(iter, struct elasticsearch_request, list);
 
-		/* Get the requests */
-		mutex_lock(&connector->request_mutex);
-		if (list2_empty(&connector->request)) {
-			mutex_unlock(&connector->request_mutex);
-			if (connector->exit) break;
-			continue;
+		/* A bulk holds at least one request */
+		if (count > 0 &&
+		    ((options->max_bulk_count > 0 && count >= options->max_bulk_count) ||
+		     (options->max_bulk_size > 0 && size + req->size > options->max_bulk_size))) {
+			break;
 		}
 
-		list2_swap(&connector->request, &copy);
-		mutex_unlock(&connector->request_mutex);
+		count++;
+		size += req->size;
+	}
+
+	list2_insert_list(list2_end(pending), list2_begin(&connector->request), iter);
+	connector->request_count -= count;
+
+	mutex_unlock(&connector->request_mutex);
+}
+
+static size_t free_requests(struct list2 *list)
+{
+	list2_iter iter = list2_begin(list), end = list2_end(list);
+	size_t count = 0;
+
+	while (iter != end) {
+		struct elasticsearch_request *req = list2_get(iter, struct elasticsearch_request, list);
+		iter = list2_erase(iter);
+		free_request(req);
+		count++;
+	}
+
+	return count;
+}
+
+/* Send the pending requests, returns false if they must be sent again */
+static bool send_requests(struct elasticsearch_connector *connector, struct list2 *pending,
+		int *lasterror)
+{
+	char url[BUFFER_SIZE];
+	list2_iter iter, end;
+	int code;
 
-		/* Build request data */
-		vector_resize(&connector->request_content, 0);
-
-		end = list2_end(&copy);
-		for (iter = list2_begin(&copy); iter != end; ) {
-			struct elasticsearch_request *req = list2_get(iter, struct elasticsearch_request, list);
-
-			switch (req->request_type) {
-			case NEWINDEX:
-				{
-					snprintf(url, BUFFER_SIZE, "%s/%s", connector->server_address, req->index);
-					code = do_one_request(connector, url, req->data, &lasterror);
-					if (code > 0 && code != 400) {
-						LOG_ERROR(elasticsearch, "request failed: %s return error %d", url, code);
-					}
+	/* Build request data */
+	vector_resize(&connector->request_content, 0);
+
+	end = list2_end(pending);
+	for (iter = list2_begin(pending); iter != end; ) {
+		struct elasticsearch_request *req = list2_get(iter, struct elasticsearch_request, list);
+
+		switch (req->request_type) {
+		case NEWINDEX:
+			{
+				snprintf(url, BUFFER_SIZE, "%s/%s", connector->server_address, req->index);
+				code = do_one_request(connector, url, req->data, req->size, lasterror);
+				if (code > 0 && code != 400) {
+					LOG_ERROR(elasticsearch, "request failed: %s return error %d", url, code);
 				}
-				break;
-
-			case INSERT:
-			case UPDATE:
-				{
-					snprintf(buffer, BUFFER_SIZE, "{ \"%s\" : { \"_index\" : \"%s\", \"_type\" : \"%s\"",
-							(req->request_type == INSERT ? "index" : "update"), req->index, req->type);
-					append(&connector->request_content, buffer);
-
-					if (req->id) {
-						snprintf(buffer, BUFFER_SIZE, ", \"_id\" : \"%s\"", req->id);
-						append(&connector->request_content, buffer);
-					}
-
-					append(&connector->request_content, " } }\n");
-					append(&connector->request_content, req->data);
-					append(&connector->request_content, "\n");
+
+				/* The index must exist before the documents are sent */
+				if (code < 0 || code >= 500) {
+					return false;
 				}
-				break;
 
-			default:
-				LOG_ERROR(elasticsearch, "invalid request type: %d", req->request_type);
-				break;
+				iter = list2_erase(iter);
+				free_request(req);
+				continue;
 			}
 
-			iter = list2_erase(iter);
-			free_request(req);
+		case INSERT:
+		case UPDATE:
+			/* Action line and document are already rendered */
+			append(&connector->request_content, req->data, req->size);
+			break;
+
+		default:
+			LOG_ERROR(elasticsearch, "invalid request type: %d", req->request_type);
+			break;
 		}
 
-		/* Do bulk request if needed :*/
-		if (vector_count(&connector->request_content) > 0) {
-			snprintf(url, BUFFER_SIZE, "%s/_bulk", connector->server_address);
-			*vector_push(&connector->request_content, char) = '\0';
+		iter = list2_next(iter);
+	}
+
+	/* Do bulk request if needed :*/
+	if (vector_count(&connector->request_content) > 0) {
+		snprintf(url, BUFFER_SIZE, "%s/_bulk", connector->server_address);
+		code = do_one_request(connector, url, vector_first(&connector->request_content, char),
+				vector_count(&connector->request_content), lasterror);
+		if (code) {
+			if (code != -1) {
+				LOG_ERROR(elasticsearch, "request failed: %s return error %d", url, code);
+			}
 
-			code = do_one_request(connector, url, vector_first(&connector->request_content, char), &lasterror);
-			if (code) {
-				if (code != -1) {
-					LOG_ERROR(elasticsearch, "request failed: %s return error %d", url, code);
-				}
+			/* Retry on connection errors, server errors and throttling */
+			if (code == -1 || code >= 500 || code == 429) {
+				return false;
 			}
 		}
 	}
 
-	connector->started = false;
+	*lasterror = 0;
+	free_requests(pending);
+	return true;
+}
+
+/* Sleep unless the connector is closed */
+static void backoff_wait(struct elasticsearch_connector *connector, int delay)
+{
+	while (delay > 0 && !connector->exit) {
+		const int step = delay > BACKOFF_MIN ? BACKOFF_MIN : delay;
+		usleep(step * 1000);
+		delay -= step;
+	}
+}
+
+static void *elasticsearch_request_thread(void *_connector)
+{
+	struct elasticsearch_connector *connector = _connector;
+	struct list2 pending;
+	int lasterror = 0;
+	int backoff = 0;
+
+	list2_init(&pending);
+
+	while (true) {
+		if (backoff > 0) {
+			/* Retry the failed requests */
+			backoff_wait(connector, backoff);
+		}
+		else {
+			/* Wait for request */
+			semaphore_wait(&connector->request_wait);
+
+			/* Let the requests accumulate to fill the bulk. The wakeups
+			 * left by the requests of a previous bulk find an empty queue
+			 * and must not wait. */
+			if (connector->options.flush_interval > 0 && !connector->exit) {
+				bool wait;
+
+				mutex_lock(&connector->request_mutex);
+				wait = connector->request_count > 0 &&
+					(connector->options.max_bulk_count <= 0 ||
+					 connector->request_count < connector->options.max_bulk_count);
+				mutex_unlock(&connector->request_mutex);
+
+				if (wait) usleep(connector->options.flush_interval * 1000);
+			}
+		}
+
+		if (list2_empty(&pending)) {
+			take_requests(connector, &pending);
+		}
+
+		if (list2_empty(&pending)) {
+			if (connector->exit) break;
+			continue;
+		}
+
+		/* Each request posted the semaphore, the requests left
+		 * for the next bulks will wake up the thread again */
+		if (send_requests(connector, &pending, &lasterror)) {
+			backoff = 0;
+		}
+		else if (connector->exit) {
+			/* Give up, the server is not reachable */
+			const size_t count = free_requests(&pending);
+
+			mutex_lock(&connector->request_mutex);
+			connector->dropped += count;
+			mutex_unlock(&connector->request_mutex);
+
+			backoff = 0;
+		}
+		else {
+			backoff = backoff > 0 ? backoff * 2 : BACKOFF_MIN;
+			if (backoff > BACKOFF_MAX) backoff = BACKOFF_MAX;
+		}
+	}
 
 	return NULL;
 }
 
-#define DUPSTR(name) \
-	if (name) { \
-		req->name = strdup(name); \
-		if (!req->name) { \
-			error("memory error"); \
-			free_request(req); \
-			return false; \
-		} \
+/* Extra space for the action line of the bulk request */
+#define ACTION_SIZE    128
+
+static void write_action(struct json_writer *writer, int reqtype, const char *index,
+		const char *type, const char *id)
+{
+	json_begin_object(writer);
+	json_write_key(writer, reqtype == INSERT ? "index" : "update");
+	json_begin_object(writer);
+	json_write_key(writer, "_index");
+	json_write_string(writer, index);
+	json_write_key(writer, "_type");
+	json_write_string(writer, type);
+	if (id) {
+		json_write_key(writer, "_id");
+		json_write_string(writer, id);
 	}
+	json_end_object(writer);
+	json_end_object(writer);
+	json_append(writer, "\n", 1);
+}
 
+/*
+ * Render the request once, the processing thread only concatenates
+ * the entries to build the bulk request.
+ */
 static bool elasticsearch_request(struct elasticsearch_connector *connector, bool delayed,
-		int reqtype, const char *index, const char *type, const char *id, json_t *data)
+		int reqtype, const char *index, const char *type, const char *id,
+		const char *data, size_t len)
 {
 	struct elasticsearch_request *req;
+	struct vector content;
+	struct json_writer writer;
 
 	assert(connector);
+	assert(data);
 
 	req = malloc(sizeof(struct elasticsearch_request));
 	if (!req) {
 		error("memory error");
-		free(data);
 		return false;
 	}
 
 	memset(req, 0, sizeof(struct elasticsearch_request));
-
 	req->request_type = reqtype;
 
-	DUPSTR(index);
-	DUPSTR(type);
-	DUPSTR(id);
+	req->index = strdup(index);
+	if (!req->index) {
+		error("memory error");
+		free_request(req);
+		return false;
+	}
+
+	vector_create(&content, char, NULL);
+	if (!vector_reserve(&content, len + ACTION_SIZE + (index ? strlen(index) : 0) +
+			(type ? strlen(type) : 0) + (id ? strlen(id) : 0))) {
+		error("memory error");
+		free_request(req);
+		return false;
+	}
+
+	json_writer_init(&writer, &content);
+
+	if (reqtype == NEWINDEX) {
+		json_append(&writer, data, len);
+	}
+	else {
+		write_action(&writer, reqtype, index, type, id);
 
-	req->data = json_dumps(data, JSON_COMPACT);
-	json_decref(data);
-	if (!req->data) {
-		error("cannot dump json object");
+		if (reqtype == UPDATE) {
+			json_append(&writer, "{\"doc\":", 7);
+			json_append(&writer, data, len);
+			json_append(&writer, "}\n", 2);
+		}
+		else {
+			json_append(&writer, data, len);
+			json_append(&writer, "\n", 1);
+		}
+	}
+
+	if (json_writer_failed(&writer)) {
+		if (!check_error()) error("memory error");
+		vector_destroy(&content);
 		free_request(req);
 		return false;
 	}
 
+	/* Take the ownership of the rendered content */
+	req->size = vector_count(&content);
+	req->data = content.data;
+
 	push_request(connector, req, delayed);
 	return true;
-
 }
 
 void elasticsearch_genid(char *id, size_t size)
@@ -529,157 +723,35 @@ void elasticsearch_genid(char *id, size_t size)
 	base64_encode(uuid, 16, id);
 }
 
-bool elasticsearch_newindex(struct elasticsearch_connector *connector, const char *index, json_t *data)
+bool elasticsearch_newindex(struct elasticsearch_connector *connector, const char *index,
+		const char *data, size_t len)
 {
 	assert(connector);
 	assert(index);
 
 	/* This request is delayed, it will wait for the next request to start the processing thread
 	 * if it is not already started. */
-	return elasticsearch_request(connector, true, NEWINDEX, index, NULL, NULL, data);
+	return elasticsearch_request(connector, true, NEWINDEX, index, NULL, NULL, data, len);
 }
 
 bool elasticsearch_insert(struct elasticsearch_connector *connector, const char *index,
-		const char *type, const char *id, json_t *data)
+		const char *type, const char *id, const char *doc, size_t len)
 {
 
 	assert(connector);
 	assert(index);
 	assert(type);
 
-	return elasticsearch_request(connector, false, INSERT, index, type, id, data);
+	return elasticsearch_request(connector, false, INSERT, index, type, id, doc, len);
 }
 
 bool elasticsearch_update(struct elasticsearch_connector *connector, const char *index, const char *type,
-		const char *id, json_t *data)
+		const char *id, const char *doc, size_t len)
 {
-	json_t *json_update;
-
 	assert(connector);
 	assert(index);
 	assert(type);
 	assert(id);
 
-	json_update = json_object();
-	if (!json_update || json_object_set(json_update, "doc", data)) {
-		error("memory error");
-		json_decref(data);
-		return false;
-	}
-
-	json_decref(data);
-
-	return elasticsearch_request(connector, false, UPDATE, index, type, id, json_update);
-}
-
-#if 0
-/* Elasticsearch synchroneous API not used any more */
-bool elasticsearch_insert_sync(struct elasticsearch_connector *connector, const char *index,
-		const char *type, const char *id, json_t *doc)
-{
-	int res;
-	size_t len;
-	char *url, *json_dump;
-
-	assert(connector);
-	assert(index);
-	assert(type);
-
-	/* Format uri: <server>/<index>/<type>/id */
-	len = strlen(connector->server_address) + strlen(index) + strlen(type) +
-			(id ? strlen(id) : 0) + 4;
-	url = malloc(len);
-	if (!url) {
-		error("memory error");
-		return false;
-	}
-
-	if (id) {
-		snprintf(url, len, "%s/%s/%s/%s", connector->server_address,
-				index, type, id);
-	}
-	else {
-		snprintf(url, len, "%s/%s/%s", connector->server_address,
-				index, type);
-	}
-
-	json_dump = json_dumps(doc, JSON_COMPACT);
-	if (!json_dump) {
-		error("cannot dump json object");
-		free(url);
-		return false;
-	}
-
-	res = elasticsearch_post(connector, url, json_dump, NULL);
-	free(url);
-	free(json_dump);
-	json_decref(doc);
-
-	if (check_error()) return false;
-
-	if (res < 200 || res >= 300) {
-		error("post error: result %d %s", res, url);
-		return false;
-	}
-
-	return true;
-}
-
-bool elasticsearch_update_sync(struct elasticsearch_connector *connector, const char *index, const char *type,
-		const char *id, json_t *doc)
-{
-	int res;
-	json_t *json_update;
-	size_t len;
-	char *url, *json_dump;
-
-	assert(connector);
-	assert(index);
-	assert(type);
-	assert(id);
-
-	return false;
-
-	/* Format uri: <server>/<index>/<type>/id/_update */
-	len = strlen(connector->server_address) + strlen(index) + strlen(type) + strlen(id) + 12;
-	url = malloc(len);
-	if (!url) {
-		error("memory error");
-		return false;
-	}
-
-	snprintf(url, len, "%s/%s/%s/%s/_update", connector->server_address,
-			index, type, id);
-
-	json_update = json_object();
-	if (!json_update || json_object_set(json_update, "doc", doc)) {
-		error("memory error");
-		free(url)
-		return false;
-	}
-
-	json_decref(doc);
-	doc = NULL;
-
-	json_dump = json_dumps(json_update, JSON_COMPACT);
-	if (!json_dump) {
-		error("cannot dump json object");
-		free(url);
-		return false;
-	}
-
-	res = elasticsearch_post(connector, url, json_dump, NULL);
-	free(url);
-	free(json_dump);
-	json_decref(doc);
-
-	if (check_error()) return false;
-
-	if (res < 200 || res >= 300) {
-		error("post error: result %d %s", res);
-		return false;
-	}
-
-	return true;
+	return elasticsearch_request(connector, false, UPDATE, index, type, id, doc, len);
 }
-#endif
@@ -8,8 +8,6 @@
 #include "haka/elasticsearch.h"
 
 #include <haka/time.h>
-
-#include <jansson.h>
 %}
 
 %include "haka/lua/swig.si"
@@ -24,29 +22,29 @@
 struct elasticsearch_connector {
 	%extend {
 		elasticsearch_connector(const char *address) {
-			return elasticsearch_connector_new(address);
+			return elasticsearch_connector_new(address, NULL);
 		}
 
 		~elasticsearch_connector() {
 			elasticsearch_connector_close($self);
 		}
 
-		void newindex(const char *index, json_t *data) {
-			if (!index || !data) { error("invalid parameter"); return; }
+		void newindex(const char *index, const char *JSON, size_t JSON_SIZE) {
+			if (!index) { error("invalid parameter"); return; }
 
-			elasticsearch_newindex($self, index, data);
+			elasticsearch_newindex($self, index, JSON, JSON_SIZE);
 		}
 
-		void insert(const char *index, const char *type, const char *id, json_t *data) {
-			if (!index || !type || !data) { error("invalid parameter"); return; }
+		void insert(const char *index, const char *type, const char *id, const char *JSON, size_t JSON_SIZE) {
+			if (!index || !type) { error("invalid parameter"); return; }
 
-			elasticsearch_insert($self, index, type, id, data);
+			elasticsearch_insert($self, index, type, id, JSON, JSON_SIZE);
 		}
 
-		void update(const char *index, const char *type, const char *id, json_t *data) {
-			if (!index || !type || !id || !data) { error("invalid parameter"); return; }
+		void update(const char *index, const char *type, const char *id, const char *JSON, size_t JSON_SIZE) {
+			if (!index || !type || !id) { error("invalid parameter"); return; }
 
-			elasticsearch_update($self, index, type, id, data);
+			elasticsearch_update($self, index, type, id, JSON, JSON_SIZE);
 		}
 
 		void timestamp(struct time *time, char **TEMP_OUTPUT)
@@ -15,16 +15,28 @@
 
 struct elasticsearch_connector;
 
-struct elasticsearch_connector *elasticsearch_connector_new(const char *server);
+struct elasticsearch_options {
+	size_t   max_bulk_size;   /* Maximum size in bytes of a bulk request, 0 for no limit */
+	size_t   max_bulk_count;  /* Maximum number of documents in a bulk request, 0 for no limit */
+	uint32   flush_interval;  /* Time in milliseconds to wait for more documents before a bulk request */
+	size_t   max_queue;       /* Maximum number of pending documents, 0 for no limit */
+	bool     compress;        /* Compress the requests with gzip */
+};
+
+extern const struct elasticsearch_options elasticsearch_default_options;
+
+struct elasticsearch_connector *elasticsearch_connector_new(const char *server,
+		const struct elasticsearch_options *options);
 bool                            elasticsearch_connector_close(struct elasticsearch_connector *connector);
+uint64                          elasticsearch_dropped(struct elasticsearch_connector *connector);
 void                            elasticsearch_genid(char *id, size_t size);
 bool                            elasticsearch_newindex(struct elasticsearch_connector *connector,
-		const char *index, json_t *data);
+		const char *index, const char *data, size_t len);
 bool                            elasticsearch_formattimestamp(const struct time *time,
         char *timestr, size_t size);
 bool                            elasticsearch_insert(struct elasticsearch_connector *connector,
-		const char *index, const char *type, const char *id, json_t *doc);
+		const char *index, const char *type, const char *id, const char *doc, size_t len);
 bool                            elasticsearch_update(struct elasticsearch_connector *connector,
-		const char *index, const char *type, const char *id, json_t *doc);
+		const char *index, const char *type, const char *id, const char *doc, size_t len);
 
 #endif /* _ELASTICSEARCH_H_ */
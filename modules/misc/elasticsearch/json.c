@@ -4,95 +4,391 @@
 
 #include "json.h"
 
-#include <jansson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <lua.h>
 
 #include <haka/error.h>
 #include <haka/lua/luautils.h>
 
 
-static json_t *lua_element_to_json(struct lua_State *L, int index)
+/*
+ * Output
+ */
+
+static bool reserve(struct json_writer *writer, size_t len)
+{
+	struct vector *out = writer->out;
+	const size_t count = vector_count(out);
+
+	if (writer->failed) return false;
+
+	/* Grow geometrically as most values are small */
+	if (count + len > out->allocated_count) {
+		size_t size = out->allocated_count * 2;
+		if (size < count + len) size = count + len;
+		if (size < 256) size = 256;
+
+		if (!vector_reserve(out, size)) {
+			writer->failed = true;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void json_append(struct json_writer *writer, const char *data, size_t len)
+{
+	struct vector *out = writer->out;
+	const size_t count = vector_count(out);
+
+	if (len == 0 || !reserve(writer, len)) return;
+
+	vector_resize(out, count + len);
+	memcpy(vector_get(out, char, count), data, len);
+}
+
+static void append_char(struct json_writer *writer, char c)
+{
+	json_append(writer, &c, 1);
+}
+
+static void fail(struct json_writer *writer, const char *message)
+{
+	if (!writer->failed) {
+		error("%s", message);
+		writer->failed = true;
+	}
+}
+
+
+/*
+ * Strings
+ */
+
+#define CHAR_COPY      0
+#define CHAR_ESCAPE    1  /* Control characters, quote and backslash */
+#define CHAR_UTF8      2  /* Start of a multi-byte sequence */
+
+static uint8 char_class[256];
+
+INIT static void _json_init()
+{
+	int c;
+
+	for (c = 0; c < 256; ++c) {
+		if (c < 0x20 || c == '"' || c == '\\') char_class[c] = CHAR_ESCAPE;
+		else if (c >= 0x80) char_class[c] = CHAR_UTF8;
+		else char_class[c] = CHAR_COPY;
+	}
+}
+
+/* Length of the valid UTF-8 sequence at str, 0 if invalid */
+static size_t utf8_length(const uint8 *str, const uint8 *end)
+{
+	size_t len, i;
+	uint32 c = str[0];
+
+	if (c >= 0xc2 && c <= 0xdf) len = 2;
+	else if (c >= 0xe0 && c <= 0xef) len = 3;
+	else if (c >= 0xf0 && c <= 0xf4) len = 4;
+	else return 0;
+
+	if (end - str < len) return 0;
+
+	for (i = 1; i < len; ++i) {
+		if ((str[i] & 0xc0) != 0x80) return 0;
+	}
+
+	/* Overlong forms, surrogates and code points above 0x10ffff */
+	if (c == 0xe0 && str[1] < 0xa0) return 0;
+	if (c == 0xed && str[1] > 0x9f) return 0;
+	if (c == 0xf0 && str[1] < 0x90) return 0;
+	if (c == 0xf4 && str[1] > 0x8f) return 0;
+
+	return len;
+}
+
+static void append_escape(struct json_writer *writer, uint8 c)
+{
+	static const char hex[] = "0123456789abcdef";
+	char buffer[6];
+
+	switch (c) {
+	case '"':  json_append(writer, "\\\"", 2); return;
+	case '\\': json_append(writer, "\\\\", 2); return;
+	case '\n': json_append(writer, "\\n", 2); return;
+	case '\r': json_append(writer, "\\r", 2); return;
+	case '\t': json_append(writer, "\\t", 2); return;
+	case '\b': json_append(writer, "\\b", 2); return;
+	case '\f': json_append(writer, "\\f", 2); return;
+	default:
+		/* Control characters and invalid UTF-8 bytes (taken as latin-1) */
+		buffer[0] = '\\';
+		buffer[1] = 'u';
+		buffer[2] = '0';
+		buffer[3] = '0';
+		buffer[4] = hex[c >> 4];
+		buffer[5] = hex[c & 0xf];
+		json_append(writer, buffer, 6);
+	}
+}
+
+void json_append_string(struct json_writer *writer, const char *str, size_t len)
+{
+	const uint8 *iter = (const uint8 *)str;
+	const uint8 *end = iter + len;
+	const uint8 *run = iter;
+
+	/* The string is at least as large as the input */
+	if (!reserve(writer, len + 2)) return;
+
+	append_char(writer, '"');
+
+	while (iter < end) {
+		const uint8 class = char_class[*iter];
+
+		if (class == CHAR_COPY) {
+			iter++;
+			continue;
+		}
+
+		if (class == CHAR_UTF8) {
+			const size_t seq = utf8_length(iter, end);
+			if (seq > 0) {
+				iter += seq;
+				continue;
+			}
+		}
+
+		json_append(writer, (const char *)run, iter - run);
+		append_escape(writer, *iter);
+		run = ++iter;
+	}
+
+	json_append(writer, (const char *)run, iter - run);
+	append_char(writer, '"');
+}
+
+
+/*
+ * Structure
+ */
+
+void json_writer_init(struct json_writer *writer, struct vector *out)
+{
+	writer->out = out;
+	writer->depth = 0;
+	writer->empty = 0;
+	writer->key = false;
+	writer->failed = false;
+}
+
+/* Insert the separator before a new element */
+static void separator(struct json_writer *writer)
+{
+	if (writer->key) {
+		writer->key = false;
+	}
+	else if (writer->depth > 0) {
+		const uint64 bit = 1ULL << (writer->depth-1);
+
+		if (writer->empty & bit) writer->empty &= ~bit;
+		else append_char(writer, ',');
+	}
+}
+
+static void begin(struct json_writer *writer, char c)
+{
+	separator(writer);
+
+	if (writer->depth == JSON_MAX_DEPTH) {
+		fail(writer, "json nesting too deep");
+		return;
+	}
+
+	writer->empty |= 1ULL << writer->depth;
+	writer->depth++;
+	append_char(writer, c);
+}
+
+static void end(struct json_writer *writer, char c)
+{
+	if (writer->depth == 0) {
+		fail(writer, "json invalid end of container");
+		return;
+	}
+
+	writer->depth--;
+	writer->empty &= ~(1ULL << writer->depth);
+	append_char(writer, c);
+}
+
+void json_begin_object(struct json_writer *writer) { begin(writer, '{'); }
+void json_end_object(struct json_writer *writer)   { end(writer, '}'); }
+void json_begin_array(struct json_writer *writer)  { begin(writer, '['); }
+void json_end_array(struct json_writer *writer)    { end(writer, ']'); }
+
+void json_write_lkey(struct json_writer *writer, const char *key, size_t len)
+{
+	separator(writer);
+	json_append_string(writer, key, len);
+	append_char(writer, ':');
+	writer->key = true;
+}
+
+void json_write_key(struct json_writer *writer, const char *key)
+{
+	json_write_lkey(writer, key, strlen(key));
+}
+
+void json_write_lstring(struct json_writer *writer, const char *str, size_t len)
+{
+	separator(writer);
+	json_append_string(writer, str, len);
+}
+
+void json_write_string(struct json_writer *writer, const char *str)
+{
+	if (str) json_write_lstring(writer, str, strlen(str));
+	else json_write_null(writer);
+}
+
+void json_write_number(struct json_writer *writer, double num)
+{
+	char buffer[32];
+	int len;
+
+	if (!isfinite(num)) {
+		fail(writer, "json invalid number");
+		return;
+	}
+
+	/* Shortest form that gives back the same number */
+	len = snprintf(buffer, sizeof(buffer), "%.15g", num);
+	if (strtod(buffer, NULL) != num) {
+		len = snprintf(buffer, sizeof(buffer), "%.17g", num);
+	}
+
+	/* Keep a real number */
+	if (!strpbrk(buffer, ".eE")) {
+		buffer[len++] = '.';
+		buffer[len++] = '0';
+	}
+
+	separator(writer);
+	json_append(writer, buffer, len);
+}
+
+void json_write_integer(struct json_writer *writer, int64 num)
+{
+	char buffer[24];
+	const int len = snprintf(buffer, sizeof(buffer), "%lld", (long long)num);
+
+	separator(writer);
+	json_append(writer, buffer, len);
+}
+
+void json_write_boolean(struct json_writer *writer, bool value)
+{
+	separator(writer);
+	if (value) json_append(writer, "true", 4);
+	else json_append(writer, "false", 5);
+}
+
+void json_write_null(struct json_writer *writer)
+{
+	separator(writer);
+	json_append(writer, "null", 4);
+}
+
+
+/*
+ * Lua values
+ */
+
+static void lua_element_to_json(struct lua_State *L, int index, struct json_writer *writer)
 {
-	json_t *ret = NULL;
 	const int val_type = lua_type(L, index);
 	const int h = lua_gettop(L);
 
-	lua_pushvalue(L, index);
-
 	switch (val_type) {
-	case LUA_TBOOLEAN: {
-		const int int_val = lua_toboolean(L, -1);
-		ret = int_val ? json_true() : json_false();
-		if (!ret) error("json boolean conversion error");
+	case LUA_TBOOLEAN:
+		json_write_boolean(writer, lua_toboolean(L, index));
+		break;
+
+	case LUA_TSTRING: {
+		size_t len;
+		const char *str_val = lua_tolstring(L, index, &len);
+		json_write_lstring(writer, str_val, len);
 		break;
 	}
-	case LUA_TSTRING:
 	case LUA_TUSERDATA: {
-		const char *str_val = lua_converttostring(L, -1, NULL);
+		size_t len;
+		const char *str_val = lua_converttostring(L, index, &len);
 		if (!str_val) {
-			error("cannot convert value to string");
+			fail(writer, "cannot convert value to string");
 			break;
 		}
 
-		ret = json_string(str_val);
-		if (!ret) error("json string conversion error");
+		json_write_lstring(writer, str_val, len);
 		break;
 	}
-	case LUA_TNUMBER: {
-		lua_Number num_val = lua_tonumber(L, -1);
-		ret = json_real(num_val);
-		if (!ret) error("json number conversion error");
+	case LUA_TNUMBER:
+		json_write_number(writer, lua_tonumber(L, index));
 		break;
-	}
+
 	case LUA_TTABLE: {
-		ret = json_object();
-		if (!ret) {
-			error("json table conversion error");
-			break;
-		}
+		json_begin_object(writer);
 
 		lua_pushnil(L);
-		while (lua_next(L, -2) != 0) {
+		while (!writer->failed && lua_next(L, index) != 0) {
 			size_t len;
-			const char *str_val = lua_tolstring(L, -2, &len);
-			json_t *val = lua_element_to_json(L, -1);
-			if (!val) {
-				json_decref(ret);
-				ret = NULL;
-				break;
-			}
+			const char *key;
 
-			if (json_object_set(ret, str_val, val) != 0) {
-				error("json table conversion error");
-				json_decref(val);
-				json_decref(ret);
-				ret = NULL;
+			/* Convert a copy of the key to keep the iteration valid */
+			lua_pushvalue(L, -2);
+			key = lua_tolstring(L, -1, &len);
+			if (!key) {
+				fail(writer, "json invalid table key");
 				break;
 			}
 
+			json_write_lkey(writer, key, len);
+			lua_pop(L, 1);
+
+			lua_element_to_json(L, lua_gettop(L), writer);
 			lua_pop(L, 1);
 		}
 
+		json_end_object(writer);
 		break;
 	}
-	case LUA_TFUNCTION: {
-		error("function cannot be converted to json");
+	case LUA_TFUNCTION:
+		fail(writer, "function cannot be converted to json");
 		break;
-	}
-	case LUA_TNIL: {
-		ret = json_null();
-		if (!ret) error("json nil conversion error");
+
+	case LUA_TNIL:
+		json_write_null(writer);
 		break;
-	}
+
 	default:
-		error("invalid value type (%s)", lua_typename(L, val_type));
+		if (!writer->failed) {
+			error("invalid value type (%s)", lua_typename(L, val_type));
+			writer->failed = true;
+		}
 	}
 
 	lua_settop(L, h);
-	return ret;
 }
 
-json_t *lua2json(struct lua_State *L, int index)
+bool lua2json(struct lua_State *L, int index, struct json_writer *writer)
 {
-	return lua_element_to_json(L, index);
+	if (index < 0) index = lua_gettop(L) + index + 1;
+
+	lua_element_to_json(L, index, writer);
+	return !writer->failed;
 }
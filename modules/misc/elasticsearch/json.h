@@ -2,10 +2,56 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
-#include <jansson.h>
+#ifndef _ELASTICSEARCH_JSON_H_
+#define _ELASTICSEARCH_JSON_H_
 
 #include <haka/types.h>
+#include <haka/compiler.h>
+#include <haka/container/vector.h>
 
 struct lua_State;
 
-json_t *lua2json(struct lua_State *L, int index);
+/*
+ * Streaming json writer
+ *
+ * The values are written in compact form at the end of a vector of char.
+ * The writer inserts the separators. On error, the writer stops and
+ * json_writer_failed() returns true.
+ */
+
+#define JSON_MAX_DEPTH    64
+
+struct json_writer {
+	struct vector  *out;
+	int             depth;
+	uint64          empty;   /* Bit set for containers without element */
+	bool            key;     /* A key was written, a value is expected */
+	bool            failed;
+};
+
+void json_writer_init(struct json_writer *writer, struct vector *out);
+INLINE bool json_writer_failed(const struct json_writer *writer) { return writer->failed; }
+
+void json_begin_object(struct json_writer *writer);
+void json_end_object(struct json_writer *writer);
+void json_begin_array(struct json_writer *writer);
+void json_end_array(struct json_writer *writer);
+void json_write_key(struct json_writer *writer, const char *key);
+void json_write_lkey(struct json_writer *writer, const char *key, size_t len);
+void json_write_string(struct json_writer *writer, const char *str);
+void json_write_lstring(struct json_writer *writer, const char *str, size_t len);
+void json_write_number(struct json_writer *writer, double num);
+void json_write_integer(struct json_writer *writer, int64 num);
+void json_write_boolean(struct json_writer *writer, bool value);
+void json_write_null(struct json_writer *writer);
+
+/* Append raw data to the output, no separator is added */
+void json_append(struct json_writer *writer, const char *data, size_t len);
+
+/* Append a string with its quotes, the special characters are escaped */
+void json_append_string(struct json_writer *writer, const char *str, size_t len);
+
+/* Write the lua value at the given index */
+bool lua2json(struct lua_State *L, int index, struct json_writer *writer);
+
+#endif /* _ELASTICSEARCH_JSON_H_ */
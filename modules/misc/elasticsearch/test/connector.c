@@ -0,0 +1,362 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <zlib.h>
+#include <check.h>
+#include <haka/config.h>
+#include <haka/thread.h>
+
+#include "../haka/elasticsearch.h"
+
+
+/*
+ * Local stand-in for the elasticsearch server. It records the requests
+ * and answers them with the next status code of its list.
+ */
+
+#define MAX_REQUESTS   16
+#define MAX_BODY       4096
+
+struct server_request {
+	char     url[64];
+	char     body[MAX_BODY];
+	size_t   size;
+	bool     gzip;
+};
+
+static int server_socket;
+static int server_port;
+static thread_t server_thread;
+static volatile bool server_exit;
+
+static mutex_t server_lock;
+static struct server_request server_requests[MAX_REQUESTS];
+static int server_count;
+static int server_connections;
+static int server_codes[MAX_REQUESTS];
+
+static bool server_read(int fd, char *buffer, size_t size, size_t *len)
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+
+	while (!server_exit) {
+		ssize_t ret;
+
+		if (poll(&pfd, 1, 100) <= 0) continue;
+
+		ret = read(fd, buffer + *len, size - *len);
+		if (ret <= 0) return false;
+
+		*len += ret;
+		return true;
+	}
+	return false;
+}
+
+static char *header_end(char *buffer, size_t len)
+{
+	size_t i;
+	for (i=0; i+4<=len; ++i) {
+		if (memcmp(buffer+i, "\r\n\r\n", 4) == 0) return buffer+i;
+	}
+	return NULL;
+}
+
+/* Handle the requests of a connection until the client closes it */
+static void server_connection(int fd)
+{
+	char buffer[2*MAX_BODY];
+	size_t len = 0;
+
+	while (true) {
+		struct server_request *req;
+		char *end, *header, reply[128];
+		size_t header_size, body_size = 0;
+		int code;
+
+		while (!(end = header_end(buffer, len))) {
+			if (!server_read(fd, buffer, sizeof(buffer), &len)) return;
+		}
+
+		header_size = end + 4 - buffer;
+		*end = '\0';
+
+		header = strstr(buffer, "\r\nContent-Length:");
+		if (header) body_size = strtoul(header + 17, NULL, 10);
+		ck_assert(header_size + body_size <= sizeof(buffer));
+
+		while (len < header_size + body_size) {
+			if (!server_read(fd, buffer, sizeof(buffer), &len)) return;
+		}
+
+		mutex_lock(&server_lock);
+		ck_assert(server_count < MAX_REQUESTS);
+		req = &server_requests[server_count];
+		sscanf(buffer, "POST %63s", req->url);
+		req->gzip = strstr(buffer, "\r\nContent-Encoding: gzip") != NULL;
+		req->size = body_size < MAX_BODY ? body_size : MAX_BODY;
+		memcpy(req->body, buffer + header_size, req->size);
+		code = server_codes[server_count] ? server_codes[server_count] : 200;
+		server_count++;
+		mutex_unlock(&server_lock);
+
+		snprintf(reply, sizeof(reply), "HTTP/1.1 %d Test\r\nContent-Length: 2\r\n\r\n{}", code);
+		if (write(fd, reply, strlen(reply)) < 0) return;
+
+		memmove(buffer, buffer + header_size + body_size, len - header_size - body_size);
+		len -= header_size + body_size;
+	}
+}
+
+static void *server_main(void *data)
+{
+	struct pollfd pfd = { server_socket, POLLIN, 0 };
+
+	while (!server_exit) {
+		int fd;
+
+		if (poll(&pfd, 1, 100) <= 0) continue;
+
+		fd = accept(server_socket, NULL, NULL);
+		if (fd < 0) continue;
+
+		mutex_lock(&server_lock);
+		server_connections++;
+		mutex_unlock(&server_lock);
+
+		server_connection(fd);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static void setup()
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+
+	ck_assert(mutex_init(&server_lock, false));
+	memset(server_requests, 0, sizeof(server_requests));
+	memset(server_codes, 0, sizeof(server_codes));
+	server_count = 0;
+	server_connections = 0;
+	server_exit = false;
+
+	server_socket = socket(AF_INET, SOCK_STREAM, 0);
+	ck_assert(server_socket >= 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	ck_assert(bind(server_socket, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	ck_assert(listen(server_socket, 4) == 0);
+	ck_assert(getsockname(server_socket, (struct sockaddr *)&addr, &addrlen) == 0);
+	server_port = ntohs(addr.sin_port);
+
+	ck_assert(thread_create(&server_thread, server_main, NULL));
+}
+
+static void teardown()
+{
+	server_exit = true;
+	thread_join(server_thread, NULL);
+	close(server_socket);
+	mutex_destroy(&server_lock);
+}
+
+static struct elasticsearch_connector *connector_new(const struct elasticsearch_options *options)
+{
+	char url[64];
+	struct elasticsearch_connector *connector;
+
+	snprintf(url, sizeof(url), "http://127.0.0.1:%d", server_port);
+	connector = elasticsearch_connector_new(url, options);
+	ck_assert(connector);
+	return connector;
+}
+
+static void insert(struct elasticsearch_connector *connector, const char *id, const char *doc)
+{
+	ck_assert(elasticsearch_insert(connector, "alerts", "alert", id, doc, strlen(doc)));
+}
+
+/* Wait for the connector to send some requests */
+static int wait_requests(int count)
+{
+	int i, ret = 0;
+
+	for (i=0; i<100; ++i) {
+		mutex_lock(&server_lock);
+		ret = server_count;
+		mutex_unlock(&server_lock);
+
+		if (ret >= count) break;
+		usleep(50000);
+	}
+
+	return ret;
+}
+
+static void check_body(int index, const char *expected)
+{
+	const struct server_request *req = &server_requests[index];
+
+	ck_assert_msg(strcmp(req->url, "/_bulk") == 0, "url '%s'", req->url);
+	ck_assert_msg(req->size == strlen(expected) &&
+		memcmp(req->body, expected, req->size) == 0,
+		"body '%.*s' expected '%s'", (int)req->size, req->body, expected);
+}
+
+#define ACTION(id) "{\"index\":{\"_index\":\"alerts\",\"_type\":\"alert\",\"_id\":\"" id "\"}}\n"
+
+START_TEST(test_bulk_body)
+{
+	struct elasticsearch_options options = elasticsearch_default_options;
+	struct elasticsearch_connector *connector;
+
+	/* The documents are queued before the first bulk is sent */
+	options.flush_interval = 200;
+	connector = connector_new(&options);
+
+	insert(connector, "1", "{\"a\":1}");
+	insert(connector, "2", "{\"b\":\"x\"}");
+
+	ck_assert_int_eq(wait_requests(1), 1);
+	check_body(0, ACTION("1") "{\"a\":1}\n" ACTION("2") "{\"b\":\"x\"}\n");
+	ck_assert(!server_requests[0].gzip);
+
+	ck_assert(elasticsearch_connector_close(connector));
+	ck_assert_int_eq(server_count, 1);
+}
+END_TEST
+
+START_TEST(test_bulk_split)
+{
+	struct elasticsearch_options options = elasticsearch_default_options;
+	struct elasticsearch_connector *connector;
+
+	options.flush_interval = 200;
+	options.max_bulk_count = 2;
+	connector = connector_new(&options);
+
+	insert(connector, "1", "{}");
+	insert(connector, "2", "{}");
+	insert(connector, "3", "{}");
+
+	/* The bulks share the same connection */
+	ck_assert_int_eq(wait_requests(2), 2);
+	check_body(0, ACTION("1") "{}\n" ACTION("2") "{}\n");
+	check_body(1, ACTION("3") "{}\n");
+	ck_assert_int_eq(server_connections, 1);
+
+	ck_assert(elasticsearch_connector_close(connector));
+}
+END_TEST
+
+START_TEST(test_bulk_gzip)
+{
+	struct elasticsearch_options options = elasticsearch_default_options;
+	struct elasticsearch_connector *connector;
+	const char *expected = ACTION("1") "{\"a\":1}\n";
+	char body[MAX_BODY];
+	uLongf size = sizeof(body);
+	z_stream stream;
+
+	options.compress = true;
+	connector = connector_new(&options);
+
+	insert(connector, "1", "{\"a\":1}");
+
+	ck_assert_int_eq(wait_requests(1), 1);
+	ck_assert(server_requests[0].gzip);
+
+	memset(&stream, 0, sizeof(stream));
+	ck_assert(inflateInit2(&stream, 15 + 16) == Z_OK);
+	stream.next_in = (Bytef *)server_requests[0].body;
+	stream.avail_in = server_requests[0].size;
+	stream.next_out = (Bytef *)body;
+	stream.avail_out = size;
+	ck_assert(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+	size = stream.total_out;
+	inflateEnd(&stream);
+
+	ck_assert(size == strlen(expected) && memcmp(body, expected, size) == 0);
+
+	ck_assert(elasticsearch_connector_close(connector));
+}
+END_TEST
+
+START_TEST(test_retry)
+{
+	struct elasticsearch_connector *connector;
+
+	/* The server is overloaded then throttles the requests */
+	server_codes[0] = 503;
+	server_codes[1] = 429;
+	connector = connector_new(NULL);
+
+	insert(connector, "1", "{}");
+
+	ck_assert_int_eq(wait_requests(3), 3);
+	check_body(0, ACTION("1") "{}\n");
+	check_body(1, ACTION("1") "{}\n");
+	check_body(2, ACTION("1") "{}\n");
+
+	ck_assert(elasticsearch_connector_close(connector));
+	ck_assert_int_eq(server_count, 3);
+}
+END_TEST
+
+START_TEST(test_no_retry_on_client_error)
+{
+	struct elasticsearch_connector *connector;
+
+	server_codes[0] = 400;
+	connector = connector_new(NULL);
+
+	insert(connector, "1", "{}");
+	ck_assert_int_eq(wait_requests(1), 1);
+
+	/* A rejected bulk is not sent again */
+	usleep(300000);
+	ck_assert(elasticsearch_connector_close(connector));
+	ck_assert_int_eq(server_count, 1);
+}
+END_TEST
+
+int main(int argc, char *argv[])
+{
+	int number_failed;
+
+	Suite *suite = suite_create("elasticsearch_connector");
+	TCase *tcase = tcase_create("case");
+	tcase_set_timeout(tcase, 20);
+	tcase_add_checked_fixture(tcase, setup, teardown);
+	tcase_add_test(tcase, test_bulk_body);
+	tcase_add_test(tcase, test_bulk_split);
+	tcase_add_test(tcase, test_bulk_gzip);
+	tcase_add_test(tcase, test_retry);
+	tcase_add_test(tcase, test_no_retry_on_client_error);
+	suite_add_tcase(suite, tcase);
+
+	SRunner *runner = srunner_create(suite);
+#ifdef HAKA_DEBUG
+	srunner_set_fork_status(runner, CK_NOFORK);
+#endif
+	srunner_run_all(runner, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(runner);
+	srunner_free(runner);
+
+	return number_failed;
+}
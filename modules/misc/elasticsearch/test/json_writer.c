@@ -0,0 +1,175 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <string.h>
+#include <check.h>
+#include <haka/config.h>
+#include <haka/container/vector.h>
+
+#include "../json.h"
+
+
+static struct vector out;
+static struct json_writer writer;
+
+static void setup()
+{
+	ck_assert(vector_create(&out, char, NULL));
+	json_writer_init(&writer, &out);
+}
+
+static void teardown()
+{
+	vector_destroy(&out);
+}
+
+static void check_output(const char *expected)
+{
+	const size_t len = strlen(expected);
+
+	ck_assert(!json_writer_failed(&writer));
+	ck_assert_msg(vector_count(&out) == len &&
+		memcmp(vector_first(&out, char), expected, len) == 0,
+		"json '%.*s' expected '%s'", (int)vector_count(&out),
+		vector_first(&out, char), expected);
+}
+
+static void check_string(const char *str, size_t len, const char *expected)
+{
+	vector_resize(&out, 0);
+	json_write_lstring(&writer, str, len);
+	check_output(expected);
+}
+
+START_TEST(test_string_escape)
+{
+	check_string("abc", 3, "\"abc\"");
+	check_string("", 0, "\"\"");
+	check_string("a\"b\\c", 5, "\"a\\\"b\\\\c\"");
+	check_string("\n\r\t\b\f", 5, "\"\\n\\r\\t\\b\\f\"");
+	check_string("\x01\x1f\x7f", 3, "\"\\u0001\\u001f\x7f\"");
+	check_string("a\0b", 3, "\"a\\u0000b\"");
+	check_string("</script>", 9, "\"</script>\"");
+}
+END_TEST
+
+START_TEST(test_string_utf8)
+{
+	/* Valid sequences are copied */
+	check_string("\xc3\xa9t\xc3\xa9", 5, "\"\xc3\xa9t\xc3\xa9\"");
+	check_string("\xe2\x82\xac", 3, "\"\xe2\x82\xac\"");
+	check_string("\xf0\x9f\x98\x80", 4, "\"\xf0\x9f\x98\x80\"");
+
+	/* Invalid bytes are taken as latin-1 */
+	check_string("\xe9t\xe9", 3, "\"\\u00e9t\\u00e9\"");
+	check_string("\xc3", 1, "\"\\u00c3\"");
+	check_string("\xc3(", 2, "\"\\u00c3(\"");
+	check_string("\xc0\xaf", 2, "\"\\u00c0\\u00af\"");
+	check_string("\xe0\x80\xaf", 3, "\"\\u00e0\\u0080\\u00af\"");
+	check_string("\xed\xa0\x80", 3, "\"\\u00ed\\u00a0\\u0080\"");
+	check_string("\xf4\x90\x80\x80", 4, "\"\\u00f4\\u0090\\u0080\\u0080\"");
+	check_string("\xe2\x82", 2, "\"\\u00e2\\u0082\"");
+}
+END_TEST
+
+static void check_number(double num, const char *expected)
+{
+	vector_resize(&out, 0);
+	json_write_number(&writer, num);
+	check_output(expected);
+}
+
+START_TEST(test_number)
+{
+	check_number(0, "0.0");
+	check_number(42, "42.0");
+	check_number(-3.5, "-3.5");
+	check_number(0.1, "0.1");
+	check_number(1e300, "1e+300");
+	check_number(1.0/3, "0.33333333333333331");
+
+	vector_resize(&out, 0);
+	json_write_integer(&writer, -9007199254740993LL);
+	check_output("-9007199254740993");
+}
+END_TEST
+
+START_TEST(test_number_invalid)
+{
+	json_write_number(&writer, 1.0/0.0);
+	ck_assert(json_writer_failed(&writer));
+}
+END_TEST
+
+START_TEST(test_nesting)
+{
+	json_begin_object(&writer);
+	json_write_key(&writer, "a");
+	json_write_integer(&writer, 1);
+	json_write_key(&writer, "b");
+	json_begin_array(&writer);
+	json_write_boolean(&writer, true);
+	json_begin_object(&writer);
+	json_end_object(&writer);
+	json_begin_array(&writer);
+	json_end_array(&writer);
+	json_write_null(&writer);
+	json_end_array(&writer);
+	json_write_key(&writer, "c\n");
+	json_write_string(&writer, NULL);
+	json_end_object(&writer);
+
+	check_output("{\"a\":1,\"b\":[true,{},[],null],\"c\\n\":null}");
+}
+END_TEST
+
+START_TEST(test_nesting_depth)
+{
+	int i;
+
+	for (i=0; i<JSON_MAX_DEPTH; ++i) {
+		json_begin_array(&writer);
+	}
+	ck_assert(!json_writer_failed(&writer));
+
+	json_begin_array(&writer);
+	ck_assert(json_writer_failed(&writer));
+}
+END_TEST
+
+START_TEST(test_nesting_invalid_end)
+{
+	json_begin_array(&writer);
+	json_end_array(&writer);
+	json_end_array(&writer);
+	ck_assert(json_writer_failed(&writer));
+}
+END_TEST
+
+int main(int argc, char *argv[])
+{
+	int number_failed;
+
+	Suite *suite = suite_create("json_writer");
+	TCase *tcase = tcase_create("case");
+	tcase_add_checked_fixture(tcase, setup, teardown);
+	tcase_add_test(tcase, test_string_escape);
+	tcase_add_test(tcase, test_string_utf8);
+	tcase_add_test(tcase, test_number);
+	tcase_add_test(tcase, test_number_invalid);
+	tcase_add_test(tcase, test_nesting);
+	tcase_add_test(tcase, test_nesting_depth);
+	tcase_add_test(tcase, test_nesting_invalid_end);
+	suite_add_tcase(suite, tcase);
+
+	SRunner *runner = srunner_create(suite);
+#ifdef HAKA_DEBUG
+	srunner_set_fork_status(runner, CK_NOFORK);
+#endif
+	srunner_run_all(runner, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(runner);
+	srunner_free(runner);
+
+	return number_failed;
+}
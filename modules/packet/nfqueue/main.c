@@ -647,7 +647,7 @@ static int packet_do_receive(struct packet_module_state *state, struct packet **
 	FD_SET(interrupt_fd, &read_set);
 	if (interrupt_fd > max_fd) max_fd = interrupt_fd;
 
-	rv = select(max_fd+1, &read_set, NULL, NULL, NULL);
+	rv = engine_thread_select(max_fd+1, &read_set);
 	if (rv <= 0) {
 		if (rv == -1 && errno != EINTR) {
 			LOG_ERROR(nfqueue, "packet reception failed, %s", errno_error(errno));
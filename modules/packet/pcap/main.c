@@ -365,7 +365,7 @@ static int packet_do_receive(struct packet_module_state *state, struct packet **
 		FD_SET(engine_thread_interrupt_fd(), &read_set);
 		if (engine_thread_interrupt_fd() > max_fd) max_fd = engine_thread_interrupt_fd();
 
-		ret = select(max_fd+1, &read_set, NULL, NULL, NULL);
+		ret = engine_thread_select(max_fd+1, &read_set);
 		if (ret < 0) {
 			if (errno == EINTR) {
 				return 0;
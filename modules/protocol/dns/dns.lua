@@ -259,8 +259,8 @@ function module.dissect(flow)
 	dns_dissector:dissect(flow)
 end
 
-function module.install_udp_rule(port)
-	dns_dissector:install_udp_rule(port)
+function module.install_udp_rule(port, direction)
+	dns_dissector:install_udp_rule(port, direction)
 end
 
 --
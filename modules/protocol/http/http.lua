@@ -3,8 +3,10 @@
 -- file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 local class = require('class')
+local rem = require(haka.regexp_module())
 
 local tcp_connection = require("protocol/tcp_connection")
+local http_parser = require("protocol/http_parser")
 
 local module = {}
 
@@ -27,6 +29,28 @@ http_dissector:register_streamed_event('request_data')
 http_dissector:register_streamed_event('response_data')
 http_dissector:register_streamed_event('receive_data')
 
+http_dissector:register_match_key('srcport', function (http) return http.flow and http.flow.srcport end)
+http_dissector:register_match_key('dstport', function (http) return http.flow and http.flow.dstport end)
+http_dissector:register_match_key('method', function (http, request) return request.method end,
+	nil, { 'request' })
+http_dissector:register_match_key('uri', function (http, request) return request.uri end,
+	nil, { 'request' })
+-- Host name without case and without port ("Example.com:8080" gives
+-- "example.com"), the brackets of an IPv6 address are kept
+local function host_name(host)
+	host = host:lower()
+	return host:match("^(.-):%d*$") or host
+end
+
+http_dissector:register_match_key('host',
+	function (http, request)
+		local host = request.headers['Host']
+		return host and host_name(host)
+	end,
+	host_name, { 'request' })
+http_dissector:register_match_key('status', function (http, response) return response.status end,
+	tostring, { 'response' })
+
 function http_dissector.method:__init(flow)
 	class.super(http_dissector).__init(self, flow)
 	self._want_data_modification = false
@@ -36,7 +60,19 @@ function http_dissector.method:enable_data_modification()
 	self._want_data_modification = true
 end
 
+local state_data_event = {
+	request = 'request_data',
+	response = 'response_data'
+}
+
 function http_dissector.method:push_data(current, data, iter, last, state, chunk)
+	-- Skip the data stream when nobody uses it
+	if not current.data and not self._enable_data_modification and
+	   not self:haslisteners('receive_data') and
+	   not self:haslisteners(state_data_event[state]) then
+		return
+	end
+
 	if not current.data then
 		current.data = haka.vbuffer_sub_stream()
 	end
@@ -55,7 +91,7 @@ function http_dissector.method:push_data(current, data, iter, last, state, chunk
 			self:trigger('receive_data', current.data, currentiter, 'down')
 		end
 
-		self:trigger(state..'_data', current.data, currentiter)
+		self:trigger(state_data_event[state], current.data, currentiter)
 	end
 
 	local sub
@@ -104,8 +140,8 @@ function module.dissect(flow)
 	http_dissector:dissect(flow)
 end
 
-function module.install_tcp_rule(port)
-	http_dissector:install_tcp_rule(port)
+function module.install_tcp_rule(port, direction)
+	http_dissector:install_tcp_rule(port, direction)
 end
 
 
@@ -116,22 +152,44 @@ end
 local HeaderResult = class.class("HeaderResult", haka.grammar.result.ArrayResult)
 
 function HeaderResult.method:__init()
-	rawset(self, '_cache', {})
+	rawset(self, '_lower', {})
 end
 
-function HeaderResult.method:__index(key)
-	local key = key:lower()
+-- Headers indexed by lower case name. The index is built by the native
+-- parser, or on first use when the headers come from the grammar.
+local function header_index(self)
+	local index = rawget(self, '_index')
+	if not index then
+		index = {}
+		for _, header in ipairs(self) do
+			local name = header.name
+			if name then
+				name = name:lower()
+				if not index[name] then
+					index[name] = header
+				end
+			end
+		end
+		rawset(self, '_index', index)
+	end
+	return index
+end
 
-	local cache = self._cache[key]
-	if cache and cache.name == key then
-		return cache.value
+-- Lower case version of the keys used by the rules
+local function lower_key(self, key)
+	local lower = rawget(self, '_lower')
+	local lowerkey = lower[key]
+	if not lowerkey then
+		lowerkey = key:lower()
+		lower[key] = lowerkey
 	end
+	return lowerkey
+end
 
-	for i, header in ipairs(self) do
-		if header.name and header.name:lower() == key then
-			self._cache[key] = header
-			return header.value
-		end
+function HeaderResult.method:__index(key)
+	local header = header_index(self)[lower_key(self, key)]
+	if header then
+		return header.value
 	end
 end
 
@@ -152,21 +210,19 @@ end
 function HeaderResult.method:__newindex(key, value)
 	local lowerkey = key
 	if type(lowerkey) == 'string' then
-		lowerkey = lowerkey:lower()
+		lowerkey = lower_key(self, key)
 	end
 
 	-- Try to update existing header
-	for i, header in ipairs(self) do
-		if header.name and header.name:lower() == lowerkey then
-			if value then
-				header.value = value
-			else
-				self:remove(i)
-				self._cache[lowerkey] = nil
-			end
-
-			return
+	local header = header_index(self)[lowerkey]
+	if header then
+		if value then
+			header.value = value
+		else
+			self:remove(header)
 		end
+
+		return
 	end
 
 	-- Finally insert new header
@@ -175,6 +231,16 @@ function HeaderResult.method:__newindex(key, value)
 	end
 end
 
+function HeaderResult.method:remove(el)
+	rawset(self, '_index', nil)
+	class.super(HeaderResult).remove(self, el)
+end
+
+function HeaderResult.method:append(init)
+	rawset(self, '_index', nil)
+	class.super(HeaderResult).append(self, init)
+end
+
 
 local HttpRequestResult = class.class("HttpRequestResult", haka.grammar.Result)
 
@@ -205,6 +271,174 @@ HttpResponseResult.property.split_cookies = {
 }
 
 
+--
+-- HTTP tokens
+--
+
+local patterns = {
+	method = '[^()<>@,;:%\\"/%[%]?={}[:blank:]]+',
+	uri = '[[:alnum:][:punct:]]+',
+	version = '[0-9]+%.[0-9]+',
+	status = '[0-9]{3}',
+	reason = '[^%r%n]+',
+	header_name = '[^:[:blank:]]+',
+	header_value = '[^%r%n]+',
+}
+
+local function update_body_mode(ctx, lower_name, value)
+	if lower_name == 'content-length' then
+		ctx.content_length = tonumber(value)
+		ctx.mode = 'content'
+	elseif lower_name == 'transfer-encoding' and
+	       value:lower() == 'chunked' then
+		ctx.mode = 'chunked'
+	end
+end
+
+local function create_header(entity, init)
+	local vbuf = haka.vbuffer_from(init.name..': '..init.value..'\r\n')
+	return vbuf, entity:create(vbuf:pos('begin'), init)
+end
+
+
+--
+-- Native start line and headers parsing
+--
+
+local compiled_patterns = {}
+
+local function check_token(pattern, value)
+	local re = compiled_patterns[pattern]
+	if not re then
+		re = rem.re:compile("^(?:"..patterns[pattern]..")")
+		compiled_patterns[pattern] = re
+	end
+
+	if not re:match(value) then
+		error(string.format("token value '%s' does not verify /%s/", value, patterns[pattern]))
+	end
+end
+
+-- The native parser returns each token as a sub-buffer followed by its
+-- value, the setters check the new value and write it back in the buffer
+local function set_token(token, index, pattern, value)
+	check_token(pattern, value)
+	token[index] = value
+	token[index-1]:setstring(value)
+end
+
+local function native_field(cls, name, index)
+	cls.property[name] = {
+		get = function (self)
+			local fields = rawget(self, '_fields')
+			if fields then return fields[index][2] end
+		end,
+		set = function (self, value)
+			local fields = rawget(self, '_fields')
+			if fields then
+				set_token(fields[index], 2, name, value)
+			else
+				rawset(self, name, value)
+			end
+		end
+	}
+end
+
+native_field(HttpRequestResult, 'method', 1)
+native_field(HttpRequestResult, 'uri', 2)
+native_field(HttpRequestResult, 'version', 3)
+native_field(HttpResponseResult, 'version', 1)
+native_field(HttpResponseResult, 'status', 2)
+native_field(HttpResponseResult, 'reason', 3)
+
+-- Header read by the native parser, the table returned by the parser is
+-- kept as is: { line, name_sub, name, value_sub, value, lower_name }
+local NativeHeader = class.class("NativeHeader", haka.grammar.result.Result)
+
+function NativeHeader.method:__init(headers, native)
+	rawset(self, '_headers', headers)
+	rawset(self, '_native', native)
+	rawset(self, '_sub', native[1])
+end
+
+NativeHeader.property.name = {
+	get = function (self) return rawget(self, '_native')[3] end,
+	set = function (self, value)
+		set_token(rawget(self, '_native'), 3, 'header_name', value)
+		rawset(rawget(self, '_headers'), '_index', nil)
+	end
+}
+
+NativeHeader.property.value = {
+	get = function (self) return rawget(self, '_native')[5] end,
+	set = function (self, value)
+		set_token(rawget(self, '_native'), 5, 'header_value', value)
+	end
+}
+
+-- Parse the start line and the headers in one pass. Returns false when the
+-- native parser cannot handle the message, the grammar is then used and
+-- reports the error if the message is invalid.
+local function native_parse(res, ctx, request)
+	local iter = ctx.iter
+	local begin = iter:copy()
+	local mark = begin:copy()
+	mark:mark(haka.packet_mode() == 'passthrough')
+
+	-- The first data are parsed at once to reject invalid messages early.
+	-- The next ones are only scanned for the end of the headers and the
+	-- message is parsed again when it is complete.
+	local fields, headers_begin, headers, last
+	local first, found, state, size = true, false, 0, 0
+	local chunk = iter:sub('available')
+	while chunk do
+		size = size + #chunk
+		found, state = http_parser.scan_end(chunk, state)
+
+		if found or first then
+			fields, headers_begin, headers, last = http_parser.parse(haka.vbuffer_sub(begin, iter), request)
+			-- On failure, the second value tells if more data are needed
+			if fields or not headers_begin then break end
+		end
+
+		if size > http_parser.MAX_SIZE then break end
+
+		first = false
+		chunk = iter:sub('available')
+	end
+
+	mark:unmark()
+
+	if not fields then
+		ctx:update(begin)
+		return false
+	end
+
+	ctx:update(last)
+	rawset(res, '_fields', fields)
+
+	local result = HeaderResult:new()
+	local index = {}
+	result:_init(headers_begin, http_dissector.grammar.header, create_header)
+
+	for _, h in ipairs(headers) do
+		local header = NativeHeader:new(result, h)
+		local lower_name = h[6]
+
+		table.insert(result, header)
+		if not index[lower_name] then
+			index[lower_name] = header
+		end
+
+		update_body_mode(ctx, lower_name, h[5])
+	end
+
+	rawset(result, '_index', index)
+	res.headers = result
+	return true
+end
+
+
 --
 -- HTTP Grammar
 --
@@ -218,19 +452,19 @@ http_dissector.grammar = haka.grammar.new("http", function ()
 	-- http request/response version
 	version = record{
 		token('HTTP/'),
-		field('version', token('[0-9]+%.[0-9]+'))
+		field('version', token(patterns.version))
 	}
 
 	-- http response status code
 	status = record{
-		field('status', token('[0-9]{3}'))
+		field('status', token(patterns.status))
 	}
 
 	-- http request line
 	request_line = record{
-		field('method', token('[^()<>@,;:%\\"/%[%]?={}[:blank:]]+')),
+		field('method', token(patterns.method)),
 		WS,
-		field('uri', token('[[:alnum:][:punct:]]+')),
+		field('uri', token(patterns.uri)),
 		WS,
 		version,
 		CRLF
@@ -242,26 +476,19 @@ http_dissector.grammar = haka.grammar.new("http", function ()
 		WS,
 		status,
 		WS,
-		field('reason', token('[^%r%n]+')),
+		field('reason', token(patterns.reason)),
 		CRLF
 	}
 
 	-- headers list
 	header = record{
-		field('name', token('[^:[:blank:]]+')),
+		field('name', token(patterns.header_name)),
 		token(':'),
 		WS,
-		field('value', token('[^%r%n]+')),
+		field('value', token(patterns.header_value)),
 		CRLF
 	}:apply(function (self, res, ctx)
-		local lower_name =  self.name:lower()
-		if lower_name == 'content-length' then
-			ctx.content_length = tonumber(self.value)
-			ctx.mode = 'content'
-		elseif lower_name == 'transfer-encoding' and
-		       self.value:lower() == 'chunked' then
-			ctx.mode = 'chunked'
-		end
+		update_body_mode(ctx, self.name:lower(), self.value)
 	end)
 
 	headers = record{
@@ -271,10 +498,7 @@ http_dissector.grammar = haka.grammar.new("http", function ()
 				return la == 0xa or la == 0xd
 			end)
 			:result(HeaderResult)
-			:creation(function (entity, init)
-				local vbuf = haka.vbuffer_from(init.name..': '..init.value..'\r\n')
-				return vbuf, entity:create(vbuf:pos('begin'), init)
-			end)
+			:creation(create_header)
 		),
 		CRLF
 	}
@@ -334,10 +558,21 @@ http_dissector.grammar = haka.grammar.new("http", function ()
 		function (self, ctx) return ctx.mode end
 	)
 
-	-- http request
+	-- http request, the grammar is only used when the native parser
+	-- cannot handle the message
 	request_headers = record{
-		request_line,
-		headers,
+		execute(function (self, ctx)
+			ctx.native_headers = native_parse(self, ctx, true)
+		end),
+		branch(
+			{
+				grammar = record{
+					request_line,
+					headers
+				}
+			},
+			function (self, ctx) if not ctx.native_headers then return 'grammar' end end
+		),
 		execute(function (self, ctx)
 			ctx.user:trigger_event(ctx:result(1), ctx.iter, ctx.retain_mark)
 		end)
@@ -350,8 +585,18 @@ http_dissector.grammar = haka.grammar.new("http", function ()
 
 	-- http response
 	response_headers = record{
-		response_line,
-		headers,
+		execute(function (self, ctx)
+			ctx.native_headers = native_parse(self, ctx, false)
+		end),
+		branch(
+			{
+				grammar = record{
+					response_line,
+					headers
+				}
+			},
+			function (self, ctx) if not ctx.native_headers then return 'grammar' end end
+		),
 		execute(function (self, ctx)
 			ctx.user:trigger_event(ctx:result(1), ctx.iter, ctx.retain_mark)
 		end)
@@ -362,7 +607,7 @@ http_dissector.grammar = haka.grammar.new("http", function ()
 		body
 	}:result(HttpResponseResult)
 
-	export(request, response)
+	export(request, response, header)
 end)
 
 
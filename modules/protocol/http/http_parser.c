@@ -0,0 +1,319 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <haka/compiler.h>
+#include <haka/error.h>
+
+#include "http_parser.h"
+
+
+/*
+ * Character classes of the http grammar tokens
+ */
+
+#define CHAR_BLANK    (1 << 0)  /* [[:blank:]] */
+#define CHAR_METHOD   (1 << 1)  /* [^()<>@,;:\"/[]?={}[:blank:]] */
+#define CHAR_URI      (1 << 2)  /* [[:alnum:][:punct:]] */
+#define CHAR_DIGIT    (1 << 3)  /* [0-9] */
+#define CHAR_NAME     (1 << 4)  /* [^:[:blank:]] */
+#define CHAR_TEXT     (1 << 5)  /* [^\r\n] */
+
+static uint8 char_class[256];
+
+INIT static void _http_parser_init()
+{
+	static const char separators[] = "()<>@,;:\\\"/[]?={} \t";
+	int c;
+
+	for (c = 0; c < 256; ++c) {
+		uint8 flags = 0;
+
+		if (c == ' ' || c == '\t') flags |= CHAR_BLANK;
+		else if (c != ':') flags |= CHAR_NAME;
+
+		if (c == 0 || !memchr(separators, c, sizeof(separators)-1)) flags |= CHAR_METHOD;
+		if (c > 0x20 && c < 0x7f) flags |= CHAR_URI;
+		if (c >= '0' && c <= '9') flags |= CHAR_DIGIT;
+		if (c != '\r' && c != '\n') flags |= CHAR_TEXT;
+
+		char_class[c] = flags;
+	}
+}
+
+#define IS(c, class)   ((char_class[(uint8)(c)] & (class)) != 0)
+
+
+/*
+ * Tokens
+ *
+ * Each token is matched greedily like the regular expressions of the
+ * grammar. A token reaching the end of the data is partial as it could
+ * continue in the next data.
+ */
+
+static int parse_class(const char **p, const char *end, uint8 class,
+		struct http_parser_span *span, const char *data)
+{
+	const char *iter = *p;
+
+	while (iter < end && IS(*iter, class)) iter++;
+
+	if (iter == end) return HTTP_PARSE_PARTIAL;
+	if (iter == *p) return HTTP_PARSE_ERROR;
+
+	if (span) {
+		span->offset = *p - data;
+		span->length = iter - *p;
+	}
+
+	*p = iter;
+	return HTTP_PARSE_OK;
+}
+
+static int parse_literal(const char **p, const char *end, const char *literal, size_t len)
+{
+	const size_t avail = end - *p;
+
+	if (avail < len) {
+		return memcmp(*p, literal, avail) == 0 ? HTTP_PARSE_PARTIAL : HTTP_PARSE_ERROR;
+	}
+
+	if (memcmp(*p, literal, len) != 0) return HTTP_PARSE_ERROR;
+
+	*p += len;
+	return HTTP_PARSE_OK;
+}
+
+static int parse_crlf(const char **p, const char *end)
+{
+	const char *iter = *p;
+
+	if (iter < end && *iter == '\r') iter++;
+	if (iter == end) return HTTP_PARSE_PARTIAL;
+	if (*iter != '\n') return HTTP_PARSE_ERROR;
+
+	*p = iter + 1;
+	return HTTP_PARSE_OK;
+}
+
+static int parse_version(const char **p, const char *end, struct http_parser_span *span,
+		const char *data)
+{
+	const char *begin;
+	int ret;
+
+	if ((ret = parse_literal(p, end, "HTTP/", 5)) != HTTP_PARSE_OK) return ret;
+
+	begin = *p;
+	if ((ret = parse_class(p, end, CHAR_DIGIT, NULL, data)) != HTTP_PARSE_OK) return ret;
+	if ((ret = parse_literal(p, end, ".", 1)) != HTTP_PARSE_OK) return ret;
+	if ((ret = parse_class(p, end, CHAR_DIGIT, NULL, data)) != HTTP_PARSE_OK) return ret;
+
+	span->offset = begin - data;
+	span->length = *p - begin;
+	return HTTP_PARSE_OK;
+}
+
+static int parse_status(const char **p, const char *end, struct http_parser_span *span,
+		const char *data)
+{
+	int i;
+
+	for (i = 0; i < 3; ++i) {
+		if (*p + i == end) return HTTP_PARSE_PARTIAL;
+		if (!IS((*p)[i], CHAR_DIGIT)) return HTTP_PARSE_ERROR;
+	}
+
+	span->offset = *p - data;
+	span->length = 3;
+	*p += 3;
+	return HTTP_PARSE_OK;
+}
+
+#define CHECK(x) if ((ret = (x)) != HTTP_PARSE_OK) return ret
+
+static int parse_request_line(const char **p, const char *end, struct http_parser_result *result,
+		const char *data)
+{
+	int ret;
+
+	CHECK(parse_class(p, end, CHAR_METHOD, &result->fields[0], data));
+	CHECK(parse_class(p, end, CHAR_BLANK, NULL, data));
+	CHECK(parse_class(p, end, CHAR_URI, &result->fields[1], data));
+	CHECK(parse_class(p, end, CHAR_BLANK, NULL, data));
+	CHECK(parse_version(p, end, &result->fields[2], data));
+	return parse_crlf(p, end);
+}
+
+static int parse_response_line(const char **p, const char *end, struct http_parser_result *result,
+		const char *data)
+{
+	int ret;
+
+	CHECK(parse_version(p, end, &result->fields[0], data));
+	CHECK(parse_class(p, end, CHAR_BLANK, NULL, data));
+	CHECK(parse_status(p, end, &result->fields[1], data));
+	CHECK(parse_class(p, end, CHAR_BLANK, NULL, data));
+	CHECK(parse_class(p, end, CHAR_TEXT, &result->fields[2], data));
+	return parse_crlf(p, end);
+}
+
+static int parse_header(const char **p, const char *end, struct http_parser_header *header,
+		const char *data)
+{
+	const char *begin = *p;
+	int ret;
+
+	CHECK(parse_class(p, end, CHAR_NAME, &header->name, data));
+	CHECK(parse_literal(p, end, ":", 1));
+	CHECK(parse_class(p, end, CHAR_BLANK, NULL, data));
+	CHECK(parse_class(p, end, CHAR_TEXT, &header->value, data));
+	CHECK(parse_crlf(p, end));
+
+	header->line.offset = begin - data;
+	header->line.length = *p - begin;
+	return HTTP_PARSE_OK;
+}
+
+static int _http_parse(const char *data, size_t len, bool request, struct http_parser_result *result)
+{
+	const char *p = data;
+	const char *end = data + len;
+	int ret;
+
+	result->header_count = 0;
+
+	if (request) {
+		CHECK(parse_request_line(&p, end, result, data));
+	}
+	else {
+		CHECK(parse_response_line(&p, end, result, data));
+	}
+
+	result->headers_offset = p - data;
+
+	while (true) {
+		if (p == end) return HTTP_PARSE_PARTIAL;
+
+		/* Empty line at the end of the headers */
+		if (*p == '\r' || *p == '\n') {
+			CHECK(parse_crlf(&p, end));
+			break;
+		}
+
+		if (result->header_count == HTTP_PARSER_MAX_HEADERS) {
+			return HTTP_PARSE_UNSUPPORTED;
+		}
+
+		CHECK(parse_header(&p, end, &result->headers[result->header_count], data));
+		result->header_count++;
+	}
+
+	result->length = p - data;
+	return HTTP_PARSE_OK;
+}
+
+int http_parse(const char *data, size_t len, bool request, struct http_parser_result *result)
+{
+	int ret;
+
+	result->data = data;
+
+	if (len > HTTP_PARSER_MAX_SIZE) {
+		ret = _http_parse(data, HTTP_PARSER_MAX_SIZE, request, result);
+		if (ret == HTTP_PARSE_PARTIAL) ret = HTTP_PARSE_UNSUPPORTED;
+		return ret;
+	}
+
+	return _http_parse(data, len, request, result);
+}
+
+int http_parse_vbuffer(struct vbuffer_sub *data, bool request, struct http_parser_result *result)
+{
+	struct vbuffer_sub_mmap iter = vbuffer_mmap_init;
+	const uint8 *ptr, *first = (const uint8 *)"";
+	size_t len, size = 0, count = 0;
+
+	result->copy = NULL;
+
+	while ((ptr = vbuffer_mmap(data, &len, false, &iter, NULL))) {
+		if (len == 0) continue;
+		if (count++ == 0) first = ptr;
+
+		size += len;
+		if (size > HTTP_PARSER_MAX_SIZE) break;
+	}
+
+	if (check_error()) return HTTP_PARSE_ERROR;
+
+	/* Common case, all the data are in the same memory block */
+	if (count <= 1) {
+		return http_parse((const char *)first, size, request, result);
+	}
+
+	if (size > HTTP_PARSER_MAX_SIZE) size = HTTP_PARSER_MAX_SIZE+1;
+
+	result->copy = malloc(size);
+	if (!result->copy) {
+		error("memory error");
+		return HTTP_PARSE_ERROR;
+	}
+
+	size = vbuffer_sub_read(data, (uint8 *)result->copy, size);
+	if (check_error()) return HTTP_PARSE_ERROR;
+
+	return http_parse(result->copy, size, request, result);
+}
+
+void http_parser_result_clear(struct http_parser_result *result)
+{
+	free(result->copy);
+	result->copy = NULL;
+	result->data = NULL;
+}
+
+bool http_scan_end(const char *data, size_t len, int *state)
+{
+	const char *p = data;
+	const char *end = data + len;
+	int current = *state;
+
+	while (p < end) {
+		if (current == HTTP_SCAN_LINE) {
+			p = memchr(p, '\n', end - p);
+			if (!p) break;
+
+			current = HTTP_SCAN_EOL;
+			p++;
+			continue;
+		}
+
+		if (*p == '\n') {
+			*state = current;
+			return true;
+		}
+
+		current = (current == HTTP_SCAN_EOL && *p == '\r') ? HTTP_SCAN_EOL_CR : HTTP_SCAN_LINE;
+		p++;
+	}
+
+	*state = current;
+	return false;
+}
+
+bool http_scan_end_vbuffer(struct vbuffer_sub *data, int *state)
+{
+	struct vbuffer_sub_mmap iter = vbuffer_mmap_init;
+	const uint8 *ptr;
+	size_t len;
+
+	while ((ptr = vbuffer_mmap(data, &len, false, &iter, NULL))) {
+		if (http_scan_end((const char *)ptr, len, state)) return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,65 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef _HTTP_PARSER_H_
+#define _HTTP_PARSER_H_
+
+#include <haka/types.h>
+#include <haka/vbuffer.h>
+
+#define HTTP_PARSE_OK           0
+#define HTTP_PARSE_PARTIAL      1  /* More data are needed */
+#define HTTP_PARSE_ERROR       -1  /* The data does not follow the grammar */
+#define HTTP_PARSE_UNSUPPORTED -2  /* Too large to be handled natively */
+
+/* Maximum number of headers and size of the header block handled by
+ * the native parser. Larger messages are left to the Lua grammar. */
+#define HTTP_PARSER_MAX_HEADERS 128
+#define HTTP_PARSER_MAX_SIZE    (64*1024)
+
+struct http_parser_span {
+	size_t  offset;
+	size_t  length;
+};
+
+struct http_parser_header {
+	struct http_parser_span line;  /* Whole line, end of line included */
+	struct http_parser_span name;
+	struct http_parser_span value;
+};
+
+struct http_parser_result {
+	/* Method, uri and version for a request, version, status and
+	 * reason for a response */
+	struct http_parser_span   fields[3];
+	size_t                    headers_offset;  /* End of the start line */
+	size_t                    header_count;
+	struct http_parser_header headers[HTTP_PARSER_MAX_HEADERS];
+	size_t                    length;  /* Total size, final end of line included */
+	const char               *data;    /* Parsed bytes */
+	char                     *copy;    /* \private */
+};
+
+/* Parse the start line and the headers of a message. The accepted syntax
+ * is the one of the http grammar, spans are offsets in data. */
+int  http_parse(const char *data, size_t len, bool request, struct http_parser_result *result);
+
+/* Same as http_parse() on a buffer. The data are read in place when they
+ * lie in a single memory block and copied otherwise. The result must be
+ * cleared with http_parser_result_clear(). */
+int  http_parse_vbuffer(struct vbuffer_sub *data, bool request, struct http_parser_result *result);
+void http_parser_result_clear(struct http_parser_result *result);
+
+/* States of the scan for the end of the headers */
+#define HTTP_SCAN_LINE     0  /* Inside a line */
+#define HTTP_SCAN_EOL      1  /* After an end of line */
+#define HTTP_SCAN_EOL_CR   2  /* After an end of line and a \r */
+
+/* Look for the empty line ending the headers. The scan can be split on
+ * consecutive data, the state is kept between the calls and must start
+ * at HTTP_SCAN_LINE. Returns true when the empty line is found. */
+bool http_scan_end(const char *data, size_t len, int *state);
+bool http_scan_end_vbuffer(struct vbuffer_sub *data, int *state);
+
+#endif /* _HTTP_PARSER_H_ */
@@ -0,0 +1,430 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+%module http_parser
+
+%include "haka/lua/swig.si"
+%include "haka/lua/vbuffer.si"
+
+%{
+#include <assert.h>
+#include <ctype.h>
+
+#include <haka/error.h>
+
+#include "http_parser.h"
+#include "http_uri.h"
+
+/* Position in the parsed buffer, moved forward only */
+struct span_cursor {
+	struct vbuffer_iterator  iter;
+	size_t                   offset;
+};
+
+static void cursor_move(struct span_cursor *cursor, size_t offset, bool split)
+{
+	assert(offset >= cursor->offset);
+
+	vbuffer_iterator_advance(&cursor->iter, offset - cursor->offset);
+	cursor->offset = offset;
+
+	/* Split like the grammar does at the end of each token */
+	if (split) vbuffer_iterator_split(&cursor->iter);
+}
+
+static bool push_sub(lua_State *L, struct vbuffer_iterator *begin, struct vbuffer_iterator *end)
+{
+	struct vbuffer_sub *sub = malloc(sizeof(struct vbuffer_sub));
+	if (!sub) {
+		error("memory error");
+		return false;
+	}
+
+	vbuffer_sub_create_between_position(sub, begin, end);
+	vbuffer_sub_register(sub);
+	SWIG_NewPointerObj(L, sub, SWIGTYPE_p_vbuffer_sub, 1);
+	return true;
+}
+
+static bool push_span(lua_State *L, struct span_cursor *cursor, const struct http_parser_span *span)
+{
+	struct vbuffer_iterator begin;
+
+	cursor_move(cursor, span->offset, false);
+	vbuffer_iterator_copy(&cursor->iter, &begin);
+	cursor_move(cursor, span->offset + span->length, true);
+
+	return push_sub(L, &begin, &cursor->iter);
+}
+
+static void push_lower(lua_State *L, const char *str, size_t len)
+{
+	luaL_Buffer buffer;
+	size_t i;
+
+	luaL_buffinit(L, &buffer);
+	for (i = 0; i < len; ++i) {
+		luaL_addchar(&buffer, tolower((unsigned char)str[i]));
+	}
+	luaL_pushresult(&buffer);
+}
+
+/*
+ * Build the field and header tables from the parsing result:
+ *   fields = { { sub, value }, ... }
+ *   headers_begin = position of the first header
+ *   headers = { { line, name_sub, name, value_sub, value, lower_name }, ... }
+ *   last = position after the headers
+ */
+static bool push_result(lua_State *L, struct vbuffer_sub *data, struct http_parser_result *result)
+{
+	struct span_cursor cursor;
+	struct vbuffer_iterator line;
+	const char *str = result->data;
+	size_t i;
+
+	vbuffer_sub_begin(data, &cursor.iter);
+	cursor.offset = 0;
+
+	lua_createtable(L, 3, 0);
+	for (i = 0; i < 3; ++i) {
+		const struct http_parser_span *span = &result->fields[i];
+
+		lua_createtable(L, 2, 0);
+		if (!push_span(L, &cursor, span)) return false;
+		lua_rawseti(L, -2, 1);
+		lua_pushlstring(L, str + span->offset, span->length);
+		lua_rawseti(L, -2, 2);
+		lua_rawseti(L, -2, i+1);
+	}
+
+	cursor_move(&cursor, result->headers_offset, true);
+	SWIG_NewPointerObj(L, vbuffer_iterator_lua_allocate(&cursor.iter),
+		SWIGTYPE_p_vbuffer_iterator, 1);
+
+	lua_createtable(L, result->header_count, 0);
+	for (i = 0; i < result->header_count; ++i) {
+		const struct http_parser_header *header = &result->headers[i];
+
+		/* The end of the previous line is the beginning of this one */
+		cursor_move(&cursor, header->line.offset, true);
+		vbuffer_iterator_copy(&cursor.iter, &line);
+
+		lua_createtable(L, 6, 0);
+		if (!push_span(L, &cursor, &header->name)) return false;
+		lua_rawseti(L, -2, 2);
+		lua_pushlstring(L, str + header->name.offset, header->name.length);
+		lua_rawseti(L, -2, 3);
+		if (!push_span(L, &cursor, &header->value)) return false;
+		lua_rawseti(L, -2, 4);
+		lua_pushlstring(L, str + header->value.offset, header->value.length);
+		lua_rawseti(L, -2, 5);
+		push_lower(L, str + header->name.offset, header->name.length);
+		lua_rawseti(L, -2, 6);
+
+		cursor_move(&cursor, header->line.offset + header->line.length, true);
+		if (!push_sub(L, &line, &cursor.iter)) return false;
+		lua_rawseti(L, -2, 1);
+
+		lua_rawseti(L, -2, i+1);
+	}
+
+	cursor_move(&cursor, result->length, true);
+	SWIG_NewPointerObj(L, vbuffer_iterator_lua_allocate(&cursor.iter),
+		SWIGTYPE_p_vbuffer_iterator, 1);
+
+	return true;
+}
+
+/*
+ * Parse the start line and the headers at the beginning of the buffer.
+ * Returns the fields, the position of the headers, the headers and the
+ * position after them, or
+ * nil and a boolean set to true if more data are needed.
+ */
+int http_parse_native(lua_State *L)
+{
+	struct vbuffer_sub *data = NULL;
+	struct http_parser_result result;
+	bool request;
+	int ret, top;
+	int SWIG_arg = 0;
+
+	SWIG_check_num_args("http_parser.parse", 2, 2)
+
+	if (!SWIG_IsOK(SWIG_ConvertPtr(L, 1, (void**)&data, SWIGTYPE_p_vbuffer_sub, 0)) || !data) {
+		SWIG_fail_ptr("http_parser.parse", 1, SWIGTYPE_p_vbuffer_sub);
+	}
+
+	request = lua_toboolean(L, 2);
+
+	ret = http_parse_vbuffer(data, request, &result);
+	if (ret != HTTP_PARSE_OK) {
+		http_parser_result_clear(&result);
+
+		if (check_error()) {
+			lua_pushstring(L, clear_error());
+			goto fail;
+		}
+
+		lua_pushnil(L);
+		lua_pushboolean(L, ret == HTTP_PARSE_PARTIAL);
+		SWIG_arg += 2;
+		return SWIG_arg;
+	}
+
+	top = lua_gettop(L);
+	if (!push_result(L, data, &result)) {
+		http_parser_result_clear(&result);
+		lua_settop(L, top);
+		lua_pushstring(L, clear_error());
+		goto fail;
+	}
+
+	http_parser_result_clear(&result);
+	SWIG_arg += 4;
+	return SWIG_arg;
+
+fail:
+	return lua_error(L);
+}
+
+/*
+ * Scan the data for the empty line ending the headers. The state returned
+ * with the boolean must be given back with the data that follows.
+ */
+int http_scan_end_native(lua_State *L)
+{
+	struct vbuffer_sub *data = NULL;
+	int state;
+	bool found;
+	int SWIG_arg = 0;
+
+	SWIG_check_num_args("http_parser.scan_end", 2, 2)
+
+	if (!SWIG_IsOK(SWIG_ConvertPtr(L, 1, (void**)&data, SWIGTYPE_p_vbuffer_sub, 0)) || !data) {
+		SWIG_fail_ptr("http_parser.scan_end", 1, SWIGTYPE_p_vbuffer_sub);
+	}
+
+	state = luaL_checkint(L, 2);
+
+	found = http_scan_end_vbuffer(data, &state);
+	if (check_error()) {
+		lua_pushstring(L, clear_error());
+		goto fail;
+	}
+
+	lua_pushboolean(L, found);
+	lua_pushinteger(L, state);
+	SWIG_arg += 2;
+	return SWIG_arg;
+
+fail:
+	return lua_error(L);
+}
+
+static void set_span_field(lua_State *L, int index, const char *name, const char *str,
+		const struct http_parser_span *span)
+{
+	lua_pushlstring(L, str + span->offset, span->length);
+	lua_setfield(L, index, name);
+}
+
+#define SET_FIELD(name) \
+	if (split.name.length > 0) set_span_field(L, 1, #name, uri, &split.name)
+
+/*
+ * Fill the uri splitter object with the components of the uri.
+ */
+int http_uri_split_native(lua_State *L)
+{
+	struct http_uri split;
+	const char *uri;
+	size_t len;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+	uri = luaL_checklstring(L, 2, &len);
+
+	http_uri_split(uri, len, &split);
+
+	SET_FIELD(scheme);
+	SET_FIELD(path);
+	SET_FIELD(authority);
+	SET_FIELD(userinfo);
+	SET_FIELD(host);
+	SET_FIELD(port);
+	SET_FIELD(fragment);
+
+	if (split.user.length > 0) {
+		set_span_field(L, 1, "user", uri, &split.user);
+		set_span_field(L, 1, "pass", uri, &split.pass);
+	}
+
+	if (split.query.length > 0) {
+		const char *query = uri + split.query.offset;
+		struct http_parser_span name, value;
+		size_t pos = 0;
+
+		set_span_field(L, 1, "query", uri, &split.query);
+
+		lua_newtable(L);
+		while (http_uri_next_arg(query, split.query.length, &pos, &name, &value)) {
+			lua_pushlstring(L, query + name.offset, name.length);
+			lua_pushlstring(L, query + value.offset, value.length);
+			lua_rawset(L, -3);
+		}
+		lua_setfield(L, 1, "args");
+	}
+
+	return 0;
+}
+
+#define URI_DECODE          0
+#define URI_DECODE_LOWER    1
+#define URI_DECODE_PATH     2
+
+#define URI_SCRATCH_SIZE    2048
+
+/*
+ * Decode the string at the top of the stack and replace it by the
+ * decoded value. Strings that are left unchanged are not copied.
+ */
+static bool decode_value(lua_State *L, int mode)
+{
+	char scratch[URI_SCRATCH_SIZE];
+	char *buffer = scratch;
+	size_t len, size;
+	const char *str = lua_tolstring(L, -1, &len);
+
+	if (mode == URI_DECODE && !memchr(str, '%', len)) return true;
+
+	if (len > URI_SCRATCH_SIZE) {
+		buffer = malloc(len);
+		if (!buffer) {
+			error("memory error");
+			return false;
+		}
+	}
+
+	size = http_uri_decode(str, len, buffer, mode == URI_DECODE_LOWER);
+	if (mode == URI_DECODE_PATH) {
+		size = http_uri_remove_dot_segments(buffer, size);
+	}
+
+	if (size != len || memcmp(buffer, str, len) != 0) {
+		lua_pop(L, 1);
+		lua_pushlstring(L, buffer, size);
+	}
+
+	if (buffer != scratch) free(buffer);
+	return true;
+}
+
+static int decode_mode(lua_State *L, int key, bool top)
+{
+	const char *name;
+
+	if (!top || lua_type(L, key) != LUA_TSTRING) return URI_DECODE;
+
+	name = lua_tostring(L, key);
+	if (strcmp(name, "scheme") == 0 || strcmp(name, "host") == 0) return URI_DECODE_LOWER;
+	if (strcmp(name, "path") == 0) return URI_DECODE_PATH;
+	return URI_DECODE;
+}
+
+/* Decode all the strings of a table and of its sub-tables */
+static bool decode_table(lua_State *L, int index, bool top)
+{
+	lua_pushnil(L);
+	while (lua_next(L, index)) {
+		const int key = lua_gettop(L) - 1;
+
+		if (lua_type(L, -1) == LUA_TTABLE) {
+			if (!decode_table(L, lua_gettop(L), false)) return false;
+		}
+		else if (lua_type(L, -1) == LUA_TSTRING) {
+			if (!decode_value(L, decode_mode(L, key, top))) return false;
+
+			lua_pushvalue(L, key);
+			lua_insert(L, -2);
+			lua_rawset(L, index);
+			continue;
+		}
+
+		lua_pop(L, 1);
+	}
+
+	return true;
+}
+
+static bool field_equals(lua_State *L, const char *name, const char *value)
+{
+	const char *str;
+	bool ret;
+
+	lua_getfield(L, 1, name);
+	str = lua_tostring(L, -1);
+	ret = str && strcmp(str, value) == 0;
+	lua_pop(L, 1);
+	return ret;
+}
+
+static bool field_isnil(lua_State *L, const char *name)
+{
+	bool ret;
+
+	lua_getfield(L, 1, name);
+	ret = lua_isnil(L, -1);
+	lua_pop(L, 1);
+	return ret;
+}
+
+/*
+ * Normalize the uri splitter object in place:
+ *   - decode percent-encoded unreserved characters
+ *   - lower case the scheme and the host
+ *   - remove the default port
+ *   - remove the dot segments of the path
+ */
+int http_uri_normalize_native(lua_State *L)
+{
+	luaL_checktype(L, 1, LUA_TTABLE);
+	lua_settop(L, 1);
+
+	if (!decode_table(L, 1, true)) {
+		lua_pushstring(L, clear_error());
+		return lua_error(L);
+	}
+
+	/* use http as default scheme */
+	if (field_isnil(L, "scheme") && !field_isnil(L, "authority")) {
+		lua_pushstring(L, "http");
+		lua_setfield(L, 1, "scheme");
+	}
+
+	/* remove default port */
+	if (field_equals(L, "port", "80")) {
+		lua_pushnil(L);
+		lua_setfield(L, 1, "port");
+	}
+
+	/* add '/' to path */
+	if (field_equals(L, "scheme", "http") &&
+	    (field_isnil(L, "path") || field_equals(L, "path", ""))) {
+		lua_pushstring(L, "/");
+		lua_setfield(L, 1, "path");
+	}
+
+	return 1;
+}
+%}
+
+%types(struct vbuffer_sub *, struct vbuffer_iterator *);
+
+%constant int MAX_SIZE = HTTP_PARSER_MAX_SIZE;
+
+%native(parse) int http_parse_native(lua_State *L);
+%native(scan_end) int http_scan_end_native(lua_State *L);
+%native(uri_split) int http_uri_split_native(lua_State *L);
+%native(uri_normalize) int http_uri_normalize_native(lua_State *L);
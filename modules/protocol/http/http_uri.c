@@ -0,0 +1,259 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <ctype.h>
+#include <string.h>
+
+#include "http_uri.h"
+
+
+static void set_span(struct http_parser_span *span, const char *uri, const char *begin,
+		const char *end)
+{
+	span->offset = begin - uri;
+	span->length = end - begin;
+}
+
+static const char *find(const char *begin, const char *end, char c)
+{
+	const char *found = memchr(begin, c, end - begin);
+	return found ? found : end;
+}
+
+static void split_authority(const char *uri, const char *begin, const char *end,
+		struct http_uri *split)
+{
+	const char *host = begin, *host_end = end;
+	const char *at, *digits, *iter;
+
+	set_span(&split->authority, uri, begin, end);
+
+	/* authority = [ userinfo @ ] host [ : port ] */
+	at = find(begin, end, '@');
+	if (at < end) {
+		set_span(&split->userinfo, uri, begin, at);
+		host = at + 1;
+	}
+
+	/* The port is ':', any character but ':' and at least one digit
+	 * up to the end of the authority */
+	digits = end;
+	while (digits > host && isdigit((uint8)digits[-1])) digits--;
+
+	iter = digits - host >= 2 ? digits - 2 : host;
+	for (; iter + 2 < end; ++iter) {
+		if (iter[0] == ':' && iter[1] != ':') {
+			set_span(&split->port, uri, iter + 1, end);
+			host_end = iter;
+			break;
+		}
+	}
+
+	set_span(&split->host, uri, host, host_end);
+
+	/* userinfo = user : password (deprecated usage) */
+	if (split->userinfo.length > 0) {
+		const char *sep = at;
+		while (sep > begin && sep[-1] != ':') sep--;
+
+		if (sep - 1 > begin) {
+			set_span(&split->user, uri, begin, sep - 1);
+			set_span(&split->pass, uri, sep, at);
+		}
+	}
+}
+
+void http_uri_split(const char *uri, size_t len, struct http_uri *split)
+{
+	const char *end = uri + len;
+	const char *core_end, *query, *iter, *authority, *path;
+
+	memset(split, 0, sizeof(*split));
+
+	/* uri = core_uri [ ?query ] [ #fragment ] */
+	core_end = uri;
+	while (core_end < end && *core_end != '#' && *core_end != '?') core_end++;
+
+	iter = core_end;
+	while (iter < end && *iter == '?') iter++;
+	query = iter;
+	iter = find(iter, end, '#');
+	set_span(&split->query, uri, query, iter);
+
+	while (iter < end && *iter == '#') iter++;
+	set_span(&split->fragment, uri, iter, end);
+
+	/* scheme */
+	iter = uri;
+	while (iter < core_end && isalpha((uint8)*iter)) iter++;
+
+	authority = uri;
+	if (core_end - iter >= 3 && memcmp(iter, "://", 3) == 0) {
+		set_span(&split->scheme, uri, uri, iter);
+		authority = iter + 3;
+	}
+
+	/* authority and path */
+	path = find(authority, core_end, '/');
+	set_span(&split->path, uri, path, core_end);
+
+	if (path > authority) {
+		split_authority(uri, authority, path, split);
+	}
+}
+
+bool http_uri_next_arg(const char *query, size_t len, size_t *pos,
+		struct http_parser_span *name, struct http_parser_span *value)
+{
+	const char *end = query + len;
+	const char *iter = query + *pos;
+	const char *begin;
+
+	/* Skip the separators that do not start an argument */
+	while (iter < end && (*iter == '=' || *iter == '&')) iter++;
+	if (iter == end) {
+		*pos = len;
+		return false;
+	}
+
+	begin = iter;
+	while (iter < end && *iter != '=' && *iter != '&') iter++;
+	set_span(name, query, begin, iter);
+
+	if (iter < end && *iter == '=') iter++;
+
+	begin = iter;
+	while (iter < end && *iter != '&' && *iter != '?') iter++;
+	set_span(value, query, begin, iter);
+
+	if (iter < end && *iter == '&') iter++;
+
+	*pos = iter - query;
+	return true;
+}
+
+static int hex_value(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static bool is_unreserved(int c)
+{
+	return (c >= '0' && c <= '9') ||
+	       (c >= 'A' && c <= 'Z') ||
+	       (c >= 'a' && c <= 'z') ||
+	       c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+size_t http_uri_decode(const char *src, size_t len, char *dst, bool lower)
+{
+	const char *end = src + len;
+	char *out = dst;
+
+	while (src < end) {
+		if (*src == '%' && end - src >= 3) {
+			const int high = hex_value(src[1]);
+			const int low = hex_value(src[2]);
+
+			if (high >= 0 && low >= 0) {
+				const int c = (high << 4) | low;
+
+				if (is_unreserved(c)) {
+					*out++ = lower ? tolower(c) : c;
+				}
+				else {
+					*out++ = '%';
+					*out++ = lower ? tolower((uint8)src[1]) : toupper((uint8)src[1]);
+					*out++ = lower ? tolower((uint8)src[2]) : toupper((uint8)src[2]);
+				}
+
+				src += 3;
+				continue;
+			}
+		}
+
+		*out++ = lower ? tolower((uint8)*src) : *src;
+		src++;
+	}
+
+	return out - dst;
+}
+
+/*
+ * The output is built in place, it never goes past the data that are
+ * still to be read. Segments are joined with '/' in the output.
+ */
+struct dot_output {
+	char    *base;
+	char    *iter;
+	size_t   count;
+};
+
+static void push_segment(struct dot_output *output, const char *segment, size_t len)
+{
+	if (output->count > 0) *output->iter++ = '/';
+	memmove(output->iter, segment, len);
+	output->iter += len;
+	output->count++;
+}
+
+static void pop_segment(struct dot_output *output)
+{
+	if (output->count == 0) return;
+
+	if (--output->count == 0) {
+		output->iter = output->base;
+	}
+	else {
+		while (*--output->iter != '/');
+	}
+}
+
+#define STARTS(str)   (avail >= sizeof(str)-1 && memcmp(iter, str, sizeof(str)-1) == 0)
+#define IS(str)       (avail == sizeof(str)-1 && memcmp(iter, str, sizeof(str)-1) == 0)
+
+size_t http_uri_remove_dot_segments(char *path, size_t len)
+{
+	const char *iter = path, *end = path + len;
+	struct dot_output output;
+
+	/* The leading slash is kept in place */
+	output.base = (len > 0 && *path == '/') ? path + 1 : path;
+	output.iter = output.base;
+	output.count = 0;
+
+	while (iter < end) {
+		const size_t avail = end - iter;
+
+		if (STARTS("../")) iter += 3;
+		else if (STARTS("./")) iter += 2;
+		else if (STARTS("/../")) {
+			iter += 3;
+			pop_segment(&output);
+		}
+		else if (IS("/..")) {
+			pop_segment(&output);
+			push_segment(&output, "", 0);
+			iter = end;
+		}
+		else if (STARTS("/./")) iter += 2;
+		else if (IS("/.")) {
+			push_segment(&output, "", 0);
+			iter = end;
+		}
+		else {
+			const char *segment;
+
+			if (*iter == '/') iter++;
+			segment = iter;
+			iter = find(iter, end, '/');
+			push_segment(&output, segment, iter - segment);
+		}
+	}
+
+	return output.iter - path;
+}
@@ -0,0 +1,44 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef _HTTP_URI_H_
+#define _HTTP_URI_H_
+
+#include <haka/types.h>
+
+#include "http_parser.h"
+
+/* Components of an uri, an empty span means that the component is not
+ * present. The password is present whenever the user is. */
+struct http_uri {
+	struct http_parser_span scheme;
+	struct http_parser_span authority;
+	struct http_parser_span userinfo;
+	struct http_parser_span user;
+	struct http_parser_span pass;
+	struct http_parser_span host;
+	struct http_parser_span port;
+	struct http_parser_span path;
+	struct http_parser_span query;
+	struct http_parser_span fragment;
+};
+
+/* Split an uri in one pass, spans are offsets in uri. */
+void   http_uri_split(const char *uri, size_t len, struct http_uri *split);
+
+/* Iterate over the arguments of a query, pos must be initialized to 0.
+ * Returns false when there is no more argument. */
+bool   http_uri_next_arg(const char *query, size_t len, size_t *pos,
+		struct http_parser_span *name, struct http_parser_span *value);
+
+/* Decode the percent-encoded unreserved characters and upper case the
+ * remaining escape sequences. The output is never larger than the input
+ * and can be lower cased on the fly. Returns the size written to dst. */
+size_t http_uri_decode(const char *src, size_t len, char *dst, bool lower);
+
+/* Remove the dot segments of a path in place (rfc 3986). Returns the new
+ * size of the path. */
+size_t http_uri_remove_dot_segments(char *path, size_t len);
+
+#endif /* _HTTP_URI_H_ */
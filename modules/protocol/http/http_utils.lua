@@ -3,6 +3,7 @@
 -- file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 local class = require('class')
+local http_parser = require('protocol/http_parser')
 
 local module = {}
 
@@ -10,69 +11,6 @@ module.uri = {}
 module.cookies = {}
 
 
-local _unreserved = table.dict({string.byte("-"),
-				string.byte("."),
-				string.byte("_"),
-				string.byte("~")})
-
-local str = string.char
-
-local function uri_safe_decode(uri)
-	local uri = string.gsub(uri, '%%(%x%x)',
-		function(p)
-			local val = tonumber(p, 16)
-			if (val > 47 and val < 58) or
-			   (val > 64 and val < 91) or
-			   (val > 96 and val < 123) or
-			   (table.contains(_unreserved, val)) then
-				return str(val)
-			else
-				return '%' .. string.upper(p)
-			end
-		end)
-	return uri
-end
-
-local function uri_safe_decode_split(tab)
-	for k, v in pairs(tab) do
-		if type(v) == 'table' then
-			uri_safe_decode_split(v)
-		else
-			tab[k] = uri_safe_decode(v)
-		end
-	end
-end
-
-local _prefixes = {{'^%.%./', ''}, {'^%./', ''}, {'^/%.%./', '/'}, {'^/%.%.$', '/'}, {'^/%./', '/'}, {'^/%.$', '/'}}
-
-local function remove_dot_segments(path)
-	local output = {}
-	local slash = ''
-	local nb = 0
-	if path:sub(1,1) == '/' then slash = '/' end
-	while path ~= '' do
-		local index = 0
-		for _, prefix in ipairs(_prefixes) do
-			path, nb = path:gsub(prefix[1], prefix[2])
-			if nb > 0 then
-				if index == 2 or index == 3 then
-					table.remove(output, #output)
-				end
-				break
-			end
-			index = index + 1
-		end
-		if nb == 0 then
-			if path:sub(1,1) == '/' then path = path:sub(2) end
-			local left, right = path:match('([^/]*)([/]?.*)')
-			table.insert(output, left)
-			path = right
-		end
-	end
-	return slash .. table.concat(output, '/')
-end
-
-
 -- Uri splitter object
 
 local HttpUriSplit = class.class('HttpUriSplit')
@@ -80,63 +18,9 @@ local HttpUriSplit = class.class('HttpUriSplit')
 function HttpUriSplit.method:__init(uri)
 	assert(uri, "uri parameter required")
 
-	local splitted_uri = {}
-	local core_uri
-	local query, fragment, path, authority
-
-	-- uri = core_uri [ ?query ] [ #fragment ]
-	core_uri, query, fragment =
-	    string.match(uri, '([^#?]*)[%?]*([^#]*)[#]*(.*)')
-
-	-- query (+ split params)
-	if query and query ~= '' then
-		self.query = query
-		local args = {}
-		string.gsub(self.query, '([^=&]+)(=?([^&?]*))&?',
-		    function(p, q, r) args[p] = r or true return '' end)
-		self.args = args
-	end
-
-	-- fragment
-	if fragment and fragment ~= '' then
-		self.fragment = fragment
-	end
-
-	-- scheme
-	local temp = string.gsub(core_uri, '^(%a*)://',
-	    function(p) if p ~= '' then self.scheme = p end return '' end)
-
-	-- authority and path
-	authority, path = string.match(temp, '([^/]*)([/]*.*)$')
-
-	if (path and path ~= '') then
-		self.path = path
-	end
-
+	-- uri = [ scheme :// ] [ authority ] [ path ] [ ?query ] [ #fragment ]
 	-- authority = [ userinfo @ ] host [ : port ]
-	if authority and authority ~= '' then
-		self.authority = authority
-
-		-- userinfo
-		authority = string.gsub(authority, "^([^@]*)@",
-			function(p) if p ~= '' then self.userinfo = p end return '' end)
-
-		-- port
-		authority = string.gsub(authority, ":([^:][%d]+)$",
-			function(p) if p ~= '' then self.port = p end return '' end)
-
-		-- host
-		if authority ~= '' then self.host = authority end
-
-		-- userinfo = user : password (deprecated usage)
-		if self.userinfo then
-			local user, pass = string.match(self.userinfo, '(.*):(.*)')
-			if user and user ~= '' then
-				self.user = user
-				self.pass = pass
-			end
-		end
-	end
+	http_parser.uri_split(self, uri)
 end
 
 function HttpUriSplit.method:__tostring()
@@ -208,34 +92,10 @@ end
 
 function HttpUriSplit.method:normalize()
 	assert(self)
-	-- decode percent-encoded octets of unresserved chars
-	-- capitalize letters in escape sequences
-	uri_safe_decode_split(self)
-
-	-- use http as default scheme
-	if not self.scheme and self.authority then
-		self.scheme = 'http'
-	end
-
-	-- scheme and host are not case sensitive
-	if self.scheme then self.scheme = string.lower(self.scheme) end
-	if self.host then self.host = string.lower(self.host) end
-
-	-- remove default port
-	if self.port and self.port == '80' then
-		self.port = nil
-	end
-
-	-- add '/' to path
-	if self.scheme == 'http' and (not self.path or self.path == '') then
-		self.path = '/'
-	end
-
-	-- normalize path according to rfc 3986
-	if self.path then self.path = remove_dot_segments(self.path) end
-
-	return self
-
+	-- decode percent-encoded octets of unreserved chars, capitalize
+	-- letters in escape sequences, lower case scheme and host, remove
+	-- default port and normalize path according to rfc 3986
+	return http_parser.uri_normalize(self)
 end
 
 
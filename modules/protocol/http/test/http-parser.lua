@@ -0,0 +1,80 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+local http_parser = require('protocol/http_parser')
+
+TestHttpParser = {}
+
+function TestHttpParser:test_request()
+	local buf = haka.vbuffer_from("GET /index.html HTTP/1.1\r\nHost: www.example.com\r\nAccept:  */*\r\n\r\nbody")
+	local fields, headers_begin, headers, last = http_parser.parse(buf:sub(), true)
+
+	assertEquals(fields[1][2], "GET")
+	assertEquals(fields[2][2], "/index.html")
+	assertEquals(fields[3][2], "1.1")
+	assertEquals(fields[2][1]:asstring(), "/index.html")
+	assertEquals(haka.vbuffer_sub(headers_begin, last):asstring(), "Host: www.example.com\r\nAccept:  */*\r\n\r\n")
+	assertEquals(#headers, 2)
+	assertEquals(headers[1][1]:asstring(), "Host: www.example.com\r\n")
+	assertEquals(headers[1][3], "Host")
+	assertEquals(headers[1][5], "www.example.com")
+	assertEquals(headers[1][6], "host")
+	assertEquals(headers[2][5], "*/*")
+	assertEquals(buf:sub(last):asstring(), "body")
+end
+
+function TestHttpParser:test_response()
+	local buf = haka.vbuffer_from("HTTP/1.0 404 Not Found\n\n")
+	local fields, headers_begin, headers, last = http_parser.parse(buf:sub(), false)
+
+	assertEquals(fields[1][2], "1.0")
+	assertEquals(fields[2][2], "404")
+	assertEquals(fields[3][2], "Not Found")
+	assertEquals(#headers, 0)
+	assertEquals(buf:sub(last):asstring(), "")
+end
+
+function TestHttpParser:test_partial()
+	local buf = haka.vbuffer_from("GET / HTTP/1.1\r\nHost: www.exa")
+	local fields, partial = http_parser.parse(buf:sub(), true)
+
+	assertEquals(fields, nil)
+	assertEquals(partial, true)
+end
+
+function TestHttpParser:test_invalid()
+	local buf = haka.vbuffer_from("GET / HTTP/1.1\r\nHost:www.example.com\r\n\r\n")
+	local fields, partial = http_parser.parse(buf:sub(), true)
+
+	assertEquals(fields, nil)
+	assertEquals(partial, false)
+end
+
+function TestHttpParser:test_across_chunks()
+	local buf = haka.vbuffer_from("GET / HTT")
+	buf:append(haka.vbuffer_from("P/1.1\r\nHost: www.example.com\r\n\r\n"))
+	local fields, headers_begin, headers, last = http_parser.parse(buf:sub(), true)
+
+	assertEquals(fields[3][2], "1.1")
+	assertEquals(headers[1][5], "www.example.com")
+	assertEquals(fields[3][1]:asstring(), "1.1")
+end
+
+function TestHttpParser:test_scan_end()
+	local found, state = http_parser.scan_end(haka.vbuffer_from("GET / HTTP/1.1\r\nHost: www.example.com\r\n"):sub(), 0)
+	assertEquals(found, false)
+
+	-- The empty line is split between two chunks
+	found, state = http_parser.scan_end(haka.vbuffer_from("\r"):sub(), state)
+	assertEquals(found, false)
+	found, state = http_parser.scan_end(haka.vbuffer_from("\nbody"):sub(), state)
+	assertEquals(found, true)
+
+	found, state = http_parser.scan_end(haka.vbuffer_from("GET / HTTP/1.1\n\r\r\n"):sub(), 0)
+	assertEquals(found, false)
+	found, state = http_parser.scan_end(haka.vbuffer_from("GET / HTTP/1.1\n\n"):sub(), 0)
+	assertEquals(found, true)
+end
+
+addTestSuite('TestHttpParser')
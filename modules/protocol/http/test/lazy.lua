@@ -0,0 +1,19 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+-- With only ipv4 rules, the connections are tracked but their streams are
+-- not reassembled and the http dissector is not selected. If it were, the
+-- bad request would be detected and the connection dropped.
+
+local ipv4 = require("protocol/ipv4")
+local http = require("protocol/http")
+
+http.install_tcp_rule(80)
+
+haka.rule {
+	hook = ipv4.events.receive_packet,
+	eval = function (pkt)
+		print(string.format("SRC:%s - DST:%s", pkt.src, pkt.dst))
+	end
+}
@@ -0,0 +1,31 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+local http = require('protocol/http')
+
+TestHttpMatchHost = {}
+
+local function request_host(host)
+	local key = http.events.request.keys.host
+	return key.get(nil, { headers = { Host = host } })
+end
+
+function TestHttpMatchHost:test_host_without_port()
+	assertEquals(request_host("Example.com:8080"), "example.com")
+	assertEquals(request_host("example.com:"), "example.com")
+	assertEquals(request_host("EXAMPLE.com"), "example.com")
+end
+
+function TestHttpMatchHost:test_ipv6_host()
+	assertEquals(request_host("[::1]:8080"), "[::1]")
+	assertEquals(request_host("[::1]"), "[::1]")
+end
+
+function TestHttpMatchHost:test_rule_value()
+	local key = http.events.request.keys.host
+	assertEquals(key.value("Example.com"), "example.com")
+	assertEquals(key.value("example.com:80"), "example.com")
+end
+
+addTestSuite('TestHttpMatchHost')
@@ -23,6 +23,19 @@ haka.rule {
 		request.headers["Haka2"] = "Done"
 		request.headers["Haka2"] = nil
 
+		-- The modified values are written back in the headers
+		for _, header in ipairs(request.headers) do
+			if header.name == "Host" then
+				assert(header._sub:asstring() == "Host: haka.powered.tld\r\n")
+			elseif header.name == "Accept" then
+				header.name = "X-Accept"
+				assert(request.headers["X-Accept"] == "*/*")
+				assert(header._sub:asstring() == "X-Accept: */*\r\n")
+				header.name = "Accept"
+				assert(header._sub:asstring() == "Accept: */*\r\n")
+			end
+		end
+
 		print("HTTP MODIFIED REQUEST")
 		debug.pprint(request, nil, nil, { debug.hide_underscore, debug.hide_function })
 	end
@@ -237,6 +237,17 @@ struct cnx *cnx_get(struct cnx_table *table, struct cnx_key *key,
 	}
 }
 
+size_t cnx_count(struct cnx_table *table)
+{
+	size_t count;
+
+	mutex_lock(&table->mutex);
+	count = HASH_COUNT(table->head);
+	mutex_unlock(&table->mutex);
+
+	return count;
+}
+
 bool cnx_foreach(struct cnx_table *table, bool include_dropped, bool (*callback)(void *data, struct cnx *, int index), void *data)
 {
 	struct cnx_table_elem *ptr, *tmp;
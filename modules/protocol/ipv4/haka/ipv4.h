@@ -60,6 +60,18 @@ struct ipv4_header {
 };
 /** \endcond */
 
+/**
+ * Flow of an IPv4 packet, read from its header without dissecting it.
+ */
+struct ipv4_flow {
+	ipv4addr src;
+	ipv4addr dst;
+	uint8    proto;
+	uint16   srcport;   /**< First 16 bits of the protocol header, 0 for a fragment */
+	uint16   dstport;   /**< Next 16 bits of the protocol header, 0 for a fragment */
+	bool     fragment;
+};
+
 /**
  * IPv4 opaque structure
  */
@@ -89,6 +101,7 @@ size_t ipv4_get_payload_length(struct ipv4 *ip);
 const char *ipv4_get_proto_dissector(struct ipv4 *ip);
 void ipv4_register_proto_dissector(uint8 proto, const char *dissector);
 void ipv4_action_drop(struct ipv4 *ip);
+bool ipv4_packet_flow(struct packet *packet, struct ipv4_flow *flow);
 
 struct checksum_partial {
 	bool    odd;
@@ -756,6 +756,61 @@ size_t ipv4_get_payload_length(struct ipv4 *ip)
 	return vbuffer_size(ip->payload);
 }
 
+/*
+ * Read the addresses and ports of a packet without dissecting it. The packet
+ * is left untouched, it is only copied from. Returns false if the packet is
+ * not an IPv4 packet.
+ */
+bool ipv4_packet_flow(struct packet *packet, struct ipv4_flow *flow)
+{
+	struct vbuffer *payload;
+	struct vbuffer_sub sub;
+	struct ipv4_header header;
+	const char *dissector;
+	size_t header_len;
+	uint16 ports[2];
+
+	assert(packet);
+	assert(flow);
+
+	dissector = packet_dissector(packet);
+	if (!dissector || strcmp(dissector, "ipv4") != 0) {
+		return false;
+	}
+
+	payload = packet_payload(packet);
+
+	vbuffer_sub_create(&sub, payload, 0, sizeof(struct ipv4_header));
+	if (vbuffer_sub_read(&sub, (uint8 *)&header, sizeof(struct ipv4_header)) < sizeof(struct ipv4_header)) {
+		return false;
+	}
+
+	header_len = header.hdr_len << IPV4_HDR_LEN_OFFSET;
+	if (header.version != 4 || header_len < sizeof(struct ipv4_header)) {
+		return false;
+	}
+
+	flow->src = SWAP_FROM_IPV4(ipv4addr, header.src);
+	flow->dst = SWAP_FROM_IPV4(ipv4addr, header.dst);
+	flow->proto = header.proto;
+	flow->fragment = IPV4_GET_BIT(uint16, header.fragment, IPV4_FLAG_MF) ||
+		IPV4_GET_BITS(uint16, header.fragment, IPV4_FRAGMENTOFFSET_BITS) != 0;
+	flow->srcport = 0;
+	flow->dstport = 0;
+
+	/* Only the first fragment holds the ports, they are only known
+	 * after reassembly */
+	if (!flow->fragment) {
+		vbuffer_sub_create(&sub, payload, header_len, sizeof(ports));
+		if (vbuffer_sub_read(&sub, (uint8 *)ports, sizeof(ports)) == sizeof(ports)) {
+			flow->srcport = SWAP_FROM_BE(uint16, ports[0]);
+			flow->dstport = SWAP_FROM_BE(uint16, ports[1]);
+		}
+	}
+
+	return true;
+}
+
 void ipv4_action_drop(struct ipv4 *ip)
 {
 	IPV4_CHECK(ip);
@@ -296,6 +296,8 @@ struct ipv4 {
 		struct ipv4_addr *dst;
 
 		%immutable;
+		int src_packed;
+		int dst_packed;
 		const char *name { return "ipv4"; }
 		struct packet *raw { IPV4_CHECK($self, NULL); return $self->packet; }
 		struct ipv4_flags *flags { IPV4_CHECK($self, NULL); return (struct ipv4_flags *)$self; }
@@ -354,6 +356,8 @@ int lua_inet_checksum(struct vbuffer *buf);
 	void ipv4_src_set(struct ipv4 *ip, struct ipv4_addr *v) { ipv4_set_src(ip, v->addr); }
 	struct ipv4_addr *ipv4_dst_get(struct ipv4 *ip) { return ipv4_addr_new(ipv4_get_dst(ip)); }
 	void ipv4_dst_set(struct ipv4 *ip, struct ipv4_addr *v) { ipv4_set_dst(ip, v->addr); }
+	int ipv4_src_packed_get(struct ipv4 *ip) { return ipv4_get_src(ip); }
+	int ipv4_dst_packed_get(struct ipv4 *ip) { return ipv4_get_dst(ip); }
 
 	#define IPV4_FLAGS_GETSET(field) \
 		bool ipv4_flags_##field##_get(struct ipv4_flags *flags) { return ipv4_get_flags_##field((struct ipv4 *)flags); } \
@@ -369,8 +373,57 @@ int lua_inet_checksum(struct vbuffer *buf);
 	struct ipv4_addr *ipv4_network_net_get(struct ipv4_network *network) { return ipv4_addr_new(network->net.net); }
 
 	unsigned char ipv4_network_mask_get(struct ipv4_network *network) { return network->net.mask; }
+
+	/* Getters of the header fields, of the flags and of the packed addresses for the ffi bindings */
+	int ipv4_ffi_getters(struct lua_State *L)
+	{
+		lua_newtable(L);
+		LUA_FFI_FUNCTION(L, "version", ipv4_version_get);
+		LUA_FFI_FUNCTION(L, "hdr_len", ipv4_hdr_len_get);
+		LUA_FFI_FUNCTION(L, "tos", ipv4_tos_get);
+		LUA_FFI_FUNCTION(L, "len", ipv4_len_get);
+		LUA_FFI_FUNCTION(L, "id", ipv4_id_get);
+		LUA_FFI_FUNCTION(L, "frag_offset", ipv4_frag_offset_get);
+		LUA_FFI_FUNCTION(L, "ttl", ipv4_ttl_get);
+		LUA_FFI_FUNCTION(L, "proto", ipv4_proto_get);
+		LUA_FFI_FUNCTION(L, "checksum", ipv4_checksum_get);
+
+		lua_newtable(L);
+		LUA_FFI_FUNCTION(L, "rb", ipv4_flags_rb_get);
+		LUA_FFI_FUNCTION(L, "df", ipv4_flags_df_get);
+		LUA_FFI_FUNCTION(L, "mf", ipv4_flags_mf_get);
+
+		lua_newtable(L);
+		LUA_FFI_FUNCTION(L, "src_packed", ipv4_src_packed_get);
+		LUA_FFI_FUNCTION(L, "dst_packed", ipv4_dst_packed_get);
+		return 3;
+	}
+
+	/* Flow of a packet given as a light userdata, read without binding the
+	 * packet to the Lua state */
+	int ipv4_packet_flow_lua(struct lua_State *L)
+	{
+		struct ipv4_flow flow;
+		struct packet *pkt = (struct packet *)lua_touserdata(L, 1);
+
+		if (!pkt || !ipv4_packet_flow(pkt, &flow)) {
+			lua_pushnil(L);
+			return 1;
+		}
+
+		lua_pushinteger(L, (int)flow.src);
+		lua_pushinteger(L, (int)flow.dst);
+		lua_pushinteger(L, flow.proto);
+		lua_pushinteger(L, flow.srcport);
+		lua_pushinteger(L, flow.dstport);
+		lua_pushboolean(L, flow.fragment);
+		return 6;
+	}
 %}
 
+%native(_ffi_getters) int ipv4_ffi_getters(struct lua_State *L);
+%native(_packet_flow) int ipv4_packet_flow_lua(struct lua_State *L);
+
 %luacode {
 	local this = unpack({...})
 
@@ -384,21 +437,57 @@ int lua_inet_checksum(struct vbuffer *buf);
 
 	local ipv4_protocol_dissectors = {}
 
+	local ipv4_dissector = haka.dissector.new{
+		type = haka.helper.PacketDissector,
+		name = 'ipv4'
+	}
+
 	function this.register_protocol(proto, dissector)
 		if ipv4_protocol_dissectors[proto] then
 			error("IPv4 protocol %d dissector already registered", proto);
 		end
 
 		ipv4_protocol_dissectors[proto] = dissector
+		ipv4_dissector:add_next_dissector(dissector)
 	end
 
-	local ipv4_dissector = haka.dissector.new{
-		type = haka.helper.PacketDissector,
-		name = 'ipv4'
-	}
-
 	ipv4_dissector.options.enable_reassembly = true
 
+	local ipv4_flow_lookups = {}
+
+	-- Register the lookup of the flows of a protocol, called with the
+	-- packed addresses and the ports of a packet
+	function this.register_flow_lookup(proto, lookup)
+		ipv4_flow_lookups[proto] = lookup
+	end
+
+	haka.flow_owners.ipv4 = function (pkt)
+		local src, dst, proto, srcport, dstport, fragment = this._packet_flow(pkt)
+		if not src then return false end
+
+		-- The fragments are kept by the state that started to reassemble
+		-- them, the previous one while it is still running
+		if fragment then return true end
+
+		local lookup = ipv4_flow_lookups[proto]
+		return lookup and lookup(src, dst, srcport, dstport) or false
+	end
+
+	-- Packed value of an address given as a string, a number or an addr
+	function this.packed(addr)
+		if type(addr) == 'string' then
+			return this.addr(addr).packed
+		elseif type(addr) == 'number' then
+			return addr
+		else
+			return addr.packed
+		end
+	end
+
+	ipv4_dissector:register_match_key('src', function (ip) return ip.src_packed end, this.packed)
+	ipv4_dissector:register_match_key('dst', function (ip) return ip.dst_packed end, this.packed)
+	ipv4_dissector:register_match_key('proto', function (ip) return ip.proto end)
+
 	function ipv4_dissector:new(pkt)
 		return this._dissect(pkt)
 	end
@@ -417,7 +506,7 @@ int lua_inet_checksum(struct vbuffer *buf);
 
 		if pkt then
 			local next_dissector = ipv4_protocol_dissectors[pkt.proto]
-			if next_dissector then
+			if next_dissector and next_dissector:isneeded() then
 				return next_dissector:receive(pkt)
 			else
 				return pkt:send()
@@ -452,6 +541,18 @@ int lua_inet_checksum(struct vbuffer *buf);
 	this.events = ipv4_dissector.events
 	this.options = ipv4_dissector.options
 
+	local ffibinding = require('ffibinding')
+	if ffibinding.enabled then
+		local fields, flags, addresses = this._ffi_getters()
+		local getters = ffibinding.functions('unsigned int (*)(void *)', fields)
+		for name, get in pairs(ffibinding.functions('int (*)(void *)', addresses)) do
+			getters[name] = get
+		end
+		ffibinding.getters('ipv4', getters)
+		ffibinding.getters('ipv4_flags', ffibinding.functions('bool (*)(void *)', flags))
+	end
+	this._ffi_getters = nil
+
 	function this.create(pkt)
 		return ipv4_dissector:create(pkt)
 	end
@@ -31,6 +31,7 @@ const char *packet_dissector(struct packet *pkt);
 
 	function this.register(name, dissector)
 		dissectors[name] = dissector
+		raw_dissector:add_next_dissector(dissector)
 	end
 
 	raw_dissector.options.drop_unknown_dissector = false
@@ -42,6 +43,10 @@ const char *packet_dissector(struct packet *pkt);
 		if dissector then
 			local next_dissector = dissectors[dissector]
 			if next_dissector then
+				if not next_dissector:isneeded() then
+					return self:send()
+				end
+
 				return next_dissector:receive(self)
 			else
 				if raw_dissector.options.drop_unknown_dissector then
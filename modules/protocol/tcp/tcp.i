@@ -217,8 +217,36 @@ TCP_FLAGS_GETSET(cwr);
 unsigned int tcp_flags_all_get(struct tcp_flags *flags) { return tcp_get_flags((struct tcp *)flags); }
 void tcp_flags_all_set(struct tcp_flags *flags, unsigned int v) { return tcp_set_flags((struct tcp *)flags, v); }
 
+/* Getters of the header fields and of the flags for the ffi bindings */
+int tcp_ffi_getters(struct lua_State *L)
+{
+	lua_newtable(L);
+	LUA_FFI_FUNCTION(L, "srcport", tcp_srcport_get);
+	LUA_FFI_FUNCTION(L, "dstport", tcp_dstport_get);
+	LUA_FFI_FUNCTION(L, "seq", tcp_seq_get);
+	LUA_FFI_FUNCTION(L, "ack_seq", tcp_ack_seq_get);
+	LUA_FFI_FUNCTION(L, "res", tcp_res_get);
+	LUA_FFI_FUNCTION(L, "hdr_len", tcp_hdr_len_get);
+	LUA_FFI_FUNCTION(L, "window_size", tcp_window_size_get);
+	LUA_FFI_FUNCTION(L, "checksum", tcp_checksum_get);
+	LUA_FFI_FUNCTION(L, "urgent_pointer", tcp_urgent_pointer_get);
+
+	lua_newtable(L);
+	LUA_FFI_FUNCTION(L, "fin", tcp_flags_fin_get);
+	LUA_FFI_FUNCTION(L, "syn", tcp_flags_syn_get);
+	LUA_FFI_FUNCTION(L, "rst", tcp_flags_rst_get);
+	LUA_FFI_FUNCTION(L, "psh", tcp_flags_psh_get);
+	LUA_FFI_FUNCTION(L, "ack", tcp_flags_ack_get);
+	LUA_FFI_FUNCTION(L, "urg", tcp_flags_urg_get);
+	LUA_FFI_FUNCTION(L, "ecn", tcp_flags_ecn_get);
+	LUA_FFI_FUNCTION(L, "cwr", tcp_flags_cwr_get);
+	return 2;
+}
+
 %}
 
+%native(_ffi_getters) int tcp_ffi_getters(struct lua_State *L);
+
 %luacode {
 	local this = unpack({...})
 
@@ -231,11 +259,14 @@ void tcp_flags_all_set(struct tcp_flags *flags, unsigned int v) { return tcp_set
 		return this._dissect(pkt)
 	end
 
+	tcp_dissector:register_match_key('srcport', function (pkt) return pkt.srcport end)
+	tcp_dissector:register_match_key('dstport', function (pkt) return pkt.dstport end)
+
 	function tcp_dissector.method:receive()
 		haka.context:signal(self, tcp_dissector.events['receive_packet'])
 
 		local next_dissector = tcp_dissector.next_dissector
-		if next_dissector then
+		if next_dissector and next_dissector:isneeded() then
 			return next_dissector:receive(self)
 		else
 			return self:send()
@@ -275,11 +306,20 @@ void tcp_flags_all_set(struct tcp_flags *flags, unsigned int v) { return tcp_set
 
 	this.events = tcp_dissector.events
 
+	local ffibinding = require('ffibinding')
+	if ffibinding.enabled then
+		local fields, flags = this._ffi_getters()
+		ffibinding.getters('tcp', ffibinding.functions('unsigned int (*)(void *)', fields))
+		ffibinding.getters('tcp_flags', ffibinding.functions('bool (*)(void *)', flags))
+	end
+	this._ffi_getters = nil
+
 	function this.create(ip)
 		return tcp_dissector:create(ip)
 	end
 
 	function this.select_next_dissector(dissector)
 		tcp_dissector.next_dissector = dissector
+		tcp_dissector:add_next_dissector(dissector)
 	end
 }
@@ -18,14 +18,43 @@ local tcp_connection_dissector = haka.dissector.new{
 }
 
 tcp_connection_dissector.cnx_table = ipv4.cnx_table()
+tcp_connection_dissector.port_table = haka.helper.PortTable:new()
+
+haka.open_flows.tcp = function ()
+	return tcp_connection_dissector.cnx_table:count()
+end
+
+ipv4.register_flow_lookup(6, function (srcip, dstip, srcport, dstport)
+	local connection, _, dropped = tcp_connection_dissector.cnx_table:get(srcip, dstip, srcport, dstport)
+	return connection ~= nil or dropped
+end)
+
+-- The connections are always tracked, skipping them would lose the
+-- state of the flows opened while no rule needs them. The reassembly and
+-- the flow dissectors still depend on the rules.
+tcp_connection_dissector.options.lazy = false
 
 tcp_connection_dissector:register_event('new_connection')
 tcp_connection_dissector:register_event('receive_packet')
 tcp_connection_dissector:register_streamed_event('receive_data')
 tcp_connection_dissector:register_event('end_connection')
 
+tcp_connection_dissector:register_match_key('srcip', function (flow) return flow.srcip.packed end, ipv4.packed)
+tcp_connection_dissector:register_match_key('dstip', function (flow) return flow.dstip.packed end, ipv4.packed)
+tcp_connection_dissector:register_match_key('srcport', function (flow) return flow.srcport end)
+tcp_connection_dissector:register_match_key('dstport', function (flow) return flow.dstport end)
+
 local function tcp_get_key(pkt)
-	return pkt.ip.src, pkt.ip.dst, pkt.srcport, pkt.dstport
+	return pkt.ip.src_packed, pkt.ip.dst_packed, pkt.srcport, pkt.dstport
+end
+
+-- Dissector installed on the ports of the new flow
+local function select_dissector(flow)
+	local cls = tcp_connection_dissector.port_table:lookup(flow)
+	if cls and cls:isneeded() then
+		log.debug("selecting %s dissector on flow", cls.name)
+		flow:select_next_dissector(cls:new(flow))
+	end
 end
 
 function tcp_connection_dissector:receive(pkt)
@@ -38,7 +67,9 @@ function tcp_connection_dissector:receive(pkt)
 
 			local ret, err = xpcall(function ()
 					haka.context:exec(connection.data, function ()
+						select_dissector(self)
 						self:trigger('new_connection', pkt)
+						self._reassemble = self:needstreams()
 					end)
 				end, debug.format_error)
 
@@ -143,6 +174,7 @@ tcp_connection_dissector.state_machine = haka.state_machine.new("tcp", function
 	local function send(dir)
 		return function(self, pkt)
 			self.stream[self[dir]]:init(pkt.seq+1)
+			self._lastseq[self[dir]] = pkt.seq+1
 			pkt:send()
 		end
 	end
@@ -455,6 +487,8 @@ function tcp_connection_dissector.method:__init(connection, pkt)
 	class.super(tcp_connection_dissector).__init(self)
 	self.stream = {}
 	self._restart = false
+	self._reassemble = true
+	self._lastseq = {}
 
 	self.srcip = pkt.ip.src
 	self.dstip = pkt.ip.dst
@@ -473,6 +507,8 @@ function tcp_connection_dissector.method:clearstream()
 		self.stream.down:clear()
 		self.stream = nil
 	end
+
+	self:release_comanagers()
 end
 
 function tcp_connection_dissector.method:restart()
@@ -506,7 +542,23 @@ function tcp_connection_dissector.method:_trigger_receive(direction, stream, cur
 	end
 end
 
+-- The streams are only reassembled if a dissector has been selected on
+-- the flow or if a rule listens to the data. Otherwise, the packets are
+-- sent as they come and only the connection state is tracked.
+function tcp_connection_dissector.method:needstreams()
+	return self:next_dissector() ~= nil or self:haslisteners('receive_data')
+end
+
 function tcp_connection_dissector.method:push(pkt, direction, finish)
+	if not self._reassemble then
+		local len = #pkt.payload
+		if len > 0 then
+			self._lastseq[direction] = (pkt.seq + len) % 2^32
+		end
+
+		return self:_sendpkt(pkt, direction)
+	end
+
 	local stream = self.stream[direction]
 
 	local current = stream:push(pkt)
@@ -516,6 +568,8 @@ function tcp_connection_dissector.method:push(pkt, direction, finish)
 end
 
 function tcp_connection_dissector.method:finish(direction)
+	if not self._reassemble then return end
+
 	local stream = self.stream[direction]
 
 	stream.stream:finish()
@@ -592,7 +646,11 @@ function tcp_connection_dissector.method:_forgereset(direction)
 		tcprst.dstport = self.srcport
 	end
 
-	tcprst.seq = self.stream[direction].lastseq
+	if self._reassemble then
+		tcprst.seq = self.stream[direction].lastseq
+	else
+		tcprst.seq = self._lastseq[direction]
+	end
 
 	tcprst.flags.rst = true
 
@@ -627,6 +685,7 @@ end
 tcp.select_next_dissector(tcp_connection_dissector)
 
 module.events = tcp_connection_dissector.events
+module.options = tcp_connection_dissector.options
 
 --
 -- Helpers
@@ -636,21 +695,16 @@ module.helper = {}
 
 module.helper.TcpFlowDissector = class.class('TcpFlowDissector', haka.helper.FlowDissector)
 
+-- The dissector is not created if no rule needs it
 function module.helper.TcpFlowDissector.dissect(cls, flow)
-	flow:select_next_dissector(cls:new(flow))
+	if cls:isneeded() then
+		flow:select_next_dissector(cls:new(flow))
+	end
 end
 
-function module.helper.TcpFlowDissector.install_tcp_rule(cls, port)
-	haka.rule{
-		name = string.format("install %s dissector", cls.name),
-		hook = tcp_connection_dissector.events.new_connection,
-		eval = function (flow, pkt)
-			if pkt.dstport == port then
-				log.debug("selecting %s dissector on flow", cls.name)
-				flow:select_next_dissector(cls:new(flow))
-			end
-		end
-	}
+function module.helper.TcpFlowDissector.install_tcp_rule(cls, port, direction)
+	tcp_connection_dissector.port_table:add(cls, port, direction)
+	haka.event.invalidate()
 end
 
 module.helper.TcpFlowDissector.property.connection = {
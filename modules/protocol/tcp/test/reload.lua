@@ -0,0 +1,24 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+-- Reload of the configuration in the middle of the first connection
+-- (hakapcap --reload-after). The first connection must end in the
+-- previous configuration, which is released once the connection is
+-- closed, and the next ones must be handled by the new configuration.
+-- The pcap time jumps after the first connection to let it time out.
+
+require("protocol/ipv4")
+require("protocol/tcp")
+local tcp_connection = require("protocol/tcp_connection")
+
+local count = 0
+
+haka.rule{
+	hook = tcp_connection.events.end_connection,
+	eval = function (flow)
+		count = count + 1
+		haka.log("end tcp connection %s:%i -> %s:%i, %d in this configuration",
+			flow.srcip, flow.srcport, flow.dstip, flow.dstport, count)
+	end
+}
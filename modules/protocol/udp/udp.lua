@@ -14,8 +14,8 @@ local function compute_checksum(pkt)
 	-- size of the udp pseudo-header
 	local pseudo_header = haka.vbuffer_allocate(12)
 	-- source and destination ipv4 addresses
-	pseudo_header:sub(0,4):setnumber(pkt.ip.src.packed)
-	pseudo_header:sub(4,4):setnumber(pkt.ip.dst.packed)
+	pseudo_header:sub(0,4):setnumber(pkt.ip.src_packed)
+	pseudo_header:sub(4,4):setnumber(pkt.ip.dst_packed)
 	-- padding (null byte)
 	pseudo_header:sub(8,1):setnumber(0)
 	-- UDP protocol number
@@ -50,6 +50,9 @@ udp_dissector.grammar = haka.grammar.new("udp", function ()
 	export(packet)
 end)
 
+udp_dissector:register_match_key('srcport', function (pkt) return pkt.srcport end)
+udp_dissector:register_match_key('dstport', function (pkt) return pkt.dstport end)
+
 function udp_dissector.method:next_dissector()
 	return udp_dissector.next_dissector
 end
@@ -98,5 +101,6 @@ return {
 	end,
 	select_next_dissector = function (dissector)
 		udp_dissector.next_dissector = dissector
+		udp_dissector:add_next_dissector(dissector)
 	end
 }
@@ -17,14 +17,43 @@ local udp_connection_dissector = haka.dissector.new{
 }
 
 udp_connection_dissector.cnx_table = ipv4.cnx_table()
+udp_connection_dissector.port_table = haka.helper.PortTable:new()
+
+haka.open_flows.udp = function ()
+	return udp_connection_dissector.cnx_table:count()
+end
+
+ipv4.register_flow_lookup(17, function (srcip, dstip, srcport, dstport)
+	local connection, _, dropped = udp_connection_dissector.cnx_table:get(srcip, dstip, srcport, dstport)
+	return connection ~= nil or dropped
+end)
+
+-- The connections are always tracked, skipping them would lose the
+-- state of the flows opened while no rule needs them. The flow dissectors
+-- still depend on the rules.
+udp_connection_dissector.options.lazy = false
 
 udp_connection_dissector:register_event('new_connection')
 udp_connection_dissector:register_event('receive_packet')
 udp_connection_dissector:register_event('receive_data')
 udp_connection_dissector:register_event('end_connection')
 
+udp_connection_dissector:register_match_key('srcip', function (flow) return flow.srcip.packed end, ipv4.packed)
+udp_connection_dissector:register_match_key('dstip', function (flow) return flow.dstip.packed end, ipv4.packed)
+udp_connection_dissector:register_match_key('srcport', function (flow) return flow.srcport end)
+udp_connection_dissector:register_match_key('dstport', function (flow) return flow.dstport end)
+
 local function udp_get_cnx_key(pkt)
-	return pkt.ip.src, pkt.ip.dst, pkt.srcport, pkt.dstport
+	return pkt.ip.src_packed, pkt.ip.dst_packed, pkt.srcport, pkt.dstport
+end
+
+-- Dissector installed on the ports of the new flow
+local function select_dissector(flow)
+	local cls = udp_connection_dissector.port_table:lookup(flow)
+	if cls and cls:isneeded() then
+		log.debug("selecting %s dissector on flow", cls.name)
+		flow:select_next_dissector(cls:new(flow))
+	end
 end
 
 function udp_connection_dissector:receive(pkt)
@@ -34,6 +63,7 @@ function udp_connection_dissector:receive(pkt)
 		local self = udp_connection_dissector:new(pkt)
 
 		haka.context:exec(data, function ()
+			select_dissector(self)
 			self:trigger('new_connection', pkt)
 		end)
 
@@ -185,6 +215,7 @@ end
 udp.select_next_dissector(udp_connection_dissector)
 
 module.events = udp_connection_dissector.events
+module.options = udp_connection_dissector.options
 
 --
 -- Helpers
@@ -194,21 +225,16 @@ module.helper = {}
 
 module.helper.UdpFlowDissector =  class.class('UdpFlowDissector', haka.helper.FlowDissector)
 
+-- The dissector is not created if no rule needs it
 function module.helper.UdpFlowDissector.dissect(cls, flow)
-	flow:select_next_dissector(cls:new(flow))
+	if cls:isneeded() then
+		flow:select_next_dissector(cls:new(flow))
+	end
 end
 
-function module.helper.UdpFlowDissector.install_udp_rule(cls, port)
-	haka.rule{
-		name = string.format("install %s dissector", cls.name),
-		hook = udp_connection_dissector.events.new_connection,
-		eval = function (flow, pkt)
-			if pkt.dstport == port then
-				log.debug("selecting %s dissector on flow", cls.name)
-				flow:select_next_dissector(cls:new(flow))
-			end
-		end
-	}
+function module.helper.UdpFlowDissector.install_udp_rule(cls, port, direction)
+	udp_connection_dissector.port_table:add(cls, port, direction)
+	haka.event.invalidate()
 end
 
 module.helper.UdpFlowDissector.property.connection = {
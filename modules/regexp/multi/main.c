@@ -0,0 +1,922 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Multi-pattern literal matcher.
+ *
+ * The pattern is a list of literal alternatives separated by '|'. All of
+ * them are compiled into a single Aho-Corasick automaton that is turned
+ * into a complete DFA, so the data is scanned only once whatever the
+ * number of alternatives. The input alphabet is reduced to the set of
+ * bytes used by the patterns to keep the transition table small.
+ *
+ * As the automaton has no lookahead, a match is reported as soon as one of
+ * the alternatives ends. When several alternatives end at the same
+ * position, the longest one is reported.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <haka/error.h>
+#include <haka/log.h>
+#include <haka/regexp_module.h>
+#include <haka/thread.h>
+
+#include "multi.h"
+
+static REGISTER_LOG_SECTION(multi);
+
+#define CHECK_REGEXP_TYPE(re)\
+	do {\
+		if (re == NULL || re->super.module != &HAKA_MODULE) {\
+			error("Wrong regexp struct passed to multi module");\
+			goto type_error;\
+		}\
+	} while(0)
+
+#define CHECK_REGEXP_SINK_TYPE(sink)\
+	do {\
+		if (sink == NULL || sink->super.regexp->module != &HAKA_MODULE) {\
+			error("Wrong regexp_sink struct passed to multi module");\
+			goto type_error;\
+		}\
+	} while(0)
+
+#define ROOT_STATE      0
+#define NO_STATE        -1
+#define NO_PATTERN      -1
+
+/* Flag set on a transition that leads to a state where at least one
+ * alternative ends */
+#define ACCEPT_FLAG     (1U << 31)
+
+struct multi_state {
+	int32         fail;         /* longest proper suffix also in the trie */
+	int32         depth;        /* length of the prefix leading to this state */
+	int32         output;       /* first pattern ending on this state */
+	int32         dict;         /* next state on the fail chain with an output */
+	int32         match_length; /* longest pattern ending here, 0 if none */
+};
+
+struct regexp_multi {
+	struct regexp         super;
+	int                   pattern_count;
+	int32                *pattern_next;  /* next pattern ending on the same state */
+	int                   class_count;
+	uint8                 classes[256];
+	int                   state_count;
+	struct multi_state   *states;
+	uint32               *delta;         /* state_count * class_count transitions */
+};
+
+struct regexp_sink_multi {
+	struct regexp_sink super;
+	int32              state;
+	size_t             processed_length;
+};
+
+static int  init(struct parameters *args);
+static void cleanup();
+
+static int                   match(const char *pattern, int options, const char *buf, int len, struct regexp_result *result);
+static int                   vbmatch(const char *pattern, int options, struct vbuffer_sub *vbuf, struct vbuffer_sub *result);
+
+static struct regexp        *compile(const char *pattern, int options);
+static void                  release_regexp(struct regexp *re);
+static int                   exec(struct regexp *re, const char *buf, int len, struct regexp_result *result);
+static int                   vbexec(struct regexp *re, struct vbuffer_sub *vbuf, struct vbuffer_sub *result);
+
+static struct regexp_sink   *create_sink(struct regexp *re);
+static void                  free_regexp_sink(struct regexp_sink *sink);
+static int                   feed(struct regexp_sink *sink, const char *buf, int len, bool eof, struct regexp_result *result);
+static int                   vbfeed(struct regexp_sink *sink, struct vbuffer_sub *vbuf, bool eof,
+		struct vbuffer_iterator *begin, struct vbuffer_iterator *end);
+
+static struct regexp_sink_multi *_create_sink(struct regexp *_re);
+static void                      _free_regexp_sink(struct regexp_sink_multi *sink);
+static int                       _partial_exec(struct regexp_sink_multi *sink, const char *buf, int len, bool eof, struct regexp_result *result);
+static int                       _vbpartial_exec(struct regexp_sink_multi *sink, struct vbuffer_sub *vbuf, bool eof,
+		struct vbuffer_iterator *begin, struct vbuffer_iterator *end);
+
+struct regexp_module HAKA_MODULE = {
+	module: {
+		type:        MODULE_REGEXP,
+		name:        "Multi-pattern regexp engine",
+		description: "Aho-Corasick based multi-pattern literal matching engine",
+		api_version: HAKA_API_VERSION,
+		init:        init,
+		cleanup:     cleanup
+	},
+
+	match:   match,
+	vbmatch: vbmatch,
+
+	compile:        compile,
+	release_regexp: release_regexp,
+	exec:           exec,
+	vbexec:         vbexec,
+
+	create_sink:      create_sink,
+	free_regexp_sink: free_regexp_sink,
+	feed:             feed,
+	vbfeed:           vbfeed,
+};
+
+static int init(struct parameters *args)
+{
+	return 0;
+}
+
+static void cleanup()
+{
+}
+
+/*
+ * Pattern parsing
+ */
+
+struct multi_literals {
+	uint8   *data;
+	size_t   size;
+	size_t   capacity;
+	size_t  *ends;      /* end offset of each alternative in data */
+	int      count;
+	int      capacity_count;
+};
+
+static bool literals_push_byte(struct multi_literals *lit, uint8 byte)
+{
+	if (lit->size == lit->capacity) {
+		const size_t capacity = lit->capacity ? lit->capacity*2 : 64;
+		uint8 *data = realloc(lit->data, capacity);
+		if (!data) {
+			error("memory error");
+			return false;
+		}
+		lit->data = data;
+		lit->capacity = capacity;
+	}
+
+	lit->data[lit->size++] = byte;
+	return true;
+}
+
+static bool literals_end(struct multi_literals *lit)
+{
+	if (lit->count == lit->capacity_count) {
+		const int capacity = lit->capacity_count ? lit->capacity_count*2 : 16;
+		size_t *ends = realloc(lit->ends, capacity*sizeof(size_t));
+		if (!ends) {
+			error("memory error");
+			return false;
+		}
+		lit->ends = ends;
+		lit->capacity_count = capacity;
+	}
+
+	lit->ends[lit->count++] = lit->size;
+	return true;
+}
+
+static void literals_destroy(struct multi_literals *lit)
+{
+	free(lit->data);
+	free(lit->ends);
+}
+
+static int hexvalue(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static bool parse_pattern(const char *pattern, int options, struct multi_literals *lit)
+{
+	const char *iter = pattern;
+	size_t start = 0;
+	const char *errorstr;
+
+	while (true) {
+		uint8 byte;
+		const char c = *iter;
+
+		if (c == '|' || c == '\0') {
+			if (lit->size == start) {
+				errorstr = "empty alternative";
+				goto error;
+			}
+
+			if (!literals_end(lit)) return false;
+			start = lit->size;
+
+			if (c == '\0') break;
+			++iter;
+			continue;
+		}
+
+		if ((options & REGEXP_EXTENDED) && isspace((unsigned char)c)) {
+			++iter;
+			continue;
+		}
+
+		if ((options & REGEXP_EXTENDED) && c == '#') {
+			while (*iter && *iter != '\n') ++iter;
+			continue;
+		}
+
+		if (c == '\\') {
+			const char e = *(iter+1);
+			switch (e) {
+			case 'n': byte = '\n'; iter += 2; break;
+			case 'r': byte = '\r'; iter += 2; break;
+			case 't': byte = '\t'; iter += 2; break;
+			case 'f': byte = '\f'; iter += 2; break;
+			case 'v': byte = '\v'; iter += 2; break;
+			case 'x':
+				{
+					const int h = hexvalue(*(iter+2));
+					const int l = h < 0 ? -1 : hexvalue(*(iter+3));
+					if (l < 0) {
+						errorstr = "invalid hexadecimal escape";
+						goto error;
+					}
+					byte = (h << 4) | l;
+					iter += 4;
+				}
+				break;
+			default:
+				if (e == '\0' || isalnum((unsigned char)e)) {
+					errorstr = "unsupported escape sequence";
+					goto error;
+				}
+				byte = e;
+				iter += 2;
+				break;
+			}
+		}
+		else if (strchr(".^$*+?()[]{}", c)) {
+			errorstr = "unsupported regexp construct";
+			goto error;
+		}
+		else {
+			byte = c;
+			++iter;
+		}
+
+		if (options & REGEXP_CASE_INSENSITIVE) byte = tolower(byte);
+		if (!literals_push_byte(lit, byte)) return false;
+	}
+
+	return true;
+
+error:
+	error("Multi-pattern compilation failed with error '%s' at offset %d",
+			errorstr, (int)(iter - pattern));
+	return false;
+}
+
+/*
+ * Automaton construction
+ */
+
+static inline uint32 *transitions(struct regexp_multi *re, int32 state)
+{
+	return re->delta + state*re->class_count;
+}
+
+static int32 new_state(struct regexp_multi *re, int *capacity, int32 depth)
+{
+	int i;
+	uint32 *delta;
+
+	if (re->state_count == *capacity) {
+		const int new_capacity = *capacity*2;
+		struct multi_state *states;
+
+		states = realloc(re->states, new_capacity*sizeof(struct multi_state));
+		if (!states) {
+			error("memory error");
+			return NO_STATE;
+		}
+		re->states = states;
+
+		delta = realloc(re->delta, new_capacity*re->class_count*sizeof(uint32));
+		if (!delta) {
+			error("memory error");
+			return NO_STATE;
+		}
+		re->delta = delta;
+
+		*capacity = new_capacity;
+	}
+
+	re->states[re->state_count].fail = ROOT_STATE;
+	re->states[re->state_count].depth = depth;
+	re->states[re->state_count].output = NO_PATTERN;
+	re->states[re->state_count].dict = NO_STATE;
+	re->states[re->state_count].match_length = 0;
+
+	delta = transitions(re, re->state_count);
+	for (i=0; i<re->class_count; ++i) {
+		delta[i] = (uint32)NO_STATE;
+	}
+
+	return re->state_count++;
+}
+
+static void build_classes(struct regexp_multi *re, struct multi_literals *lit, int options)
+{
+	int i;
+	bool used[256] = { false };
+
+	for (i=0; i<lit->size; ++i) {
+		used[lit->data[i]] = true;
+	}
+
+	/* Class 0 groups all bytes not used by any pattern */
+	re->class_count = 1;
+	for (i=0; i<256; ++i) {
+		re->classes[i] = used[i] ? re->class_count++ : 0;
+	}
+
+	if (options & REGEXP_CASE_INSENSITIVE) {
+		for (i=0; i<256; ++i) {
+			if (isupper(i)) re->classes[i] = re->classes[tolower(i)];
+		}
+	}
+}
+
+static bool build_trie(struct regexp_multi *re, struct multi_literals *lit, int *capacity)
+{
+	int id;
+	size_t begin = 0;
+
+	for (id=0; id<lit->count; ++id) {
+		size_t i;
+		int32 state = ROOT_STATE;
+
+		for (i=begin; i<lit->ends[id]; ++i) {
+			const uint8 class = re->classes[lit->data[i]];
+			int32 next = (int32)transitions(re, state)[class];
+			if (next == NO_STATE) {
+				next = new_state(re, capacity, re->states[state].depth+1);
+				if (next == NO_STATE) return false;
+				transitions(re, state)[class] = next;
+			}
+			state = next;
+		}
+
+		/* Keep the pattern ids ordered on a given state */
+		re->pattern_next[id] = NO_PATTERN;
+		if (re->states[state].output == NO_PATTERN) {
+			re->states[state].output = id;
+		}
+		else {
+			int32 last = re->states[state].output;
+			while (re->pattern_next[last] != NO_PATTERN) last = re->pattern_next[last];
+			re->pattern_next[last] = id;
+		}
+
+		begin = lit->ends[id];
+	}
+
+	return true;
+}
+
+static bool build_automaton(struct regexp_multi *re)
+{
+	int c, head = 0, tail = 0;
+	int32 *queue;
+
+	queue = malloc(re->state_count*sizeof(int32));
+	if (!queue) {
+		error("memory error");
+		return false;
+	}
+
+	/* Breadth first traversal to compute the failure links and turn the
+	 * trie into a complete DFA */
+	for (c=0; c<re->class_count; ++c) {
+		uint32 *delta = transitions(re, ROOT_STATE);
+		if ((int32)delta[c] == NO_STATE) {
+			delta[c] = ROOT_STATE;
+		}
+		else {
+			re->states[delta[c]].fail = ROOT_STATE;
+			queue[tail++] = delta[c];
+		}
+	}
+
+	while (head < tail) {
+		const int32 state = queue[head++];
+		struct multi_state *s = &re->states[state];
+		uint32 *delta = transitions(re, state);
+		const uint32 *fail_delta = transitions(re, s->fail);
+
+		if (s->output != NO_PATTERN) {
+			s->match_length = s->depth;
+		}
+		else if (s->dict != NO_STATE) {
+			s->match_length = re->states[s->dict].depth;
+		}
+
+		for (c=0; c<re->class_count; ++c) {
+			const int32 next = (int32)delta[c];
+			if (next == NO_STATE) {
+				delta[c] = fail_delta[c];
+			}
+			else {
+				struct multi_state *n = &re->states[next];
+				n->fail = fail_delta[c];
+				n->dict = re->states[n->fail].output != NO_PATTERN ? n->fail : re->states[n->fail].dict;
+				queue[tail++] = next;
+			}
+		}
+	}
+
+	free(queue);
+
+	/* Flag the transitions leading to an accepting state, this avoids
+	 * looking at the state data in the scanning loop */
+	for (c=0; c<re->state_count*re->class_count; ++c) {
+		if (re->states[re->delta[c]].match_length) {
+			re->delta[c] |= ACCEPT_FLAG;
+		}
+	}
+
+	return true;
+}
+
+static void _release_regexp(struct regexp_multi *re)
+{
+	free(re->pattern_next);
+	free(re->states);
+	free(re->delta);
+	free(re);
+}
+
+static struct regexp *compile(const char *pattern, int options)
+{
+	struct regexp_multi *re;
+	struct multi_literals lit = { 0 };
+	int capacity = 64;
+
+	assert(pattern);
+
+	if (!parse_pattern(pattern, options, &lit)) {
+		literals_destroy(&lit);
+		return NULL;
+	}
+
+	re = malloc(sizeof(struct regexp_multi));
+	if (!re) {
+		literals_destroy(&lit);
+		error("memory error");
+		return NULL;
+	}
+
+	memset(re, 0, sizeof(struct regexp_multi));
+	re->super.module = &HAKA_MODULE;
+	re->super.ref_count = 1;
+	re->pattern_count = lit.count;
+
+	build_classes(re, &lit, options);
+
+	re->pattern_next = malloc(lit.count*sizeof(int32));
+	re->states = malloc(capacity*sizeof(struct multi_state));
+	re->delta = malloc(capacity*re->class_count*sizeof(uint32));
+	if (!re->pattern_next || !re->states || !re->delta) {
+		error("memory error");
+		goto error;
+	}
+
+	if (new_state(re, &capacity, 0) != ROOT_STATE ||
+	    !build_trie(re, &lit, &capacity) ||
+	    !build_automaton(re)) {
+		goto error;
+	}
+
+	LOG_DEBUG(multi, "compiled %d patterns into %d states and %d byte classes",
+			re->pattern_count, re->state_count, re->class_count);
+
+	literals_destroy(&lit);
+	return (struct regexp *)re;
+
+error:
+	literals_destroy(&lit);
+	_release_regexp(re);
+	return NULL;
+}
+
+static void release_regexp(struct regexp *_re)
+{
+	struct regexp_multi *re = (struct regexp_multi *)_re;
+
+	CHECK_REGEXP_TYPE(re);
+
+	if (atomic_dec(&re->super.ref_count) != 0) return;
+
+	_release_regexp(re);
+
+type_error:
+	return;
+}
+
+/*
+ * Scanning
+ */
+
+/* Run the automaton on the data starting from the given state. Stops on the first
+ * accepting state and returns the number of bytes consumed, the state is
+ * updated accordingly. */
+static inline size_t scan(const struct regexp_multi *re, int32 *state, const uint8 *buf, size_t len)
+{
+	const uint32 *delta = re->delta;
+	const uint8 *classes = re->classes;
+	const int class_count = re->class_count;
+	uint32 current = *state;
+	size_t i;
+
+	for (i=0; i<len; ++i) {
+		current = delta[current*class_count + classes[buf[i]]];
+		if (current & ACCEPT_FLAG) {
+			*state = current & ~ACCEPT_FLAG;
+			return i+1;
+		}
+	}
+
+	*state = current;
+	return len;
+}
+
+static int match(const char *pattern, int options, const char *buf, int len, struct regexp_result *result)
+{
+	int ret;
+	struct regexp *re;
+
+	assert(pattern);
+	assert(buf);
+
+	re = compile(pattern, options);
+	if (re == NULL) return REGEXP_ERROR;
+
+	ret = exec(re, buf, len, result);
+
+	release_regexp(re);
+
+	return ret;
+}
+
+static int vbmatch(const char *pattern, int options, struct vbuffer_sub *vbuf, struct vbuffer_sub *result)
+{
+	int ret;
+	struct regexp *re;
+
+	assert(pattern);
+	assert(vbuf);
+
+	re = compile(pattern, options);
+	if (re == NULL) return REGEXP_ERROR;
+
+	ret = vbexec(re, vbuf, result);
+
+	release_regexp(re);
+
+	return ret;
+}
+
+static int exec(struct regexp *_re, const char *buf, int len, struct regexp_result *result)
+{
+	struct regexp_multi *re = (struct regexp_multi *)_re;
+	int32 state = ROOT_STATE;
+	size_t end;
+
+	CHECK_REGEXP_TYPE(re);
+	assert(buf);
+
+	if (result != NULL) {
+		*result = regexp_result_init;
+	}
+
+	end = scan(re, &state, (const uint8 *)buf, len);
+	if (!re->states[state].match_length) {
+		return REGEXP_NOMATCH;
+	}
+
+	if (result != NULL) {
+		result->first = end - re->states[state].match_length;
+		result->last = end;
+	}
+	return REGEXP_MATCH;
+
+type_error:
+	return REGEXP_ERROR;
+}
+
+static int vbexec(struct regexp *re, struct vbuffer_sub *vbuf, struct vbuffer_sub *result)
+{
+	int ret;
+	struct regexp_sink_multi *sink;
+
+	assert(re);
+	assert(vbuf);
+
+	sink = _create_sink(re);
+	if (sink == NULL) return REGEXP_ERROR;
+
+	if (result) {
+		*result = vbuffer_sub_init;
+		ret = _vbpartial_exec(sink, vbuf, true, &result->begin, &result->end);
+	}
+	else {
+		ret = _vbpartial_exec(sink, vbuf, true, NULL, NULL);
+	}
+
+	_free_regexp_sink(sink);
+
+	return ret;
+}
+
+static struct regexp_sink *create_sink(struct regexp *re)
+{
+	assert(re);
+
+	return (struct regexp_sink *)_create_sink(re);
+}
+
+static struct regexp_sink_multi *_create_sink(struct regexp *_re)
+{
+	struct regexp_multi *re = (struct regexp_multi *)_re;
+	struct regexp_sink_multi *sink;
+
+	CHECK_REGEXP_TYPE(re);
+
+	sink = malloc(sizeof(struct regexp_sink_multi));
+	if (!sink) {
+		error("memory error");
+		return NULL;
+	}
+
+	sink->super.regexp = _re;
+	sink->super.match = REGEXP_NOMATCH;
+	sink->state = ROOT_STATE;
+	sink->processed_length = 0;
+
+	atomic_inc(&re->super.ref_count);
+
+	return sink;
+
+type_error:
+	return NULL;
+}
+
+static void free_regexp_sink(struct regexp_sink *_sink)
+{
+	struct regexp_sink_multi *sink = (struct regexp_sink_multi *)_sink;
+
+	CHECK_REGEXP_SINK_TYPE(sink);
+
+	_free_regexp_sink(sink);
+
+type_error:
+	return;
+}
+
+static void _free_regexp_sink(struct regexp_sink_multi *sink)
+{
+	assert(sink);
+
+	release_regexp(sink->super.regexp);
+	free(sink);
+}
+
+static int feed(struct regexp_sink *_sink, const char *buf, int len, bool eof, struct regexp_result *result)
+{
+	struct regexp_sink_multi *sink = (struct regexp_sink_multi *)_sink;
+
+	CHECK_REGEXP_SINK_TYPE(sink);
+	assert(buf);
+
+	return _partial_exec(sink, buf, len, eof, result);
+
+type_error:
+	return REGEXP_ERROR;
+}
+
+static int vbfeed(struct regexp_sink *_sink, struct vbuffer_sub *vbuf, bool eof,
+		struct vbuffer_iterator *begin, struct vbuffer_iterator *end)
+{
+	struct regexp_sink_multi *sink = (struct regexp_sink_multi *)_sink;
+
+	CHECK_REGEXP_SINK_TYPE(sink);
+
+	return _vbpartial_exec(sink, vbuf, eof, begin, end);
+
+type_error:
+	return REGEXP_ERROR;
+}
+
+/* Feed some data to the sink, returns true and fill the result with
+ * absolute offsets when an alternative is found. */
+static bool _feed_chunk(struct regexp_sink_multi *sink, const uint8 *buf, size_t len,
+		struct regexp_result *result)
+{
+	const struct regexp_multi *re = (const struct regexp_multi *)sink->super.regexp;
+	const size_t end = scan(re, &sink->state, buf, len);
+	const int32 match_length = re->states[sink->state].match_length;
+
+	sink->processed_length += end;
+
+	if (match_length) {
+		sink->super.match = REGEXP_MATCH;
+		result->first = sink->processed_length - match_length;
+		result->last = sink->processed_length;
+		return true;
+	}
+
+	return false;
+}
+
+/* Set the sink final state once all the data have been fed. When some
+ * data are still expected, a prefix of an alternative ending the data is a
+ * partial match which starts at the position of the current state prefix. */
+static int _finish(struct regexp_sink_multi *sink, bool eof, struct regexp_result *result)
+{
+	const struct regexp_multi *re = (const struct regexp_multi *)sink->super.regexp;
+
+	if (!eof && sink->state != ROOT_STATE) {
+		sink->super.match = REGEXP_PARTIAL;
+		result->first = sink->processed_length - re->states[sink->state].depth;
+	}
+	else {
+		sink->super.match = REGEXP_NOMATCH;
+	}
+
+	return sink->super.match;
+}
+
+static int _partial_exec(struct regexp_sink_multi *sink, const char *buf, int len, bool eof, struct regexp_result *result)
+{
+	struct regexp_result tmp = regexp_result_init;
+
+	assert(sink);
+	assert(buf);
+
+	/* If we already match don't bother with the automaton again */
+	if (sink->super.match == REGEXP_MATCH)
+		return sink->super.match;
+
+	if (!_feed_chunk(sink, (const uint8 *)buf, len, &tmp)) {
+		_finish(sink, eof, &tmp);
+	}
+
+	if (result) *result = tmp;
+	return sink->super.match;
+}
+
+static int _vbpartial_exec(struct regexp_sink_multi *sink, struct vbuffer_sub *vbuf, bool eof,
+		struct vbuffer_iterator *begin, struct vbuffer_iterator *end)
+{
+	size_t len;
+	const uint8 *ptr;
+	const size_t start = sink->processed_length;
+	struct vbuffer_sub_mmap mmap_iter = vbuffer_mmap_init;
+	struct regexp_result result = regexp_result_init;
+	struct vbuffer_iterator iter = vbuffer_iterator_init;
+	struct vbuffer_iterator first = vbuffer_iterator_init;
+	bool has_first = false;
+
+	assert(sink);
+
+	if (sink->super.match == REGEXP_MATCH)
+		return sink->super.match;
+
+	if (vbuf) {
+		bool found = false;
+
+		while ((ptr = vbuffer_mmap(vbuf, &len, false, &mmap_iter, &iter))) {
+			if (!has_first) {
+				first = iter;
+				has_first = true;
+			}
+
+			if (_feed_chunk(sink, ptr, len, &result)) {
+				found = true;
+				break;
+			}
+		}
+
+		if (!found) _finish(sink, eof, &result);
+	}
+	else {
+		_finish(sink, eof, &result);
+	}
+
+	/* Positions can only be reported inside the data of this call. A partial
+	 * match started in a previous call keeps the begin reported at that time. */
+	if (has_first) {
+		if (begin && result.first != (size_t)-1 && result.first >= start) {
+			vbuffer_iterator_copy(&first, begin);
+			vbuffer_iterator_advance(begin, result.first - start);
+		}
+		if (end && result.last != (size_t)-1) {
+			vbuffer_iterator_copy(&first, end);
+			vbuffer_iterator_advance(end, result.last - start);
+		}
+	}
+
+	return sink->super.match;
+}
+
+/*
+ * Pattern ids
+ */
+
+static void mark_outputs(const struct regexp_multi *re, int32 state, bool *matched, int *count)
+{
+	while (state != NO_STATE) {
+		int32 id = re->states[state].output;
+		while (id != NO_PATTERN) {
+			if (!matched[id]) {
+				matched[id] = true;
+				++*count;
+			}
+			id = re->pattern_next[id];
+		}
+		state = re->states[state].dict;
+	}
+}
+
+static void scan_all(const struct regexp_multi *re, int32 *state, const uint8 *buf, size_t len,
+		bool *matched, int *count)
+{
+	while (len > 0) {
+		const size_t consumed = scan(re, state, buf, len);
+		if (re->states[*state].match_length) {
+			mark_outputs(re, *state, matched, count);
+		}
+		buf += consumed;
+		len -= consumed;
+	}
+}
+
+int regexp_multi_count(struct regexp *_re)
+{
+	struct regexp_multi *re = (struct regexp_multi *)_re;
+
+	CHECK_REGEXP_TYPE(re);
+
+	return re->pattern_count;
+
+type_error:
+	return -1;
+}
+
+int regexp_multi_matches(struct regexp *_re, const char *buf, size_t len, bool *matched)
+{
+	struct regexp_multi *re = (struct regexp_multi *)_re;
+	int32 state = ROOT_STATE;
+	int count = 0;
+
+	CHECK_REGEXP_TYPE(re);
+	assert(buf);
+	assert(matched);
+
+	memset(matched, 0, re->pattern_count*sizeof(bool));
+	scan_all(re, &state, (const uint8 *)buf, len, matched, &count);
+
+	return count;
+
+type_error:
+	return -1;
+}
+
+int regexp_multi_vbmatches(struct regexp *_re, struct vbuffer_sub *vbuf, bool *matched)
+{
+	struct regexp_multi *re = (struct regexp_multi *)_re;
+	struct vbuffer_sub_mmap mmap_iter = vbuffer_mmap_init;
+	int32 state = ROOT_STATE;
+	int count = 0;
+	const uint8 *ptr;
+	size_t len;
+
+	CHECK_REGEXP_TYPE(re);
+	assert(vbuf);
+	assert(matched);
+
+	memset(matched, 0, re->pattern_count*sizeof(bool));
+	while ((ptr = vbuffer_mmap(vbuf, &len, false, &mmap_iter, NULL))) {
+		scan_all(re, &state, ptr, len, matched, &count);
+	}
+
+	return count;
+
+type_error:
+	return -1;
+}
@@ -0,0 +1,21 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef _REGEXP_MULTI_H_
+#define _REGEXP_MULTI_H_
+
+#include <haka/types.h>
+#include <haka/regexp_module.h>
+
+/* Number of alternatives (pattern ids) in a regexp compiled by this module. */
+int  regexp_multi_count(struct regexp *re);
+
+/* Scan the whole data and set matched[i] for every alternative found, i
+ * being its index from 0 (the pattern id returned in Lua is i+1). The array
+ * must contain regexp_multi_count() elements. Returns the number of distinct
+ * alternatives matched or -1 on error. */
+int  regexp_multi_matches(struct regexp *re, const char *buf, size_t len, bool *matched);
+int  regexp_multi_vbmatches(struct regexp *re, struct vbuffer_sub *vbuf, bool *matched);
+
+#endif /* _REGEXP_MULTI_H_ */
@@ -0,0 +1,92 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+%module multi
+
+%{
+
+#include <haka/regexp_module.h>
+#include <haka/compiler.h>
+
+#include "multi.h"
+
+extern struct regexp_module HAKA_MODULE;
+
+static struct regexp_module *re = &HAKA_MODULE;
+
+STATIC_ASSERT(sizeof(bool) == sizeof(char), invalid_bool_size);
+
+static bool *alloc_matched(struct regexp *regexp, char **TEMP_OUTPUT, size_t *TEMP_SIZE)
+{
+	const int count = regexp_multi_count(regexp);
+	if (count < 0) return NULL;
+
+	*TEMP_OUTPUT = malloc(count);
+	if (!*TEMP_OUTPUT) {
+		error("memory error");
+		return NULL;
+	}
+
+	*TEMP_SIZE = count;
+	return (bool *)*TEMP_OUTPUT;
+}
+
+static void _matches(struct regexp *regexp, const char *STRING, size_t SIZE,
+		char **TEMP_OUTPUT, size_t *TEMP_SIZE)
+{
+	bool *matched = alloc_matched(regexp, TEMP_OUTPUT, TEMP_SIZE);
+	if (matched) {
+		regexp_multi_matches(regexp, STRING, SIZE, matched);
+	}
+}
+
+static void _vbmatches(struct regexp *regexp, struct vbuffer_sub *vbuf,
+		char **TEMP_OUTPUT, size_t *TEMP_SIZE)
+{
+	bool *matched;
+
+	if (!vbuf) {
+		error("nil argument");
+		return;
+	}
+
+	matched = alloc_matched(regexp, TEMP_OUTPUT, TEMP_SIZE);
+	if (matched) {
+		regexp_multi_vbmatches(regexp, vbuf, matched);
+	}
+}
+
+%}
+
+%include "haka/lua/swig.si"
+
+struct regexp_module *re;
+
+void _matches(struct regexp *regexp, const char *STRING, size_t SIZE,
+		char **TEMP_OUTPUT, size_t *TEMP_SIZE);
+void _vbmatches(struct regexp *regexp, struct vbuffer_sub *vbuf,
+		char **TEMP_OUTPUT, size_t *TEMP_SIZE);
+
+%luacode {
+	local this = unpack({...})
+
+	local function matches(regexp, input)
+		local flags
+		if type(input) == 'string' then
+			flags = this._matches(regexp, input)
+		else
+			flags = this._vbmatches(regexp, input)
+		end
+
+		local ret = {}
+		for i = 1, #flags do
+			if flags:byte(i) ~= 0 then
+				table.insert(ret, i)
+			end
+		end
+		return ret
+	end
+
+	this.matches = matches
+}
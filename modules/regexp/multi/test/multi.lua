@@ -0,0 +1,144 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+TestRegexpMulti = {}
+
+function TestRegexpMulti:setUp()
+	self.rem = require("regexp/multi")
+end
+
+function TestRegexpMulti:test_match_should_return_first_alternative_found()
+	-- When
+	local ret, first, last = self.rem.re:match("she|he|his|hers", "ahishers")
+	-- Then
+	assertEquals(ret, "his")
+	assertEquals(first, 1)
+	assertEquals(last, 4)
+end
+
+function TestRegexpMulti:test_match_should_fail_when_no_alternative_match()
+	-- When
+	local ret = self.rem.re:match("select|union|insert", "GET /index.html")
+	-- Then
+	assertFalse(ret)
+end
+
+function TestRegexpMulti:test_match_should_match_insensitively()
+	-- When
+	local ret = self.rem.re:match("select|union", "1 UNION 2", self.rem.re.CASE_INSENSITIVE)
+	-- Then
+	assertEquals(ret, "UNION")
+end
+
+function TestRegexpMulti:test_match_should_handle_escapes()
+	-- When
+	local ret = self.rem.re:match("%|%x41|%r%n", "a|Ab")
+	-- Then
+	assertEquals(ret, "|")
+end
+
+function TestRegexpMulti:test_compile_should_fail_on_regexp_construct()
+	-- When
+	local ok, err = pcall(function () return self.rem.re:compile("foo.*bar") end)
+	-- Then
+	assertFalse(ok)
+	assertTrue(string.find(err, "unsupported regexp construct", 1, true) ~= nil)
+end
+
+function TestRegexpMulti:test_compile_should_fail_on_empty_alternative()
+	-- When
+	local ok, err = pcall(function () return self.rem.re:compile("foo||bar") end)
+	-- Then
+	assertFalse(ok)
+	assertTrue(string.find(err, "empty alternative", 1, true) ~= nil)
+end
+
+function TestRegexpMulti:test_matches_should_return_all_ids()
+	-- Given
+	local re = self.rem.re:compile("select|union|insert|drop")
+	-- When
+	local ids = self.rem.matches(re, "id=1 union select * from users")
+	-- Then
+	assertEquals(#ids, 2)
+	assertEquals(ids[1], 1)
+	assertEquals(ids[2], 2)
+end
+
+function TestRegexpMulti:test_matches_should_return_overlapping_ids()
+	-- Given
+	local re = self.rem.re:compile("he|she|his|hers")
+	-- When
+	local ids = self.rem.matches(re, "ushers")
+	-- Then
+	assertEquals(#ids, 3)
+	assertEquals(ids[1], 1)
+	assertEquals(ids[2], 2)
+	assertEquals(ids[3], 4)
+end
+
+function TestRegexpMulti:test_matches_should_work_across_chunks()
+	-- Given
+	local re = self.rem.re:compile("dead|beef|coffee")
+	local vbuf = haka.vbuffer_from("bar de")
+	vbuf:append(haka.vbuffer_from("ad be"))
+	vbuf:append(haka.vbuffer_from("ef"))
+	-- When
+	local ids = self.rem.matches(re, vbuf:sub(0))
+	-- Then
+	assertEquals(#ids, 2)
+	assertEquals(ids[1], 1)
+	assertEquals(ids[2], 2)
+end
+
+function TestRegexpMulti:test_matches_should_fail_on_foreign_regexp()
+	-- Given
+	local pcre = require("regexp/pcre")
+	local re = pcre.re:compile("dead")
+	-- When
+	local ok = pcall(self.rem.matches, re, "dead")
+	-- Then
+	assertFalse(ok)
+end
+
+function TestRegexpMulti:test_feed_should_match_across_chunks()
+	-- Given
+	local re = self.rem.re:compile("dead|beef")
+	local sink = re:create_sink()
+	local vbuf = haka.vbuffer_from("bar de")
+	vbuf:append(haka.vbuffer_from("ad beef"))
+	-- When
+	local ret, begin, last = sink:feed(vbuf:sub(0), true)
+	-- Then
+	assertTrue(ret)
+	assertEquals(haka.vbuffer_sub(begin, last):asstring(), "dead")
+end
+
+function TestRegexpMulti:test_feed_should_be_partial_at_end_of_chunk()
+	-- Given
+	local re = self.rem.re:compile("dead|beef")
+	local sink = re:create_sink()
+	-- When
+	local ret = sink:feed(haka.vbuffer_from("bar de"):sub(0), false)
+	-- Then
+	assertFalse(ret)
+	assertTrue(sink:ispartial())
+	-- When
+	ret = sink:feed(haka.vbuffer_from("ad"):sub(0), true)
+	-- Then
+	assertTrue(ret)
+end
+
+function TestRegexpMulti:test_match_should_find_on_iterator()
+	-- Given
+	local re = self.rem.re:compile("dead|beef")
+	local vbuf = haka.vbuffer_from("bar de")
+	vbuf:append(haka.vbuffer_from("ad beef"))
+	local iter = vbuf:pos("begin")
+	-- When
+	local ret = re:match(iter, true)
+	-- Then
+	assertEquals(ret:asstring(), "dead")
+end
+
+addTestSuite('TestRegexpMulti')
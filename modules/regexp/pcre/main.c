@@ -8,6 +8,7 @@
 
 #include <haka/error.h>
 #include <haka/log.h>
+#include <haka/regexp_literal.h>
 #include <haka/regexp_module.h>
 #include <haka/thread.h>
 
@@ -45,6 +46,7 @@ struct regexp_pcre {
 	struct regexp super;
 	pcre *pcre;
 	atomic_t wscount_max;
+	struct regexp_literal literal;
 };
 
 struct regexp_sink_pcre {
@@ -173,6 +175,7 @@ static struct regexp *compile(const char *pattern, int options)
 	if (re->pcre == NULL) goto error;
 	re->super.ref_count = 1;
 	re->wscount_max = WSCOUNT_DEFAULT;
+	regexp_literal_extract(pattern, options, &re->literal);
 
 	return (struct regexp *)re;
 
@@ -205,15 +208,22 @@ static int exec(struct regexp *re, const char *buf, int len, struct regexp_resul
 	return _exec(re, buf, len, result);
 }
 
-static int vbexec(struct regexp *re, struct vbuffer_sub *vbuf, struct vbuffer_sub *result)
+static int vbexec(struct regexp *_re, struct vbuffer_sub *vbuf, struct vbuffer_sub *result)
 {
 	int ret;
+	struct regexp_pcre *re = (struct regexp_pcre *)_re;
 	struct regexp_sink_pcre *sink;
 
-	assert(re);
+	CHECK_REGEXP_TYPE(re);
 	assert(vbuf);
 
-	sink = _create_sink(re);
+	/* The regexp cannot match if its literal is not in the data */
+	if (!regexp_literal_vbcontains(&re->literal, vbuf)) {
+		if (result) *result = vbuffer_sub_init;
+		return REGEXP_NOMATCH;
+	}
+
+	sink = _create_sink(_re);
 
 	if (sink == NULL) return REGEXP_ERROR;
 
@@ -231,6 +241,9 @@ static int vbexec(struct regexp *re, struct vbuffer_sub *vbuf, struct vbuffer_su
 	_free_regexp_sink(sink);
 
 	return ret;
+
+type_error:
+	return REGEXP_ERROR;
 }
 
 static struct regexp_sink *create_sink(struct regexp *re)
@@ -373,6 +386,10 @@ static int _exec(struct regexp *_re, const char *buf, int len, struct regexp_res
 		*result = regexp_result_init;
 	}
 
+	if (!regexp_literal_contains(&re->literal, buf, len)) {
+		return REGEXP_NOMATCH;
+	}
+
 	ret = pcre_exec(re->pcre, NULL, buf, len, 0, 0, ovector, OVECTOR_SIZE);
 
 	/* Got some match (ret = 0) if we get more than OVECTOR_SIZE */
@@ -417,6 +434,14 @@ static int _partial_exec(struct regexp_sink_pcre *sink, const char *buf, int len
 	if (sink->super.match > 0)
 		return sink->super.match;
 
+	/* Without a partial match in progress, a match cannot start in data
+	 * that do not contain the literal prefix of the regexp */
+	if (sink->super.match == REGEXP_NOMATCH && regexp_literal_skip(&re->literal, buf, len)) {
+		sink->started = true;
+		sink->processed_length += len;
+		return sink->super.match;
+	}
+
 try_again:
 	/* HARD means that we prefer partial matches over full ones, SOFT is the contrary.
 	 * In our case, we prefer partial match unless we are at the end of the stream
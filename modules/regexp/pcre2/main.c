@@ -0,0 +1,811 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+
+#include <haka/compiler.h>
+#include <haka/error.h>
+#include <haka/log.h>
+#include <haka/regexp_literal.h>
+#include <haka/regexp_module.h>
+#include <haka/thread.h>
+
+static REGISTER_LOG_SECTION(pcre2);
+
+/* We enforce multiline on all API */
+#define DEFAULT_COMPILE_OPTIONS PCRE2_MULTILINE
+
+/* All matching modes used by this module are JIT compiled */
+#define JIT_OPTIONS (PCRE2_JIT_COMPLETE | PCRE2_JIT_PARTIAL_SOFT | PCRE2_JIT_PARTIAL_HARD)
+
+/* The default JIT stack is 32 KB and lives on the machine stack,
+ * allocate a bigger one per thread */
+#define JIT_STACK_MIN (32*1024)
+#define JIT_STACK_MAX (512*1024)
+
+/* The data of a pending partial match are kept up to 64 KB. Longer
+ * partial matches go on with the DFA matcher which does not need them */
+#define PENDING_MAX (64*1024)
+
+/* DFA workspace, 4 KB = 1024 int32 like the pcre module */
+#define WSCOUNT 1024
+
+#define CHECK_REGEXP_TYPE(re)\
+	do {\
+		if (re == NULL || re->super.module != &HAKA_MODULE) {\
+			error("Wrong regexp struct passed to PCRE2 module");\
+			goto type_error;\
+		}\
+	} while(0)
+
+#define CHECK_REGEXP_SINK_TYPE(sink)\
+	do {\
+		if (sink == NULL || sink->super.regexp->module != &HAKA_MODULE) {\
+			error("Wrong regexp_sink struct passed to PCRE2 module");\
+			goto type_error;\
+		}\
+	} while(0)
+
+struct regexp_pcre2 {
+	struct regexp super;
+	pcre2_code *code;
+	uint32 max_lookbehind;
+	struct regexp_literal literal;
+};
+
+struct regexp_sink_pcre2 {
+	struct regexp_sink super;
+	size_t processed_length;
+	pcre2_match_data *match_data;
+	/* Data kept from the previous feeds while a partial match is pending.
+	 * The next data are appended to it and the match restarts at
+	 * pending_start. */
+	uint8 *pending;
+	size_t pending_size;
+	size_t pending_capacity;
+	size_t pending_start;
+	/* DFA workspace, only allocated while a partial match too long to
+	 * be kept in the pending data is going on */
+	int *workspace;
+	size_t match_start;
+};
+
+/* Per-thread matching context holding the JIT stack */
+struct pcre2_thread_data {
+	pcre2_match_context *context;
+	pcre2_jit_stack *jit_stack;
+	pcre2_match_data *match_data;
+};
+
+static local_storage_t thread_data_key;
+
+static int  init(struct parameters *args);
+static void cleanup();
+
+static int                   match(const char *pattern, int options, const char *buf, int len, struct regexp_result *result);
+static int                   vbmatch(const char *pattern, int options, struct vbuffer_sub *vbuf, struct vbuffer_sub *result);
+
+static struct regexp        *compile(const char *pattern, int options);
+static void                  release_regexp(struct regexp *re);
+static int                   exec(struct regexp *re, const char *buf, int len, struct regexp_result *result);
+static int                   vbexec(struct regexp *re, struct vbuffer_sub *vbuf, struct vbuffer_sub *result);
+
+static struct regexp_sink   *create_sink(struct regexp *re);
+static void                  free_regexp_sink(struct regexp_sink *sink);
+static int                   feed(struct regexp_sink *sink, const char *buf, int len, bool eof, struct regexp_result *result);
+static int                   vbfeed(struct regexp_sink *sink, struct vbuffer_sub *vbuf, bool eof,
+		struct vbuffer_iterator *begin, struct vbuffer_iterator *end);
+
+static int                       _exec(struct regexp *re, const char *buf, int len, struct regexp_result *result);
+static int                       _partial_exec(struct regexp_sink_pcre2 *sink, const char *buf, int len, bool eof, struct regexp_result *result);
+static struct regexp_sink_pcre2 *_create_sink(struct regexp *_re);
+static void                      _free_regexp_sink(struct regexp_sink_pcre2 *sink);
+static int                       _vbpartial_exec(struct regexp_sink_pcre2 *sink, struct vbuffer_sub *vbuf, bool _eof,
+		struct vbuffer_iterator *begin, struct vbuffer_iterator *end);
+
+struct regexp_module HAKA_MODULE = {
+	module: {
+		type:        MODULE_REGEXP,
+		name:        "PCRE2 regexp engine",
+		description: "PCRE2 regexp engine with JIT compilation",
+		api_version: HAKA_API_VERSION,
+		init:        init,
+		cleanup:     cleanup
+	},
+
+	match:   match,
+	vbmatch: vbmatch,
+
+	compile:        compile,
+	release_regexp: release_regexp,
+	exec:           exec,
+	vbexec:         vbexec,
+
+	create_sink:      create_sink,
+	free_regexp_sink: free_regexp_sink,
+	feed:             feed,
+	vbfeed:           vbfeed,
+};
+
+static void thread_data_free(void *_data)
+{
+	struct pcre2_thread_data *data = (struct pcre2_thread_data *)_data;
+	if (data) {
+		pcre2_match_data_free(data->match_data);
+		pcre2_match_context_free(data->context);
+		pcre2_jit_stack_free(data->jit_stack);
+		free(data);
+	}
+}
+
+static struct pcre2_thread_data *get_thread_data()
+{
+	struct pcre2_thread_data *data = (struct pcre2_thread_data *)local_storage_get(&thread_data_key);
+	if (!data) {
+		data = malloc(sizeof(struct pcre2_thread_data));
+		if (!data) {
+			error("memory error");
+			return NULL;
+		}
+
+		data->context = pcre2_match_context_create(NULL);
+		data->jit_stack = pcre2_jit_stack_create(JIT_STACK_MIN, JIT_STACK_MAX, NULL);
+		data->match_data = pcre2_match_data_create(1, NULL);
+		if (!data->context || !data->jit_stack || !data->match_data) {
+			thread_data_free(data);
+			error("memory error");
+			return NULL;
+		}
+
+		pcre2_jit_stack_assign(data->context, NULL, data->jit_stack);
+
+		if (!local_storage_set(&thread_data_key, data)) {
+			thread_data_free(data);
+			return NULL;
+		}
+	}
+	return data;
+}
+
+INIT static void _pcre2_init()
+{
+	UNUSED const bool ret = local_storage_init(&thread_data_key, thread_data_free);
+	assert(ret);
+}
+
+FINI static void _pcre2_fini()
+{
+	thread_data_free(local_storage_get(&thread_data_key));
+	local_storage_destroy(&thread_data_key);
+}
+
+static int init(struct parameters *args)
+{
+	return 0;
+}
+
+static void cleanup()
+{
+}
+
+static int match(const char *pattern, int options, const char *buf, int len, struct regexp_result *result)
+{
+	int ret;
+	struct regexp *re;
+
+	assert(pattern);
+	assert(buf);
+
+	re = compile(pattern, options);
+	if (re == NULL) return REGEXP_ERROR;
+
+	ret = exec(re, buf, len, result);
+
+	release_regexp(re);
+
+	return ret;
+}
+
+static int vbmatch(const char *pattern, int options, struct vbuffer_sub *vbuf, struct vbuffer_sub *result)
+{
+	int ret;
+	struct regexp *re;
+
+	assert(pattern);
+	assert(vbuf);
+
+	re = compile(pattern, options);
+	if (re == NULL) return REGEXP_ERROR;
+
+	ret = vbexec(re, vbuf, result);
+
+	release_regexp(re);
+
+	return ret;
+}
+
+static struct regexp *compile(const char *pattern, int options)
+{
+	uint32 pcre2_options = DEFAULT_COMPILE_OPTIONS;
+	int errorcode;
+	PCRE2_SIZE erroffset;
+	struct regexp_pcre2 *re;
+	int ret;
+
+	assert(pattern);
+
+	re = malloc(sizeof(struct regexp_pcre2));
+	if (!re) {
+		error("memory error");
+		return NULL;
+	}
+
+	/* Convert options to PCRE2 options */
+	if (options & REGEXP_CASE_INSENSITIVE) pcre2_options |= PCRE2_CASELESS;
+	if (options & REGEXP_EXTENDED) pcre2_options |= PCRE2_EXTENDED;
+
+	re->super.module = &HAKA_MODULE;
+	re->code = pcre2_compile((PCRE2_SPTR)pattern, PCRE2_ZERO_TERMINATED, pcre2_options,
+			&errorcode, &erroffset, NULL);
+	if (re->code == NULL) goto error;
+	re->super.ref_count = 1;
+	regexp_literal_extract(pattern, options, &re->literal);
+
+	if (pcre2_pattern_info(re->code, PCRE2_INFO_MAXLOOKBEHIND, &re->max_lookbehind) != 0) {
+		re->max_lookbehind = 0;
+	}
+
+	/* The interpreter is used as a fallback if JIT is not available
+	 * on this platform */
+	ret = pcre2_jit_compile(re->code, JIT_OPTIONS);
+	if (ret != 0) {
+		LOG_DEBUG(pcre2, "JIT compilation failed with error %d, using interpreter", ret);
+	}
+
+	return (struct regexp *)re;
+
+error:
+	{
+		PCRE2_UCHAR errorstr[256];
+		pcre2_get_error_message(errorcode, errorstr, sizeof(errorstr));
+		free(re);
+		error("PCRE compilation failed with error '%s' at offset %d", errorstr, (int)erroffset);
+	}
+	return NULL;
+}
+
+static void release_regexp(struct regexp *_re)
+{
+	struct regexp_pcre2 *re = (struct regexp_pcre2 *)_re;
+
+	CHECK_REGEXP_TYPE(re);
+
+	if (atomic_dec(&re->super.ref_count) != 0) return;
+
+	pcre2_code_free(re->code);
+	free(re);
+
+type_error:
+	return;
+}
+
+static int exec(struct regexp *re, const char *buf, int len, struct regexp_result *result)
+{
+	assert(re);
+	assert(buf);
+
+	return _exec(re, buf, len, result);
+}
+
+static int vbexec(struct regexp *_re, struct vbuffer_sub *vbuf, struct vbuffer_sub *result)
+{
+	int ret;
+	struct regexp_pcre2 *re = (struct regexp_pcre2 *)_re;
+	struct regexp_sink_pcre2 *sink;
+
+	CHECK_REGEXP_TYPE(re);
+	assert(vbuf);
+
+	/* The regexp cannot match if its literal is not in the data */
+	if (!regexp_literal_vbcontains(&re->literal, vbuf)) {
+		if (result) *result = vbuffer_sub_init;
+		return REGEXP_NOMATCH;
+	}
+
+	sink = _create_sink(_re);
+
+	if (sink == NULL) return REGEXP_ERROR;
+
+	if (result) {
+		*result = vbuffer_sub_init;
+		_vbpartial_exec(sink, vbuf, true, &result->begin, &result->end);
+	}
+	else {
+		_vbpartial_exec(sink, vbuf, true, NULL, NULL);
+	}
+
+	ret = sink->super.match;
+	if (ret == REGEXP_PARTIAL) ret = REGEXP_NOMATCH;
+
+	_free_regexp_sink(sink);
+
+	return ret;
+
+type_error:
+	return REGEXP_ERROR;
+}
+
+static struct regexp_sink *create_sink(struct regexp *re)
+{
+	assert(re);
+
+	return (struct regexp_sink *)_create_sink(re);
+}
+
+static struct regexp_sink_pcre2 *_create_sink(struct regexp *_re)
+{
+	struct regexp_pcre2 *re = (struct regexp_pcre2 *)_re;
+	struct regexp_sink_pcre2 *sink;
+
+	CHECK_REGEXP_TYPE(re);
+
+	sink = malloc(sizeof(struct regexp_sink_pcre2));
+	if (!sink) {
+		error("memory error");
+		return NULL;
+	}
+
+	sink->super.regexp = _re;
+	sink->super.match = REGEXP_NOMATCH;
+	sink->processed_length = 0;
+	sink->pending = NULL;
+	sink->pending_size = 0;
+	sink->pending_capacity = 0;
+	sink->pending_start = 0;
+	sink->workspace = NULL;
+	sink->match_start = 0;
+	sink->match_data = pcre2_match_data_create(1, NULL);
+	if (!sink->match_data) {
+		free(sink);
+		error("memory error");
+		return NULL;
+	}
+
+	atomic_inc(&re->super.ref_count);
+
+	return sink;
+
+type_error:
+	return NULL;
+}
+
+static void free_regexp_sink(struct regexp_sink *_sink)
+{
+	struct regexp_sink_pcre2 *sink = (struct regexp_sink_pcre2 *)_sink;
+
+	CHECK_REGEXP_SINK_TYPE(sink);
+
+	_free_regexp_sink(sink);
+
+type_error:
+	return;
+}
+
+static void _free_regexp_sink(struct regexp_sink_pcre2 *sink)
+{
+	assert(sink);
+
+	release_regexp(sink->super.regexp);
+	pcre2_match_data_free(sink->match_data);
+	free(sink->pending);
+	free(sink->workspace);
+	free(sink);
+}
+
+static int feed(struct regexp_sink *_sink, const char *buf, int len, bool eof, struct regexp_result *result)
+{
+	struct regexp_sink_pcre2 *sink = (struct regexp_sink_pcre2 *)_sink;
+
+	CHECK_REGEXP_SINK_TYPE(sink);
+	assert(buf);
+
+	return _partial_exec(sink, buf, len, eof, result);
+
+type_error:
+	return REGEXP_ERROR;
+}
+
+static int vbfeed(struct regexp_sink *_sink, struct vbuffer_sub *vbuf, bool eof,
+		struct vbuffer_iterator *begin, struct vbuffer_iterator *end)
+{
+	struct regexp_sink_pcre2 *sink = (struct regexp_sink_pcre2 *)_sink;
+
+	CHECK_REGEXP_SINK_TYPE(sink);
+
+	return _vbpartial_exec(sink, vbuf, eof, begin, end);
+
+type_error:
+	return REGEXP_ERROR;
+}
+
+static int _exec(struct regexp *_re, const char *buf, int len, struct regexp_result *result)
+{
+	int ret;
+	struct regexp_pcre2 *re = (struct regexp_pcre2 *)_re;
+	struct pcre2_thread_data *data;
+
+	CHECK_REGEXP_TYPE(re);
+	assert(buf);
+
+	if (result != NULL) {
+		*result = regexp_result_init;
+	}
+
+	if (!regexp_literal_contains(&re->literal, buf, len)) {
+		return REGEXP_NOMATCH;
+	}
+
+	data = get_thread_data();
+	if (!data) return REGEXP_ERROR;
+
+	ret = pcre2_match(re->code, (PCRE2_SPTR)buf, len, 0, 0, data->match_data, data->context);
+
+	/* Got some match (ret = 0) if the ovector is too small */
+	if (ret >= 0) {
+		if (result != NULL) {
+			const PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(data->match_data);
+			result->first = ovector[0];
+			result->last = ovector[1];
+		}
+		return REGEXP_MATCH;
+	}
+
+	switch (ret) {
+		case PCRE2_ERROR_NOMATCH:
+			return REGEXP_NOMATCH;
+		default:
+			error("PCRE2 internal error %d", ret);
+			return REGEXP_ERROR;
+	}
+
+type_error:
+	return REGEXP_ERROR;
+}
+
+static bool pending_set(struct regexp_sink_pcre2 *sink, const uint8 *data, size_t size)
+{
+	if (size > sink->pending_capacity) {
+		uint8 *pending = realloc(sink->pending, size);
+		if (!pending) {
+			error("memory error");
+			return false;
+		}
+		sink->pending = pending;
+		sink->pending_capacity = size;
+	}
+
+	/* The data can overlap when they come from the pending buffer itself */
+	memmove(sink->pending, data, size);
+	sink->pending_size = size;
+	return true;
+}
+
+static bool pending_append(struct regexp_sink_pcre2 *sink, const char *buf, int len)
+{
+	const size_t size = sink->pending_size + len;
+
+	if (size > sink->pending_capacity) {
+		size_t capacity = sink->pending_capacity * 2;
+		uint8 *pending;
+
+		if (capacity < size) capacity = size;
+
+		pending = realloc(sink->pending, capacity);
+		if (!pending) {
+			error("memory error");
+			return false;
+		}
+		sink->pending = pending;
+		sink->pending_capacity = capacity;
+	}
+
+	memcpy(sink->pending + sink->pending_size, buf, len);
+	sink->pending_size = size;
+	return true;
+}
+
+/* Run the DFA matcher. It keeps the state of a partial match in its
+ * workspace and then goes on with the next data alone, with the
+ * PCRE2_DFA_RESTART option (see pcre2partial(3)). */
+static int _dfa_exec(struct regexp_sink_pcre2 *sink, struct pcre2_thread_data *data,
+		const uint8 *subject, size_t subject_size, size_t start, size_t subject_offset,
+		uint32 options, struct regexp_result *result)
+{
+	int ret;
+	const PCRE2_SIZE *ovector;
+	struct regexp_pcre2 *re = (struct regexp_pcre2 *)sink->super.regexp;
+
+	if (!sink->workspace) {
+		sink->workspace = malloc(WSCOUNT*sizeof(int));
+		if (!sink->workspace) {
+			error("memory error");
+			return REGEXP_ERROR;
+		}
+	}
+
+	ret = pcre2_dfa_match(re->code, subject, subject_size, start, options,
+			sink->match_data, data->context, sink->workspace, WSCOUNT);
+
+	ovector = pcre2_get_ovector_pointer(sink->match_data);
+
+	if (ret >= 0 || ret == PCRE2_ERROR_PARTIAL) {
+		/* On a restart, the match started in some previous data */
+		if (!(options & PCRE2_DFA_RESTART)) {
+			sink->match_start = subject_offset + ovector[0];
+		}
+
+		if (result) {
+			result->first = sink->match_start;
+		}
+
+		if (ret == PCRE2_ERROR_PARTIAL) {
+			sink->super.match = REGEXP_PARTIAL;
+			return sink->super.match;
+		}
+
+		if (result) {
+			result->last = subject_offset + ovector[1];
+		}
+		sink->super.match = REGEXP_MATCH;
+	}
+	else if (ret == PCRE2_ERROR_NOMATCH) {
+		sink->super.match = REGEXP_NOMATCH;
+	}
+	else {
+		error("PCRE2 DFA matching error %d", ret);
+		sink->super.match = REGEXP_ERROR;
+	}
+
+	free(sink->workspace);
+	sink->workspace = NULL;
+	return sink->super.match;
+}
+
+static int _partial_exec(struct regexp_sink_pcre2 *sink, const char *buf, int len, bool eof, struct regexp_result *result)
+{
+	int ret;
+	uint32 options;
+	const PCRE2_SIZE *ovector;
+	struct regexp_pcre2 *re;
+	struct pcre2_thread_data *data;
+	const uint8 *subject;
+	size_t subject_size, subject_offset, start;
+
+	assert(sink);
+	assert(buf);
+
+	re = (struct regexp_pcre2 *)sink->super.regexp;
+
+	/* If we already match don't bother with regexp again */
+	if (sink->super.match > 0)
+		return sink->super.match;
+
+	/* HARD means that we prefer partial matches over full ones, SOFT is the contrary.
+	 * In our case, we prefer partial match unless we are at the end of the stream
+	 * in which case a full match is better. */
+	options = eof ? PCRE2_PARTIAL_SOFT : PCRE2_PARTIAL_HARD;
+	if (!eof) options |= PCRE2_NOTEOL;
+
+	/* A partial match too long to keep its data goes on with the DFA matcher */
+	if (sink->workspace) {
+		data = get_thread_data();
+		if (!data) goto error;
+
+		ret = _dfa_exec(sink, data, (const uint8 *)buf, len, 0, sink->processed_length,
+				options | PCRE2_NOTBOL | PCRE2_DFA_RESTART, result);
+		if (ret == REGEXP_ERROR) goto error;
+
+		if (ret != REGEXP_NOMATCH) {
+			sink->processed_length += len;
+			return ret;
+		}
+
+		/* As with the pcre module, a new match is then only looked for
+		 * in the current data */
+	}
+
+	/* Without a partial match in progress, a match cannot start in data
+	 * that do not contain the literal prefix of the regexp */
+	if (sink->super.match == REGEXP_NOMATCH && regexp_literal_skip(&re->literal, buf, len)) {
+		sink->processed_length += len;
+		return sink->super.match;
+	}
+
+	data = get_thread_data();
+	if (!data) goto error;
+
+	/* On a pending partial match, PCRE2 needs to see again the data from
+	 * the start of the partial match (see pcre2partial(3)) */
+	if (sink->super.match == REGEXP_PARTIAL) {
+		if (!pending_append(sink, buf, len)) goto error;
+
+		subject = sink->pending;
+		subject_size = sink->pending_size;
+		subject_offset = sink->processed_length - (sink->pending_size - len);
+		start = sink->pending_start;
+	}
+	else {
+		subject = (const uint8 *)buf;
+		subject_size = len;
+		subject_offset = sink->processed_length;
+		start = 0;
+	}
+
+	if (subject_offset > 0) options |= PCRE2_NOTBOL;
+
+	sink->processed_length += len;
+
+	if (sink->super.match == REGEXP_PARTIAL && subject_size - start > PENDING_MAX) {
+		ret = _dfa_exec(sink, data, subject, subject_size, start, subject_offset, options, result);
+		sink->pending_size = 0;
+		if (ret == REGEXP_ERROR) goto error;
+		return ret;
+	}
+
+	ret = pcre2_match(re->code, subject, subject_size, start, options,
+			sink->match_data, data->context);
+
+	ovector = pcre2_get_ovector_pointer(sink->match_data);
+
+	if (ret >= 0) {
+		if (result) {
+			result->first = subject_offset + ovector[0];
+			result->last = subject_offset + ovector[1];
+		}
+		sink->super.match = REGEXP_MATCH;
+		sink->pending_size = 0;
+		return sink->super.match;
+	}
+
+	switch (ret) {
+		case PCRE2_ERROR_PARTIAL:
+			{
+				/* Keep the data from the start of the partial match
+				 * including the characters needed by lookbehind assertions */
+				const size_t partial = ovector[0];
+				const size_t keep = partial > re->max_lookbehind ? partial - re->max_lookbehind : 0;
+
+				if (subject_size - partial > PENDING_MAX) {
+					ret = _dfa_exec(sink, data, subject, subject_size, partial, subject_offset,
+							options, result);
+					sink->pending_size = 0;
+					if (ret == REGEXP_ERROR) goto error;
+					return ret;
+				}
+
+				if (!pending_set(sink, subject + keep, subject_size - keep)) goto error;
+				sink->pending_start = partial - keep;
+
+				if (result) {
+					result->first = subject_offset + partial;
+				}
+				sink->super.match = REGEXP_PARTIAL;
+				return sink->super.match;
+			}
+		case PCRE2_ERROR_NOMATCH:
+			sink->super.match = REGEXP_NOMATCH;
+			sink->pending_size = 0;
+			return sink->super.match;
+		default:
+			error("PCRE2 internal error %d", ret);
+			goto error;
+	}
+
+error:
+	sink->super.match = REGEXP_ERROR;
+	sink->pending_size = 0;
+	return REGEXP_ERROR;
+}
+
+/* Get the vbuffer position of an absolute offset. The offset is either inside
+ * the current chunk or inside some data kept for a partial match that started
+ * in a previous chunk of the same vbuffer. */
+static void locate(struct vbuffer_iterator *chunk_iter, size_t chunk_offset,
+		struct vbuffer_iterator *partial_iter, size_t partial_offset,
+		size_t offset, struct vbuffer_iterator *position)
+{
+	if (offset >= chunk_offset) {
+		vbuffer_iterator_copy(chunk_iter, position);
+		vbuffer_iterator_advance(position, offset - chunk_offset);
+	}
+	else if (vbuffer_iterator_isvalid(partial_iter) && offset >= partial_offset) {
+		vbuffer_iterator_copy(partial_iter, position);
+		vbuffer_iterator_advance(position, offset - partial_offset);
+	}
+	else {
+		*position = vbuffer_iterator_init;
+	}
+}
+
+static int _vbpartial_exec(struct regexp_sink_pcre2 *sink, struct vbuffer_sub *vbuf, bool _eof,
+		struct vbuffer_iterator *begin, struct vbuffer_iterator *end)
+{
+	int ret = 0;
+	size_t len, plen = 0;
+	size_t offset;
+	struct vbuffer_sub_mmap mmap_iter = vbuffer_mmap_init;
+	const uint8 *pptr = NULL;
+	struct regexp_result result = regexp_result_init;
+	struct vbuffer_iterator iter = vbuffer_iterator_init;
+	struct vbuffer_iterator piter = vbuffer_iterator_init;
+	struct vbuffer_iterator partial_iter = vbuffer_iterator_init;
+	size_t partial_offset = 0;
+
+	assert(sink);
+
+	if (!vbuf) {
+		if (_eof && sink->super.match == REGEXP_PARTIAL) {
+			/* If the eof is set and we are inside a partial match, we need
+			 * to send some empty data to make sure we can detect a regexp
+			 * that use the EOL. */
+			_partial_exec(sink, "", 0, _eof, NULL);
+		}
+	}
+	else {
+		/* In order to avoid vbuffer ending with empty chunck,
+		 * we keep previous non-empty ptr in pptr and
+		 * wait for end or next non-empty ptr to match against it */
+		do {
+			const uint8 *ptr = vbuffer_mmap(vbuf, &len, false, &mmap_iter, &iter);
+			bool last = (ptr == NULL);
+			bool eof = _eof && last;
+
+			/* Skip empty chunks except for end of vbuffer where we want to send previous valid */
+			if (len == 0 && !last) continue;
+
+			/* We got a new valid pointer, send previous one to pcre2 */
+			if (pptr) {
+				/* eof if last is empty */
+				result = regexp_result_init;
+
+				/* save the sink processed length to only get the indices inside the current data */
+				offset = sink->processed_length;
+
+				ret = _partial_exec(sink, (const char *)pptr, plen, eof && len == 0, &result);
+
+				if (result.first != (size_t)-1) {
+					struct vbuffer_iterator first;
+					locate(&piter, offset, &partial_iter, partial_offset, result.first, &first);
+
+					if (ret == REGEXP_PARTIAL) {
+						partial_iter = first;
+						partial_offset = result.first;
+					}
+
+					if (begin && vbuffer_iterator_isvalid(&first)) {
+						*begin = first;
+					}
+				}
+				if (end && (result.last != (size_t)-1)) {
+					locate(&piter, offset, &partial_iter, partial_offset, result.last, end);
+				}
+
+				/* if match or something goes wrong avoid parsing more */
+				if (ret != REGEXP_NOMATCH && ret != REGEXP_PARTIAL) break;
+			}
+
+			pptr = ptr;
+			plen = len;
+			piter = iter;
+
+		} while (pptr != NULL);
+	}
+
+	return sink->super.match;
+}
@@ -0,0 +1,19 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+%module pcre2
+
+%{
+
+#include <haka/regexp_module.h>
+
+extern struct regexp_module HAKA_MODULE;
+
+static struct regexp_module *re = &HAKA_MODULE;
+
+%}
+
+%include "haka/lua/swig.si"
+
+struct regexp_module *re;
@@ -0,0 +1,90 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+TestRegexpPcre2 = {}
+
+function TestRegexpPcre2:setUp()
+	self.rem = require("regexp/pcre2")
+end
+
+function TestRegexpPcre2:test_feed_should_match_across_chunks()
+	-- Given
+	local re = self.rem.re:compile("abc[0-9]+def")
+	local sink = re:create_sink()
+	local result = haka.regexp_result()
+	-- When
+	assertFalse(sink:feed("xxab", false, result))
+	assertTrue(sink:ispartial())
+	assertFalse(sink:feed("c12", false, result))
+	assertTrue(sink:ispartial())
+	local ret = sink:feed("34def yy", true, result)
+	-- Then
+	assertTrue(ret)
+	assertEquals(result.first, 2)
+	assertEquals(result.last, 12)
+end
+
+function TestRegexpPcre2:test_feed_should_match_after_failed_partial()
+	-- Given
+	local re = self.rem.re:compile("abc[0-9]def")
+	local sink = re:create_sink()
+	local result = haka.regexp_result()
+	-- When
+	assertFalse(sink:feed("xxabc1", false, result))
+	assertTrue(sink:ispartial())
+	local ret = sink:feed("x abc9def", true, result)
+	-- Then
+	assertTrue(ret)
+	assertEquals(result.first, 8)
+	assertEquals(result.last, 15)
+end
+
+function TestRegexpPcre2:test_feed_should_match_long_partial()
+	-- Given
+	local re = self.rem.re:compile("begin[a-z]*end")
+	local sink = re:create_sink()
+	local result = haka.regexp_result()
+	local chunk = string.rep("a", 1024)
+	-- When
+	assertFalse(sink:feed("xxbegin", false, result))
+	for i=1,200 do
+		assertFalse(sink:feed(chunk, false, result))
+		assertTrue(sink:ispartial())
+	end
+	local ret = sink:feed("aaend!", true, result)
+	-- Then
+	assertTrue(ret)
+	assertEquals(result.first, 2)
+	assertEquals(result.last, 7 + 200*1024 + 5)
+end
+
+function TestRegexpPcre2:test_feed_should_match_after_failed_long_partial()
+	-- Given
+	local re = self.rem.re:compile("begin[a-z]*end")
+	local sink = re:create_sink()
+	local result = haka.regexp_result()
+	local chunk = "xxbegin" .. string.rep("a", 100000 - 7)
+	-- When
+	assertFalse(sink:feed(chunk, false, result))
+	assertFalse(sink:feed("aa", false, result))
+	assertTrue(sink:ispartial())
+	local ret = sink:feed("1 beginxend", true, result)
+	-- Then
+	assertTrue(ret)
+	assertEquals(result.first, 100004)
+	assertEquals(result.last, 100013)
+end
+
+function TestRegexpPcre2:test_feed_should_not_match_long_partial_at_eof()
+	-- Given
+	local re = self.rem.re:compile("begin[a-z]*end")
+	local sink = re:create_sink()
+	-- When
+	assertFalse(sink:feed("begin" .. string.rep("a", 100000), false))
+	local ret = sink:feed("aaa", true)
+	-- Then
+	assertFalse(ret)
+end
+
+addTestSuite('TestRegexpPcre2')
@@ -323,5 +323,6 @@ SmtpDissector.state_machine = haka.state_machine.new("smtp", function ()
 end)
 
 module.events = SmtpDissector.events
+module.options = SmtpDissector.options
 
 return module
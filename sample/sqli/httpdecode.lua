@@ -1,4 +1,6 @@
 
+local native = require('misc/decode')
+
 ------------------------------------
 -- Transformation Methods
 ------------------------------------
@@ -20,12 +22,7 @@ end
 
 -- Percent decode
 function decode(uri)
-	if uri then
-		uri = string.gsub (uri, '+', ' ')
-		uri = string.gsub (uri, '%%(%x%x)',
-		function(h) return string.char(tonumber(h,16)) end)
-		return uri
-	end
+	if uri then return native.form(uri) end
 end
 
 -- Lower case
@@ -465,6 +465,7 @@ struct redirect_logger *redirect_logger_create(d)
 	list_init(&logger->logger);
 	logger->logger.message = redirect_logger_message;
 	logger->logger.destroy = redirect_logger_destroy;
+	logger->logger.async = false;
 	logger->logger.mark_for_remove = false;
 	logger->fd = -1;
 	mutex_init(&logger->mutex, false);
@@ -520,6 +521,7 @@ struct redirect_alerter *redirect_alerter_create(d)
 	alerter->alerter.alert = redirect_alerter_alert;
 	alerter->alerter.update = redirect_alerter_update;
 	alerter->alerter.destroy = redirect_alerter_destroy;
+	alerter->alerter.async = false;
 	alerter->alerter.mark_for_remove = false;
 	alerter->fd = -1;
 	mutex_init(&alerter->mutex, false);
@@ -538,6 +540,19 @@ static enum clt_client_rc ctl_client_process_command(struct ctl_client_state *st
 		haka_exit();
 		return CTL_CLIENT_DONE;
 	}
+	else if (strcmp(command, "RELOAD") == 0) {
+		LOG_INFO(MODULE, "reloading configuration %s", get_configuration_script());
+
+		if (!thread_pool_reload(get_thread_pool())) {
+			const char *err = clear_error();
+			LOG_ERROR(MODULE, "reload failed: %s", err);
+			ctl_send_status(state->fd, -1, err);
+		}
+		else {
+			ctl_send_status(state->fd, 0, NULL);
+		}
+		return CTL_CLIENT_OK;
+	}
 	else if (strcmp(command, "LOGS") == 0) {
 		struct redirect_logger *logger = redirect_logger_create(state->fd);
 		struct redirect_alerter *alerter = redirect_alerter_create(state->fd);
@@ -17,8 +17,10 @@
 #include <haka/error.h>
 #include <haka/alert.h>
 #include <haka/alert_module.h>
+#include <haka/regexp_module.h>
 #include <haka/version.h>
 #include <haka/lua/state.h>
+#include <haka/lua/alloc.h>
 #include <haka/luadebug/debugger.h>
 #include <haka/luadebug/interactive.h>
 #include <haka/luadebug/user.h>
@@ -282,6 +284,32 @@ int read_configuration(const char *file)
 		}
 	}
 
+	/* Lua garbage collection */
+	{
+		struct thread_gc_config gc;
+		gc.step = parameters_get_integer(config, "general:lua_gc_step", 16);
+		gc.idle_step = parameters_get_integer(config, "general:lua_gc_idle_step", 256);
+		gc.max_pause = parameters_get_integer(config, "general:lua_gc_max_pause", 500);
+		gc.max_memory = parameters_get_integer(config, "general:lua_gc_max_memory", 0);
+		thread_set_gc_config(&gc);
+
+		lua_alloc_set_enabled(parameters_get_boolean(config, "general:lua_allocator", LUA_ALLOC_SUPPORTED));
+		lua_alloc_set_hugepages(parameters_get_boolean(config, "general:lua_hugepages", false));
+	}
+
+	/* Configuration reload */
+	thread_set_reload_drain_timeout(parameters_get_integer(config, "general:reload_drain_timeout", 600));
+
+	/* Regexp engine used by the grammars */
+	{
+		const char *regexp = parameters_get_string(config, "general:regexp", NULL);
+		if (regexp && !regexp_module_set_default(regexp)) {
+			LOG_FATAL(core, clear_error());
+			clean_exit();
+			exit(1);
+		}
+	}
+
 	/* Log level */
 	{
 		const char *_level = parameters_get_string(config, "log:level", "info");
@@ -345,6 +373,22 @@ int read_configuration(const char *file)
 		const char *module;
 
 		parameters_open_section(config, "alert");
+
+		{
+			struct alert_limits limits;
+			limits.aggregate_window = parameters_get_integer(config, "aggregate_window", 0);
+			limits.rate = parameters_get_integer(config, "rate_limit", 0);
+			limits.burst = parameters_get_integer(config, "rate_burst", limits.rate);
+			limits.key_rate = parameters_get_integer(config, "key_rate_limit", 0);
+			limits.key_burst = parameters_get_integer(config, "key_rate_burst", limits.key_rate);
+
+			if (!alert_set_limits(&limits)) {
+				LOG_FATAL(core, "cannot set alert limits: %s", clear_error());
+				clean_exit();
+				return 1;
+			}
+		}
+
 		module = parameters_get_string(config, "module", NULL);
 		if (module) {
 			struct alerter *alerter;
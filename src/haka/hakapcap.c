@@ -14,6 +14,7 @@
 #include <haka/thread.h>
 #include <haka/alert.h>
 #include <haka/alert_module.h>
+#include <haka/regexp_module.h>
 #include <haka/error.h>
 #include <haka/version.h>
 #include <haka/parameters.h>
@@ -47,8 +48,11 @@ static void help(const char *program)
 	fprintf(stdout, "\t-a,--alert-to <file>:   Redirect alerts to given file\n");
 	fprintf(stdout, "\t--debug-lua:            Activate lua debugging\n");
 	fprintf(stdout, "\t--dump-dissector-graph: Dump dissector internals (grammar and state machine) in file <name>.dot\n");
+	fprintf(stdout, "\t--regexp <module>:      Select the regexp module used by the grammars\n");
+	fprintf(stdout, "\t                          (default: regexp/pcre)\n");
 	fprintf(stdout, "\t--no-pass-through, --pass-through:\n");
 	fprintf(stdout, "\t                        Select pass-through mode (default: true)\n");
+	fprintf(stdout, "\t--reload-after <count>: Reload the configuration after <count> packets\n");
 	fprintf(stdout, "\t-o <output>:            Save result in a pcap file\n");
 }
 
@@ -75,6 +79,8 @@ static int parse_cmdline(int *argc, char ***argv)
 		{ "dump-dissector-graph", no_argument,       0, 'G' },
 		{ "no-pass-through",      no_argument,       0, 'p' },
 		{ "pass-through",         no_argument,       0, 'P' },
+		{ "regexp",               required_argument, 0, 'R' },
+		{ "reload-after",         required_argument, 0, 'r' },
 		{ 0,                      0,                 0, 0 }
 	};
 
@@ -131,6 +137,18 @@ static int parse_cmdline(int *argc, char ***argv)
 			dissector_graph = true;
 			break;
 
+		case 'R':
+			if (!regexp_module_set_default(optarg)) {
+				LOG_FATAL(core, clear_error());
+				clean_exit();
+				exit(1);
+			}
+			break;
+
+		case 'r':
+			thread_set_reload_after(atoi(optarg));
+			break;
+
 		default:
 			usage(stderr, (*argv)[0]);
 			return 2;
@@ -31,6 +31,7 @@ function haka.rule(r)
 	check.assert(class.isa(r.hook, haka.event.Event), "rule hook must be an event")
 	check.assert(type(r.eval) == 'function', "rule eval function expected")
 	check.assert(not r.options or type(r.options) == 'table', "rule options should be table")
+	check.assert(not r.match or type(r.match) == 'table', "rule match should be table")
 
 	local loc = debug.getinfo(2, 'nSl')
 	r.location = string.format("%s:%d", loc.short_src, loc.currentline)
@@ -38,7 +39,7 @@ function haka.rule(r)
 
 	table.insert(module.rules, r)
 
-	haka.context.connections:register(r.hook, r.eval, r.options or {})
+	haka.context.connections:register(r.hook, r.eval, r.options or {}, r.match)
 end
 
 function haka.console.rules()
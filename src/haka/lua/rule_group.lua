@@ -56,12 +56,13 @@ function haka.rule_group(args)
 	check.assert(not args.continue or type(args.continue) == 'function', "rule group continue function expected")
 	check.assert(not args.final or type(args.final) == 'function', "rule group final function expected")
 	check.assert(not args.options or type(args.options) == 'table', "rule group options should be table")
+	check.assert(not args.match or type(args.match) == 'table', "rule group match should be table")
 
 	local group = rule_group:new(args)
 
 	haka.context.connections:register(args.hook,
 		function (...) group:eval(...) end,
-		args.options)
+		args.options, args.match)
 
 	table.insert(rule.rules, group)
 
@@ -0,0 +1,22 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+-- Stress the method and property lookups on the dissector classes
+
+local ipv4 = require('protocol/ipv4')
+local tcp_connection = require('protocol/tcp_connection')
+
+local count = 0
+
+haka.rule{
+	hook = tcp_connection.events.receive_packet,
+	eval = function (flow, pkt, direction)
+		for i = 1, 100 do
+			-- Method, property and missing field
+			if flow:can_continue() and flow.name and not flow.unknown then
+				count = count + 1
+			end
+		end
+	end
+}
@@ -0,0 +1 @@
+tcp-filter.lua
\ No newline at end of file
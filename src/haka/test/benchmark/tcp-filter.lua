@@ -0,0 +1,23 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+-- Same rules as tcp-rules.lua with the port checked in the rules, to
+-- compare with the indexed dispatch of the match clause.
+
+local ipv4 = require('protocol/ipv4')
+local tcp_connection = require('protocol/tcp_connection')
+
+local count = tonumber(debug.getinfo(1, 'S').source:match("-(%d+)%.lua$"))
+
+for i = 1, count do
+	local port = 10000 + i
+	haka.rule{
+		hook = tcp_connection.events.receive_packet,
+		eval = function (flow, pkt, direction)
+			if flow.dstport == port then
+				return
+			end
+		end
+	}
+end
@@ -0,0 +1 @@
+tcp-rules.lua
\ No newline at end of file
@@ -0,0 +1,20 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+-- Scaling with the rule count, each rule filters on a port which does
+-- not appear in the capture. The rule count is taken from the script name.
+
+local ipv4 = require('protocol/ipv4')
+local tcp_connection = require('protocol/tcp_connection')
+
+local count = tonumber(debug.getinfo(1, 'S').source:match("-(%d+)%.lua$"))
+
+for i = 1, count do
+	haka.rule{
+		hook = tcp_connection.events.receive_packet,
+		match = { dstport = 10000 + i },
+		eval = function (flow, pkt, direction)
+		end
+	}
+end
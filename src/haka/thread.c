@@ -11,6 +11,7 @@
 #include <string.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
 
 #include <haka/log.h>
 #include <haka/packet_module.h>
@@ -19,6 +20,7 @@
 #include <haka/engine.h>
 #include <haka/system.h>
 #include <haka/timer.h>
+#include <haka/time.h>
 #include <haka/lua/state.h>
 #include <haka/lua/luautils.h>
 #include <haka/luadebug/debugger.h>
@@ -42,12 +44,20 @@ struct thread_state {
 	struct packet_module       *packet_module;
 	struct packet_module_state *capture;
 	struct lua_state           *lua;
+	struct lua_state           *reload;    /* New configuration, not yet used */
+	struct lua_state           *previous;  /* Configuration kept for its open flows */
+	struct time                 previous_start;
 	int                         lua_function;
 	thread_t                    thread;
 	bool                        canceled;
+	bool                        dissector_graph;
 	int32                       attach_debugger;
 	struct thread_pool         *pool;
 	struct engine_thread       *engine;
+	bool                        gc_automatic;
+	size_t                      gc_max_memory;
+	size_t                      gc_packet_count;
+	size_t                      gc_idle_count;
 };
 
 struct thread_pool {
@@ -62,38 +72,184 @@ struct thread_pool {
 
 extern bool lua_pushppacket(lua_State *L, struct packet *pkt);
 
-static void filter_wrapper(struct thread_state *state, struct packet *pkt)
+static struct thread_gc_config gc_config = {
+	step:      16,
+	idle_step: 256,
+	max_pause: 500,
+	max_memory: 0,
+};
+
+static int reload_drain_timeout = 600;
+static size_t reload_after = 0;
+
+void thread_set_gc_config(const struct thread_gc_config *config)
+{
+	gc_config = *config;
+}
+
+void thread_set_reload_drain_timeout(int seconds)
+{
+	reload_drain_timeout = seconds;
+}
+
+void thread_set_reload_after(size_t count)
+{
+	reload_after = count;
+}
+
+static uint64 gc_clock()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * The automatic collector of the packet threads is stopped, the collection
+ * is done by the packet and idle steps. It is restarted when the memory goes
+ * past the ceiling, which is the configured maximum or twice the memory in
+ * use at the end of the last cycle.
+ */
+static bool gc_explicit()
+{
+	return gc_config.step > 0 || gc_config.idle_step > 0;
+}
+
+static void gc_set_automatic(struct thread_state *state, bool automatic)
+{
+	lua_gc(state->lua->L, automatic ? LUA_GCRESTART : LUA_GCSTOP, 0);
+	state->gc_automatic = automatic;
+}
+
+static void gc_start(struct thread_state *state)
+{
+	const size_t count = lua_gc(state->lua->L, LUA_GCCOUNT, 0);
+
+	state->gc_packet_count = count;
+	state->gc_idle_count = 0;
+	state->gc_max_memory = gc_config.max_memory > 0 ? gc_config.max_memory : 2 * count;
+	gc_set_automatic(state, !gc_explicit());
+}
+
+static void gc_check_memory(struct thread_state *state)
+{
+	const size_t count = lua_gc(state->lua->L, LUA_GCCOUNT, 0);
+	const bool automatic = count > state->gc_max_memory;
+
+	if (automatic != state->gc_automatic) {
+		gc_set_automatic(state, automatic);
+	}
+}
+
+/*
+ * Run the collector by steps of the given size until the given amount of
+ * work in KB is done, until the end of the current cycle or until the time
+ * budget is spent. Returns the time spent.
+ */
+static uint64 gc_run(struct thread_state *state, int step, size_t work, uint64 budget, bool idle)
+{
+	volatile struct gc_stats *stats = engine_thread_gc_statistics(state->engine);
+	const uint64 start = gc_clock();
+	uint64 elapsed;
+	size_t done = 0;
+	bool finished;
+
+	do {
+		finished = lua_gc(state->lua->L, LUA_GCSTEP, step);
+		done += step;
+		elapsed = gc_clock() - start;
+
+		if (idle) ++stats->idle_steps;
+		else ++stats->steps;
+	} while (!finished && done < work && elapsed < budget);
+
+	if (finished) {
+		++stats->cycles;
+
+		if (gc_config.max_memory <= 0) {
+			state->gc_max_memory = 2 * lua_gc(state->lua->L, LUA_GCCOUNT, 0);
+		}
+	}
+	stats->time += elapsed;
+
+	/* A step sets the threshold of the automatic collector again */
+	if (!state->gc_automatic) {
+		lua_gc(state->lua->L, LUA_GCSTOP, 0);
+	}
+
+	return elapsed;
+}
+
+/*
+ * Collect after each packet as much memory as the packet allocated, by steps
+ * of the configured size and within the maximum pause.
+ */
+static void gc_packet_step(struct thread_state *state)
+{
+	size_t count, work;
+
+	if (gc_config.step <= 0) return;
+
+	count = lua_gc(state->lua->L, LUA_GCCOUNT, 0);
+	work = count > state->gc_packet_count ? count - state->gc_packet_count : 0;
+	if (work < (size_t)gc_config.step) work = gc_config.step;
+
+	gc_run(state, gc_config.step, work, gc_config.max_pause, false);
+
+	state->gc_packet_count = lua_gc(state->lua->L, LUA_GCCOUNT, 0);
+	gc_check_memory(state);
+}
+
+/* Larger collection when no packet is waiting */
+static void gc_idle(void *_state)
+{
+	struct thread_state *state = (struct thread_state *)_state;
+	size_t count;
+
+	if (gc_config.idle_step <= 0 || !state->lua) return;
+
+	/* Nothing to do if the memory did not grow since the last idle cycle */
+	count = lua_gc(state->lua->L, LUA_GCCOUNT, 0);
+	if (count < state->gc_idle_count + gc_config.idle_step) return;
+
+	gc_run(state, gc_config.idle_step, (size_t)-1, gc_config.max_pause, true);
+	state->gc_idle_count = lua_gc(state->lua->L, LUA_GCCOUNT, 0);
+	state->gc_packet_count = state->gc_idle_count;
+	gc_check_memory(state);
+}
+
+static void filter_wrapper(struct lua_state *lua, struct packet *pkt)
 {
 	int h;
-	LUA_STACK_MARK(state->lua->L);
+	LUA_STACK_MARK(lua->L);
 
 	packet_addref(pkt);
 
-	lua_pushcfunction(state->lua->L, lua_state_error_formater);
-	h = lua_gettop(state->lua->L);
+	lua_pushcfunction(lua->L, lua_state_error_formater);
+	h = lua_gettop(lua->L);
 
-	lua_getglobal(state->lua->L, "haka");
-	lua_getfield(state->lua->L, -1, "filter");
+	lua_getglobal(lua->L, "haka");
+	lua_getfield(lua->L, -1, "filter");
 
-	if (!lua_isnil(state->lua->L, -1)) {
-		if (!lua_pushppacket(state->lua->L, pkt)) {
+	if (!lua_isnil(lua->L, -1)) {
+		if (!lua_pushppacket(lua->L, pkt)) {
 			LOG_ERROR(core, "packet internal error");
 			packet_drop(pkt);
 		}
 		else {
-			if (lua_pcall(state->lua->L, 1, 0, h)) {
-				lua_state_print_error(state->lua->L, "filter");
+			if (lua_pcall(lua->L, 1, 0, h)) {
+				lua_state_print_error(lua->L, "filter");
 				packet_drop(pkt);
 			}
 		}
 	}
 	else {
-		lua_pop(state->lua->L, 1);
+		lua_pop(lua->L, 1);
 		packet_drop(pkt);
 	}
 
-	lua_pop(state->lua->L, 2);
-	LUA_STACK_CHECK(state->lua->L, 0);
+	lua_pop(lua->L, 2);
+	LUA_STACK_CHECK(lua->L, 0);
 
 	packet_release(pkt);
 }
@@ -112,6 +268,16 @@ static void cleanup_thread_state_lua(struct thread_state *state)
 		lua_state_close(state->lua);
 		state->lua = NULL;
 	}
+
+	if (state->previous) {
+		lua_state_close(state->previous);
+		state->previous = NULL;
+	}
+
+	if (state->reload) {
+		lua_state_close(state->reload);
+		state->reload = NULL;
+	}
 }
 
 static void cleanup_thread_state(struct thread_state *state)
@@ -129,6 +295,34 @@ static void cleanup_thread_state(struct thread_state *state)
 	free(state);
 }
 
+static struct lua_state *init_thread_lua(bool dissector_graph)
+{
+	struct lua_state *lua = lua_state_init();
+	if (!lua) {
+		return NULL;
+	}
+
+	/* Set grammar debugging */
+	lua_getglobal(lua->L, "haka");
+	lua_getfield(lua->L, -1, "grammar");
+	lua_pushboolean(lua->L, dissector_graph);
+	lua_setfield(lua->L, -2, "debug");
+
+	/* Set state machine debugging */
+	lua_getglobal(lua->L, "haka");
+	lua_getfield(lua->L, -1, "state_machine");
+	lua_pushboolean(lua->L, dissector_graph);
+	lua_setfield(lua->L, -2, "debug");
+
+	/* Load Lua sources */
+	lua_state_require(lua, "rule");
+	lua_state_require(lua, "rule_group");
+	lua_state_require(lua, "interactive");
+	lua_state_require(lua, "protocol/raw");
+
+	return lua;
+}
+
 static struct thread_state *init_thread_state(struct packet_module *packet_module,
 		int thread_id, bool dissector_graph)
 {
@@ -148,33 +342,17 @@ static struct thread_state *init_thread_state(struct packet_module *packet_modul
 	state->state = STATE_NOTSARTED;
 	state->engine = NULL;
 
+	state->dissector_graph = dissector_graph;
+
 	LOG_INFO(core, "initializing thread %d", thread_id);
 
-	state->lua = lua_state_init();
+	state->lua = init_thread_lua(dissector_graph);
 	if (!state->lua) {
 		LOG_FATAL(core, "unable to create lua state");
 		cleanup_thread_state(state);
 		return NULL;
 	}
 
-	/* Set grammar debugging */
-	lua_getglobal(state->lua->L, "haka");
-	lua_getfield(state->lua->L, -1, "grammar");
-	lua_pushboolean(state->lua->L, dissector_graph);
-	lua_setfield(state->lua->L, -2, "debug");
-
-	/* Set state machine debugging */
-	lua_getglobal(state->lua->L, "haka");
-	lua_getfield(state->lua->L, -1, "state_machine");
-	lua_pushboolean(state->lua->L, dissector_graph);
-	lua_setfield(state->lua->L, -2, "debug");
-
-	/* Load Lua sources */
-	lua_state_require(state->lua, "rule");
-	lua_state_require(state->lua, "rule_group");
-	lua_state_require(state->lua, "interactive");
-	lua_state_require(state->lua, "protocol/raw");
-
 	state->capture = packet_module->init_state(thread_id);
 	if (!state->capture) {
 		LOG_FATAL(core, "unable to create packet capture state");
@@ -185,49 +363,225 @@ static struct thread_state *init_thread_state(struct packet_module *packet_modul
 	return state;
 }
 
-static bool init_thread_lua_state(struct thread_state *state)
+static bool init_thread_lua_state(struct thread_state *state, struct lua_state *lua)
 {
 	int h;
-	LUA_STACK_MARK(state->lua->L);
+	LUA_STACK_MARK(lua->L);
 
 	if (state->pool->attach_debugger > state->attach_debugger) {
-		luadebug_debugger_start(state->lua->L, false);
+		luadebug_debugger_start(lua->L, false);
 	}
 	state->pool->attach_debugger = state->attach_debugger;
 
-	lua_pushcfunction(state->lua->L, lua_state_error_formater);
-	h = lua_gettop(state->lua->L);
+	lua_pushcfunction(lua->L, lua_state_error_formater);
+	h = lua_gettop(lua->L);
 
-	lua_getglobal(state->lua->L, "require");
-	lua_pushstring(state->lua->L, "rule");
-	if (lua_pcall(state->lua->L, 1, 0, h)) {
-		lua_state_print_error(state->lua->L, "init");
-		lua_pop(state->lua->L, 1);
+	lua_getglobal(lua->L, "require");
+	lua_pushstring(lua->L, "rule");
+	if (lua_pcall(lua->L, 1, 0, h)) {
+		lua_state_print_error(lua->L, "init");
+		lua_pop(lua->L, 1);
 
-		LUA_STACK_CHECK(state->lua->L, 0);
+		LUA_STACK_CHECK(lua->L, 0);
 		return false;
 	}
 
-	if (!lua_state_run_file(state->lua, get_configuration_script(), 0, NULL)) {
-		lua_pop(state->lua->L, 1);
+	if (!lua_state_run_file(lua, get_configuration_script(), 0, NULL)) {
+		lua_pop(lua->L, 1);
 		return false;
 	}
 
-	lua_getglobal(state->lua->L, "haka");
-	lua_getfield(state->lua->L, -1, "rule_summary");
-	if (lua_pcall(state->lua->L, 0, 0, h)) {
-		lua_state_print_error(state->lua->L, "init");
-		lua_pop(state->lua->L, 1);
+	lua_getglobal(lua->L, "haka");
+	lua_getfield(lua->L, -1, "rule_summary");
+	if (lua_pcall(lua->L, 0, 0, h)) {
+		lua_state_print_error(lua->L, "init");
+		lua_pop(lua->L, 1);
 
-		LUA_STACK_CHECK(state->lua->L, 0);
+		LUA_STACK_CHECK(lua->L, 0);
 		return false;
 	}
-	lua_pop(state->lua->L, 2);
+	lua_pop(lua->L, 2);
 
-	LUA_STACK_CHECK(state->lua->L, 0);
+	LUA_STACK_CHECK(lua->L, 0);
 	return true;
 }
 
+/* Number of flows still tracked by a Lua state */
+static int open_flow_count(struct lua_state *lua)
+{
+	int h, count = 0;
+	LUA_STACK_MARK(lua->L);
+
+	lua_pushcfunction(lua->L, lua_state_error_formater);
+	h = lua_gettop(lua->L);
+
+	lua_getglobal(lua->L, "haka");
+	lua_getfield(lua->L, -1, "open_flow_count");
+	if (lua_pcall(lua->L, 0, 1, h)) {
+		lua_state_print_error(lua->L, "reload");
+	}
+	else {
+		count = lua_tointeger(lua->L, -1);
+		lua_pop(lua->L, 1);
+	}
+
+	lua_pop(lua->L, 2);
+	LUA_STACK_CHECK(lua->L, 0);
+	return count;
+}
+
+/* The previous configuration keeps the packets of the flows it tracks */
+static struct lua_state *packet_owner(struct thread_state *state, struct packet *pkt)
+{
+	struct lua_state *lua = state->previous;
+	bool owned = false;
+	int h;
+
+	if (!lua) return state->lua;
+
+	LUA_STACK_MARK(lua->L);
+
+	lua_pushcfunction(lua->L, lua_state_error_formater);
+	h = lua_gettop(lua->L);
+
+	lua_getglobal(lua->L, "haka");
+	lua_getfield(lua->L, -1, "owns_packet");
+	lua_pushlightuserdata(lua->L, pkt);
+	if (lua_pcall(lua->L, 1, 1, h)) {
+		lua_state_print_error(lua->L, "reload");
+	}
+	else {
+		owned = lua_toboolean(lua->L, -1);
+		lua_pop(lua->L, 1);
+	}
+
+	lua_pop(lua->L, 2);
+	LUA_STACK_CHECK(lua->L, 0);
+	return owned ? lua : state->lua;
+}
+
+/*
+ * Close the previous configuration once its last flow is closed, or when
+ * the drain timeout is reached.
+ */
+static void release_previous_state(struct thread_state *state)
+{
+	struct time now, elapsed;
+	int flows;
+
+	if (!state->previous) return;
+
+	flows = open_flow_count(state->previous);
+	if (flows > 0) {
+		if (reload_drain_timeout <= 0) return;
+
+		time_gettimestamp(&now);
+		time_diff(&elapsed, &now, &state->previous_start);
+		if (time_sec(&elapsed) < reload_drain_timeout) return;
+
+		LOG_WARNING(core, "previous configuration released on thread %d with %d open flows",
+				state->thread_id, flows);
+	}
+	else {
+		LOG_INFO(core, "previous configuration released on thread %d", state->thread_id);
+	}
+
+	lua_state_close(state->previous);
+	state->previous = NULL;
+}
+
+/* Load the new configuration in a separate state, the current one is untouched */
+static void prepare_thread_reload(void *_state)
+{
+	struct thread_state *state = (struct thread_state *)_state;
+	struct lua_state *lua;
+
+	assert(!state->reload);
+
+	if (state->previous) {
+		error("previous configuration still used by %d flows on thread %d",
+				open_flow_count(state->previous), state->thread_id);
+		return;
+	}
+
+	LOG_INFO(core, "reloading configuration on thread %d", state->thread_id);
+
+	lua = init_thread_lua(state->dissector_graph);
+	if (!lua) {
+		error("unable to create lua state");
+		return;
+	}
+
+	if (!init_thread_lua_state(state, lua)) {
+		lua_state_close(lua);
+		error("unable to load configuration on thread %d", state->thread_id);
+		return;
+	}
+
+	state->reload = lua;
+}
+
+static void abort_thread_reload(void *_state)
+{
+	struct thread_state *state = (struct thread_state *)_state;
+
+	if (state->reload) {
+		lua_state_close(state->reload);
+		state->reload = NULL;
+	}
+}
+
+/*
+ * Switch to the new configuration before the next packet. The connections,
+ * streams and timers of the open flows are Lua objects of the current state,
+ * it is kept to process their packets until they are closed.
+ */
+static void commit_thread_reload(void *_state)
+{
+	struct thread_state *state = (struct thread_state *)_state;
+	int flows;
+
+	assert(state->reload);
+	assert(!state->previous);
+
+	state->previous = state->lua;
+	state->lua = state->reload;
+	state->reload = NULL;
+	time_gettimestamp(&state->previous_start);
+
+	engine_thread_set_lua_state(state->engine, state->lua->L);
+
+	/* The previous state is not stepped anymore */
+	lua_gc(state->previous->L, LUA_GCRESTART, 0);
+	gc_start(state);
+
+	lua_state_trigger_haka_event(state->lua, "started");
+
+	flows = open_flow_count(state->previous);
+	if (flows > 0) {
+		LOG_INFO(core, "configuration reloaded on thread %d, previous one kept for %d open flows",
+				state->thread_id, flows);
+	}
+	else {
+		LOG_INFO(core, "configuration reloaded on thread %d", state->thread_id);
+		lua_state_close(state->previous);
+		state->previous = NULL;
+	}
+}
+
+/* Reload from the packet thread itself, see thread_set_reload_after() */
+static void reload_thread(struct thread_state *state)
+{
+	prepare_thread_reload(state);
+
+	if (!state->reload) {
+		LOG_ERROR(core, "%s", clear_error());
+		return;
+	}
+
+	commit_thread_reload(state);
+}
+
 static void *thread_main_loop(void *_state)
 {
 	struct thread_state *state = (struct thread_state *)_state;
@@ -270,7 +624,7 @@ static void *thread_main_loop(void *_state)
 			return NULL;
 		}
 
-		if (!init_thread_lua_state(state)) {
+		if (!init_thread_lua_state(state, state->lua)) {
 			barrier_wait(&state->pool->thread_start_sync);
 			state->state = STATE_ERROR;
 			return NULL;
@@ -280,6 +634,9 @@ static void *thread_main_loop(void *_state)
 	state->engine = engine_thread_init(state->lua->L, state->thread_id);
 	engine_thread_update_status(state->engine, THREAD_RUNNING);
 
+	gc_start(state);
+	engine_thread_set_idle(state->engine, gc_idle, state);
+
 	packet_init(state->capture);
 
 	if (!state->pool->single) {
@@ -309,8 +666,20 @@ static void *thread_main_loop(void *_state)
 
 		/* The packet can be NULL in case of failure in packet receive */
 		if (pkt) {
-			filter_wrapper(state, pkt);
+			filter_wrapper(packet_owner(state, pkt), pkt);
 			pkt = NULL;
+
+			gc_packet_step(state);
+
+			if (reload_after > 0 &&
+			    engine_thread_statistics(state->engine)->recv_packets == reload_after) {
+				reload_thread(state);
+			}
+		}
+
+		if (state->previous) {
+			lua_state_runinterrupt(state->previous);
+			release_previous_state(state);
 		}
 
 		lua_state_runinterrupt(state->lua);
@@ -403,7 +772,7 @@ struct thread_pool *thread_pool_create(int count, struct packet_module *packet_m
 		pool->threads[i]->pool = pool;
 
 		if (pool->single) {
-			if (!init_thread_lua_state(pool->threads[i])) {
+			if (!init_thread_lua_state(pool->threads[i], pool->threads[i]->lua)) {
 				error("thread initialization error");
 				thread_pool_cleanup(pool);
 				return NULL;
@@ -557,6 +926,41 @@ void thread_pool_attachdebugger(struct thread_pool *pool)
 	++pool->attach_debugger;
 }
 
+bool thread_pool_reload(struct thread_pool *pool)
+{
+	int i, j;
+
+	assert(pool);
+
+	/* The new configuration is loaded on all threads before any of them
+	 * switches to it. On failure, the loaded states are discarded and all
+	 * threads keep their current configuration. */
+	for (i=0; i<pool->count; ++i) {
+		if (!pool->threads[i] || !pool->threads[i]->engine) {
+			error("thread %d is not running", i);
+			return false;
+		}
+
+		if (!engine_thread_remote_launch(pool->threads[i]->engine,
+				prepare_thread_reload, pool->threads[i])) {
+			for (j=0; j<i; ++j) {
+				engine_thread_remote_launch(pool->threads[j]->engine,
+						abort_thread_reload, pool->threads[j]);
+			}
+			return false;
+		}
+	}
+
+	/* The switch itself cannot fail, each thread moves to the new state at
+	 * its next packet boundary */
+	for (i=0; i<pool->count; ++i) {
+		engine_thread_remote_launch(pool->threads[i]->engine,
+				commit_thread_reload, pool->threads[i]);
+	}
+
+	return true;
+}
+
 struct engine_thread *thread_pool_thread(struct thread_pool *pool, int index)
 {
 	assert(index >= 0 && index < pool->count);
@@ -10,6 +10,29 @@
 
 struct thread_pool;
 
+/*
+ * Explicit Lua garbage collection of the packet threads. The steps and the
+ * memory are in KB and the pause in microseconds.
+ */
+struct thread_gc_config {
+	int     step;        /* Step done after each packet, 0 to disable */
+	int     idle_step;   /* Steps done when no packet is waiting, 0 to disable */
+	int     max_pause;   /* Maximum time spent collecting between two packets */
+	int     max_memory;  /* Memory above which the automatic collector runs again,
+	                      * 0 for twice the memory in use after the last cycle */
+};
+
+void thread_set_gc_config(const struct thread_gc_config *config);
+
+/*
+ * On reload, the previous configuration is kept until its flows are closed,
+ * for at most the drain timeout in seconds (0 to wait without limit).
+ */
+void thread_set_reload_drain_timeout(int seconds);
+
+/* Reload the configuration in place once this count of packets is received */
+void thread_set_reload_after(size_t count);
+
 struct thread_pool *thread_pool_create(int count, struct packet_module *packet_module,
 		bool attach_debugger, bool dissector_graph);
 int  thread_pool_count(struct thread_pool *pool);
@@ -19,6 +42,7 @@ void thread_pool_cancel(struct thread_pool *pool);
 void thread_pool_start(struct thread_pool *pool);
 bool thread_pool_stop(struct thread_pool *pool, int force);
 void thread_pool_attachdebugger(struct thread_pool *pool);
+bool thread_pool_reload(struct thread_pool *pool);
 bool thread_pool_issingle(struct thread_pool *pool);
 struct engine_thread *thread_pool_thread(struct thread_pool *pool, int index);
 
@@ -80,6 +80,31 @@ struct command command_stop = {
 };
 
 
+/*
+ * reload
+ */
+
+static int run_reload(int fd, int argc, char *argv[])
+{
+	printf("[....] reloading configuration");
+	fflush(stdout);
+
+	if (!ctl_send_chars(fd, "RELOAD", -1)) {
+		printf("\r[%sFAIL%s]\n", c(RED, use_colors), c(CLEAR, use_colors));
+		return COMMAND_FAILED;
+	}
+
+	return check_status(fd, NULL);
+}
+
+struct command command_reload = {
+	"reload",
+	"reload:             Reload haka configuration",
+	0,
+	run_reload
+};
+
+
 /*
  * logs
  */
@@ -19,6 +19,7 @@ struct command {
 
 extern struct command command_status;
 extern struct command command_stop;
+extern struct command command_reload;
 extern struct command command_logs;
 extern struct command command_loglevel;
 extern struct command command_debug;
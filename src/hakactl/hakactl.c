@@ -35,6 +35,7 @@ enum {
 static struct command* commands[] = {
 	&command_status,
 	&command_stop,
+	&command_reload,
 	&command_logs,
 	&command_loglevel,
 	&command_debug,
@@ -0,0 +1,40 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+local list = require('list')
+
+local CoroutinePoolInfo = list.new('coroutine_pool_info')
+
+CoroutinePoolInfo.field = {
+	'thread', 'size', 'hits', 'misses', 'managers', 'manager_hits', 'manager_misses'
+}
+
+CoroutinePoolInfo.key = 'thread'
+
+CoroutinePoolInfo.field_format = {
+	['hits']           = list.formatter.unit,
+	['misses']         = list.formatter.unit,
+	['manager_hits']   = list.formatter.unit,
+	['manager_misses'] = list.formatter.unit
+}
+
+CoroutinePoolInfo.field_aggregate = {
+	['thread']         = list.aggregator.replace('total'),
+	['size']           = list.aggregator.add,
+	['hits']           = list.aggregator.add,
+	['misses']         = list.aggregator.add,
+	['managers']       = list.aggregator.add,
+	['manager_hits']   = list.aggregator.add,
+	['manager_misses'] = list.aggregator.add
+}
+
+function console.coroutine_pool()
+	local data = hakactl.remote('all', function ()
+		return haka.console.coroutine_pool()
+	end)
+
+	local info = CoroutinePoolInfo:new()
+	info:addall(data)
+	return info
+end
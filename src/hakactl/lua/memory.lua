@@ -0,0 +1,101 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+local list = require('list')
+
+local function unit(num)
+	if num then return list.formatter.unit(num)
+	else return '-' end
+end
+
+local LuaMemoryInfo = list.new('lua_memory_info')
+
+LuaMemoryInfo.field = {
+	'thread', 'allocator', 'used', 'peak', 'allocated', 'arena', 'large'
+}
+
+LuaMemoryInfo.key = 'thread'
+
+LuaMemoryInfo.field_format = {
+	['used']      = unit,
+	['peak']      = unit,
+	['allocated'] = unit,
+	['arena']     = unit,
+	['large']     = unit
+}
+
+LuaMemoryInfo.field_aggregate = {
+	['thread']    = list.aggregator.replace('total'),
+	['used']      = list.aggregator.add,
+	['peak']      = list.aggregator.add,
+	['allocated'] = list.aggregator.add,
+	['arena']     = list.aggregator.add,
+	['large']     = list.aggregator.add
+}
+
+function console.lua_memory()
+	local data = hakactl.remote('all', function ()
+		return haka.console.lua_memory()
+	end)
+
+	local info = LuaMemoryInfo:new()
+	info:addall(data)
+	return info
+end
+
+local LuaMemoryClassInfo = list.new('lua_memory_class_info')
+
+LuaMemoryClassInfo.field = {
+	'size', 'count', 'bytes', 'allocs'
+}
+
+LuaMemoryClassInfo.key = 'size'
+
+LuaMemoryClassInfo.field_format = {
+	['count']     = list.formatter.unit,
+	['bytes']     = list.formatter.unit,
+	['allocs']    = list.formatter.unit
+}
+
+LuaMemoryClassInfo.field_aggregate = {
+	['size']      = list.aggregator.replace('total'),
+	['count']     = list.aggregator.add,
+	['bytes']     = list.aggregator.add,
+	['allocs']    = list.aggregator.add
+}
+
+function console.lua_memory_classes()
+	local data = hakactl.remote('all', function ()
+		return haka.console.lua_memory_classes()
+	end)
+
+	-- Merge the size classes of all threads
+	local classes = {}
+	local sizes = {}
+	for _, thread in ipairs(data) do
+		for _, class in ipairs(thread) do
+			local merged = classes[class.size]
+			if not merged then
+				merged = { size = class.size, count = 0, bytes = 0, allocs = 0 }
+				classes[class.size] = merged
+				table.insert(sizes, class.size)
+			end
+
+			merged.count = merged.count + class.count
+			merged.bytes = merged.bytes + class.bytes
+			merged.allocs = merged.allocs + class.allocs
+		end
+	end
+
+	table.sort(sizes)
+
+	local merged = {}
+	for _, size in ipairs(sizes) do
+		table.insert(merged, classes[size])
+	end
+
+	local info = LuaMemoryClassInfo:new()
+	info:add(merged)
+	return info
+end
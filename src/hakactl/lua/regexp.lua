@@ -0,0 +1,35 @@
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+local list = require('list')
+
+local RegexpCacheInfo = list.new('regexp_cache_info')
+
+RegexpCacheInfo.field = {
+	'thread', 'size', 'hits', 'misses'
+}
+
+RegexpCacheInfo.key = 'thread'
+
+RegexpCacheInfo.field_format = {
+	['hits']   = list.formatter.unit,
+	['misses'] = list.formatter.unit
+}
+
+RegexpCacheInfo.field_aggregate = {
+	['thread'] = list.aggregator.replace('total'),
+	['size']   = list.aggregator.add,
+	['hits']   = list.aggregator.add,
+	['misses'] = list.aggregator.add
+}
+
+function console.regexp_cache()
+	local data = hakactl.remote('all', function ()
+		return haka.console.regexp_cache()
+	end)
+
+	local info = RegexpCacheInfo:new()
+	info:addall(data)
+	return info
+end
@@ -8,7 +8,7 @@ local ThreadInfo = list.new('thread_info')
 
 ThreadInfo.field = {
 	'id', 'status', 'recv_pkt', 'recv_bytes',
-	'trans_pkt', 'trans_bytes', 'drop_pkt'
+	'trans_pkt', 'trans_bytes', 'drop_pkt', 'gc_ms', 'gc_cycles'
 }
 
 ThreadInfo.key = 'id'
@@ -18,7 +18,9 @@ ThreadInfo.field_format = {
 	['recv_bytes']  = list.formatter.unit,
 	['trans_pkt']   = list.formatter.unit,
 	['trans_bytes'] = list.formatter.unit,
-	['drop_pkt']    = list.formatter.unit
+	['drop_pkt']    = list.formatter.unit,
+	['gc_ms']       = list.formatter.unit,
+	['gc_cycles']   = list.formatter.unit
 }
 
 ThreadInfo.field_aggregate = {
@@ -27,7 +29,9 @@ ThreadInfo.field_aggregate = {
 	['recv_bytes']  = list.aggregator.add,
 	['trans_pkt']   = list.aggregator.add,
 	['trans_bytes'] = list.aggregator.add,
-	['drop_pkt']    = list.aggregator.add
+	['drop_pkt']    = list.aggregator.add,
+	['gc_ms']       = list.aggregator.add,
+	['gc_cycles']   = list.aggregator.add
 }
 
 function console.threads()